@@ -0,0 +1,281 @@
+#include "Allocator.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace nfw
+{
+	namespace
+	{
+		constexpr uint32_t SIZE_CLASS_NUM = 9;              // 16 B - 4 KiB
+		constexpr size_t MIN_BLOCK_SIZE = 16;
+		constexpr size_t POOL_CHUNK_SIZE = 64 * 1024;
+		constexpr uint8_t LARGE_CLASS = 0xFF;
+
+		// right in front of every returned pointer
+		struct AllocationHeader
+		{
+			uint64_t size;
+			uint32_t offset;        // from the start of the block
+			uint8_t sizeClass;
+			uint8_t category;
+			uint16_t padding;
+		};
+		static_assert(sizeof(AllocationHeader) == MIN_BLOCK_SIZE);
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		struct SizeClassPool
+		{
+			std::mutex mutex;
+			FreeBlock* freeList = nullptr;
+			uint8_t* chunkCursor = nullptr;
+			uint8_t* chunkEnd = nullptr;
+		};
+
+		struct CategoryCounters
+		{
+			std::atomic<uint64_t> liveBytes = 0;
+			std::atomic<uint64_t> peakBytes = 0;
+			std::atomic<uint64_t> allocationNum = 0;
+			std::atomic<uint64_t> currentFrameAllocationNum = 0;
+			std::atomic<uint64_t> lastFrameAllocationNum = 0;
+		};
+
+		struct AllocatorState
+		{
+			std::array<SizeClassPool, SIZE_CLASS_NUM> pools;
+			std::array<CategoryCounters, (size_t)MemoryCategory::MAX_NUM> counters;
+		};
+
+		// never destroyed, NRI objects may be freed during static destruction
+		AllocatorState& GetState()
+		{
+			static AllocatorState* state = new AllocatorState();
+			return *state;
+		}
+
+		size_t GetClassSize(uint32_t sizeClass)
+		{
+			return MIN_BLOCK_SIZE << sizeClass;
+		}
+
+		uint8_t GetSizeClass(size_t blockSize)
+		{
+			for (uint32_t i = 0; i < SIZE_CLASS_NUM; i++)
+			{
+				if (blockSize <= GetClassSize(i))
+				{
+					return (uint8_t)i;
+				}
+			}
+			return LARGE_CLASS;
+		}
+
+		uint8_t* AllocateBlock(uint8_t sizeClass, size_t blockSize)
+		{
+			if (sizeClass == LARGE_CLASS)
+			{
+				return (uint8_t*)std::malloc(blockSize);
+			}
+
+			SizeClassPool& pool = GetState().pools[sizeClass];
+			const size_t classSize = GetClassSize(sizeClass);
+
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			if (pool.freeList)
+			{
+				FreeBlock* block = pool.freeList;
+				pool.freeList = block->next;
+				return (uint8_t*)block;
+			}
+			if (pool.chunkCursor == pool.chunkEnd)
+			{
+				// malloc alignment keeps every block of the chunk 16-byte aligned
+				pool.chunkCursor = (uint8_t*)std::malloc(POOL_CHUNK_SIZE);
+				if (!pool.chunkCursor)
+				{
+					pool.chunkEnd = nullptr;
+					return nullptr;
+				}
+				pool.chunkEnd = pool.chunkCursor + POOL_CHUNK_SIZE;
+			}
+			uint8_t* block = pool.chunkCursor;
+			pool.chunkCursor += classSize;
+			return block;
+		}
+
+		void ReleaseBlock(uint8_t sizeClass, uint8_t* block)
+		{
+			if (sizeClass == LARGE_CLASS)
+			{
+				std::free(block);
+				return;
+			}
+
+			SizeClassPool& pool = GetState().pools[sizeClass];
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			FreeBlock* freeBlock = (FreeBlock*)block;
+			freeBlock->next = pool.freeList;
+			pool.freeList = freeBlock;
+		}
+
+		void AddLiveBytes(CategoryCounters& counters, uint64_t size)
+		{
+			const uint64_t liveBytes = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+			uint64_t peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+			while (liveBytes > peakBytes && !counters.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		AllocationHeader& GetHeader(void* memory)
+		{
+			return *((AllocationHeader*)memory - 1);
+		}
+
+		void* NRIAllocate(void*, size_t size, size_t alignment)
+		{
+			return Allocator::Allocate(MemoryCategory::NRI, size, alignment);
+		}
+
+		void* NRIReallocate(void*, void* memory, size_t size, size_t alignment)
+		{
+			return Allocator::Reallocate(MemoryCategory::NRI, memory, size, alignment);
+		}
+
+		void NRIFree(void*, void* memory)
+		{
+			Allocator::Free(memory);
+		}
+	}
+
+	void* Allocator::Allocate(MemoryCategory category, size_t size, size_t alignment)
+	{
+		// blocks start 16-byte aligned, a bigger alignment costs up to alignment - 16 bytes of padding
+		alignment = std::max(alignment, MIN_BLOCK_SIZE);
+		const size_t blockSize = sizeof(AllocationHeader) + size + (alignment - MIN_BLOCK_SIZE);
+		const uint8_t sizeClass = GetSizeClass(blockSize);
+
+		uint8_t* block = AllocateBlock(sizeClass, blockSize);
+		if (!block)
+		{
+			return nullptr;
+		}
+
+		const uintptr_t address = ((uintptr_t)block + sizeof(AllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		void* memory = (void*)address;
+
+		AllocationHeader& header = GetHeader(memory);
+		header.size = size;
+		header.offset = (uint32_t)(address - (uintptr_t)block);
+		header.sizeClass = sizeClass;
+		header.category = (uint8_t)category;
+
+		CategoryCounters& counters = GetState().counters[(size_t)category];
+		AddLiveBytes(counters, size);
+		counters.allocationNum.fetch_add(1, std::memory_order_relaxed);
+		counters.currentFrameAllocationNum.fetch_add(1, std::memory_order_relaxed);
+
+		return memory;
+	}
+
+	void* Allocator::Reallocate(MemoryCategory category, void* memory, size_t size, size_t alignment)
+	{
+		if (!memory)
+		{
+			return Allocate(category, size, alignment);
+		}
+		if (size == 0)
+		{
+			Free(memory);
+			return nullptr;
+		}
+
+		// shrinking or growing within the block keeps the pointer
+		alignment = std::max(alignment, MIN_BLOCK_SIZE);
+		AllocationHeader& header = GetHeader(memory);
+		if (header.sizeClass != LARGE_CLASS && header.category == (uint8_t)category && ((uintptr_t)memory & (alignment - 1)) == 0
+			&& header.offset + size <= GetClassSize(header.sizeClass))
+		{
+			CategoryCounters& counters = GetState().counters[(size_t)category];
+			if (size > header.size)
+			{
+				AddLiveBytes(counters, size - header.size);
+			}
+			else
+			{
+				counters.liveBytes.fetch_sub(header.size - size, std::memory_order_relaxed);
+			}
+			header.size = size;
+			return memory;
+		}
+
+		void* newMemory = Allocate(category, size, alignment);
+		if (newMemory)
+		{
+			std::memcpy(newMemory, memory, std::min((size_t)header.size, size));
+			Free(memory);
+		}
+		return newMemory;
+	}
+
+	void Allocator::Free(void* memory)
+	{
+		if (!memory)
+		{
+			return;
+		}
+
+		const AllocationHeader header = GetHeader(memory);
+		GetState().counters[header.category].liveBytes.fetch_sub(header.size, std::memory_order_relaxed);
+		ReleaseBlock(header.sizeClass, (uint8_t*)memory - header.offset);
+	}
+
+	nri::AllocationCallbacks Allocator::GetNRIAllocationCallbacks()
+	{
+		nri::AllocationCallbacks allocationCallbacks = {};
+		allocationCallbacks.Allocate = NRIAllocate;
+		allocationCallbacks.Reallocate = NRIReallocate;
+		allocationCallbacks.Free = NRIFree;
+		return allocationCallbacks;
+	}
+
+	void Allocator::BeginFrame()
+	{
+		for (CategoryCounters& counters : GetState().counters)
+		{
+			counters.lastFrameAllocationNum.store(counters.currentFrameAllocationNum.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+
+	MemoryCategoryStats Allocator::GetStats(MemoryCategory category)
+	{
+		const CategoryCounters& counters = GetState().counters[(size_t)category];
+
+		MemoryCategoryStats stats;
+		stats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+		stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+		stats.allocationNum = counters.allocationNum.load(std::memory_order_relaxed);
+		stats.frameAllocationNum = counters.lastFrameAllocationNum.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	const char* Allocator::GetCategoryName(MemoryCategory category)
+	{
+		switch (category)
+		{
+		case MemoryCategory::NRI: return "NRI";
+		case MemoryCategory::FRAME_ARENA: return "frame arena";
+		default: return "unknown";
+		}
+	}
+
+} // namespace nfw
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Api.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nfw
+{
+	enum class MemoryCategory : uint8_t
+	{
+		NRI,            // CPU side of NRI and its backends
+		FRAME_ARENA,    // FrameArena blocks
+
+		MAX_NUM
+	};
+
+	struct MemoryCategoryStats
+	{
+		uint64_t liveBytes = 0;
+		uint64_t peakBytes = 0;
+		uint64_t allocationNum = 0;         // since start
+		uint64_t frameAllocationNum = 0;    // during the last complete frame
+	};
+
+	// Tracked CPU allocations.
+	// Small requests come from size-class pools, each class has its own lock, so they stay off the global heap and
+	// its lock; larger ones go to the heap. Pooled blocks are recycled but never returned to the system.
+	// Every allocation is counted in its category, counters can be read from any thread at any time.
+	class Allocator
+	{
+	public:
+		static void* Allocate(MemoryCategory category, size_t size, size_t alignment = alignof(std::max_align_t));
+		static void* Reallocate(MemoryCategory category, void* memory, size_t size, size_t alignment = alignof(std::max_align_t));
+		static void Free(void* memory);
+
+		// Callbacks for DeviceCreationDesc, allocations are counted as MemoryCategory::NRI
+		static nri::AllocationCallbacks GetNRIAllocationCallbacks();
+
+		// Closes the per-frame counters of the previous frame; called once per frame
+		static void BeginFrame();
+
+		static MemoryCategoryStats GetStats(MemoryCategory category);
+		static const char* GetCategoryName(MemoryCategory category);
+	};
+} // namespace nfw
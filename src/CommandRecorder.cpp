@@ -0,0 +1,311 @@
+#include "CommandRecorder.h"
+
+#include <cstring>
+
+namespace nfw
+{
+	constexpr uint32_t CACHED_DESCRIPTOR_SET_MAX_NUM = 8;
+	constexpr uint32_t CACHED_VERTEX_BUFFER_MAX_NUM = 8;
+	constexpr uint32_t CACHED_VIEWPORT_MAX_NUM = 8;
+	constexpr uint32_t CACHED_ROOT_CONSTANT_MAX_NUM = 4;
+	constexpr uint32_t CACHED_ROOT_CONSTANT_MAX_SIZE = 128;
+
+	struct RootConstantCache
+	{
+		std::array<uint8_t, CACHED_ROOT_CONSTANT_MAX_SIZE> data;
+		uint32_t size;
+	};
+
+	class CommandRecorder::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::CommandBuffer& commandBuffer)
+			: NRI(nri)
+			, m_commandBuffer(commandBuffer)
+		{
+			Invalidate();
+		}
+		~Impl() {}
+
+		nri::Result Begin(const nri::DescriptorPool* descriptorPool)
+		{
+			Invalidate();
+			m_stats = {};
+			m_descriptorPool = descriptorPool;
+			return NRI.BeginCommandBuffer(m_commandBuffer, descriptorPool);
+		}
+
+		nri::Result End()
+		{
+			return NRI.EndCommandBuffer(m_commandBuffer);
+		}
+
+		void Invalidate()
+		{
+			m_pipelineLayout = nullptr;
+			m_pipeline = nullptr;
+			m_descriptorPool = nullptr;
+			m_indexBuffer = nullptr;
+			m_indexOffset = 0;
+			m_indexType = nri::IndexType::UINT16;
+			m_viewportNum = 0;
+			m_scissorNum = 0;
+			InvalidateBindings();
+		}
+
+		void SetPipelineLayout(const nri::PipelineLayout& pipelineLayout)
+		{
+			if (m_pipelineLayout == &pipelineLayout)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetPipelineLayout(m_commandBuffer, pipelineLayout);
+			m_pipelineLayout = &pipelineLayout;
+			m_stats.issuedNum++;
+
+			// a new layout invalidates everything bound through the previous one
+			InvalidateBindings();
+		}
+
+		void SetPipeline(const nri::Pipeline& pipeline)
+		{
+			if (m_pipeline == &pipeline)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetPipeline(m_commandBuffer, pipeline);
+			m_pipeline = &pipeline;
+			m_stats.issuedNum++;
+		}
+
+		void SetDescriptorPool(const nri::DescriptorPool& descriptorPool)
+		{
+			if (m_descriptorPool == &descriptorPool)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetDescriptorPool(m_commandBuffer, descriptorPool);
+			m_descriptorPool = &descriptorPool;
+			m_stats.issuedNum++;
+
+			// sets from the previous pool are gone with it
+			InvalidateBindings();
+		}
+
+		void SetDescriptorSet(uint32_t setIndex, const nri::DescriptorSet& descriptorSet, const uint32_t* dynamicConstantBufferOffsets)
+		{
+			const bool cacheable = setIndex < CACHED_DESCRIPTOR_SET_MAX_NUM;
+			// dynamic offsets can change with the same set, so those binds are never dropped
+			if (cacheable && !dynamicConstantBufferOffsets && m_descriptorSets[setIndex] == &descriptorSet)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetDescriptorSet(m_commandBuffer, setIndex, descriptorSet, dynamicConstantBufferOffsets);
+			if (cacheable)
+			{
+				m_descriptorSets[setIndex] = dynamicConstantBufferOffsets ? nullptr : &descriptorSet;
+			}
+			m_stats.issuedNum++;
+		}
+
+		void SetRootConstants(uint32_t rootConstantIndex, const void* data, uint32_t size)
+		{
+			const bool cacheable = rootConstantIndex < CACHED_ROOT_CONSTANT_MAX_NUM && size <= CACHED_ROOT_CONSTANT_MAX_SIZE;
+			if (cacheable)
+			{
+				RootConstantCache& cache = m_rootConstants[rootConstantIndex];
+				if (cache.size == size && memcmp(cache.data.data(), data, size) == 0)
+				{
+					m_stats.droppedNum++;
+					return;
+				}
+				memcpy(cache.data.data(), data, size);
+				cache.size = size;
+			}
+			NRI.CmdSetRootConstants(m_commandBuffer, rootConstantIndex, data, size);
+			m_stats.issuedNum++;
+		}
+
+		void SetIndexBuffer(const nri::Buffer& buffer, uint64_t offset, nri::IndexType indexType)
+		{
+			if (m_indexBuffer == &buffer && m_indexOffset == offset && m_indexType == indexType)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetIndexBuffer(m_commandBuffer, buffer, offset, indexType);
+			m_indexBuffer = &buffer;
+			m_indexOffset = offset;
+			m_indexType = indexType;
+			m_stats.issuedNum++;
+		}
+
+		void SetVertexBuffers(uint32_t baseSlot, uint32_t bufferNum, const nri::Buffer* const* buffers, const uint64_t* offsets)
+		{
+			const bool cacheable = baseSlot + bufferNum <= CACHED_VERTEX_BUFFER_MAX_NUM;
+			if (cacheable)
+			{
+				bool same = true;
+				for (uint32_t i = 0; i < bufferNum && same; ++i)
+				{
+					same = m_vertexBuffers[baseSlot + i] == buffers[i] && m_vertexOffsets[baseSlot + i] == offsets[i];
+				}
+				if (same)
+				{
+					m_stats.droppedNum++;
+					return;
+				}
+			}
+			NRI.CmdSetVertexBuffers(m_commandBuffer, baseSlot, bufferNum, buffers, offsets);
+			for (uint32_t i = 0; i < bufferNum && baseSlot + i < CACHED_VERTEX_BUFFER_MAX_NUM; ++i)
+			{
+				m_vertexBuffers[baseSlot + i] = cacheable ? buffers[i] : nullptr;
+				m_vertexOffsets[baseSlot + i] = offsets[i];
+			}
+			m_stats.issuedNum++;
+		}
+
+		void SetViewports(const nri::Viewport* viewports, uint32_t viewportNum)
+		{
+			if (viewportNum == m_viewportNum && memcmp(m_viewports.data(), viewports, viewportNum * sizeof(nri::Viewport)) == 0)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetViewports(m_commandBuffer, viewports, viewportNum);
+			m_viewportNum = viewportNum <= CACHED_VIEWPORT_MAX_NUM ? viewportNum : 0;
+			memcpy(m_viewports.data(), viewports, m_viewportNum * sizeof(nri::Viewport));
+			m_stats.issuedNum++;
+		}
+
+		void SetScissors(const nri::Rect* rects, uint32_t rectNum)
+		{
+			if (rectNum == m_scissorNum && memcmp(m_scissors.data(), rects, rectNum * sizeof(nri::Rect)) == 0)
+			{
+				m_stats.droppedNum++;
+				return;
+			}
+			NRI.CmdSetScissors(m_commandBuffer, rects, rectNum);
+			m_scissorNum = rectNum <= CACHED_VIEWPORT_MAX_NUM ? rectNum : 0;
+			memcpy(m_scissors.data(), rects, m_scissorNum * sizeof(nri::Rect));
+			m_stats.issuedNum++;
+		}
+
+		void Barrier(const nri::BarrierGroupDesc& barrierGroupDesc) { NRI.CmdBarrier(m_commandBuffer, barrierGroupDesc); }
+
+		void BeginRendering(const nri::AttachmentsDesc& attachmentsDesc) { NRI.CmdBeginRendering(m_commandBuffer, attachmentsDesc); }
+
+		void ClearAttachments(const nri::ClearDesc* clearDescs, uint32_t clearDescNum, const nri::Rect* rects, uint32_t rectNum)
+		{
+			NRI.CmdClearAttachments(m_commandBuffer, clearDescs, clearDescNum, rects, rectNum);
+		}
+
+		void EndRendering() { NRI.CmdEndRendering(m_commandBuffer); }
+
+		void Draw(const nri::DrawDesc& drawDesc) { NRI.CmdDraw(m_commandBuffer, drawDesc); }
+
+		void DrawIndexed(const nri::DrawIndexedDesc& drawIndexedDesc) { NRI.CmdDrawIndexed(m_commandBuffer, drawIndexedDesc); }
+
+		nri::CommandBuffer& GetCommandBuffer() const { return m_commandBuffer; }
+
+		CommandRecorderStats GetStats() const { return m_stats; }
+
+	private:
+		void InvalidateBindings()
+		{
+			m_descriptorSets.fill(nullptr);
+			m_vertexBuffers.fill(nullptr);
+			m_vertexOffsets.fill(0);
+			for (RootConstantCache& cache : m_rootConstants)
+			{
+				cache.size = 0;
+			}
+		}
+
+	private:
+		NRIInterface& NRI;
+		nri::CommandBuffer& m_commandBuffer;
+
+		const nri::PipelineLayout* m_pipelineLayout = nullptr;
+		const nri::Pipeline* m_pipeline = nullptr;
+		const nri::DescriptorPool* m_descriptorPool = nullptr;
+		std::array<const nri::DescriptorSet*, CACHED_DESCRIPTOR_SET_MAX_NUM> m_descriptorSets = {};
+		std::array<RootConstantCache, CACHED_ROOT_CONSTANT_MAX_NUM> m_rootConstants = {};
+		const nri::Buffer* m_indexBuffer = nullptr;
+		uint64_t m_indexOffset = 0;
+		nri::IndexType m_indexType = nri::IndexType::UINT16;
+		std::array<const nri::Buffer*, CACHED_VERTEX_BUFFER_MAX_NUM> m_vertexBuffers = {};
+		std::array<uint64_t, CACHED_VERTEX_BUFFER_MAX_NUM> m_vertexOffsets = {};
+		std::array<nri::Viewport, CACHED_VIEWPORT_MAX_NUM> m_viewports = {};
+		std::array<nri::Rect, CACHED_VIEWPORT_MAX_NUM> m_scissors = {};
+		uint32_t m_viewportNum = 0;
+		uint32_t m_scissorNum = 0;
+
+		CommandRecorderStats m_stats;
+	};
+
+	// constructor
+	CommandRecorder::CommandRecorder(NRIInterface& NRI, nri::CommandBuffer& commandBuffer)
+		: m_impl(std::make_unique<Impl>(NRI, commandBuffer))
+	{
+	}
+
+	// destructor
+	CommandRecorder::~CommandRecorder()
+	{
+	}
+
+	nri::Result CommandRecorder::Begin(const nri::DescriptorPool* descriptorPool) { return m_impl->Begin(descriptorPool); }
+
+	nri::Result CommandRecorder::End() { return m_impl->End(); }
+
+	void CommandRecorder::Invalidate() { m_impl->Invalidate(); }
+
+	void CommandRecorder::SetPipelineLayout(const nri::PipelineLayout& pipelineLayout) { m_impl->SetPipelineLayout(pipelineLayout); }
+
+	void CommandRecorder::SetPipeline(const nri::Pipeline& pipeline) { m_impl->SetPipeline(pipeline); }
+
+	void CommandRecorder::SetDescriptorPool(const nri::DescriptorPool& descriptorPool) { m_impl->SetDescriptorPool(descriptorPool); }
+
+	void CommandRecorder::SetDescriptorSet(uint32_t setIndex, const nri::DescriptorSet& descriptorSet, const uint32_t* dynamicConstantBufferOffsets)
+	{
+		m_impl->SetDescriptorSet(setIndex, descriptorSet, dynamicConstantBufferOffsets);
+	}
+
+	void CommandRecorder::SetRootConstants(uint32_t rootConstantIndex, const void* data, uint32_t size) { m_impl->SetRootConstants(rootConstantIndex, data, size); }
+
+	void CommandRecorder::SetIndexBuffer(const nri::Buffer& buffer, uint64_t offset, nri::IndexType indexType) { m_impl->SetIndexBuffer(buffer, offset, indexType); }
+
+	void CommandRecorder::SetVertexBuffers(uint32_t baseSlot, uint32_t bufferNum, const nri::Buffer* const* buffers, const uint64_t* offsets)
+	{
+		m_impl->SetVertexBuffers(baseSlot, bufferNum, buffers, offsets);
+	}
+
+	void CommandRecorder::SetViewports(const nri::Viewport* viewports, uint32_t viewportNum) { m_impl->SetViewports(viewports, viewportNum); }
+
+	void CommandRecorder::SetScissors(const nri::Rect* rects, uint32_t rectNum) { m_impl->SetScissors(rects, rectNum); }
+
+	void CommandRecorder::Barrier(const nri::BarrierGroupDesc& barrierGroupDesc) { m_impl->Barrier(barrierGroupDesc); }
+
+	void CommandRecorder::BeginRendering(const nri::AttachmentsDesc& attachmentsDesc) { m_impl->BeginRendering(attachmentsDesc); }
+
+	void CommandRecorder::ClearAttachments(const nri::ClearDesc* clearDescs, uint32_t clearDescNum, const nri::Rect* rects, uint32_t rectNum)
+	{
+		m_impl->ClearAttachments(clearDescs, clearDescNum, rects, rectNum);
+	}
+
+	void CommandRecorder::EndRendering() { m_impl->EndRendering(); }
+
+	void CommandRecorder::Draw(const nri::DrawDesc& drawDesc) { m_impl->Draw(drawDesc); }
+
+	void CommandRecorder::DrawIndexed(const nri::DrawIndexedDesc& drawIndexedDesc) { m_impl->DrawIndexed(drawIndexedDesc); }
+
+	nri::CommandBuffer& CommandRecorder::GetCommandBuffer() const { return m_impl->GetCommandBuffer(); }
+
+	CommandRecorderStats CommandRecorder::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
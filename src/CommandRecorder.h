@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct CommandRecorderStats
+	{
+		uint32_t issuedNum = 0;
+		uint32_t droppedNum = 0;
+	};
+
+	// Records into one command buffer and drops state calls that would rebind what is already bound.
+	// The cache is reset by Begin, so it never leaks between recordings.
+	class CommandRecorder
+	{
+		DISALLOW_COPY_AND_ASSIGN(CommandRecorder);
+	public:
+		CommandRecorder(NRIInterface& NRI, nri::CommandBuffer& commandBuffer);
+		~CommandRecorder();
+
+		nri::Result Begin(const nri::DescriptorPool* descriptorPool);
+		nri::Result End();
+
+		// Forgets the cached state, e.g. after recording into the command buffer directly
+		void Invalidate();
+
+		void SetPipelineLayout(const nri::PipelineLayout& pipelineLayout);
+		void SetPipeline(const nri::Pipeline& pipeline);
+
+		// Sets bound afterwards must come from this pool
+		void SetDescriptorPool(const nri::DescriptorPool& descriptorPool);
+		void SetDescriptorSet(uint32_t setIndex, const nri::DescriptorSet& descriptorSet, const uint32_t* dynamicConstantBufferOffsets);
+		void SetRootConstants(uint32_t rootConstantIndex, const void* data, uint32_t size);
+		void SetIndexBuffer(const nri::Buffer& buffer, uint64_t offset, nri::IndexType indexType);
+		void SetVertexBuffers(uint32_t baseSlot, uint32_t bufferNum, const nri::Buffer* const* buffers, const uint64_t* offsets);
+		void SetViewports(const nri::Viewport* viewports, uint32_t viewportNum);
+		void SetScissors(const nri::Rect* rects, uint32_t rectNum);
+
+		void Barrier(const nri::BarrierGroupDesc& barrierGroupDesc);
+		void BeginRendering(const nri::AttachmentsDesc& attachmentsDesc);
+		void ClearAttachments(const nri::ClearDesc* clearDescs, uint32_t clearDescNum, const nri::Rect* rects, uint32_t rectNum);
+		void EndRendering();
+		void Draw(const nri::DrawDesc& drawDesc);
+		void DrawIndexed(const nri::DrawIndexedDesc& drawIndexedDesc);
+
+		nri::CommandBuffer& GetCommandBuffer() const;
+
+		// Counts since the last Begin
+		CommandRecorderStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
@@ -0,0 +1,189 @@
+#include "Defragmenter.h"
+#include "TextureStorage.h"
+#include "TextureHeap.h"
+#include "UploadQueue.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+namespace nfw
+{
+	namespace
+	{
+		// A copy of a texture in a compact block, swapped in by Update
+		struct Move
+		{
+			TextureHandle texture;
+			uint32_t version = 0;       // of the texture when the copy started, a replaced texture drops the copy
+			nri::Texture* staged = nullptr;
+			TextureMemory memory;
+			Task<nri::Result> task;
+		};
+	}
+
+	class Defragmenter::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, TextureStoragePtr textureStorage, UploadQueuePtr uploadQueue, const DefragmenterDesc& desc)
+			: NRI(nri)
+			, m_device(device)
+			, m_storage(textureStorage)
+			, m_uploadQueue(uploadQueue)
+			, m_desc(desc)
+		{}
+
+		~Impl()
+		{
+			for (std::unique_ptr<Move>& move : m_moves)
+			{
+				m_uploadQueue->Wait(move->task);
+				DestroyStaged(*move);
+			}
+		}
+
+		void Update()
+		{
+			NFW_TRACE_SCOPE("Defragmenter::Update");
+
+			InstallMoves();
+
+			// pinned textures stay where they are, so their blocks cannot be emptied
+			m_pinnedBlocks.clear();
+			m_storage->ForEach([&](TextureHandle texture)
+			{
+				const TextureMemory& memory = m_storage->GetTextureMemory(texture);
+				if (memory && m_storage->IsPinned(texture))
+				{
+					m_pinnedBlocks.push_back(memory.block);
+				}
+			});
+
+			TextureHeap& heap = m_storage->GetTextureHeap();
+			const uint32_t block = heap.BeginEvacuation(m_desc.sparseUsage, m_pinnedBlocks);
+			if (block != UINT32_MAX)
+			{
+				// the budget is checked before each texture, one bigger than it still moves on its own
+				uint64_t bytes = 0;
+				m_storage->ForEach([&](TextureHandle texture)
+				{
+					const TextureMemory& memory = m_storage->GetTextureMemory(texture);
+					if (bytes >= m_desc.moveMaxBytes || !memory || memory.block != block || m_storage->IsPinned(texture) || IsMoving(texture))
+					{
+						return;
+					}
+					if (StartMove(texture))
+					{
+						bytes += memory.size;
+					}
+				});
+			}
+
+			m_stats.movingNum = (uint32_t)m_moves.size();
+		}
+
+		DefragmenterStats GetStats() const { return m_stats; }
+
+	private:
+		bool IsMoving(TextureHandle texture) const
+		{
+			return std::any_of(m_moves.begin(), m_moves.end(), [texture](const std::unique_ptr<Move>& move) { return move->texture == texture; });
+		}
+
+		bool StartMove(TextureHandle texture)
+		{
+			nri::Texture& src = *m_storage->GetTexture(texture);
+
+			std::unique_ptr<Move> move = std::make_unique<Move>();
+			move->texture = texture;
+			move->version = m_storage->GetVersion(texture);
+
+			// the evacuating block takes nothing new, the copy lands in another one
+			nri::Result result = NRI.CreateTexture(m_device, NRI.GetTextureDesc(src), move->staged);
+			if (result == nri::Result::SUCCESS)
+			{
+				result = m_storage->GetTextureHeap().Bind(*move->staged, move->memory);
+			}
+			if (result != nri::Result::SUCCESS)
+			{
+				DestroyStaged(*move);
+				return false;
+			}
+
+			move->task = RunMove(*move->staged, src, m_storage->GetTextureUploadDesc(texture).after);
+			move->task.Start();
+			m_moves.push_back(std::move(move));
+			return true;
+		}
+
+		Task<nri::Result> RunMove(nri::Texture& staged, nri::Texture& src, nri::AccessLayoutStage state)
+		{
+			co_return co_await m_uploadQueue->CopyTexture(staged, src, state);
+		}
+
+		void InstallMoves()
+		{
+			for (size_t i = 0; i < m_moves.size();)
+			{
+				Move& move = *m_moves[i];
+				if (!move.task.IsDone())
+				{
+					i++;
+					continue;
+				}
+
+				// evicted, restaged or released meanwhile, the copy is stale
+				const bool current = m_storage->IsValid(move.texture) && m_storage->GetVersion(move.texture) == move.version;
+				if (move.task.GetResult() == nri::Result::SUCCESS && current
+					&& m_storage->ReplaceTexture(move.texture, move.staged, move.memory, m_storage->GetMipOffset(move.texture)) == nri::Result::SUCCESS)
+				{
+					m_stats.moveNum++;
+					m_stats.movedBytes += move.memory.size;
+				}
+				else
+				{
+					DestroyStaged(move);
+				}
+
+				m_moves[i] = std::move(m_moves.back());
+				m_moves.pop_back();
+			}
+		}
+
+		void DestroyStaged(Move& move)
+		{
+			if (move.staged)
+			{
+				NRI.DestroyTexture(*move.staged);
+				move.staged = nullptr;
+			}
+			m_storage->GetTextureHeap().Free(move.memory);
+			move.memory = {};
+		}
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		TextureStoragePtr m_storage;
+		UploadQueuePtr m_uploadQueue;
+		DefragmenterDesc m_desc;
+
+		std::vector<std::unique_ptr<Move>> m_moves;
+		std::vector<uint32_t> m_pinnedBlocks;
+		DefragmenterStats m_stats;
+	};
+
+	// constructor
+	Defragmenter::Defragmenter(NRIInterface& NRI, nri::Device& device, TextureStoragePtr textureStorage, UploadQueuePtr uploadQueue, const DefragmenterDesc& desc)
+		: m_impl(std::make_unique<Impl>(NRI, device, textureStorage, uploadQueue, desc))
+	{
+	}
+
+	// destructor
+	Defragmenter::~Defragmenter()
+	{
+	}
+
+	void Defragmenter::Update() { m_impl->Update(); }
+
+	DefragmenterStats Defragmenter::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct DefragmenterDesc
+	{
+		float sparseUsage = 0.5f;                   // heap blocks used less than this share are emptied
+		uint64_t moveMaxBytes = 16 * 1024 * 1024;   // texture memory copied per frame
+	};
+
+	struct DefragmenterStats
+	{
+		uint32_t movingNum = 0;         // copies in flight
+		uint64_t moveNum = 0;           // since start
+		uint64_t movedBytes = 0;        // since start
+	};
+
+	// Compacts the TextureHeap of a TextureStorage while textures come and go.
+	// Update picks a sparsely used block and moves its textures out a few at a time: each gets a new texture in
+	// another block, filled by a GPU copy through the UploadQueue and swapped in by a later Update, which bumps the
+	// texture version so descriptor sets are rewritten. Handles stay the same. The heap frees the block once its
+	// last range has been through the deletion queue. Pinned textures are never moved, nor their blocks emptied.
+	// Update must be called from the thread that builds frames, after anything else that replaces textures.
+	class Defragmenter
+	{
+		DISALLOW_COPY_AND_ASSIGN(Defragmenter);
+	public:
+		Defragmenter(NRIInterface& NRI, nri::Device& device, TextureStoragePtr textureStorage, UploadQueuePtr uploadQueue, const DefragmenterDesc& desc = {});
+
+		// Finishes running copies through UploadQueue::Wait, so it belongs on the thread that updates the queue
+		~Defragmenter();
+
+		// Once per frame: swaps in finished copies, then starts new ones within moveMaxBytes
+		void Update();
+
+		DefragmenterStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
@@ -0,0 +1,175 @@
+#include "DeletionQueue.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+namespace nfw
+{
+	namespace
+	{
+		// destruction order inside one collection, views before resources before memory
+		enum class DeletionType : uint8_t
+		{
+			DESCRIPTOR,
+			PIPELINE,
+			PIPELINE_LAYOUT,
+			BUFFER,
+			TEXTURE,
+			MEMORY,
+			FUNCTION,
+		};
+
+		struct Deletion
+		{
+			uint64_t fenceValue;
+			DeletionType type;
+			void* object;       // std::function<void()> owned by the entry for FUNCTION
+		};
+	}
+
+	class DeletionQueue::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Fence& fence)
+			: NRI(nri)
+			, m_fence(fence)
+		{}
+
+		~Impl()
+		{
+			Flush();
+		}
+
+		void SetFenceValue(uint64_t fenceValue)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			// Prepare and Render may report frames out of order, never go back
+			m_fenceValue = std::max(m_fenceValue, fenceValue);
+		}
+
+		uint64_t GetFenceValue() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_fenceValue;
+		}
+
+		void Release(DeletionType type, void* object)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_deletions.push_back({ m_fenceValue, type, object });
+		}
+
+		uint32_t Collect()
+		{
+			const uint64_t completedValue = NRI.GetFenceValue(m_fence);
+
+			std::vector<Deletion> deletions;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				// values only grow, so the finished ones are at the front
+				while (!m_deletions.empty() && m_deletions.front().fenceValue <= completedValue)
+				{
+					deletions.push_back(m_deletions.front());
+					m_deletions.pop_front();
+				}
+			}
+			Destroy(deletions);
+			return (uint32_t)deletions.size();
+		}
+
+		uint32_t Flush()
+		{
+			std::vector<Deletion> deletions;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				deletions.assign(m_deletions.begin(), m_deletions.end());
+				m_deletions.clear();
+			}
+			Destroy(deletions);
+			return (uint32_t)deletions.size();
+		}
+
+		uint32_t GetPendingNum() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return (uint32_t)m_deletions.size();
+		}
+
+	private:
+		void Destroy(std::vector<Deletion>& deletions)
+		{
+			if (deletions.empty())
+			{
+				return;
+			}
+			NFW_TRACE_SCOPE("DeletionQueue::Destroy");
+
+			std::stable_sort(deletions.begin(), deletions.end(), [](const Deletion& a, const Deletion& b) { return a.type < b.type; });
+			for (const Deletion& deletion : deletions)
+			{
+				switch (deletion.type)
+				{
+				case DeletionType::DESCRIPTOR: NRI.DestroyDescriptor(*(nri::Descriptor*)deletion.object); break;
+				case DeletionType::PIPELINE: NRI.DestroyPipeline(*(nri::Pipeline*)deletion.object); break;
+				case DeletionType::PIPELINE_LAYOUT: NRI.DestroyPipelineLayout(*(nri::PipelineLayout*)deletion.object); break;
+				case DeletionType::BUFFER: NRI.DestroyBuffer(*(nri::Buffer*)deletion.object); break;
+				case DeletionType::TEXTURE: NRI.DestroyTexture(*(nri::Texture*)deletion.object); break;
+				case DeletionType::MEMORY: NRI.FreeMemory(*(nri::Memory*)deletion.object); break;
+				case DeletionType::FUNCTION:
+				{
+					std::unique_ptr<std::function<void()>> release((std::function<void()>*)deletion.object);
+					(*release)();
+					break;
+				}
+				}
+			}
+		}
+
+		NRIInterface& NRI;
+		nri::Fence& m_fence;
+
+		mutable std::mutex m_mutex;
+		std::deque<Deletion> m_deletions;
+		uint64_t m_fenceValue = 0;
+	};
+
+	// constructor
+	DeletionQueue::DeletionQueue(NRIInterface& NRI, nri::Fence& fence)
+		: m_impl(std::make_unique<Impl>(NRI, fence))
+	{
+	}
+
+	// destructor
+	DeletionQueue::~DeletionQueue()
+	{
+	}
+
+	void DeletionQueue::SetFenceValue(uint64_t fenceValue) { m_impl->SetFenceValue(fenceValue); }
+
+	uint64_t DeletionQueue::GetFenceValue() const { return m_impl->GetFenceValue(); }
+
+	void DeletionQueue::Release(nri::Buffer& buffer) { m_impl->Release(DeletionType::BUFFER, &buffer); }
+
+	void DeletionQueue::Release(nri::Texture& texture) { m_impl->Release(DeletionType::TEXTURE, &texture); }
+
+	void DeletionQueue::Release(nri::Descriptor& descriptor) { m_impl->Release(DeletionType::DESCRIPTOR, &descriptor); }
+
+	void DeletionQueue::Release(nri::Pipeline& pipeline) { m_impl->Release(DeletionType::PIPELINE, &pipeline); }
+
+	void DeletionQueue::Release(nri::PipelineLayout& pipelineLayout) { m_impl->Release(DeletionType::PIPELINE_LAYOUT, &pipelineLayout); }
+
+	void DeletionQueue::Release(nri::Memory& memory) { m_impl->Release(DeletionType::MEMORY, &memory); }
+
+	void DeletionQueue::Release(std::function<void()> release) { m_impl->Release(DeletionType::FUNCTION, new std::function<void()>(std::move(release))); }
+
+	uint32_t DeletionQueue::Collect() { return m_impl->Collect(); }
+
+	uint32_t DeletionQueue::Flush() { return m_impl->Flush(); }
+
+	uint32_t DeletionQueue::GetPendingNum() const { return m_impl->GetPendingNum(); }
+
+} // namespace nfw
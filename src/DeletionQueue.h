@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	// Deferred destruction of GPU objects.
+	// A released object is tagged with the fence value of the newest frame that may still use it and is destroyed
+	// by Collect once the fence has passed that value, so resources can go away mid-session without WaitForIdle.
+	// Release may be called from any thread.
+	class DeletionQueue
+	{
+		DISALLOW_COPY_AND_ASSIGN(DeletionQueue);
+	public:
+		DeletionQueue(NRIInterface& NRI, nri::Fence& fence);
+
+		// Destroys whatever is left, the GPU must be idle by then
+		~DeletionQueue();
+
+		// Fence value signaled by the newest frame being built, objects released from now on wait for it
+		void SetFenceValue(uint64_t fenceValue);
+		uint64_t GetFenceValue() const;
+
+		void Release(nri::Buffer& buffer);
+		void Release(nri::Texture& texture);
+		void Release(nri::Descriptor& descriptor);
+		void Release(nri::Pipeline& pipeline);
+		void Release(nri::PipelineLayout& pipelineLayout);
+
+		// Freed after every buffer and texture released with it, so bound resources go first
+		void Release(nri::Memory& memory);
+
+		// Runs last, for what is not an NRI object, e.g. a TextureHeap range whose texture is released with it
+		void Release(std::function<void()> release);
+
+		// Destroys the objects the fence has passed, returns how many were destroyed
+		uint32_t Collect();
+
+		// Destroys everything regardless of the fence, after the caller has waited for the GPU
+		uint32_t Flush();
+
+		uint32_t GetPendingNum() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
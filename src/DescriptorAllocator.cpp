@@ -0,0 +1,210 @@
+#include "DescriptorAllocator.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+namespace nfw
+{
+	namespace
+	{
+		struct PoolChain
+		{
+			std::mutex mutex;
+			std::vector<nri::DescriptorPool*> pools;
+			uint32_t current = 0;           // pool allocations go to, the ones before it are full
+			uint32_t currentSetNum = 0;     // sets taken from the current pool
+			uint32_t setNum = 0;
+		};
+	}
+
+	class DescriptorAllocator::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, nri::Fence& frameFence, const DescriptorAllocatorDesc& desc)
+			: NRI(nri)
+			, m_device(device)
+			, m_frameFence(frameFence)
+			, m_desc(desc)
+		{
+			m_desc.frameSlotNum = std::max(m_desc.frameSlotNum, 1u);
+			for (uint32_t i = 0; i < m_desc.frameSlotNum; i++)
+			{
+				m_frameChains.push_back(std::make_unique<PoolChain>());
+			}
+		}
+
+		~Impl()
+		{
+			DestroyPools(m_persistentChain);
+			for (std::unique_ptr<PoolChain>& chain : m_frameChains)
+			{
+				DestroyPools(*chain);
+			}
+		}
+
+		nri::Result AllocatePersistent(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum,
+			uint32_t variableDescriptorNum, nri::DescriptorPool** descriptorPool)
+		{
+			return Allocate(m_persistentChain, m_desc.persistentPoolDesc, pipelineLayout, setIndex, descriptorSets, descriptorSetNum, variableDescriptorNum, descriptorPool);
+		}
+
+		void BeginFrame(uint32_t frameIndex)
+		{
+			const uint32_t slot = frameIndex % m_desc.frameSlotNum;
+			PoolChain& chain = *m_frameChains[slot];
+			if (frameIndex >= m_desc.frameSlotNum)
+			{
+				NFW_TRACE_SCOPE("DescriptorAllocator::WaitFrameFence");
+				NRI.Wait(m_frameFence, 1 + frameIndex - m_desc.frameSlotNum);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(chain.mutex);
+
+				// the pools are kept, a chain that grew once does not have to grow again
+				for (nri::DescriptorPool* pool : chain.pools)
+				{
+					NRI.ResetDescriptorPool(*pool);
+				}
+				chain.current = 0;
+				chain.currentSetNum = 0;
+				chain.setNum = 0;
+			}
+			m_frameSlot.store(slot, std::memory_order_release);
+		}
+
+		nri::Result AllocateTransient(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum,
+			uint32_t variableDescriptorNum, nri::DescriptorPool** descriptorPool)
+		{
+			PoolChain& chain = *m_frameChains[m_frameSlot.load(std::memory_order_acquire)];
+			return Allocate(chain, m_desc.transientPoolDesc, pipelineLayout, setIndex, descriptorSets, descriptorSetNum, variableDescriptorNum, descriptorPool);
+		}
+
+		nri::DescriptorPool* GetPersistentPool()
+		{
+			std::lock_guard<std::mutex> lock(m_persistentChain.mutex);
+			return m_persistentChain.pools.empty() ? nullptr : m_persistentChain.pools[0];
+		}
+
+		DescriptorAllocatorStats GetStats()
+		{
+			DescriptorAllocatorStats stats;
+			{
+				std::lock_guard<std::mutex> lock(m_persistentChain.mutex);
+				stats.persistentPoolNum = (uint32_t)m_persistentChain.pools.size();
+			}
+			for (std::unique_ptr<PoolChain>& chain : m_frameChains)
+			{
+				std::lock_guard<std::mutex> lock(chain->mutex);
+				stats.transientPoolNum += (uint32_t)chain->pools.size();
+			}
+			PoolChain& chain = *m_frameChains[m_frameSlot.load(std::memory_order_acquire)];
+			std::lock_guard<std::mutex> lock(chain.mutex);
+			stats.transientSetNum = chain.setNum;
+			return stats;
+		}
+
+	private:
+		nri::Result Allocate(PoolChain& chain, const nri::DescriptorPoolDesc& poolDesc, const nri::PipelineLayout& pipelineLayout, uint32_t setIndex,
+			nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum, uint32_t variableDescriptorNum, nri::DescriptorPool** descriptorPool)
+		{
+			if (descriptorSetNum > poolDesc.descriptorSetMaxNum)
+			{
+				return nri::Result::INVALID_ARGUMENT;
+			}
+
+			std::lock_guard<std::mutex> lock(chain.mutex);
+			for (;;)
+			{
+				if (chain.current == chain.pools.size())
+				{
+					NFW_TRACE_SCOPE("DescriptorAllocator::CreatePool");
+
+					nri::DescriptorPool* pool = nullptr;
+					const nri::Result result = NRI.CreateDescriptorPool(m_device, poolDesc, pool);
+					if (result != nri::Result::SUCCESS)
+					{
+						return result;
+					}
+					chain.pools.push_back(pool);
+					chain.currentSetNum = 0;
+				}
+
+				if (chain.currentSetNum + descriptorSetNum <= poolDesc.descriptorSetMaxNum)
+				{
+					nri::DescriptorPool* pool = chain.pools[chain.current];
+					if (NRI.AllocateDescriptorSets(*pool, pipelineLayout, setIndex, descriptorSets, descriptorSetNum, variableDescriptorNum) == nri::Result::SUCCESS)
+					{
+						chain.currentSetNum += descriptorSetNum;
+						chain.setNum += descriptorSetNum;
+						if (descriptorPool)
+						{
+							*descriptorPool = pool;
+						}
+						return nri::Result::SUCCESS;
+					}
+
+					// even an empty pool can not hold the sets
+					if (chain.currentSetNum == 0)
+					{
+						return nri::Result::OUT_OF_MEMORY;
+					}
+				}
+
+				// out of sets or of one descriptor type, move on to the next pool
+				chain.current++;
+				chain.currentSetNum = 0;
+			}
+		}
+
+		void DestroyPools(PoolChain& chain)
+		{
+			for (nri::DescriptorPool* pool : chain.pools)
+			{
+				NRI.DestroyDescriptorPool(*pool);
+			}
+			chain.pools.clear();
+		}
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		nri::Fence& m_frameFence;
+		DescriptorAllocatorDesc m_desc;
+
+		PoolChain m_persistentChain;
+		std::vector<std::unique_ptr<PoolChain>> m_frameChains;
+		std::atomic<uint32_t> m_frameSlot = 0;
+	};
+
+	// constructor
+	DescriptorAllocator::DescriptorAllocator(NRIInterface& NRI, nri::Device& device, nri::Fence& frameFence, const DescriptorAllocatorDesc& desc)
+		: m_impl(std::make_unique<Impl>(NRI, device, frameFence, desc))
+	{
+	}
+
+	// destructor
+	DescriptorAllocator::~DescriptorAllocator()
+	{
+	}
+
+	nri::Result DescriptorAllocator::AllocatePersistent(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum,
+		uint32_t variableDescriptorNum, nri::DescriptorPool** descriptorPool)
+	{
+		return m_impl->AllocatePersistent(pipelineLayout, setIndex, descriptorSets, descriptorSetNum, variableDescriptorNum, descriptorPool);
+	}
+
+	void DescriptorAllocator::BeginFrame(uint32_t frameIndex) { m_impl->BeginFrame(frameIndex); }
+
+	nri::Result DescriptorAllocator::AllocateTransient(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum,
+		uint32_t variableDescriptorNum, nri::DescriptorPool** descriptorPool)
+	{
+		return m_impl->AllocateTransient(pipelineLayout, setIndex, descriptorSets, descriptorSetNum, variableDescriptorNum, descriptorPool);
+	}
+
+	nri::DescriptorPool* DescriptorAllocator::GetPersistentPool() const { return m_impl->GetPersistentPool(); }
+
+	DescriptorAllocatorStats DescriptorAllocator::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct DescriptorAllocatorDesc
+	{
+		nri::DescriptorPoolDesc persistentPoolDesc = {};    // capacity of every pool in the persistent chain
+		nri::DescriptorPoolDesc transientPoolDesc = {};     // capacity of every pool in a frame slot's chain
+		uint32_t frameSlotNum = 3;                          // frames that may hold transient sets at the same time
+	};
+
+	struct DescriptorAllocatorStats
+	{
+		uint32_t persistentPoolNum = 0;
+		uint32_t transientPoolNum = 0;      // over all frame slots
+		uint32_t transientSetNum = 0;       // allocated since the last BeginFrame
+	};
+
+	// Descriptor sets from chains of pools that grow when a pool runs out.
+	// Persistent sets live as long as the allocator. Transient sets live until their frame slot comes around again,
+	// BeginFrame resets the whole slot chain at once instead of freeing sets one by one.
+	// Sets bound together must come from the same pool on D3D12, so every allocation reports its pool
+	// for CommandRecorder::SetDescriptorPool. Allocation is thread-safe.
+	class DescriptorAllocator
+	{
+		DISALLOW_COPY_AND_ASSIGN(DescriptorAllocator);
+	public:
+		// frame i is expected to signal 1 + i on frameFence
+		DescriptorAllocator(NRIInterface& NRI, nri::Device& device, nri::Fence& frameFence, const DescriptorAllocatorDesc& desc);
+		~DescriptorAllocator();
+
+		nri::Result AllocatePersistent(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum,
+			uint32_t variableDescriptorNum = 0, nri::DescriptorPool** descriptorPool = nullptr);
+
+		// Waits for the frame that used the slot last, then resets its pools; call before the frame allocates
+		void BeginFrame(uint32_t frameIndex);
+
+		nri::Result AllocateTransient(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t descriptorSetNum,
+			uint32_t variableDescriptorNum = 0, nri::DescriptorPool** descriptorPool = nullptr);
+
+		// First persistent pool, for Begin on command buffers that bind persistent sets
+		nri::DescriptorPool* GetPersistentPool() const;
+
+		DescriptorAllocatorStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
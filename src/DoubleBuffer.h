@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace nfw
+{
+	// Lock-free single producer / single consumer double buffer.
+	// The producer fills one slot while the consumer reads the other; slots are handed over
+	// with two counters, each written by one side only. A side that runs ahead waits with
+	// spin, yield and then short sleeps, Close() wakes both sides for shutdown.
+	template <typename T>
+	class DoubleBuffer
+	{
+	public:
+		DoubleBuffer() = default;
+
+		DoubleBuffer(const DoubleBuffer&) = delete;
+		void operator=(const DoubleBuffer&) = delete;
+
+		// Producer: returns the next slot once the consumer released it, nullptr after Close()
+		T* BeginWrite()
+		{
+			const uint64_t writeCount = m_writeCount.load(std::memory_order_relaxed);
+			if (!WaitUntil([&]() { return writeCount - m_readCount.load(std::memory_order_acquire) < m_slots.size(); }))
+			{
+				return nullptr;
+			}
+			return &m_slots[writeCount % m_slots.size()];
+		}
+
+		// Producer: publishes the slot returned by BeginWrite
+		void EndWrite()
+		{
+			m_writeCount.fetch_add(1, std::memory_order_release);
+		}
+
+		// Consumer: returns the oldest published slot, nullptr after Close()
+		T* BeginRead()
+		{
+			const uint64_t readCount = m_readCount.load(std::memory_order_relaxed);
+			if (!WaitUntil([&]() { return m_writeCount.load(std::memory_order_acquire) != readCount; }))
+			{
+				return nullptr;
+			}
+			return &m_slots[readCount % m_slots.size()];
+		}
+
+		// Consumer: hands the slot returned by BeginRead back to the producer
+		void EndRead()
+		{
+			m_readCount.fetch_add(1, std::memory_order_release);
+		}
+
+		// Slots, for setup before either side runs
+		std::array<T, 2>& GetSlots() { return m_slots; }
+
+		void Close() { m_closed.store(true, std::memory_order_release); }
+		bool IsClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+	private:
+		template <typename Pred>
+		bool WaitUntil(Pred&& ready)
+		{
+			for (uint32_t i = 0; !ready(); i++)
+			{
+				if (IsClosed())
+				{
+					return false;
+				}
+
+				if (i < 64)
+				{
+					continue;
+				}
+				else if (i < 128)
+				{
+					std::this_thread::yield();
+				}
+				else
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				}
+			}
+			return !IsClosed();
+		}
+
+		std::array<T, 2> m_slots = {};
+		alignas(64) std::atomic<uint64_t> m_writeCount = 0;
+		alignas(64) std::atomic<uint64_t> m_readCount = 0;
+		std::atomic<bool> m_closed = false;
+	};
+} // namespace nfw
@@ -0,0 +1,205 @@
+#include "DrawList.h"
+#include "CommandRecorder.h"
+#include "Parallel.h"
+
+#include <thread>
+
+namespace nfw
+{
+	constexpr uint32_t RADIX_BITS = 8;
+	constexpr uint32_t RADIX_BUCKET_NUM = 1 << RADIX_BITS;
+	constexpr uint32_t RADIX_PASS_NUM = 64 / RADIX_BITS;
+	constexpr uint32_t RADIX_MIN_PARTITION_SIZE = 4096;
+
+	constexpr uint32_t DEPTH_BITS = 24;
+	constexpr uint32_t DEPTH_MAX = (1u << DEPTH_BITS) - 1;
+	constexpr uint32_t PIPELINE_ID_MASK = 0xFFF;
+	constexpr uint32_t MATERIAL_ID_MASK = 0xFFFF;
+
+	uint64_t MakeDrawKey(DrawPass pass, uint32_t pipelineId, uint32_t materialId, float depth)
+	{
+		const uint64_t passBits = static_cast<uint64_t>(pass) & 0xF;
+		const uint64_t pipelineBits = pipelineId & PIPELINE_ID_MASK;
+		const uint64_t materialBits = materialId & MATERIAL_ID_MASK;
+		const uint64_t depthBits = static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * DEPTH_MAX);
+
+		if (pass == DrawPass::TRANSLUCENT)
+		{
+			return (passBits << 60) | ((DEPTH_MAX - depthBits) << 36) | (pipelineBits << 24) | (materialBits << 8);
+		}
+		return (passBits << 60) | (pipelineBits << 48) | (materialBits << 32) | (depthBits << 8);
+	}
+
+	struct SortItem
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	class DrawList::Impl
+	{
+	public:
+		Impl() {}
+		~Impl() {}
+
+		void Clear()
+		{
+			m_commands.clear();
+			m_items.clear();
+		}
+
+		void Add(uint64_t key, const DrawCommand& command)
+		{
+			m_items.push_back({ key, static_cast<uint32_t>(m_commands.size()) });
+			m_commands.push_back(command);
+		}
+
+		void Sort()
+		{
+			const uint32_t count = static_cast<uint32_t>(m_items.size());
+			if (count < 2)
+			{
+				return;
+			}
+
+			const uint32_t threadNum = std::max(std::thread::hardware_concurrency(), 1u);
+			const uint32_t partitionNum = std::min(std::max(count / RADIX_MIN_PARTITION_SIZE, 1u), threadNum);
+			const uint32_t partitionSize = (count + partitionNum - 1) / partitionNum;
+
+			m_scratch.resize(count);
+			m_histograms.resize(partitionNum);
+
+			SortItem* src = m_items.data();
+			SortItem* dst = m_scratch.data();
+			for (uint32_t pass = 0; pass < RADIX_PASS_NUM; ++pass)
+			{
+				const uint32_t shift = pass * RADIX_BITS;
+
+				ParallelFor(partitionNum, 1, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t partition = begin; partition < end; ++partition)
+					{
+						std::array<uint32_t, RADIX_BUCKET_NUM>& histogram = m_histograms[partition];
+						histogram.fill(0);
+						const uint32_t first = partition * partitionSize;
+						const uint32_t last = std::min(first + partitionSize, count);
+						for (uint32_t i = first; i < last; ++i)
+						{
+							histogram[(src[i].key >> shift) & (RADIX_BUCKET_NUM - 1)]++;
+						}
+					}
+				});
+
+				// turn the histograms into scatter offsets, digit-major so the sort stays stable
+				bool skip = false;
+				uint32_t offset = 0;
+				for (uint32_t bucket = 0; bucket < RADIX_BUCKET_NUM; ++bucket)
+				{
+					uint32_t bucketCount = 0;
+					for (uint32_t partition = 0; partition < partitionNum; ++partition)
+					{
+						const uint32_t n = m_histograms[partition][bucket];
+						m_histograms[partition][bucket] = offset;
+						offset += n;
+						bucketCount += n;
+					}
+					// every key has the same digit, nothing moves in this pass
+					if (bucketCount == count)
+					{
+						skip = true;
+						break;
+					}
+				}
+				if (skip)
+				{
+					continue;
+				}
+
+				ParallelFor(partitionNum, 1, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t partition = begin; partition < end; ++partition)
+					{
+						std::array<uint32_t, RADIX_BUCKET_NUM>& offsets = m_histograms[partition];
+						const uint32_t first = partition * partitionSize;
+						const uint32_t last = std::min(first + partitionSize, count);
+						for (uint32_t i = first; i < last; ++i)
+						{
+							dst[offsets[(src[i].key >> shift) & (RADIX_BUCKET_NUM - 1)]++] = src[i];
+						}
+					}
+				});
+				std::swap(src, dst);
+			}
+
+			if (src != m_items.data())
+			{
+				m_items.swap(m_scratch);
+			}
+		}
+
+		void Record(CommandRecorder& recorder) const
+		{
+			for (const SortItem& item : m_items)
+			{
+				const DrawCommand& command = m_commands[item.index];
+
+				recorder.SetPipelineLayout(*command.pipelineLayout);
+				recorder.SetPipeline(*command.pipeline);
+				if (command.descriptorPool)
+				{
+					recorder.SetDescriptorPool(*command.descriptorPool);
+				}
+				if (command.rootConstantSize)
+				{
+					recorder.SetRootConstants(0, command.rootConstants, command.rootConstantSize);
+				}
+				recorder.SetIndexBuffer(*command.indexBuffer, command.indexOffset, command.indexType);
+				recorder.SetVertexBuffers(0, 1, &command.vertexBuffer, &command.vertexOffset);
+				for (uint32_t i = 0; i < DRAW_DESCRIPTOR_SET_MAX_NUM; ++i)
+				{
+					if (command.descriptorSets[i])
+					{
+						const bool dynamic = (command.dynamicConstantBufferMask >> i) & 1;
+						recorder.SetDescriptorSet(i, *command.descriptorSets[i], dynamic ? &command.dynamicConstantBufferOffsets[i] : nullptr);
+					}
+				}
+
+				recorder.DrawIndexed(command.drawIndexedDesc);
+			}
+		}
+
+		uint32_t GetDrawNum() const { return static_cast<uint32_t>(m_items.size()); }
+
+		const DrawCommand& GetSortedCommand(uint32_t index) const { return m_commands[m_items[index].index]; }
+
+	private:
+		std::vector<DrawCommand> m_commands;
+		std::vector<SortItem> m_items;
+		std::vector<SortItem> m_scratch;
+		std::vector<std::array<uint32_t, RADIX_BUCKET_NUM>> m_histograms;
+	};
+
+	// constructor
+	DrawList::DrawList()
+		: m_impl(std::make_unique<Impl>())
+	{
+	}
+
+	// destructor
+	DrawList::~DrawList()
+	{
+	}
+
+	void DrawList::Clear() { m_impl->Clear(); }
+
+	void DrawList::Add(uint64_t key, const DrawCommand& command) { m_impl->Add(key, command); }
+
+	void DrawList::Sort() { m_impl->Sort(); }
+
+	void DrawList::Record(CommandRecorder& recorder) const { m_impl->Record(recorder); }
+
+	uint32_t DrawList::GetDrawNum() const { return m_impl->GetDrawNum(); }
+
+	const DrawCommand& DrawList::GetSortedCommand(uint32_t index) const { return m_impl->GetSortedCommand(index); }
+
+} // namespace nfw
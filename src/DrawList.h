@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	constexpr uint32_t DRAW_DESCRIPTOR_SET_MAX_NUM = 4;
+
+	// Passes are submitted in this order
+	enum class DrawPass : uint8_t
+	{
+		GEOMETRY,       // front-to-back
+		TRANSLUCENT,    // back-to-front
+		OVERLAY,
+
+		MAX_NUM
+	};
+
+	// Everything needed to record one indexed draw
+	struct DrawCommand
+	{
+		nri::PipelineLayout* pipelineLayout = nullptr;
+		nri::Pipeline* pipeline = nullptr;
+		nri::DescriptorPool* descriptorPool = nullptr;     // pool of the descriptor sets, null keeps the bound one
+		std::array<nri::DescriptorSet*, DRAW_DESCRIPTOR_SET_MAX_NUM> descriptorSets = {};
+		std::array<uint32_t, DRAW_DESCRIPTOR_SET_MAX_NUM> dynamicConstantBufferOffsets = {};
+		uint8_t dynamicConstantBufferMask = 0;  // bit i set: descriptorSets[i] takes dynamicConstantBufferOffsets[i]
+		const void* rootConstants = nullptr;
+		uint32_t rootConstantSize = 0;
+		nri::Buffer* indexBuffer = nullptr;
+		uint64_t indexOffset = 0;
+		nri::IndexType indexType = nri::IndexType::UINT16;
+		nri::Buffer* vertexBuffer = nullptr;
+		uint64_t vertexOffset = 0;
+		nri::DrawIndexedDesc drawIndexedDesc = {};
+	};
+
+	// Packs a 64-bit sort key.
+	//   GEOMETRY/OVERLAY : pass(4) | pipeline(12) | material(16) | depth(24) | unused(8)
+	//   TRANSLUCENT      : pass(4) | inverted depth(24) | pipeline(12) | material(16) | unused(8)
+	// depth is the normalized [0, 1] view depth.
+	uint64_t MakeDrawKey(DrawPass pass, uint32_t pipelineId, uint32_t materialId, float depth);
+
+	// Draw submission layer.
+	// Draws are collected with a sort key, sorted with a parallel LSD radix sort
+	// and recorded in key order so that pipeline and descriptor switches are grouped.
+	// Redundant binds between neighbouring draws are dropped by the CommandRecorder.
+	class DrawList
+	{
+		DISALLOW_COPY_AND_ASSIGN(DrawList);
+	public:
+		DrawList();
+		~DrawList();
+
+		void Clear();
+		void Add(uint64_t key, const DrawCommand& command);
+		void Sort();
+
+		// Records the draws in sorted order. Viewports and scissors are left to the caller.
+		void Record(CommandRecorder& recorder) const;
+
+		uint32_t GetDrawNum() const;
+		const DrawCommand& GetSortedCommand(uint32_t index) const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
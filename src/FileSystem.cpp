@@ -0,0 +1,520 @@
+#include "FileSystem.h"
+#include "Lz4.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace nfw
+{
+	namespace fs = std::filesystem;
+
+	namespace
+	{
+		// header | files | blocks | names | block data, offsets from the start of the archive
+		constexpr uint32_t ARCHIVE_MAGIC = 0x5057464E;     // "NFWP"
+		constexpr uint32_t ARCHIVE_VERSION = 1;
+
+		struct ArchiveHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t fileNum;
+			uint32_t blockNum;
+			uint32_t blockSize;     // every block of a file but the last holds this many bytes
+			uint32_t reserved;
+			uint64_t nameSize;
+		};
+
+		struct ArchiveFile
+		{
+			uint64_t nameOffset;    // into the names
+			uint64_t size;
+			uint32_t nameLength;
+			uint32_t firstBlock;
+			uint32_t blockNum;
+			uint32_t reserved;
+		};
+
+		struct ArchiveBlock
+		{
+			uint64_t offset;
+			uint32_t compressedSize;    // equal to size when stored uncompressed
+			uint32_t size;
+		};
+
+		class MappedFile
+		{
+		public:
+			MappedFile() = default;
+			MappedFile(const MappedFile&) = delete;
+			void operator=(const MappedFile&) = delete;
+
+			~MappedFile()
+			{
+#if defined(_WIN32)
+				if (m_data)
+				{
+					UnmapViewOfFile(m_data);
+				}
+				if (m_mapping)
+				{
+					CloseHandle(m_mapping);
+				}
+				if (m_file != INVALID_HANDLE_VALUE)
+				{
+					CloseHandle(m_file);
+				}
+#else
+				if (m_data)
+				{
+					munmap((void*)m_data, m_size);
+				}
+				if (m_fd >= 0)
+				{
+					close(m_fd);
+				}
+#endif
+			}
+
+			bool Open(const std::string& path)
+			{
+#if defined(_WIN32)
+				m_file = CreateFileW(fs::path(path).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				LARGE_INTEGER size = {};
+				if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || !size.QuadPart)
+				{
+					return false;
+				}
+				m_size = (uint64_t)size.QuadPart;
+				m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (!m_mapping)
+				{
+					return false;
+				}
+				m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+				m_fd = open(path.c_str(), O_RDONLY);
+				struct stat st = {};
+				if (m_fd < 0 || fstat(m_fd, &st) != 0 || !st.st_size)
+				{
+					return false;
+				}
+				m_size = (uint64_t)st.st_size;
+				void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+				m_data = (data != MAP_FAILED) ? (const uint8_t*)data : nullptr;
+#endif
+				return m_data != nullptr;
+			}
+
+			const uint8_t* GetData() const { return m_data; }
+			uint64_t GetSize() const { return m_size; }
+
+		private:
+#if defined(_WIN32)
+			HANDLE m_file = INVALID_HANDLE_VALUE;
+			HANDLE m_mapping = nullptr;
+#else
+			int m_fd = -1;
+#endif
+			const uint8_t* m_data = nullptr;
+			uint64_t m_size = 0;
+		};
+
+		struct Archive
+		{
+			MappedFile file;
+			const ArchiveHeader* header = nullptr;
+			const ArchiveFile* files = nullptr;
+			const ArchiveBlock* blocks = nullptr;
+			std::unordered_map<std::string, uint32_t> indices;     // virtual path to file
+		};
+
+		// virtual paths use '/' whatever the platform
+		std::string Normalize(const std::string& path)
+		{
+			std::string normalized = path;
+			std::replace(normalized.begin(), normalized.end(), '\\', '/');
+			return normalized;
+		}
+
+		bool ReadLooseFile(const fs::path& path, std::vector<uint8_t>& data)
+		{
+			std::ifstream ifs(path, std::ios::in | std::ios::binary | std::ios::ate);
+			if (!ifs)
+			{
+				return false;
+			}
+			data.resize((size_t)ifs.tellg());
+			ifs.seekg(0);
+			return (bool)ifs.read((char*)data.data(), (std::streamsize)data.size());
+		}
+	}
+
+	class FileSystem::Impl
+	{
+	public:
+		static Impl& GetInstance()
+		{
+			static Impl impl;
+			return impl;
+		}
+
+		// the first use mounts the defaults
+		static Impl& Get()
+		{
+			Impl& impl = GetInstance();
+			if (!impl.m_initialized.load(std::memory_order_acquire))
+			{
+				impl.Init({});
+			}
+			return impl;
+		}
+
+		void Init(const FileSystemDesc& desc)
+		{
+			std::lock_guard<std::mutex> lock(m_initMutex);
+			if (m_initialized.load(std::memory_order_relaxed))
+			{
+				return;
+			}
+
+			m_directories = desc.directories;
+			for (FileSystemMount& directory : m_directories)
+			{
+				directory.mountPoint = Normalize(directory.mountPoint);
+			}
+
+			// searched newest first
+			for (auto it = desc.archives.rbegin(); it != desc.archives.rend(); ++it)
+			{
+				if (!fs::exists(it->path))
+				{
+					continue;
+				}
+				std::unique_ptr<Archive> archive = std::make_unique<Archive>();
+				if (!MountArchive(*archive, it->path, Normalize(it->mountPoint)))
+				{
+					std::cerr << "invalid archive: " << it->path << std::endl;
+					continue;
+				}
+				m_archives.push_back(std::move(archive));
+			}
+
+			m_initialized.store(true, std::memory_order_release);
+		}
+
+		void Shutdown()
+		{
+			std::lock_guard<std::mutex> lock(m_initMutex);
+			m_directories.clear();
+			m_archives.clear();
+			m_initialized.store(false, std::memory_order_release);
+		}
+
+		bool Exists(const std::string& path) const
+		{
+			const std::string virtualPath = Normalize(path);
+			fs::path loosePath;
+			for (const FileSystemMount& directory : m_directories)
+			{
+				if (ResolveLoose(directory, virtualPath, loosePath) && fs::is_regular_file(loosePath))
+				{
+					return true;
+				}
+			}
+			for (const std::unique_ptr<Archive>& archive : m_archives)
+			{
+				if (archive->indices.count(virtualPath))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool ReadFile(const std::string& path, std::vector<uint8_t>& data) const
+		{
+			NFW_TRACE_SCOPE("FileSystem::ReadFile");
+
+			const std::string virtualPath = Normalize(path);
+			fs::path loosePath;
+			for (const FileSystemMount& directory : m_directories)
+			{
+				if (ResolveLoose(directory, virtualPath, loosePath) && ReadLooseFile(loosePath, data))
+				{
+					return true;
+				}
+			}
+			for (const std::unique_ptr<Archive>& archive : m_archives)
+			{
+				auto it = archive->indices.find(virtualPath);
+				if (it != archive->indices.end())
+				{
+					return ReadArchiveFile(*archive, it->second, data);
+				}
+			}
+			return false;
+		}
+
+		static bool PackArchive(const std::vector<FileSystemMount>& directories, const std::string& archivePath, uint32_t blockSize)
+		{
+			NFW_TRACE_SCOPE("FileSystem::PackArchive");
+
+			struct PackedFile
+			{
+				std::string name;
+				std::vector<uint8_t> data;
+				uint32_t firstBlock;
+				uint32_t blockNum;
+			};
+
+			// the first directory wins like it does when reading loose files
+			std::vector<PackedFile> files;
+			std::unordered_map<std::string, size_t> fileIndices;
+			for (const FileSystemMount& directory : directories)
+			{
+				std::error_code error;
+				for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory.path, error))
+				{
+					if (!entry.is_regular_file())
+					{
+						continue;
+					}
+					const std::string relativePath = fs::relative(entry.path(), directory.path).generic_string();
+					const std::string mountPoint = Normalize(directory.mountPoint);
+					std::string name = mountPoint.empty() ? relativePath : mountPoint + "/" + relativePath;
+					if (fileIndices.count(name))
+					{
+						continue;
+					}
+
+					PackedFile file = { std::move(name) };
+					if (!ReadLooseFile(entry.path(), file.data))
+					{
+						return false;
+					}
+					fileIndices[file.name] = files.size();
+					files.push_back(std::move(file));
+				}
+			}
+			std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) { return a.name < b.name; });
+
+			uint32_t blockNum = 0;
+			uint64_t nameSize = 0;
+			for (PackedFile& file : files)
+			{
+				file.firstBlock = blockNum;
+				file.blockNum = (uint32_t)((file.data.size() + blockSize - 1) / blockSize);
+				blockNum += file.blockNum;
+				nameSize += file.name.size();
+			}
+
+			// every block compresses on its own, so they can also be read back in parallel
+			std::vector<std::vector<uint8_t>> blockData(blockNum);
+			std::vector<ArchiveBlock> blocks(blockNum);
+			for (const PackedFile& file : files)
+			{
+				ParallelFor(file.blockNum, 1, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i = begin; i < end; i++)
+					{
+						const uint8_t* src = file.data.data() + (uint64_t)i * blockSize;
+						const uint32_t size = (uint32_t)std::min<uint64_t>(blockSize, file.data.size() - (uint64_t)i * blockSize);
+
+						std::vector<uint8_t>& compressed = blockData[file.firstBlock + i];
+						compressed.resize(Lz4CompressBound(size));
+						size_t compressedSize = Lz4Compress(src, size, compressed.data(), compressed.size());
+						if (!compressedSize || compressedSize >= size)
+						{
+							compressed.assign(src, src + size);
+							compressedSize = size;
+						}
+						compressed.resize(compressedSize);
+						blocks[file.firstBlock + i] = { 0, (uint32_t)compressedSize, size };
+					}
+				});
+			}
+
+			const ArchiveHeader header = { ARCHIVE_MAGIC, ARCHIVE_VERSION, (uint32_t)files.size(), blockNum, blockSize, 0, nameSize };
+			uint64_t offset = sizeof(ArchiveHeader) + sizeof(ArchiveFile) * files.size() + sizeof(ArchiveBlock) * blocks.size() + nameSize;
+			for (uint32_t i = 0; i < blockNum; i++)
+			{
+				blocks[i].offset = offset;
+				offset += blocks[i].compressedSize;
+			}
+
+			std::vector<ArchiveFile> archiveFiles(files.size());
+			uint64_t nameOffset = 0;
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				archiveFiles[i] = { nameOffset, files[i].data.size(), (uint32_t)files[i].name.size(), files[i].firstBlock, files[i].blockNum, 0 };
+				nameOffset += files[i].name.size();
+			}
+
+			std::ofstream ofs(archivePath, std::ios::out | std::ios::binary | std::ios::trunc);
+			ofs.write((const char*)&header, sizeof(header));
+			ofs.write((const char*)archiveFiles.data(), (std::streamsize)(sizeof(ArchiveFile) * archiveFiles.size()));
+			ofs.write((const char*)blocks.data(), (std::streamsize)(sizeof(ArchiveBlock) * blocks.size()));
+			for (const PackedFile& file : files)
+			{
+				ofs.write(file.name.data(), (std::streamsize)file.name.size());
+			}
+			for (const std::vector<uint8_t>& data : blockData)
+			{
+				ofs.write((const char*)data.data(), (std::streamsize)data.size());
+			}
+			return (bool)ofs;
+		}
+
+	private:
+		static bool ResolveLoose(const FileSystemMount& directory, const std::string& virtualPath, fs::path& loosePath)
+		{
+			if (directory.mountPoint.empty())
+			{
+				loosePath = fs::path(directory.path) / virtualPath;
+				return true;
+			}
+			if (virtualPath.size() <= directory.mountPoint.size() || virtualPath.compare(0, directory.mountPoint.size(), directory.mountPoint) != 0
+				|| virtualPath[directory.mountPoint.size()] != '/')
+			{
+				return false;
+			}
+			loosePath = fs::path(directory.path) / virtualPath.substr(directory.mountPoint.size() + 1);
+			return true;
+		}
+
+		// Validates the table of contents against the mapped size, the block data is checked when read
+		static bool MountArchive(Archive& archive, const std::string& path, const std::string& mountPoint)
+		{
+			if (!archive.file.Open(path) || archive.file.GetSize() < sizeof(ArchiveHeader))
+			{
+				return false;
+			}
+
+			const uint8_t* data = archive.file.GetData();
+			const uint64_t size = archive.file.GetSize();
+			archive.header = (const ArchiveHeader*)data;
+			const ArchiveHeader& header = *archive.header;
+			const uint64_t tocSize = sizeof(ArchiveHeader) + sizeof(ArchiveFile) * (uint64_t)header.fileNum + sizeof(ArchiveBlock) * (uint64_t)header.blockNum;
+			if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION || !header.blockSize || tocSize > size || header.nameSize > size - tocSize)
+			{
+				return false;
+			}
+			archive.files = (const ArchiveFile*)(data + sizeof(ArchiveHeader));
+			archive.blocks = (const ArchiveBlock*)(archive.files + header.fileNum);
+
+			const char* names = (const char*)(data + tocSize);
+			archive.indices.reserve(header.fileNum);
+			for (uint32_t i = 0; i < header.fileNum; i++)
+			{
+				const ArchiveFile& file = archive.files[i];
+				// offsets come from the file, they are compared without sums that could wrap
+				if (file.nameOffset > header.nameSize || file.nameLength > header.nameSize - file.nameOffset || (uint64_t)file.firstBlock + file.blockNum > header.blockNum
+					|| file.size > (uint64_t)file.blockNum * header.blockSize)
+				{
+					return false;
+				}
+				const std::string name(names + file.nameOffset, file.nameLength);
+				archive.indices[mountPoint.empty() ? name : mountPoint + "/" + name] = i;
+			}
+			for (uint32_t i = 0; i < header.blockNum; i++)
+			{
+				const ArchiveBlock& block = archive.blocks[i];
+				if (block.offset > size || block.compressedSize > size - block.offset || block.size > header.blockSize)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static bool ReadArchiveFile(const Archive& archive, uint32_t fileIndex, std::vector<uint8_t>& data)
+		{
+			const ArchiveFile& file = archive.files[fileIndex];
+			const uint32_t blockSize = archive.header->blockSize;
+
+			// every block but the last is full and together they decompress to exactly the file
+			uint64_t totalSize = 0;
+			for (uint32_t i = 0; i < file.blockNum; i++)
+			{
+				const ArchiveBlock& block = archive.blocks[file.firstBlock + i];
+				if (i + 1 < file.blockNum && block.size != blockSize)
+				{
+					return false;
+				}
+				totalSize += block.size;
+			}
+			if (totalSize != file.size)
+			{
+				return false;
+			}
+
+			data.resize(file.size);
+
+			std::atomic<bool> succeeded = true;
+			ParallelFor(file.blockNum, 1, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; i++)
+				{
+					const ArchiveBlock& block = archive.blocks[file.firstBlock + i];
+					const uint64_t offset = (uint64_t)i * blockSize;
+					const uint8_t* src = archive.file.GetData() + block.offset;
+					if (block.compressedSize == block.size)
+					{
+						if (block.size)
+						{
+							memcpy(data.data() + offset, src, block.size);
+						}
+					}
+					else if (!Lz4Decompress(src, block.compressedSize, data.data() + offset, block.size))
+					{
+						succeeded = false;
+					}
+				}
+			});
+			return succeeded;
+		}
+
+		std::mutex m_initMutex;
+		std::atomic<bool> m_initialized = false;
+		std::vector<FileSystemMount> m_directories;
+		std::vector<std::unique_ptr<Archive>> m_archives;
+	};
+
+	void FileSystem::Init(const FileSystemDesc& desc)
+	{
+		Impl& impl = Impl::GetInstance();
+		impl.Shutdown();
+		impl.Init(desc);
+	}
+
+	void FileSystem::Shutdown() { Impl::GetInstance().Shutdown(); }
+
+	bool FileSystem::Exists(const std::string& path) { return Impl::Get().Exists(path); }
+
+	bool FileSystem::ReadFile(const std::string& path, std::vector<uint8_t>& data) { return Impl::Get().ReadFile(path, data); }
+
+	bool FileSystem::PackArchive(const std::vector<FileSystemMount>& directories, const std::string& archivePath, uint32_t blockSize)
+	{
+		return Impl::PackArchive(directories, archivePath, blockSize);
+	}
+
+} // namespace nfw
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nfw
+{
+	struct FileSystemMount
+	{
+		std::string path;           // directory or archive on disk
+		std::string mountPoint;     // virtual directory its files appear under, empty for the root
+	};
+
+	struct FileSystemDesc
+	{
+		// Loose directories are searched before any archive, so files being worked on override packed ones
+		std::vector<FileSystemMount> directories = { { "../shaders", "shaders" }, { "../../resource", "resource" } };
+
+		// Later archives take precedence; missing ones are skipped
+		std::vector<FileSystemMount> archives = { { "../assets.nfwpak", "" } };
+	};
+
+	// Read-only virtual file system every asset is loaded through.
+	// Virtual paths are relative with '/' separators, e.g. "shaders/Simple.vs.dxil". An archive is one file with a
+	// table of contents followed by the file data in blocks compressed with LZ4; it is memory-mapped when mounted,
+	// so a read is a lookup and a decompression with no file open, and the blocks of a file decompress in parallel
+	// on the job system. ReadFile is thread-safe, Init and Shutdown are not.
+	class FileSystem
+	{
+	public:
+		// Mounts the desc; called implicitly with default settings on first use
+		static void Init(const FileSystemDesc& desc = {});
+		static void Shutdown();
+
+		static bool Exists(const std::string& path);
+		static bool ReadFile(const std::string& path, std::vector<uint8_t>& data);
+
+		// Packs every file under the directories into an archive mounted at the root, the mount points become part
+		// of the stored paths. Blocks that do not shrink are stored as they are.
+		static bool PackArchive(const std::vector<FileSystemMount>& directories, const std::string& archivePath, uint32_t blockSize = 256 * 1024);
+
+	private:
+		class Impl;
+	};
+} // namespace nfw
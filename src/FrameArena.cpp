@@ -0,0 +1,158 @@
+#include "FrameArena.h"
+#include "Allocator.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace nfw
+{
+	namespace
+	{
+		struct ArenaBlock
+		{
+			uint8_t* memory;
+			size_t size;
+		};
+	}
+
+	class FrameArena::Impl
+	{
+	public:
+		Impl(size_t blockSize)
+			: m_blockSize(std::max(blockSize, (size_t)4096))
+		{
+			// growing the list inside a frame would hit the heap
+			m_blocks.reserve(16);
+			AddBlock(m_blockSize);
+		}
+
+		~Impl()
+		{
+			for (ArenaBlock& block : m_blocks)
+			{
+				Allocator::Free(block.memory);
+			}
+		}
+
+		void* Allocate(size_t size, size_t alignment)
+		{
+			// the worst case padding is taken up front, so a successful add always leaves room to align
+			const size_t paddedSize = size + alignment - 1;
+			for (;;)
+			{
+				uint8_t* memory = m_memory.load(std::memory_order_acquire);
+				const size_t capacity = m_capacity.load(std::memory_order_acquire);
+				const size_t offset = m_offset.fetch_add(paddedSize, std::memory_order_relaxed);
+				if (offset + paddedSize <= capacity && memory == m_memory.load(std::memory_order_acquire))
+				{
+					m_usedSize.fetch_add(paddedSize, std::memory_order_relaxed);
+					const uintptr_t address = ((uintptr_t)memory + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+					return (void*)address;
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				// another thread may have replaced the block already, or the add raced with one being published
+				if (memory == m_memory.load(std::memory_order_relaxed) && m_offset.load(std::memory_order_relaxed) + paddedSize > m_capacity.load(std::memory_order_relaxed))
+				{
+					if (!AddBlock(std::max(m_blockSize, paddedSize)))
+					{
+						return nullptr;
+					}
+				}
+			}
+		}
+
+		void Reset()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_blocks.size() > 1)
+			{
+				size_t totalSize = 0;
+				for (ArenaBlock& block : m_blocks)
+				{
+					totalSize += block.size;
+					Allocator::Free(block.memory);
+				}
+				m_blocks.clear();
+
+				// without one merged block the arena goes on with blocks of the old size
+				if (AddBlock(totalSize))
+				{
+					m_blockSize = totalSize;
+				}
+			}
+			m_offset.store(0, std::memory_order_relaxed);
+			m_usedSize.store(0, std::memory_order_relaxed);
+		}
+
+		size_t GetUsedSize() const
+		{
+			return m_usedSize.load(std::memory_order_relaxed);
+		}
+
+		size_t GetCapacity() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			size_t capacity = 0;
+			for (const ArenaBlock& block : m_blocks)
+			{
+				capacity += block.size;
+			}
+			return capacity;
+		}
+
+	private:
+		// with m_mutex held; the offset is published last, so a racing add either sees the new block or fails again
+		// On failure the arena is left without room, so the next allocation tries again
+		bool AddBlock(size_t size)
+		{
+			uint8_t* memory = (uint8_t*)Allocator::Allocate(MemoryCategory::FRAME_ARENA, size);
+			if (memory)
+			{
+				m_blocks.push_back({ memory, size });
+			}
+			else
+			{
+				size = 0;
+			}
+
+			m_capacity.store(0, std::memory_order_release);
+			m_memory.store(memory, std::memory_order_release);
+			m_offset.store(0, std::memory_order_relaxed);
+			m_capacity.store(size, std::memory_order_release);
+
+			return memory != nullptr;
+		}
+
+		size_t m_blockSize;
+
+		mutable std::mutex m_mutex;
+		std::vector<ArenaBlock> m_blocks;
+
+		std::atomic<uint8_t*> m_memory = nullptr;
+		std::atomic<size_t> m_capacity = 0;
+		std::atomic<size_t> m_offset = 0;
+		std::atomic<size_t> m_usedSize = 0;
+	};
+
+	// constructor
+	FrameArena::FrameArena(size_t blockSize)
+		: m_impl(std::make_unique<Impl>(blockSize))
+	{
+	}
+
+	// destructor
+	FrameArena::~FrameArena()
+	{
+	}
+
+	void* FrameArena::Allocate(size_t size, size_t alignment) { return m_impl->Allocate(size, alignment); }
+
+	void FrameArena::Reset() { m_impl->Reset(); }
+
+	size_t FrameArena::GetUsedSize() const { return m_impl->GetUsedSize(); }
+
+	size_t FrameArena::GetCapacity() const { return m_impl->GetCapacity(); }
+
+} // namespace nfw
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+#include <type_traits>
+
+namespace nfw
+{
+	// Bump allocator for transient CPU data of one frame.
+	// Allocation is an atomic add on the current block and may happen from any thread; a block that runs out is
+	// followed by a new one. Reset frees everything at once and merges the blocks, so a frame that needed more
+	// than one block fits into a single block from then on. Destructors are never run.
+	class FrameArena
+	{
+		DISALLOW_COPY_AND_ASSIGN(FrameArena);
+	public:
+		explicit FrameArena(size_t blockSize = 1024 * 1024);
+		~FrameArena();
+
+		// nullptr when no block big enough can be obtained
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+		template<typename T>
+		T* Allocate(size_t num)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "the arena does not run destructors");
+			return (T*)Allocate(sizeof(T) * num, alignof(T));
+		}
+
+		// No allocation may be in use or in progress
+		void Reset();
+
+		// Bytes allocated since the last Reset
+		size_t GetUsedSize() const;
+		size_t GetCapacity() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+
+	// For standard containers whose storage lives until the arena is reset, deallocate does nothing
+	template<typename T>
+	class FrameArenaAllocator
+	{
+	public:
+		using value_type = T;
+
+		FrameArenaAllocator(FrameArena& arena) : m_arena(&arena) {}
+
+		template<typename U>
+		FrameArenaAllocator(const FrameArenaAllocator<U>& other) : m_arena(other.GetArena()) {}
+
+		T* allocate(size_t num) { return (T*)m_arena->Allocate(sizeof(T) * num, alignof(T)); }
+		void deallocate(T*, size_t) {}
+
+		FrameArena* GetArena() const { return m_arena; }
+
+		template<typename U>
+		bool operator==(const FrameArenaAllocator<U>& other) const { return m_arena == other.GetArena(); }
+
+	private:
+		FrameArena* m_arena;
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameArenaAllocator<T>>;
+} // namespace nfw
@@ -0,0 +1,93 @@
+#include "FramePacer.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <thread>
+
+namespace nfw
+{
+	// sleep() overshoots by up to a scheduler tick, the rest is spun
+	constexpr std::chrono::microseconds FRAME_PACER_SPIN_TIME(1500);
+
+	class FramePacer::Impl
+	{
+		using Clock = std::chrono::steady_clock;
+
+	public:
+		Impl() {}
+		~Impl() {}
+
+		void SetTargetFrameRate(double framesPerSecond)
+		{
+			m_targetFrameRate = framesPerSecond > 0.0 ? framesPerSecond : 0.0;
+			m_period = m_targetFrameRate > 0.0 ?
+				std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_targetFrameRate)) : Clock::duration::zero();
+			m_deadline = Clock::time_point();
+		}
+
+		double GetTargetFrameRate() const { return m_targetFrameRate; }
+
+		void Wait()
+		{
+			if (m_period != Clock::duration::zero())
+			{
+				NFW_TRACE_SCOPE("FramePacer::Wait");
+
+				const Clock::time_point now = Clock::now();
+				if (m_deadline == Clock::time_point() || now > m_deadline + m_period)
+				{
+					// first frame or more than a frame late
+					m_deadline = now;
+				}
+				else
+				{
+					if (m_deadline - now > FRAME_PACER_SPIN_TIME)
+					{
+						std::this_thread::sleep_for(m_deadline - now - FRAME_PACER_SPIN_TIME);
+					}
+					while (Clock::now() < m_deadline)
+					{
+						std::this_thread::yield();
+					}
+				}
+				m_deadline += m_period;
+			}
+
+			const Clock::time_point now = Clock::now();
+			if (m_last != Clock::time_point())
+			{
+				m_frameMs = std::chrono::duration<double, std::milli>(now - m_last).count();
+			}
+			m_last = now;
+		}
+
+		double GetFrameMs() const { return m_frameMs; }
+
+	private:
+		double m_targetFrameRate = 0.0;
+		Clock::duration m_period = Clock::duration::zero();
+		Clock::time_point m_deadline;
+		Clock::time_point m_last;
+		double m_frameMs = 0.0;
+	};
+
+	// constructor
+	FramePacer::FramePacer()
+		: m_impl(std::make_unique<Impl>())
+	{
+	}
+
+	// destructor
+	FramePacer::~FramePacer()
+	{
+	}
+
+	void FramePacer::SetTargetFrameRate(double framesPerSecond) { m_impl->SetTargetFrameRate(framesPerSecond); }
+
+	double FramePacer::GetTargetFrameRate() const { return m_impl->GetTargetFrameRate(); }
+
+	void FramePacer::Wait() { m_impl->Wait(); }
+
+	double FramePacer::GetFrameMs() const { return m_impl->GetFrameMs(); }
+
+} // namespace nfw
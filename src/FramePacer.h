@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	// Frame rate limiter.
+	// Wait() sleeps until the next frame is due. Call it right before input is sampled so the
+	// sleep does not add to the age of the input. Deadlines advance by a fixed period and are
+	// rebased when a frame runs late, so one slow frame does not cause a burst of fast ones.
+	class FramePacer
+	{
+		DISALLOW_COPY_AND_ASSIGN(FramePacer);
+	public:
+		FramePacer();
+		~FramePacer();
+
+		// 0 disables the limiter
+		void SetTargetFrameRate(double framesPerSecond);
+		double GetTargetFrameRate() const;
+
+		void Wait();
+
+		// Time between the last two Wait() returns in milliseconds
+		double GetFrameMs() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
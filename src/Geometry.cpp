@@ -1,13 +1,64 @@
 #include "Geometry.h"
 
+#include <cstring>
+
 namespace nfw
 {
+	// vertex data starts on this boundary inside the packed buffer
+	constexpr uint64_t GEOMETRY_VERTEX_ALIGNMENT = 16;
+
 	class Geometry::Impl
 	{
 	public:
 		Impl() {}
 		~Impl() {}
 
+		void SetIndices(const uint16_t* indices, uint32_t indexNum)
+		{
+			m_indices.assign(indices, indices + indexNum);
+		}
+
+		void SetVertices(const void* vertices, uint32_t vertexNum, uint32_t vertexStride)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+			m_vertexData.assign(bytes, bytes + (size_t)vertexNum * vertexStride);
+			m_vertexNum = vertexNum;
+		}
+
+		uint32_t GetIndexNum() const { return static_cast<uint32_t>(m_indices.size()); }
+
+		uint32_t GetVertexNum() const { return m_vertexNum; }
+
+		uint64_t GetVertexOffset() const
+		{
+			const uint64_t indexDataSize = m_indices.size() * sizeof(uint16_t);
+			return (indexDataSize + GEOMETRY_VERTEX_ALIGNMENT - 1) & ~(GEOMETRY_VERTEX_ALIGNMENT - 1);
+		}
+
+		uint64_t GetPackedSize() const
+		{
+			return GetVertexOffset() + m_vertexData.size();
+		}
+
+		void Pack(uint8_t* dst) const
+		{
+			const uint64_t indexDataSize = m_indices.size() * sizeof(uint16_t);
+			const uint64_t vertexOffset = GetVertexOffset();
+			if (indexDataSize)
+			{
+				memcpy(dst, m_indices.data(), indexDataSize);
+			}
+			memset(dst + indexDataSize, 0, vertexOffset - indexDataSize);
+			if (!m_vertexData.empty())
+			{
+				memcpy(dst + vertexOffset, m_vertexData.data(), m_vertexData.size());
+			}
+		}
+
+	private:
+		std::vector<uint16_t> m_indices;
+		std::vector<uint8_t> m_vertexData;
+		uint32_t m_vertexNum = 0;
 	};
 
 	// constructor
@@ -21,4 +72,18 @@ namespace nfw
 	{
 	}
 
+	void Geometry::SetIndices(const uint16_t* indices, uint32_t indexNum) { m_impl->SetIndices(indices, indexNum); }
+
+	void Geometry::SetVertices(const void* vertices, uint32_t vertexNum, uint32_t vertexStride) { m_impl->SetVertices(vertices, vertexNum, vertexStride); }
+
+	uint32_t Geometry::GetIndexNum() const { return m_impl->GetIndexNum(); }
+
+	uint32_t Geometry::GetVertexNum() const { return m_impl->GetVertexNum(); }
+
+	uint64_t Geometry::GetVertexOffset() const { return m_impl->GetVertexOffset(); }
+
+	uint64_t Geometry::GetPackedSize() const { return m_impl->GetPackedSize(); }
+
+	void Geometry::Pack(uint8_t* dst) const { m_impl->Pack(dst); }
+
 } // namespace nfw
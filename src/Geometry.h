@@ -5,6 +5,8 @@
 
 namespace nfw
 {
+	// Index and vertex data of one mesh.
+	// Pack writes both into a single buffer, indices first and vertices at GetVertexOffset().
 	class Geometry
 	{
 		DISALLOW_COPY_AND_ASSIGN(Geometry);
@@ -12,9 +14,19 @@ namespace nfw
 		Geometry();
 		~Geometry();
 
+		void SetIndices(const uint16_t* indices, uint32_t indexNum);
+		void SetVertices(const void* vertices, uint32_t vertexNum, uint32_t vertexStride);
+
+		uint32_t GetIndexNum() const;
+		uint32_t GetVertexNum() const;
+		uint64_t GetVertexOffset() const;
+		uint64_t GetPackedSize() const;
+
+		// dst must hold GetPackedSize() bytes
+		void Pack(uint8_t* dst) const;
+
 	private:
 		class Impl;
 		std::unique_ptr<Impl> m_impl;
 	};
 } // namespace nfw
-
@@ -0,0 +1,231 @@
+#include "GpuProfiler.h"
+
+#include <cstring>
+
+namespace nfw
+{
+	class GpuProfiler::Impl
+	{
+		struct ScopeInfo
+		{
+			const char* name;
+			uint32_t depth;
+		};
+
+		struct FrameSlot
+		{
+			nri::QueryPool* queryPool = nullptr;
+			std::vector<ScopeInfo> scopes;
+			uint32_t frameIndex = 0;
+			bool pending = false;
+		};
+
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, uint32_t bufferedFrameNum, uint32_t scopeMaxNum)
+			: NRI(nri)
+			, m_device(device)
+			, m_bufferedFrameNum(bufferedFrameNum)
+			, m_scopeMaxNum(scopeMaxNum)
+			, m_frames(bufferedFrameNum)
+		{}
+
+		~Impl()
+		{
+			for (FrameSlot& frame : m_frames)
+			{
+				if (frame.queryPool)
+				{
+					NRI.DestroyQueryPool(*frame.queryPool);
+				}
+			}
+			if (m_readbackBuffer)
+			{
+				NRI.DestroyBuffer(*m_readbackBuffer);
+			}
+			for (nri::Memory* memory : m_memoryAllocations)
+			{
+				NRI.FreeMemory(*memory);
+			}
+		}
+
+		bool Init()
+		{
+			const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(m_device);
+			m_ticksToMilliseconds = deviceDesc.timestampFrequencyHz ? 1000.0 / (double)deviceDesc.timestampFrequencyHz : 0.0;
+
+			// every scope writes a begin and an end timestamp
+			const uint32_t queryNum = m_scopeMaxNum * 2;
+
+			for (FrameSlot& frame : m_frames)
+			{
+				nri::QueryPoolDesc queryPoolDesc = {};
+				queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+				queryPoolDesc.capacity = queryNum;
+				if (NRI.CreateQueryPool(m_device, queryPoolDesc, frame.queryPool) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+				frame.scopes.reserve(m_scopeMaxNum);
+			}
+
+			m_querySize = NRI.GetQuerySize(*m_frames[0].queryPool);
+			m_frameReadbackSize = (uint64_t)m_querySize * queryNum;
+
+			nri::BufferDesc bufferDesc = {};
+			bufferDesc.size = m_frameReadbackSize * m_bufferedFrameNum;
+			if (NRI.CreateBuffer(m_device, bufferDesc, m_readbackBuffer) != nri::Result::SUCCESS)
+			{
+				return false;
+			}
+
+			nri::ResourceGroupDesc resourceGroupDesc = {};
+			resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
+			resourceGroupDesc.bufferNum = 1;
+			resourceGroupDesc.buffers = &m_readbackBuffer;
+
+			m_memoryAllocations.resize(NRI.CalculateAllocationNumber(m_device, resourceGroupDesc), nullptr);
+			if (NRI.AllocateAndBindMemory(m_device, resourceGroupDesc, m_memoryAllocations.data()) != nri::Result::SUCCESS)
+			{
+				return false;
+			}
+
+			return true;
+		}
+
+		void BeginFrame(nri::CommandBuffer& commandBuffer, uint32_t frameIndex)
+		{
+			m_slot = frameIndex % m_bufferedFrameNum;
+			FrameSlot& frame = m_frames[m_slot];
+
+			// the previous frame in this slot is complete, its timestamps can be read without stalling
+			if (frame.pending)
+			{
+				Resolve(frame);
+			}
+
+			frame.scopes.clear();
+			frame.frameIndex = frameIndex;
+			frame.pending = false;
+			m_depth = 0;
+
+			NRI.CmdResetQueries(commandBuffer, *frame.queryPool, 0, m_scopeMaxNum * 2);
+		}
+
+		void EndFrame(nri::CommandBuffer& commandBuffer)
+		{
+			FrameSlot& frame = m_frames[m_slot];
+			const uint32_t scopeNum = static_cast<uint32_t>(frame.scopes.size());
+			if (scopeNum == 0)
+			{
+				return;
+			}
+
+			NRI.CmdCopyQueries(commandBuffer, *frame.queryPool, 0, scopeNum * 2, *m_readbackBuffer, m_slot * m_frameReadbackSize);
+			frame.pending = true;
+		}
+
+		uint32_t BeginScope(nri::CommandBuffer& commandBuffer, const char* name)
+		{
+			FrameSlot& frame = m_frames[m_slot];
+			const uint32_t scope = static_cast<uint32_t>(frame.scopes.size());
+			if (scope >= m_scopeMaxNum)
+			{
+				m_depth++;
+				return INVALID_SCOPE;
+			}
+
+			frame.scopes.push_back({ name, m_depth++ });
+			NRI.CmdEndQuery(commandBuffer, *frame.queryPool, scope * 2);
+			return scope;
+		}
+
+		void EndScope(nri::CommandBuffer& commandBuffer, uint32_t scope)
+		{
+			m_depth--;
+			if (scope == INVALID_SCOPE)
+			{
+				return;
+			}
+
+			NRI.CmdEndQuery(commandBuffer, *m_frames[m_slot].queryPool, scope * 2 + 1);
+		}
+
+		const std::vector<GpuScopeTiming>& GetTimings() const { return m_timings; }
+
+		uint32_t GetTimingsFrameIndex() const { return m_timingsFrameIndex; }
+
+	private:
+		void Resolve(const FrameSlot& frame)
+		{
+			const uint32_t scopeNum = static_cast<uint32_t>(frame.scopes.size());
+			const uint64_t offset = m_slot * m_frameReadbackSize;
+			const uint8_t* data = (const uint8_t*)NRI.MapBuffer(*m_readbackBuffer, offset, (uint64_t)m_querySize * scopeNum * 2);
+			if (!data)
+			{
+				return;
+			}
+
+			m_timings.resize(scopeNum);
+			for (uint32_t i = 0; i < scopeNum; ++i)
+			{
+				uint64_t begin = 0;
+				uint64_t end = 0;
+				memcpy(&begin, data + (i * 2) * m_querySize, sizeof(begin));
+				memcpy(&end, data + (i * 2 + 1) * m_querySize, sizeof(end));
+
+				m_timings[i].name = frame.scopes[i].name;
+				m_timings[i].depth = frame.scopes[i].depth;
+				m_timings[i].milliseconds = (end > begin) ? (double)(end - begin) * m_ticksToMilliseconds : 0.0;
+			}
+			m_timingsFrameIndex = frame.frameIndex;
+
+			NRI.UnmapBuffer(*m_readbackBuffer);
+		}
+
+		static constexpr uint32_t INVALID_SCOPE = ~0u;
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		const uint32_t m_bufferedFrameNum;
+		const uint32_t m_scopeMaxNum;
+
+		std::vector<FrameSlot> m_frames;
+		nri::Buffer* m_readbackBuffer = nullptr;
+		std::vector<nri::Memory*> m_memoryAllocations;
+		uint64_t m_frameReadbackSize = 0;
+		uint32_t m_querySize = sizeof(uint64_t);
+		double m_ticksToMilliseconds = 0.0;
+
+		uint32_t m_slot = 0;
+		uint32_t m_depth = 0;
+
+		std::vector<GpuScopeTiming> m_timings;
+		uint32_t m_timingsFrameIndex = 0;
+	};
+
+	// constructor
+	GpuProfiler::GpuProfiler(NRIInterface& NRI, nri::Device& device, uint32_t bufferedFrameNum, uint32_t scopeMaxNum)
+		: m_impl(std::make_unique<Impl>(NRI, device, bufferedFrameNum, scopeMaxNum))
+	{
+	}
+
+	// destructor
+	GpuProfiler::~GpuProfiler()
+	{
+	}
+
+	bool GpuProfiler::Init() { return m_impl->Init(); }
+
+	void GpuProfiler::BeginFrame(nri::CommandBuffer& commandBuffer, uint32_t frameIndex) { m_impl->BeginFrame(commandBuffer, frameIndex); }
+
+	void GpuProfiler::EndFrame(nri::CommandBuffer& commandBuffer) { m_impl->EndFrame(commandBuffer); }
+
+	uint32_t GpuProfiler::BeginScope(nri::CommandBuffer& commandBuffer, const char* name) { return m_impl->BeginScope(commandBuffer, name); }
+
+	void GpuProfiler::EndScope(nri::CommandBuffer& commandBuffer, uint32_t scope) { m_impl->EndScope(commandBuffer, scope); }
+
+	const std::vector<GpuScopeTiming>& GpuProfiler::GetTimings() const { return m_impl->GetTimings(); }
+
+	uint32_t GpuProfiler::GetTimingsFrameIndex() const { return m_impl->GetTimingsFrameIndex(); }
+
+} // namespace nfw
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct GpuScopeTiming
+	{
+		const char* name;
+		uint32_t depth;
+		double milliseconds;
+	};
+
+	// Per-pass GPU timing with timestamp queries.
+	// Every buffered frame has its own query pool and readback region. Results are read back
+	// when the frame slot comes around again, after the frame fence has already been waited on,
+	// so reading them never stalls.
+	class GpuProfiler
+	{
+		DISALLOW_COPY_AND_ASSIGN(GpuProfiler);
+	public:
+		GpuProfiler(NRIInterface& NRI, nri::Device& device, uint32_t bufferedFrameNum, uint32_t scopeMaxNum = 64);
+		~GpuProfiler();
+
+		bool Init();
+
+		// Must be called after the frame fence for this slot has been waited on
+		void BeginFrame(nri::CommandBuffer& commandBuffer, uint32_t frameIndex);
+		void EndFrame(nri::CommandBuffer& commandBuffer);
+
+		// name must outlive the frame, string literals are expected
+		uint32_t BeginScope(nri::CommandBuffer& commandBuffer, const char* name);
+		void EndScope(nri::CommandBuffer& commandBuffer, uint32_t scope);
+
+		// Timings of the most recently resolved frame, in scope begin order
+		const std::vector<GpuScopeTiming>& GetTimings() const;
+		uint32_t GetTimingsFrameIndex() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+
+	// RAII scope that also emits a debug annotation
+	class GpuProfileScope
+	{
+		DISALLOW_COPY_AND_ASSIGN(GpuProfileScope);
+	public:
+		GpuProfileScope(NRIInterface& NRI, GpuProfiler& profiler, nri::CommandBuffer& commandBuffer, const char* name)
+			: NRI(NRI)
+			, m_profiler(profiler)
+			, m_commandBuffer(commandBuffer)
+		{
+			NRI.CmdBeginAnnotation(m_commandBuffer, name);
+			m_scope = m_profiler.BeginScope(m_commandBuffer, name);
+		}
+
+		~GpuProfileScope()
+		{
+			m_profiler.EndScope(m_commandBuffer, m_scope);
+			NRI.CmdEndAnnotation(m_commandBuffer);
+		}
+
+	private:
+		NRIInterface& NRI;
+		GpuProfiler& m_profiler;
+		nri::CommandBuffer& m_commandBuffer;
+		uint32_t m_scope;
+	};
+} // namespace nfw
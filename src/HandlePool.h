@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace nfw
+{
+	// 32-bit reference into a HandlePool: slot index in the low bits, generation of the slot in the high bits.
+	// A handle to a freed slot fails IsValid once the slot is reused; the zero value is never valid.
+	template <typename Tag>
+	struct Handle
+	{
+		static constexpr uint32_t INDEX_BITS = 20;
+		static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+		static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+		uint32_t value = 0;
+
+		static Handle Make(uint32_t index, uint32_t generation) { return { (generation << INDEX_BITS) | index }; }
+
+		uint32_t GetIndex() const { return value & INDEX_MASK; }
+		uint32_t GetGeneration() const { return value >> INDEX_BITS; }
+
+		explicit operator bool() const { return value != 0; }
+		bool operator==(const Handle& other) const { return value == other.value; }
+		bool operator!=(const Handle& other) const { return value != other.value; }
+	};
+
+	// Structure-of-arrays storage addressed by generational handles.
+	// Every column is one contiguous array allocated up front for the whole capacity, so element addresses never
+	// change and hot fields are read with a single index, no pointer chasing and no reference counting.
+	// Allocate and Free are thread-safe; accessing a slot while it is freed is not.
+	template <typename Tag, typename... Columns>
+	class HandlePool
+	{
+	public:
+		using HandleType = Handle<Tag>;
+
+		explicit HandlePool(uint32_t capacity)
+			: m_capacity(std::min(capacity, HandleType::INDEX_MASK))
+			, m_columns(std::make_unique<Columns[]>(m_capacity)...)
+			, m_generations(std::make_unique<uint32_t[]>(m_capacity))
+			, m_alive(std::make_unique<bool[]>(m_capacity))
+		{
+			// handed out low indices first, so live slots stay packed at the front
+			m_freeIndices.reserve(m_capacity);
+			for (uint32_t i = m_capacity; i > 0; i--)
+			{
+				m_freeIndices.push_back(i - 1);
+			}
+			for (uint32_t i = 0; i < m_capacity; i++)
+			{
+				m_generations[i] = 1;
+			}
+		}
+
+		HandlePool(const HandlePool&) = delete;
+		void operator=(const HandlePool&) = delete;
+
+		// Invalid handle when the pool is full; the columns of the slot hold default values
+		HandleType Allocate()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_freeIndices.empty())
+			{
+				return {};
+			}
+			const uint32_t index = m_freeIndices.back();
+			m_freeIndices.pop_back();
+			m_alive[index] = true;
+			m_aliveNum++;
+			m_end = std::max(m_end, index + 1);
+			return HandleType::Make(index, m_generations[index]);
+		}
+
+		void Free(HandleType handle)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!IsValid(handle))
+			{
+				return;
+			}
+			const uint32_t index = handle.GetIndex();
+			std::apply([index](auto&... columns) { ((columns[index] = {}), ...); }, m_columns);
+
+			// generation 0 is skipped so that no live handle is ever zero
+			uint32_t generation = (m_generations[index] + 1) & HandleType::GENERATION_MASK;
+			m_generations[index] = generation ? generation : 1;
+			m_alive[index] = false;
+			m_aliveNum--;
+			m_freeIndices.push_back(index);
+		}
+
+		bool IsValid(HandleType handle) const
+		{
+			const uint32_t index = handle.GetIndex();
+			return handle && index < m_capacity && m_alive[index] && m_generations[index] == handle.GetGeneration();
+		}
+
+		template <size_t I>
+		auto& Get(HandleType handle)
+		{
+			assert(IsValid(handle));
+			return std::get<I>(m_columns)[handle.GetIndex()];
+		}
+
+		template <size_t I>
+		const auto& Get(HandleType handle) const
+		{
+			assert(IsValid(handle));
+			return std::get<I>(m_columns)[handle.GetIndex()];
+		}
+
+		// Calls func(handle) for every live slot in index order; no slot may be allocated or freed meanwhile
+		template <typename Func>
+		void ForEach(Func func) const
+		{
+			for (uint32_t i = 0; i < m_end; i++)
+			{
+				if (m_alive[i])
+				{
+					func(HandleType::Make(i, m_generations[i]));
+				}
+			}
+		}
+
+		uint32_t GetAliveNum() const { return m_aliveNum; }
+		uint32_t GetCapacity() const { return m_capacity; }
+
+	private:
+		const uint32_t m_capacity;
+		std::tuple<std::unique_ptr<Columns[]>...> m_columns;
+		std::unique_ptr<uint32_t[]> m_generations;
+		std::unique_ptr<bool[]> m_alive;
+
+		std::mutex m_mutex;
+		std::vector<uint32_t> m_freeIndices;
+		uint32_t m_aliveNum = 0;
+		uint32_t m_end = 0;     // one past the highest index ever allocated
+	};
+} // namespace nfw
@@ -0,0 +1,341 @@
+#include "HeapCheck.h"
+
+#ifdef NFW_HEAP_CHECK_ENABLED
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <dbghelp.h>
+#else
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+namespace nfw
+{
+	namespace
+	{
+		constexpr uint32_t STACK_DEPTH_MAX = 16;
+		constexpr uint32_t CALL_SITE_MAX_NUM = 1024;    // power of 2
+		constexpr uint32_t SKIPPED_FRAME_NUM = 2;       // record and operator new
+
+		struct CallSite
+		{
+			uint64_t hash;
+			uint32_t depth;
+			std::array<void*, STACK_DEPTH_MAX> frames;
+			uint64_t frameAllocationNum;    // since the last report
+			bool reported;
+		};
+
+		// no member allocates, it is used from inside operator new
+		struct HeapCheckState
+		{
+			std::mutex mutex;
+			std::array<CallSite, CALL_SITE_MAX_NUM> callSites = {};
+			uint64_t droppedNum = 0;    // table full
+			uint64_t frameAllocationNum = 0;
+			uint64_t lastFrameAllocationNum = 0;
+		};
+
+		std::atomic<bool> s_enabled = false;
+		std::atomic<int32_t> s_openFrameNum = 0;
+
+		// set while the check itself runs, its own allocations are not counted
+		thread_local bool t_inside = false;
+
+		HeapCheckState& GetState()
+		{
+			static HeapCheckState state;
+			return state;
+		}
+
+		uint32_t CaptureStack(void** frames)
+		{
+#if defined(_WIN32)
+			return RtlCaptureStackBackTrace(SKIPPED_FRAME_NUM, STACK_DEPTH_MAX, frames, nullptr);
+#else
+			void* captured[STACK_DEPTH_MAX + SKIPPED_FRAME_NUM];
+			const int capturedNum = backtrace(captured, (int)std::size(captured));
+			uint32_t depth = 0;
+			for (int i = SKIPPED_FRAME_NUM; i < capturedNum; i++)
+			{
+				frames[depth++] = captured[i];
+			}
+			return depth;
+#endif
+		}
+
+		void PrintStack(const CallSite& callSite)
+		{
+#if defined(_WIN32)
+			static bool symbolsInitialized = false;
+			HANDLE process = GetCurrentProcess();
+			if (!symbolsInitialized)
+			{
+				SymSetOptions(SYMOPT_LOAD_LINES | SYMOPT_UNDNAME);
+				SymInitialize(process, nullptr, TRUE);
+				symbolsInitialized = true;
+			}
+
+			alignas(SYMBOL_INFO) char symbolBuffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
+			SYMBOL_INFO* symbol = (SYMBOL_INFO*)symbolBuffer;
+			for (uint32_t i = 0; i < callSite.depth; i++)
+			{
+				const DWORD64 address = (DWORD64)callSite.frames[i];
+				symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+				symbol->MaxNameLen = MAX_SYM_NAME;
+
+				DWORD64 symbolOffset = 0;
+				const char* name = SymFromAddr(process, address, &symbolOffset, symbol) ? symbol->Name : "?";
+
+				IMAGEHLP_LINE64 line = { sizeof(IMAGEHLP_LINE64) };
+				DWORD lineOffset = 0;
+				if (SymGetLineFromAddr64(process, address, &lineOffset, &line))
+				{
+					std::fprintf(stderr, "    %s (%s:%lu)\n", name, line.FileName, line.LineNumber);
+				}
+				else
+				{
+					std::fprintf(stderr, "    %s\n", name);
+				}
+			}
+#else
+			std::fflush(stderr);
+			backtrace_symbols_fd(callSite.frames.data(), (int)callSite.depth, STDERR_FILENO);
+#endif
+		}
+
+		void RecordAllocation()
+		{
+			if (!s_enabled.load(std::memory_order_relaxed) || s_openFrameNum.load(std::memory_order_relaxed) <= 0 || t_inside)
+			{
+				return;
+			}
+			t_inside = true;
+
+			std::array<void*, STACK_DEPTH_MAX> frames;
+			const uint32_t depth = CaptureStack(frames.data());
+
+			// FNV-1a over the return addresses
+			uint64_t hash = 14695981039346656037ull;
+			for (uint32_t i = 0; i < depth; i++)
+			{
+				hash ^= (uint64_t)(uintptr_t)frames[i];
+				hash *= 1099511628211ull;
+			}
+
+			HeapCheckState& state = GetState();
+			{
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.frameAllocationNum++;
+
+				uint32_t index = (uint32_t)hash & (CALL_SITE_MAX_NUM - 1);
+				for (uint32_t probe = 0; probe < CALL_SITE_MAX_NUM; probe++, index = (index + 1) & (CALL_SITE_MAX_NUM - 1))
+				{
+					CallSite& callSite = state.callSites[index];
+					if (callSite.depth == 0)
+					{
+						callSite.hash = hash;
+						callSite.depth = depth;
+						callSite.frames = frames;
+					}
+					if (callSite.hash == hash && callSite.depth == depth)
+					{
+						callSite.frameAllocationNum++;
+						break;
+					}
+					if (probe == CALL_SITE_MAX_NUM - 1)
+					{
+						state.droppedNum++;
+					}
+				}
+			}
+
+			t_inside = false;
+		}
+
+		void* AllocateAligned(size_t size, size_t alignment)
+		{
+#if defined(_WIN32)
+			return _aligned_malloc(size ? size : 1, alignment);
+#else
+			return std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+		}
+
+		void FreeAligned(void* memory)
+		{
+#if defined(_WIN32)
+			_aligned_free(memory);
+#else
+			std::free(memory);
+#endif
+		}
+	}
+
+	void HeapCheck::SetEnabled(bool enabled)
+	{
+		s_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	bool HeapCheck::IsEnabled()
+	{
+		return s_enabled.load(std::memory_order_relaxed);
+	}
+
+	void HeapCheck::BeginFrame()
+	{
+		if (IsEnabled())
+		{
+			s_openFrameNum.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void HeapCheck::EndFrame(uint32_t frameIndex)
+	{
+		// a frame begun before the check was enabled has nothing to close
+		int32_t openFrameNum = s_openFrameNum.load(std::memory_order_relaxed);
+		while (openFrameNum > 0 && !s_openFrameNum.compare_exchange_weak(openFrameNum, openFrameNum - 1, std::memory_order_relaxed))
+		{
+		}
+		if (!IsEnabled())
+		{
+			return;
+		}
+
+		const bool inside = t_inside;
+		t_inside = true;
+
+		HeapCheckState& state = GetState();
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.lastFrameAllocationNum = state.frameAllocationNum;
+			state.frameAllocationNum = 0;
+
+			if (state.lastFrameAllocationNum)
+			{
+				std::fprintf(stderr, "heap check: frame %u made %llu heap allocations\n", frameIndex, (unsigned long long)state.lastFrameAllocationNum);
+				for (CallSite& callSite : state.callSites)
+				{
+					if (!callSite.frameAllocationNum)
+					{
+						continue;
+					}
+
+					std::fprintf(stderr, "  %llu x call site %016llx%s\n", (unsigned long long)callSite.frameAllocationNum, (unsigned long long)callSite.hash,
+						callSite.reported ? "" : ", first seen at:");
+					if (!callSite.reported)
+					{
+						PrintStack(callSite);
+						callSite.reported = true;
+					}
+					callSite.frameAllocationNum = 0;
+				}
+				if (state.droppedNum)
+				{
+					std::fprintf(stderr, "  %llu allocations from call sites that did not fit the table\n", (unsigned long long)state.droppedNum);
+					state.droppedNum = 0;
+				}
+			}
+		}
+
+		t_inside = inside;
+	}
+
+	uint64_t HeapCheck::GetFrameAllocationNum()
+	{
+		HeapCheckState& state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		return state.lastFrameAllocationNum;
+	}
+
+} // namespace nfw
+
+void* operator new(size_t size)
+{
+	nfw::RecordAllocation();
+	void* memory = std::malloc(size ? size : 1);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	nfw::RecordAllocation();
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	nfw::RecordAllocation();
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	nfw::RecordAllocation();
+	void* memory = nfw::AllocateAligned(size, (size_t)alignment);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	nfw::RecordAllocation();
+	return nfw::AllocateAligned(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	nfw::RecordAllocation();
+	return nfw::AllocateAligned(size, (size_t)alignment);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { nfw::FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { nfw::FreeAligned(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { nfw::FreeAligned(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { nfw::FreeAligned(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { nfw::FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { nfw::FreeAligned(memory); }
+
+#else
+
+namespace nfw
+{
+	void HeapCheck::SetEnabled(bool) {}
+	bool HeapCheck::IsEnabled() { return false; }
+	void HeapCheck::BeginFrame() {}
+	void HeapCheck::EndFrame(uint32_t) {}
+	uint64_t HeapCheck::GetFrameAllocationNum() { return 0; }
+} // namespace nfw
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace nfw
+{
+	// Debug mode that reports global heap allocations made inside frames.
+	// Built with NFW_HEAP_CHECK_ENABLED, the global operator new is replaced and, while enabled, every allocation
+	// between BeginFrame and EndFrame is counted on any thread and attributed to its call stack. EndFrame reports
+	// the count and prints the stack of each call site the first time it shows up. With pipelined frames the
+	// windows of neighbouring frames overlap, an allocation is then reported by the frame that ends first.
+	// Without the define every call is a no-op.
+	class HeapCheck
+	{
+	public:
+		static void SetEnabled(bool enabled);
+		static bool IsEnabled();
+
+		// Start of Prepare
+		static void BeginFrame();
+
+		// End of Render, reports to stderr
+		static void EndFrame(uint32_t frameIndex);
+
+		// Allocations reported by the last EndFrame
+		static uint64_t GetFrameAllocationNum();
+	};
+} // namespace nfw
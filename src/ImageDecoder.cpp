@@ -0,0 +1,19 @@
+#include "ImageDecoder.h"
+
+#include <cstring>
+
+namespace nfw
+{
+	bool DecodeImage(const uint8_t* data, size_t size, uint32_t scaleShift, DecodedImage& image)
+	{
+		if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+		{
+			return DecodeJpeg(data, size, scaleShift, image);
+		}
+		if (size >= 8 && !memcmp(data, "\x89PNG\r\n\x1A\n", 8))
+		{
+			return DecodePng(data, size, image);
+		}
+		return false;
+	}
+} // namespace nfw
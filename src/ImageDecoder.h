@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nfw
+{
+	// RGBA8 pixels of a decoded image, rows tightly packed.
+	// width and height are those of the file, the pixels are max(size >> scaleShift, 1) in each direction.
+	struct DecodedImage
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t scaleShift = 0;
+		std::vector<uint8_t> pixels;
+	};
+
+	// Picks the decoder by signature. scaleShift (0-3) asks for an image 1/2, 1/4 or 1/8 of the size when the
+	// decoder can produce it cheaper than the full one; the image tells which scale it was decoded at.
+	// The decoders split their work with ParallelFor, inside a SerialScope they run on the calling thread alone.
+	bool DecodeImage(const uint8_t* data, size_t size, uint32_t scaleShift, DecodedImage& image);
+
+	// Baseline JPEG with 1 or 3 components and any sampling factors. Scaling happens in the IDCT, which only
+	// keeps the low frequencies of each block; restart intervals are entropy decoded in parallel.
+	bool DecodeJpeg(const uint8_t* data, size_t size, uint32_t scaleShift, DecodedImage& image);
+
+	// Every PNG color type and bit depth, interlaced or not, always at full size
+	bool DecodePng(const uint8_t* data, size_t size, DecodedImage& image);
+} // namespace nfw
@@ -0,0 +1,517 @@
+#include "JobSystem.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <objbase.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace nfw
+{
+	namespace
+	{
+		constexpr int64_t JOB_DEQUE_INITIAL_CAPACITY = 1024;
+		constexpr uint32_t JOB_SPIN_NUM = 64;
+
+		struct Job
+		{
+			JobFunc func;
+			JobCounter* counter;
+		};
+
+		// Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+		// Push and Pop are owner only, Steal may be called from any thread.
+		class WorkStealingDeque
+		{
+			struct Array
+			{
+				explicit Array(int64_t capacity)
+					: mask(capacity - 1)
+					, items(std::make_unique<std::atomic<Job*>[]>(capacity))
+				{}
+
+				int64_t GetCapacity() const { return mask + 1; }
+				Job* Get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+				void Put(int64_t i, Job* job) { items[i & mask].store(job, std::memory_order_relaxed); }
+
+				const int64_t mask;
+				std::unique_ptr<std::atomic<Job*>[]> items;
+			};
+
+		public:
+			WorkStealingDeque()
+			{
+				m_arrays.push_back(std::make_unique<Array>(JOB_DEQUE_INITIAL_CAPACITY));
+				m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+			}
+
+			WorkStealingDeque(const WorkStealingDeque&) = delete;
+			void operator=(const WorkStealingDeque&) = delete;
+
+			void Push(Job* job)
+			{
+				const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+				const int64_t top = m_top.load(std::memory_order_acquire);
+				Array* array = m_array.load(std::memory_order_relaxed);
+				if (bottom - top > array->GetCapacity() - 1)
+				{
+					array = Grow(array, top, bottom);
+				}
+				array->Put(bottom, job);
+				std::atomic_thread_fence(std::memory_order_release);
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+
+			Job* Pop()
+			{
+				const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+				Array* array = m_array.load(std::memory_order_relaxed);
+				m_bottom.store(bottom, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				int64_t top = m_top.load(std::memory_order_relaxed);
+
+				Job* job = nullptr;
+				if (top <= bottom)
+				{
+					job = array->Get(bottom);
+					if (top == bottom)
+					{
+						// last job, race the thieves for it
+						if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+						{
+							job = nullptr;
+						}
+						m_bottom.store(bottom + 1, std::memory_order_relaxed);
+					}
+				}
+				else
+				{
+					m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				}
+				return job;
+			}
+
+			Job* Steal()
+			{
+				int64_t top = m_top.load(std::memory_order_acquire);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+				if (top >= bottom)
+				{
+					return nullptr;
+				}
+
+				Job* job = m_array.load(std::memory_order_acquire)->Get(top);
+				if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				{
+					return nullptr;
+				}
+				return job;
+			}
+
+		private:
+			Array* Grow(Array* array, int64_t top, int64_t bottom)
+			{
+				std::unique_ptr<Array> grown = std::make_unique<Array>(array->GetCapacity() * 2);
+				for (int64_t i = top; i < bottom; i++)
+				{
+					grown->Put(i, array->Get(i));
+				}
+
+				// the old array stays alive, a thief may still be reading from it
+				m_arrays.push_back(std::move(grown));
+				m_array.store(m_arrays.back().get(), std::memory_order_release);
+				return m_arrays.back().get();
+			}
+
+			alignas(64) std::atomic<int64_t> m_top = 0;
+			alignas(64) std::atomic<int64_t> m_bottom = 0;
+			std::atomic<Array*> m_array = nullptr;
+			std::vector<std::unique_ptr<Array>> m_arrays;
+		};
+
+		thread_local uint32_t t_workerIndex = ~0u;
+		thread_local uint32_t t_stealSeed = 0;
+
+		void SetThreadAffinity(std::thread& thread, uint64_t mask)
+		{
+#if defined(_WIN32)
+			SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)mask);
+#elif defined(__linux__)
+			cpu_set_t cpuSet;
+			CPU_ZERO(&cpuSet);
+			for (uint32_t cpu = 0; cpu < 64; cpu++)
+			{
+				if (mask & (1ull << cpu))
+				{
+					CPU_SET(cpu, &cpuSet);
+				}
+			}
+			pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+#else
+			(void)thread;
+			(void)mask;
+#endif
+		}
+
+		// the n-th set bit of mask, wrapping around
+		uint64_t GetNthCpu(uint64_t mask, uint32_t n)
+		{
+			const uint32_t cpuNum = (uint32_t)std::bitset<64>(mask).count();
+			n %= cpuNum;
+			for (uint32_t cpu = 0; cpu < 64; cpu++)
+			{
+				if ((mask & (1ull << cpu)) && n-- == 0)
+				{
+					return 1ull << cpu;
+				}
+			}
+			return mask;
+		}
+	}
+
+	class JobSystem::Impl
+	{
+	public:
+		Impl()
+		{
+			// workers name themselves in the trace, construct its registry first so it outlives them
+			Trace::GetTimestamp();
+		}
+
+		~Impl()
+		{
+			Shutdown();
+		}
+
+		static Impl& GetInstance()
+		{
+			static Impl impl;
+			return impl;
+		}
+
+		// the first use starts the workers with default settings
+		static Impl& Get()
+		{
+			Impl& impl = GetInstance();
+			if (!impl.m_initialized.load(std::memory_order_acquire))
+			{
+				impl.Init({});
+			}
+			return impl;
+		}
+
+		void Init(const JobSystemDesc& desc)
+		{
+			std::lock_guard<std::mutex> lock(m_initMutex);
+			if (m_initialized.load(std::memory_order_relaxed))
+			{
+				return;
+			}
+
+			const uint32_t hardwareThreadNum = std::max(std::thread::hardware_concurrency(), 2u);
+			const uint32_t workerNum = desc.workerNum ? desc.workerNum : hardwareThreadNum - 1;
+			uint64_t affinityMask = desc.affinityMask;
+			if (desc.pinWorkers && !affinityMask)
+			{
+				affinityMask = (hardwareThreadNum >= 64) ? ~0ull : (1ull << hardwareThreadNum) - 1;
+			}
+
+			m_mainThreadId = std::this_thread::get_id();
+			m_stop.store(false, std::memory_order_relaxed);
+			m_deques.clear();
+			for (uint32_t i = 0; i < workerNum; i++)
+			{
+				m_deques.push_back(std::make_unique<WorkStealingDeque>());
+			}
+
+			for (uint32_t i = 0; i < workerNum; i++)
+			{
+				m_workers.emplace_back([this, i]() { WorkerMain(i); });
+				if (affinityMask)
+				{
+					SetThreadAffinity(m_workers.back(), desc.pinWorkers ? GetNthCpu(affinityMask, i) : affinityMask);
+				}
+			}
+
+			m_initialized.store(true, std::memory_order_release);
+		}
+
+		void Shutdown()
+		{
+			std::lock_guard<std::mutex> lock(m_initMutex);
+			if (!m_initialized.load(std::memory_order_relaxed))
+			{
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> sleepLock(m_sleepMutex);
+				m_stop.store(true, std::memory_order_seq_cst);
+			}
+			m_sleepCondition.notify_all();
+
+			for (std::thread& worker : m_workers)
+			{
+				worker.join();
+			}
+			m_workers.clear();
+
+			// nobody waits for jobs that never started
+			while (Job* job = PopShared(m_sharedJobs, m_sharedMutex))
+			{
+				delete job;
+			}
+			while (Job* job = PopShared(m_mainJobs, m_mainMutex))
+			{
+				delete job;
+			}
+			for (std::unique_ptr<WorkStealingDeque>& deque : m_deques)
+			{
+				while (Job* job = deque->Steal())
+				{
+					delete job;
+				}
+			}
+
+			m_initialized.store(false, std::memory_order_release);
+		}
+
+		uint32_t GetWorkerNum() const { return (uint32_t)m_workers.size(); }
+
+		void Run(JobFunc&& func, JobCounter* counter)
+		{
+			Job* job = CreateJob(std::move(func), counter);
+			if (t_workerIndex < m_deques.size())
+			{
+				m_deques[t_workerIndex]->Push(job);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(m_sharedMutex);
+				m_sharedJobs.push_back(job);
+			}
+			WakeWorker();
+		}
+
+		void RunOnMainThread(JobFunc&& func, JobCounter* counter)
+		{
+			Job* job = CreateJob(std::move(func), counter);
+
+			std::lock_guard<std::mutex> lock(m_mainMutex);
+			m_mainJobs.push_back(job);
+		}
+
+		template <typename Done>
+		void Wait(const Done& done)
+		{
+			for (uint32_t i = 0; !done(); )
+			{
+				if (Job* job = FindJob())
+				{
+					Execute(job);
+					i = 0;
+				}
+				else if (++i > JOB_SPIN_NUM)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		uint32_t ExecuteMainThreadJobs()
+		{
+			uint32_t jobNum = 0;
+			while (Job* job = PopShared(m_mainJobs, m_mainMutex))
+			{
+				Execute(job);
+				jobNum++;
+			}
+			return jobNum;
+		}
+
+	private:
+		Job* CreateJob(JobFunc&& func, JobCounter* counter)
+		{
+			if (counter)
+			{
+				counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+			}
+			return new Job{ std::move(func), counter };
+		}
+
+		void Execute(Job* job)
+		{
+			job->func();
+			if (job->counter)
+			{
+				job->counter->m_pending.fetch_sub(1, std::memory_order_acq_rel);
+			}
+			delete job;
+		}
+
+		static Job* PopShared(std::deque<Job*>& jobs, std::mutex& mutex)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (jobs.empty())
+			{
+				return nullptr;
+			}
+			Job* job = jobs.front();
+			jobs.pop_front();
+			return job;
+		}
+
+		Job* FindJob()
+		{
+			const uint32_t workerIndex = t_workerIndex;
+			const uint32_t dequeNum = (uint32_t)m_deques.size();
+
+			if (workerIndex < dequeNum)
+			{
+				if (Job* job = m_deques[workerIndex]->Pop())
+				{
+					return job;
+				}
+			}
+			else if (std::this_thread::get_id() == m_mainThreadId)
+			{
+				if (Job* job = PopShared(m_mainJobs, m_mainMutex))
+				{
+					return job;
+				}
+			}
+
+			if (Job* job = PopShared(m_sharedJobs, m_sharedMutex))
+			{
+				return job;
+			}
+
+			// start at a different victim every time so thieves spread out
+			if (dequeNum)
+			{
+				const uint32_t start = t_stealSeed++ % dequeNum;
+				for (uint32_t i = 0; i < dequeNum; i++)
+				{
+					const uint32_t victim = (start + i) % dequeNum;
+					if (victim == workerIndex)
+					{
+						continue;
+					}
+					if (Job* job = m_deques[victim]->Steal())
+					{
+						return job;
+					}
+				}
+			}
+			return nullptr;
+		}
+
+		void WakeWorker()
+		{
+			m_epoch.fetch_add(1, std::memory_order_seq_cst);
+			if (m_sleepingNum.load(std::memory_order_seq_cst))
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+				m_sleepCondition.notify_one();
+			}
+		}
+
+		void WorkerMain(uint32_t workerIndex)
+		{
+			t_workerIndex = workerIndex;
+			t_stealSeed = workerIndex + 1;
+			Trace::SetThreadName("Worker");
+#if defined(_WIN32)
+			// jobs decode textures through WIC
+			CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+
+			while (!m_stop.load(std::memory_order_relaxed))
+			{
+				Job* job = nullptr;
+				for (uint32_t i = 0; i < JOB_SPIN_NUM && !job; i++)
+				{
+					job = FindJob();
+				}
+
+				// read the epoch before the last look so that a job pushed after it is not slept through
+				const uint64_t epoch = m_epoch.load(std::memory_order_seq_cst);
+				if (job || (job = FindJob()))
+				{
+					Execute(job);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(m_sleepMutex);
+				m_sleepingNum.fetch_add(1, std::memory_order_seq_cst);
+				m_sleepCondition.wait(lock, [&]()
+				{
+					return m_stop.load(std::memory_order_seq_cst) || m_epoch.load(std::memory_order_seq_cst) != epoch;
+				});
+				m_sleepingNum.fetch_sub(1, std::memory_order_seq_cst);
+			}
+
+#if defined(_WIN32)
+			CoUninitialize();
+#endif
+			t_workerIndex = ~0u;
+		}
+
+		std::mutex m_initMutex;
+		std::atomic<bool> m_initialized = false;
+		std::thread::id m_mainThreadId;
+
+		std::vector<std::thread> m_workers;
+		std::vector<std::unique_ptr<WorkStealingDeque>> m_deques;
+
+		std::mutex m_sharedMutex;
+		std::deque<Job*> m_sharedJobs;      // started on threads that are not workers
+		std::mutex m_mainMutex;
+		std::deque<Job*> m_mainJobs;
+
+		std::mutex m_sleepMutex;
+		std::condition_variable m_sleepCondition;
+		std::atomic<uint64_t> m_epoch = 0;
+		std::atomic<uint32_t> m_sleepingNum = 0;
+		std::atomic<bool> m_stop = false;
+	};
+
+	void JobSystem::Init(const JobSystemDesc& desc)
+	{
+		Impl& impl = Impl::GetInstance();
+		impl.Shutdown();
+		impl.Init(desc);
+	}
+
+	void JobSystem::Shutdown() { Impl::GetInstance().Shutdown(); }
+
+	uint32_t JobSystem::GetWorkerNum() { return Impl::Get().GetWorkerNum(); }
+
+	uint32_t JobSystem::GetWorkerIndex() { return t_workerIndex; }
+
+	void JobSystem::Run(JobFunc func, JobCounter* counter) { Impl::Get().Run(std::move(func), counter); }
+
+	void JobSystem::RunOnMainThread(JobFunc func, JobCounter* counter) { Impl::Get().RunOnMainThread(std::move(func), counter); }
+
+	void JobSystem::Wait(JobCounter& counter) { Impl::Get().Wait([&counter]() { return counter.IsDone(); }); }
+
+	void JobSystem::Wait(const std::function<bool()>& done) { Impl::Get().Wait(done); }
+
+	uint32_t JobSystem::ExecuteMainThreadJobs() { return Impl::Get().ExecuteMainThreadJobs(); }
+
+} // namespace nfw
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace nfw
+{
+	struct JobSystemDesc
+	{
+		uint32_t workerNum = 0;         // 0 is one worker per hardware thread except the calling one
+		uint64_t affinityMask = 0;      // CPUs the workers may run on, 0 leaves scheduling to the OS
+		bool pinWorkers = false;        // worker i only runs on the i-th CPU of affinityMask
+	};
+
+	class JobCounter;
+
+	using JobFunc = std::function<void()>;
+
+	// Work-stealing job system shared by every subsystem.
+	// Each worker owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom while idle
+	// workers steal from the top. Jobs started from other threads go through a shared queue.
+	// Waiting threads run jobs instead of blocking, so fork-join nests without deadlocking.
+	// Jobs queued with RunOnMainThread only run on the thread that called Init.
+	class JobSystem
+	{
+	public:
+		// Starts the workers; called implicitly with default settings on first use
+		static void Init(const JobSystemDesc& desc = {});
+		static void Shutdown();
+
+		static uint32_t GetWorkerNum();
+
+		// Index of the calling worker, ~0u on threads that are not workers
+		static uint32_t GetWorkerIndex();
+
+		static void Run(JobFunc func, JobCounter* counter = nullptr);
+		static void RunOnMainThread(JobFunc func, JobCounter* counter = nullptr);
+
+		// Runs queued jobs until counter is done
+		static void Wait(JobCounter& counter);
+
+		// Runs queued jobs until done returns true, for work that does not finish in a job
+		static void Wait(const std::function<bool()>& done);
+
+		// Runs the jobs queued with RunOnMainThread, returns the number run; main thread only
+		static uint32_t ExecuteMainThreadJobs();
+
+	private:
+		class Impl;
+		friend class JobCounter;
+	};
+
+	// Counts unfinished jobs, Wait() returns once every job started with it has run
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+
+		JobCounter(const JobCounter&) = delete;
+		void operator=(const JobCounter&) = delete;
+
+		bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem::Impl;
+		std::atomic<uint32_t> m_pending = 0;
+	};
+} // namespace nfw
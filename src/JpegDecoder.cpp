@@ -0,0 +1,910 @@
+#include "ImageDecoder.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NFW_JPEG_SSE2
+#endif
+
+namespace nfw
+{
+	namespace
+	{
+		// natural (row-major) position of each zigzag position in a block
+		constexpr uint8_t ZIGZAG[64] = {
+			0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+			12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+		};
+
+		constexpr uint32_t FAST_BITS = 9;
+		constexpr uint32_t MAX_COMPONENT_NUM = 3;
+		constexpr uint64_t MAX_PIXEL_NUM = 1ull << 28;
+
+		struct Huffman
+		{
+			std::array<uint16_t, 1 << FAST_BITS> fast = {};    // length << 8 | value, 0 for longer codes
+			std::array<int16_t, 1 << FAST_BITS> fastAc = {};   // AC code and its bits in one: value << 8 | run << 4 | bit count
+			std::array<int32_t, 17> maxCode = {};               // of each length, -1 when there is none
+			std::array<int32_t, 17> valueOffset = {};           // from a code to its index in values
+			std::array<uint8_t, 256> values = {};
+			bool defined = false;
+		};
+
+		// Entropy coded bytes of one restart interval, 0xFF00 is a stuffed 0xFF. Reads zeros past the end.
+		class BitReader
+		{
+		public:
+			BitReader(const uint8_t* begin, const uint8_t* end) : m_p(begin), m_end(end) {}
+
+			uint32_t Peek(uint32_t bitNum)
+			{
+				if (m_bitNum < bitNum)
+				{
+					Fill();
+				}
+				return (uint32_t)(m_buffer >> (64 - bitNum));
+			}
+
+			void Skip(uint32_t bitNum)
+			{
+				m_buffer <<= bitNum;
+				m_bitNum -= bitNum;
+			}
+
+			uint32_t Read(uint32_t bitNum)
+			{
+				if (!bitNum)
+				{
+					return 0;
+				}
+				const uint32_t value = Peek(bitNum);
+				Skip(bitNum);
+				return value;
+			}
+
+		private:
+			void Fill()
+			{
+				while (m_bitNum <= 56)
+				{
+					uint64_t byte = 0;
+					if (m_p < m_end)
+					{
+						byte = *m_p++;
+						if (byte == 0xFF && m_p < m_end && *m_p == 0x00)
+						{
+							m_p++;
+						}
+					}
+					m_buffer |= byte << (56 - m_bitNum);
+					m_bitNum += 8;
+				}
+			}
+
+			const uint8_t* m_p;
+			const uint8_t* m_end;
+			uint64_t m_buffer = 0;
+			uint32_t m_bitNum = 0;
+		};
+
+		// Reduced IDCT: the 8-point IDCT evaluated at the centers of N groups of 8 / N pixels only needs the
+		// N lowest frequencies, so a block decodes straight to N x N. table[x * N + u], transposed[u * N + x].
+		struct IdctTable
+		{
+			alignas(16) float table[64];
+			alignas(16) float transposed[64];
+		};
+
+		const IdctTable& GetIdctTable(uint32_t scaleShift)
+		{
+			static const std::array<IdctTable, 4> tables = []()
+			{
+				std::array<IdctTable, 4> result = {};
+				for (uint32_t shift = 0; shift < 4; shift++)
+				{
+					const uint32_t n = 8 >> shift;
+					for (uint32_t x = 0; x < n; x++)
+					{
+						for (uint32_t u = 0; u < n; u++)
+						{
+							const double c = u ? 1.0 : std::sqrt(0.5);
+							const float value = (float)(0.5 * c * std::cos((2 * x + 1) * u * 3.14159265358979323846 / (2 * n)));
+							result[shift].table[x * n + u] = value;
+							result[shift].transposed[u * n + x] = value;
+						}
+					}
+				}
+				return result;
+			}();
+			return tables[scaleShift];
+		}
+
+		uint8_t ClampSample(float value)
+		{
+			return (uint8_t)(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+		}
+
+		// coefficients and dequantization are N x N in natural order, the samples are level shifted back
+		void Idct(const int16_t* coefficients, const float* dequant, uint32_t scaleShift, uint8_t* dst, size_t stride)
+		{
+			const IdctTable& idct = GetIdctTable(scaleShift);
+			const uint32_t n = 8 >> scaleShift;
+
+#ifdef NFW_JPEG_SSE2
+			if (n >= 4)
+			{
+				// 4 lanes per row half, the frequency rows that are all zero are skipped
+				const uint32_t halfNum = n / 4;
+				__m128 f[8][2];
+				bool nonZero[8];
+				for (uint32_t u = 0; u < n; u++)
+				{
+					nonZero[u] = false;
+					for (uint32_t half = 0; half < halfNum; half++)
+					{
+						const __m128i packed = _mm_loadl_epi64((const __m128i*)(coefficients + u * n + half * 4));
+						const __m128i widened = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+						f[u][half] = _mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_loadu_ps(dequant + u * n + half * 4));
+						nonZero[u] |= _mm_movemask_epi8(_mm_cmpeq_epi32(widened, _mm_setzero_si128())) != 0xFFFF;
+					}
+				}
+
+				// columns: g[y] = sum over u of table[y][u] * f[u]
+				alignas(16) float g[64];
+				for (uint32_t y = 0; y < n; y++)
+				{
+					__m128 sum[2] = { _mm_setzero_ps(), _mm_setzero_ps() };
+					for (uint32_t u = 0; u < n; u++)
+					{
+						if (nonZero[u])
+						{
+							const __m128 weight = _mm_set1_ps(idct.table[y * n + u]);
+							for (uint32_t half = 0; half < halfNum; half++)
+							{
+								sum[half] = _mm_add_ps(sum[half], _mm_mul_ps(weight, f[u][half]));
+							}
+						}
+					}
+					for (uint32_t half = 0; half < halfNum; half++)
+					{
+						_mm_store_ps(g + y * n + half * 4, sum[half]);
+					}
+				}
+
+				// rows: out[y] = sum over v of g[y][v] * transposed[v]
+				const __m128 levelShift = _mm_set1_ps(128.0f);
+				for (uint32_t y = 0; y < n; y++)
+				{
+					__m128 sum[2] = { levelShift, levelShift };
+					for (uint32_t v = 0; v < n; v++)
+					{
+						const __m128 weight = _mm_set1_ps(g[y * n + v]);
+						for (uint32_t half = 0; half < halfNum; half++)
+						{
+							sum[half] = _mm_add_ps(sum[half], _mm_mul_ps(weight, _mm_load_ps(idct.transposed + v * n + half * 4)));
+						}
+					}
+					const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(sum[0]), halfNum > 1 ? _mm_cvtps_epi32(sum[1]) : _mm_setzero_si128());
+					const __m128i bytes = _mm_packus_epi16(words, words);
+					if (halfNum > 1)
+					{
+						_mm_storel_epi64((__m128i*)(dst + y * stride), bytes);
+					}
+					else
+					{
+						const int32_t packed = _mm_cvtsi128_si32(bytes);
+						memcpy(dst + y * stride, &packed, 4);
+					}
+				}
+				return;
+			}
+#endif
+
+			float f[64];
+			for (uint32_t i = 0; i < n * n; i++)
+			{
+				f[i] = coefficients[i] * dequant[i];
+			}
+
+			float g[64];
+			for (uint32_t y = 0; y < n; y++)
+			{
+				for (uint32_t v = 0; v < n; v++)
+				{
+					float sum = 0.0f;
+					for (uint32_t u = 0; u < n; u++)
+					{
+						sum += idct.table[y * n + u] * f[u * n + v];
+					}
+					g[y * n + v] = sum;
+				}
+			}
+
+			for (uint32_t y = 0; y < n; y++)
+			{
+				for (uint32_t x = 0; x < n; x++)
+				{
+					float sum = 128.0f;
+					for (uint32_t v = 0; v < n; v++)
+					{
+						sum += g[y * n + v] * idct.table[x * n + v];
+					}
+					dst[y * stride + x] = ClampSample(sum);
+				}
+			}
+		}
+
+		void YCbCrToRgba(const uint8_t* ys, const uint8_t* cbs, const uint8_t* crs, uint8_t* dst, uint32_t width)
+		{
+			uint32_t x = 0;
+#ifdef NFW_JPEG_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			const __m128 center = _mm_set1_ps(128.0f);
+			auto load = [&](const uint8_t* src)
+			{
+				int32_t packed;
+				memcpy(&packed, src, 4);
+				const __m128i bytes = _mm_cvtsi32_si128(packed);
+				return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+			};
+
+			for (; x + 4 <= width; x += 4)
+			{
+				const __m128 y = load(ys + x);
+				const __m128 cb = _mm_sub_ps(load(cbs + x), center);
+				const __m128 cr = _mm_sub_ps(load(crs + x), center);
+
+				const __m128 r = _mm_add_ps(y, _mm_mul_ps(cr, _mm_set1_ps(1.402f)));
+				const __m128 g = _mm_sub_ps(y, _mm_add_ps(_mm_mul_ps(cb, _mm_set1_ps(0.344136f)), _mm_mul_ps(cr, _mm_set1_ps(0.714136f))));
+				const __m128 b = _mm_add_ps(y, _mm_mul_ps(cb, _mm_set1_ps(1.772f)));
+
+				// RRRR GGGG BBBB AAAA, then interleaved to RGBA x 4
+				const __m128i planar = _mm_packus_epi16(_mm_packs_epi32(_mm_cvtps_epi32(r), _mm_cvtps_epi32(g)), _mm_packs_epi32(_mm_cvtps_epi32(b), _mm_set1_epi32(255)));
+				const __m128i rg = _mm_unpacklo_epi8(planar, _mm_srli_si128(planar, 4));
+				const __m128i ba = _mm_unpacklo_epi8(_mm_srli_si128(planar, 8), _mm_srli_si128(planar, 12));
+				_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(rg, ba));
+			}
+#endif
+			for (; x < width; x++)
+			{
+				const float y = ys[x];
+				const float cb = cbs[x] - 128.0f;
+				const float cr = crs[x] - 128.0f;
+				dst[x * 4 + 0] = ClampSample(y + 1.402f * cr);
+				dst[x * 4 + 1] = ClampSample(y - 0.344136f * cb - 0.714136f * cr);
+				dst[x * 4 + 2] = ClampSample(y + 1.772f * cb);
+				dst[x * 4 + 3] = 0xFF;
+			}
+		}
+
+		struct Component
+		{
+			uint32_t id = 0;
+			uint32_t h = 1;
+			uint32_t v = 1;
+			uint32_t quant = 0;
+			uint32_t dcTable = 0;
+			uint32_t acTable = 0;
+			uint32_t scaleShift = 0;    // subsampled components keep more of each block when the image is scaled
+			uint32_t blockSize = 8;
+			uint32_t blocksX = 0;       // over the padded MCUs
+			uint32_t blocksY = 0;
+			std::vector<int16_t> coefficients;  // N x N lowest frequencies of each block
+			std::vector<uint8_t> plane;         // blocksX * N samples wide
+		};
+
+		int32_t Extend(uint32_t value, uint32_t bitNum)
+		{
+			return (bitNum && value < (1u << (bitNum - 1))) ? (int32_t)value - (1 << bitNum) + 1 : (int32_t)value;
+		}
+
+		// Small AC coefficients whose code and value bits both fit in the fast lookup are decoded in one step
+		void BuildFastAc(Huffman& huffman)
+		{
+			for (uint32_t i = 0; i < (1u << FAST_BITS); i++)
+			{
+				const uint32_t fast = huffman.fast[i];
+				const uint32_t length = fast >> 8;
+				const uint32_t run = (fast >> 4) & 15;
+				const uint32_t bitNum = fast & 15;
+				if (!fast || !bitNum || length + bitNum > FAST_BITS)
+				{
+					continue;
+				}
+				const uint32_t bits = ((i << length) & ((1u << FAST_BITS) - 1)) >> (FAST_BITS - bitNum);
+				const int32_t value = Extend(bits, bitNum);
+				if (value >= -128 && value <= 127)
+				{
+					huffman.fastAc[i] = (int16_t)(value * 256 + (int32_t)(run << 4) + (int32_t)(length + bitNum));
+				}
+			}
+		}
+
+		class JpegDecoder
+		{
+		public:
+			bool Decode(const uint8_t* data, size_t size, uint32_t scaleShift, DecodedImage& image)
+			{
+				m_scaleShift = scaleShift;
+				m_blockSize = 8 >> scaleShift;
+				if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+				{
+					return false;
+				}
+
+				const uint8_t* p = data + 2;
+				const uint8_t* end = data + size;
+				bool scanned = false;
+				while (p + 2 <= end)
+				{
+					if (p[0] != 0xFF)
+					{
+						return false;
+					}
+					const uint8_t marker = p[1];
+					p += 2;
+					if (marker == 0xFF)
+					{
+						p--;
+						continue;
+					}
+					if (marker == 0xD9)
+					{
+						break;
+					}
+					if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01)
+					{
+						continue;
+					}
+
+					if (p + 2 > end)
+					{
+						return false;
+					}
+					const uint32_t length = (uint32_t)(p[0] << 8 | p[1]);
+					if (length < 2 || p + length > end)
+					{
+						return false;
+					}
+					const uint8_t* segment = p + 2;
+					const uint32_t segmentSize = length - 2;
+					p += length;
+
+					bool result = true;
+					switch (marker)
+					{
+					case 0xDB:
+						result = ReadQuantTables(segment, segmentSize);
+						break;
+					case 0xC4:
+						result = ReadHuffmanTables(segment, segmentSize);
+						break;
+					case 0xDD:
+						result = segmentSize >= 2;
+						m_restartInterval = result ? (uint32_t)(segment[0] << 8 | segment[1]) : 0;
+						break;
+					case 0xC0:
+					case 0xC1:
+						result = ReadFrame(segment, segmentSize);
+						break;
+					case 0xEE:
+						if (segmentSize >= 12 && !memcmp(segment, "Adobe", 5))
+						{
+							m_adobeTransform = segment[11];
+						}
+						break;
+					case 0xDA:
+					{
+						// the entropy coded data runs up to the first marker that is not a restart
+						const uint8_t* scanEnd = p;
+						while (scanEnd + 1 < end && !(scanEnd[0] == 0xFF && scanEnd[1] != 0x00 && (scanEnd[1] < 0xD0 || scanEnd[1] > 0xD7)))
+						{
+							scanEnd++;
+						}
+						if (scanEnd + 1 >= end)
+						{
+							scanEnd = end;
+						}
+						result = ReadScan(segment, segmentSize, p, scanEnd);
+						scanned |= result;
+						p = scanEnd;
+						break;
+					}
+					default:
+						// progressive, lossless and arithmetic coded frames
+						if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+						{
+							result = false;
+						}
+						break;
+					}
+					if (!result)
+					{
+						return false;
+					}
+				}
+
+				if (!scanned)
+				{
+					return false;
+				}
+				WriteImage(image);
+				return true;
+			}
+
+		private:
+			bool ReadQuantTables(const uint8_t* p, uint32_t size)
+			{
+				while (size)
+				{
+					const uint32_t precision = p[0] >> 4;
+					const uint32_t id = p[0] & 15;
+					const uint32_t tableSize = 1 + 64 * (precision ? 2 : 1);
+					if (id > 3 || precision > 1 || size < tableSize)
+					{
+						return false;
+					}
+					for (uint32_t i = 0; i < 64; i++)
+					{
+						m_quant[id][ZIGZAG[i]] = precision ? (uint16_t)(p[1 + i * 2] << 8 | p[2 + i * 2]) : p[1 + i];
+					}
+					p += tableSize;
+					size -= tableSize;
+				}
+				return true;
+			}
+
+			bool ReadHuffmanTables(const uint8_t* p, uint32_t size)
+			{
+				while (size >= 17)
+				{
+					const uint32_t tableClass = p[0] >> 4;
+					const uint32_t id = p[0] & 15;
+					if (tableClass > 1 || id > 3)
+					{
+						return false;
+					}
+
+					uint32_t valueNum = 0;
+					for (uint32_t i = 0; i < 16; i++)
+					{
+						valueNum += p[1 + i];
+					}
+					if (valueNum > 256 || size < 17 + valueNum)
+					{
+						return false;
+					}
+
+					Huffman& huffman = tableClass ? m_ac[id] : m_dc[id];
+					huffman = {};
+					memcpy(huffman.values.data(), p + 17, valueNum);
+
+					// canonical codes, each length continues from the previous one shifted up
+					uint32_t code = 0;
+					uint32_t index = 0;
+					for (uint32_t length = 1; length <= 16; length++)
+					{
+						const uint32_t count = p[length];
+						huffman.valueOffset[length] = (int32_t)index - (int32_t)code;
+						for (uint32_t i = 0; i < count; i++, code++, index++)
+						{
+							if (length <= FAST_BITS)
+							{
+								const uint32_t first = code << (FAST_BITS - length);
+								for (uint32_t j = 0; j < (1u << (FAST_BITS - length)); j++)
+								{
+									huffman.fast[first + j] = (uint16_t)(length << 8 | huffman.values[index]);
+								}
+							}
+						}
+						huffman.maxCode[length] = count ? (int32_t)code - 1 : -1;
+						if (code > (1u << length))
+						{
+							return false;
+						}
+						code <<= 1;
+					}
+					if (tableClass)
+					{
+						BuildFastAc(huffman);
+					}
+					huffman.defined = true;
+
+					p += 17 + valueNum;
+					size -= 17 + valueNum;
+				}
+				return size == 0;
+			}
+
+			bool ReadFrame(const uint8_t* p, uint32_t size)
+			{
+				if (m_componentNum || size < 6 || p[0] != 8)
+				{
+					return false;
+				}
+				m_height = (uint32_t)(p[1] << 8 | p[2]);
+				m_width = (uint32_t)(p[3] << 8 | p[4]);
+				m_componentNum = p[5];
+				if (!m_width || !m_height || (uint64_t)m_width * m_height > MAX_PIXEL_NUM
+					|| (m_componentNum != 1 && m_componentNum != MAX_COMPONENT_NUM) || size < 6 + m_componentNum * 3)
+				{
+					return false;
+				}
+
+				for (uint32_t i = 0; i < m_componentNum; i++)
+				{
+					Component& component = m_components[i];
+					component.id = p[6 + i * 3];
+					component.h = p[7 + i * 3] >> 4;
+					component.v = p[7 + i * 3] & 15;
+					component.quant = p[8 + i * 3];
+					if (!component.h || component.h > 4 || !component.v || component.v > 4 || component.quant > 3)
+					{
+						return false;
+					}
+					m_maxH = std::max(m_maxH, component.h);
+					m_maxV = std::max(m_maxV, component.v);
+				}
+
+				m_mcusX = (m_width + m_maxH * 8 - 1) / (m_maxH * 8);
+				m_mcusY = (m_height + m_maxV * 8 - 1) / (m_maxV * 8);
+				for (uint32_t i = 0; i < m_componentNum; i++)
+				{
+					Component& component = m_components[i];
+					component.blocksX = m_mcusX * component.h;
+					component.blocksY = m_mcusY * component.v;
+
+					// a 2x subsampled component scaled by 1/2 is decoded at full block size and needs no upsampling
+					component.scaleShift = m_scaleShift;
+					if (m_maxH / component.h == m_maxV / component.v && m_maxH % component.h == 0 && m_maxV % component.v == 0)
+					{
+						for (uint32_t ratio = m_maxH / component.h; ratio > 1 && component.scaleShift; ratio >>= 1)
+						{
+							component.scaleShift--;
+						}
+					}
+					component.blockSize = 8 >> component.scaleShift;
+					component.coefficients.assign((size_t)component.blocksX * component.blocksY * component.blockSize * component.blockSize, 0);
+				}
+				return true;
+			}
+
+			struct ScanComponent
+			{
+				Component* component;
+				const Huffman* dc;
+				const Huffman* ac;
+			};
+
+			bool ReadScan(const uint8_t* p, uint32_t size, const uint8_t* data, const uint8_t* dataEnd)
+			{
+				NFW_TRACE_SCOPE("JpegDecoder::ReadScan");
+
+				if (!m_componentNum || !size || size < 4u + p[0] * 2u || !p[0] || p[0] > m_componentNum)
+				{
+					return false;
+				}
+
+				const uint32_t scanComponentNum = p[0];
+				std::array<ScanComponent, MAX_COMPONENT_NUM> scanComponents = {};
+				for (uint32_t i = 0; i < scanComponentNum; i++)
+				{
+					const uint32_t id = p[1 + i * 2];
+					const uint32_t tables = p[2 + i * 2];
+					auto it = std::find_if(m_components.begin(), m_components.begin() + m_componentNum, [id](const Component& component) { return component.id == id; });
+					if (it == m_components.begin() + m_componentNum || (tables >> 4) > 3 || (tables & 15) > 3)
+					{
+						return false;
+					}
+					scanComponents[i] = { &*it, &m_dc[tables >> 4], &m_ac[tables & 15] };
+					if (!scanComponents[i].dc->defined || !scanComponents[i].ac->defined)
+					{
+						return false;
+					}
+				}
+				const uint8_t* spectral = p + 1 + scanComponentNum * 2;
+				if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0)
+				{
+					return false;
+				}
+
+				// a single component scan is not interleaved, its MCU is one block of the unpadded component
+				uint32_t unitsX = m_mcusX;
+				uint32_t mcuNum = m_mcusX * m_mcusY;
+				if (scanComponentNum == 1)
+				{
+					const Component& component = *scanComponents[0].component;
+					unitsX = ((m_width * component.h + m_maxH - 1) / m_maxH + 7) / 8;
+					mcuNum = unitsX * (((m_height * component.v + m_maxV - 1) / m_maxV + 7) / 8);
+				}
+
+				// restart intervals start on byte boundaries with their own DC predictions, they decode in parallel
+				std::vector<std::pair<const uint8_t*, const uint8_t*>> intervals;
+				const uint8_t* intervalBegin = data;
+				for (const uint8_t* q = data; q + 1 < dataEnd; q++)
+				{
+					if (q[0] == 0xFF && q[1] >= 0xD0 && q[1] <= 0xD7)
+					{
+						intervals.push_back({ intervalBegin, q });
+						intervalBegin = q + 2;
+						q++;
+					}
+				}
+				intervals.push_back({ intervalBegin, dataEnd });
+
+				const uint32_t interval = m_restartInterval ? m_restartInterval : mcuNum;
+				const uint32_t intervalNum = std::min((uint32_t)intervals.size(), (mcuNum + interval - 1) / interval);
+
+				std::atomic<bool> succeeded = true;
+				ParallelFor(intervalNum, 1, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i = begin; i < end && succeeded; i++)
+					{
+						BitReader reader(intervals[i].first, intervals[i].second);
+						std::array<int32_t, MAX_COMPONENT_NUM> predictions = {};
+						const uint32_t mcuEnd = std::min(mcuNum, (i + 1) * interval);
+						for (uint32_t mcu = i * interval; mcu < mcuEnd; mcu++)
+						{
+							if (!DecodeMcu(reader, scanComponents.data(), scanComponentNum, predictions.data(), mcu % unitsX, mcu / unitsX))
+							{
+								succeeded = false;
+								break;
+							}
+						}
+					}
+				});
+				return succeeded;
+			}
+
+			bool DecodeMcu(BitReader& reader, const ScanComponent* scanComponents, uint32_t scanComponentNum, int32_t* predictions, uint32_t mcuX, uint32_t mcuY)
+			{
+				if (scanComponentNum == 1)
+				{
+					return DecodeBlock(reader, scanComponents[0], predictions[0], mcuX, mcuY);
+				}
+				for (uint32_t i = 0; i < scanComponentNum; i++)
+				{
+					const ScanComponent& scanComponent = scanComponents[i];
+					for (uint32_t y = 0; y < scanComponent.component->v; y++)
+					{
+						for (uint32_t x = 0; x < scanComponent.component->h; x++)
+						{
+							if (!DecodeBlock(reader, scanComponent, predictions[i], mcuX * scanComponent.component->h + x, mcuY * scanComponent.component->v + y))
+							{
+								return false;
+							}
+						}
+					}
+				}
+				return true;
+			}
+
+			static int32_t DecodeHuffman(BitReader& reader, const Huffman& huffman)
+			{
+				const uint32_t fast = huffman.fast[reader.Peek(FAST_BITS)];
+				if (fast)
+				{
+					reader.Skip(fast >> 8);
+					return fast & 0xFF;
+				}
+				for (uint32_t length = FAST_BITS + 1; length <= 16; length++)
+				{
+					const int32_t code = (int32_t)reader.Peek(length);
+					if (code <= huffman.maxCode[length])
+					{
+						reader.Skip(length);
+						return huffman.values[code + huffman.valueOffset[length]];
+					}
+				}
+				return -1;
+			}
+
+			// Every coefficient is entropy decoded, only the N x N lowest frequencies are kept
+			bool DecodeBlock(BitReader& reader, const ScanComponent& scanComponent, int32_t& prediction, uint32_t blockX, uint32_t blockY)
+			{
+				Component& component = *scanComponent.component;
+				const uint32_t n = component.blockSize;
+				int16_t* coefficients = component.coefficients.data() + ((size_t)blockY * component.blocksX + blockX) * n * n;
+
+				const int32_t dcBitNum = DecodeHuffman(reader, *scanComponent.dc);
+				if (dcBitNum < 0 || dcBitNum > 16)
+				{
+					return false;
+				}
+				prediction += Extend(reader.Read((uint32_t)dcBitNum), (uint32_t)dcBitNum);
+				coefficients[0] = (int16_t)prediction;
+
+				for (uint32_t k = 1; k < 64;)
+				{
+					const int32_t fastAc = scanComponent.ac->fastAc[reader.Peek(FAST_BITS)];
+					if (fastAc)
+					{
+						k += (fastAc >> 4) & 15;
+						reader.Skip(fastAc & 15);
+						if (k > 63)
+						{
+							return false;
+						}
+						const uint32_t row = ZIGZAG[k] >> 3;
+						const uint32_t column = ZIGZAG[k] & 7;
+						if (row < n && column < n)
+						{
+							coefficients[row * n + column] = (int16_t)(fastAc >> 8);
+						}
+						k++;
+						continue;
+					}
+
+					const int32_t runSize = DecodeHuffman(reader, *scanComponent.ac);
+					if (runSize < 0)
+					{
+						return false;
+					}
+					const uint32_t run = (uint32_t)runSize >> 4;
+					const uint32_t bitNum = (uint32_t)runSize & 15;
+					if (!bitNum)
+					{
+						if (run != 15)
+						{
+							break;
+						}
+						k += 16;
+						continue;
+					}
+
+					k += run;
+					if (k > 63)
+					{
+						return false;
+					}
+					const int32_t value = Extend(reader.Read(bitNum), bitNum);
+					const uint32_t row = ZIGZAG[k] >> 3;
+					const uint32_t column = ZIGZAG[k] & 7;
+					if (row < n && column < n)
+					{
+						coefficients[row * n + column] = (int16_t)value;
+					}
+					k++;
+				}
+				return true;
+			}
+
+			// IDCT and color conversion, one MCU row per job
+			void WriteImage(DecodedImage& image)
+			{
+				NFW_TRACE_SCOPE("JpegDecoder::WriteImage");
+
+				image.width = m_width;
+				image.height = m_height;
+				image.scaleShift = m_scaleShift;
+				const uint32_t width = std::max(m_width >> m_scaleShift, 1u);
+				const uint32_t height = std::max(m_height >> m_scaleShift, 1u);
+				image.pixels.resize((size_t)width * height * 4);
+
+				std::array<std::array<float, 64>, MAX_COMPONENT_NUM> dequants = {};
+				for (uint32_t i = 0; i < m_componentNum; i++)
+				{
+					Component& component = m_components[i];
+					const uint32_t n = component.blockSize;
+					component.plane.resize((size_t)component.blocksX * component.blocksY * n * n);
+					for (uint32_t row = 0; row < n; row++)
+					{
+						for (uint32_t column = 0; column < n; column++)
+						{
+							dequants[i][row * n + column] = m_quant[component.quant][row * 8 + column];
+						}
+					}
+				}
+
+				const bool rgb = m_componentNum == 3 && m_adobeTransform == 0;
+				ParallelFor(m_mcusY, 1, [&](uint32_t begin, uint32_t end)
+				{
+					std::array<std::vector<uint8_t>, MAX_COMPONENT_NUM> upsampled;
+					for (uint32_t mcuY = begin; mcuY < end; mcuY++)
+					{
+						for (uint32_t i = 0; i < m_componentNum; i++)
+						{
+							Component& component = m_components[i];
+							const uint32_t n = component.blockSize;
+							const size_t stride = (size_t)component.blocksX * n;
+							for (uint32_t blockY = mcuY * component.v; blockY < (mcuY + 1) * component.v; blockY++)
+							{
+								for (uint32_t blockX = 0; blockX < component.blocksX; blockX++)
+								{
+									const int16_t* coefficients = component.coefficients.data() + ((size_t)blockY * component.blocksX + blockX) * n * n;
+									Idct(coefficients, dequants[i].data(), component.scaleShift, component.plane.data() + blockY * n * stride + blockX * n, stride);
+								}
+							}
+						}
+
+						const uint32_t mcuHeight = m_maxV * m_blockSize;
+						const uint32_t yEnd = std::min((mcuY + 1) * mcuHeight, height);
+						for (uint32_t y = mcuY * mcuHeight; y < yEnd; y++)
+						{
+							// subsampled components are repeated up to the full resolution
+							std::array<const uint8_t*, MAX_COMPONENT_NUM> rows = {};
+							for (uint32_t i = 0; i < m_componentNum; i++)
+							{
+								const Component& component = m_components[i];
+								const uint32_t samplesX = component.h * component.blockSize;
+								const uint32_t samplesY = component.v * component.blockSize;
+								const uint32_t mcuWidth = m_maxH * m_blockSize;
+								const uint8_t* row = component.plane.data() + (size_t)(y * samplesY / mcuHeight) * component.blocksX * component.blockSize;
+								if (samplesX == mcuWidth)
+								{
+									rows[i] = row;
+									continue;
+								}
+								upsampled[i].resize(width);
+								for (uint32_t x = 0; x < width; x++)
+								{
+									upsampled[i][x] = row[x * samplesX / mcuWidth];
+								}
+								rows[i] = upsampled[i].data();
+							}
+
+							uint8_t* dst = image.pixels.data() + (size_t)y * width * 4;
+							if (m_componentNum == 1)
+							{
+								for (uint32_t x = 0; x < width; x++)
+								{
+									dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = rows[0][x];
+									dst[x * 4 + 3] = 0xFF;
+								}
+							}
+							else if (rgb)
+							{
+								for (uint32_t x = 0; x < width; x++)
+								{
+									dst[x * 4 + 0] = rows[0][x];
+									dst[x * 4 + 1] = rows[1][x];
+									dst[x * 4 + 2] = rows[2][x];
+									dst[x * 4 + 3] = 0xFF;
+								}
+							}
+							else
+							{
+								YCbCrToRgba(rows[0], rows[1], rows[2], dst, width);
+							}
+						}
+					}
+				});
+			}
+
+			uint32_t m_scaleShift = 0;
+			uint32_t m_blockSize = 8;
+			uint32_t m_width = 0;
+			uint32_t m_height = 0;
+			uint32_t m_componentNum = 0;
+			uint32_t m_maxH = 1;
+			uint32_t m_maxV = 1;
+			uint32_t m_mcusX = 0;
+			uint32_t m_mcusY = 0;
+			uint32_t m_restartInterval = 0;
+			uint32_t m_adobeTransform = 1;     // 0 stores RGB as it is
+			std::array<Component, MAX_COMPONENT_NUM> m_components;
+			std::array<std::array<uint16_t, 64>, 4> m_quant = {};
+			std::array<Huffman, 4> m_dc;
+			std::array<Huffman, 4> m_ac;
+		};
+	}
+
+	bool DecodeJpeg(const uint8_t* data, size_t size, uint32_t scaleShift, DecodedImage& image)
+	{
+		NFW_TRACE_SCOPE("DecodeJpeg");
+
+		// a few KB of tables, kept off the job stacks
+		std::unique_ptr<JpegDecoder> decoder = std::make_unique<JpegDecoder>();
+		return decoder->Decode(data, size, std::min(scaleShift, 3u), image);
+	}
+} // namespace nfw
@@ -0,0 +1,207 @@
+#include "Lz4.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace nfw
+{
+	namespace
+	{
+		constexpr size_t MIN_MATCH = 4;
+		constexpr size_t LAST_LITERALS = 5;     // a block always ends with this many literals
+		constexpr size_t MATCH_FIND_LIMIT = 12; // no match starts closer to the end
+		constexpr size_t MAX_OFFSET = 65535;
+		constexpr uint32_t HASH_BITS = 16;
+
+		uint32_t Read32(const uint8_t* p)
+		{
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+
+		uint32_t Hash(uint32_t sequence)
+		{
+			return (sequence * 2654435761u) >> (32 - HASH_BITS);
+		}
+
+		// Lengths of 15 and more continue in bytes of 255 and a remainder
+		uint8_t* WriteLength(uint8_t* op, size_t length)
+		{
+			for (length -= 15; length >= 255; length -= 255)
+			{
+				*op++ = 255;
+			}
+			*op++ = (uint8_t)length;
+			return op;
+		}
+
+		bool ReadLength(const uint8_t*& ip, const uint8_t* ipEnd, size_t& length)
+		{
+			uint8_t byte;
+			do
+			{
+				if (ip == ipEnd)
+				{
+					return false;
+				}
+				byte = *ip++;
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+		// One sequence: literals, then a match unless it is the last one
+		uint8_t* WriteSequence(uint8_t* op, const uint8_t* opEnd, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+		{
+			const size_t worstSize = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+			if ((size_t)(opEnd - op) < worstSize)
+			{
+				return nullptr;
+			}
+
+			uint8_t* token = op++;
+			*token = (uint8_t)(std::min<size_t>(literalLength, 15) << 4);
+			if (literalLength >= 15)
+			{
+				op = WriteLength(op, literalLength);
+			}
+			if (literalLength)
+			{
+				memcpy(op, literals, literalLength);
+			}
+			op += literalLength;
+
+			if (matchLength)
+			{
+				*op++ = (uint8_t)offset;
+				*op++ = (uint8_t)(offset >> 8);
+
+				const size_t length = matchLength - MIN_MATCH;
+				*token |= (uint8_t)std::min<size_t>(length, 15);
+				if (length >= 15)
+				{
+					op = WriteLength(op, length);
+				}
+			}
+			return op;
+		}
+	}
+
+	size_t Lz4CompressBound(size_t srcSize)
+	{
+		return srcSize + srcSize / 255 + 16;
+	}
+
+	size_t Lz4Compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity)
+	{
+		uint8_t* op = dst;
+		const uint8_t* opEnd = dst + dstCapacity;
+		size_t anchor = 0;
+
+		if (srcSize >= MATCH_FIND_LIMIT)
+		{
+			// positions by hash of the 4 bytes there, one candidate per hash
+			std::vector<uint32_t> table((size_t)1 << HASH_BITS, UINT32_MAX);
+			const size_t matchEnd = srcSize - LAST_LITERALS;
+
+			for (size_t i = 0; i + MATCH_FIND_LIMIT <= srcSize;)
+			{
+				const uint32_t sequence = Read32(src + i);
+				const uint32_t hash = Hash(sequence);
+				const size_t candidate = table[hash];
+				table[hash] = (uint32_t)i;
+
+				if (candidate == UINT32_MAX || i - candidate > MAX_OFFSET || Read32(src + candidate) != sequence)
+				{
+					i++;
+					continue;
+				}
+
+				size_t matchLength = MIN_MATCH;
+				while (i + matchLength < matchEnd && src[candidate + matchLength] == src[i + matchLength])
+				{
+					matchLength++;
+				}
+
+				op = WriteSequence(op, opEnd, src + anchor, i - anchor, i - candidate, matchLength);
+				if (!op)
+				{
+					return 0;
+				}
+				i += matchLength;
+				anchor = i;
+			}
+		}
+
+		op = WriteSequence(op, opEnd, src + anchor, srcSize - anchor, 0, 0);
+		return op ? (size_t)(op - dst) : 0;
+	}
+
+	bool Lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+	{
+		const uint8_t* ip = src;
+		const uint8_t* ipEnd = src + srcSize;
+		uint8_t* op = dst;
+		uint8_t* opEnd = dst + dstSize;
+
+		while (ip < ipEnd)
+		{
+			const uint8_t token = *ip++;
+
+			size_t literalLength = token >> 4;
+			if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength))
+			{
+				return false;
+			}
+			if (literalLength > (size_t)(ipEnd - ip) || literalLength > (size_t)(opEnd - op))
+			{
+				return false;
+			}
+			if (literalLength)
+			{
+				memcpy(op, ip, literalLength);
+			}
+			ip += literalLength;
+			op += literalLength;
+
+			// the last sequence has no match
+			if (ip == ipEnd)
+			{
+				break;
+			}
+
+			if (ipEnd - ip < 2)
+			{
+				return false;
+			}
+			const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+			ip += 2;
+			if (!offset || offset > (size_t)(op - dst))
+			{
+				return false;
+			}
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength))
+			{
+				return false;
+			}
+			matchLength += MIN_MATCH;
+			if (matchLength > (size_t)(opEnd - op))
+			{
+				return false;
+			}
+
+			// the match may overlap what it produces, so byte by byte
+			const uint8_t* match = op - offset;
+			for (size_t i = 0; i < matchLength; i++)
+			{
+				op[i] = match[i];
+			}
+			op += matchLength;
+		}
+		return op == opEnd;
+	}
+} // namespace nfw
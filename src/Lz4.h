@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nfw
+{
+	// LZ4 block format (no frame header), enough to pack and read FileSystem archives.
+	// The compressor is the greedy single-probe variant: fast and a little behind the reference ratio.
+
+	// Worst case size of the compressed data
+	size_t Lz4CompressBound(size_t srcSize);
+
+	// Returns the compressed size, 0 when it does not fit in dstCapacity
+	size_t Lz4Compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity);
+
+	// Fails on malformed data or when it does not decompress to exactly dstSize bytes
+	bool Lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+} // namespace nfw
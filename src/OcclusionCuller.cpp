@@ -0,0 +1,460 @@
+#include "OcclusionCuller.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NFW_OCCLUSION_SSE2
+#endif
+
+namespace nfw
+{
+	constexpr uint32_t TILE_WIDTH = 32;
+	constexpr uint32_t TILE_HEIGHT = 16;
+	constexpr float NEAR_W_EPSILON = 1e-5f;
+
+	struct Occluder
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint16_t> indices;
+		glm::mat4 world;
+	};
+
+	// Screen space triangle with counter-clockwise (positive area) winding
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	class OcclusionCuller::Impl
+	{
+	public:
+		Impl(glm::uvec2 resolution)
+		{
+			// the rasterizer works on whole tiles, so round the buffer up to the tile size
+			m_resolution.x = std::max((resolution.x + TILE_WIDTH - 1) / TILE_WIDTH, 1u) * TILE_WIDTH;
+			m_resolution.y = std::max((resolution.y + TILE_HEIGHT - 1) / TILE_HEIGHT, 1u) * TILE_HEIGHT;
+			m_tileNum.x = m_resolution.x / TILE_WIDTH;
+			m_tileNum.y = m_resolution.y / TILE_HEIGHT;
+			m_tileBins.resize(m_tileNum.x * m_tileNum.y);
+
+			glm::uvec2 size = m_resolution;
+			while (true)
+			{
+				m_mipSizes.push_back(size);
+				m_mips.emplace_back(size.x * size.y, 1.0f);
+				if (size.x == 1 && size.y == 1)
+				{
+					break;
+				}
+				// round up, so the last row and column of an odd level still reach the coarser ones
+				size = { (size.x + 1) / 2, (size.y + 1) / 2 };
+			}
+		}
+		~Impl() {}
+
+		uint32_t AddOccluder(const glm::vec3* positions, uint32_t vertexNum, const uint16_t* indices, uint32_t indexNum, const glm::mat4& world)
+		{
+			Occluder occluder;
+			occluder.positions.assign(positions, positions + vertexNum);
+			occluder.indices.assign(indices, indices + indexNum);
+			occluder.world = world;
+			m_occluders.push_back(std::move(occluder));
+			return static_cast<uint32_t>(m_occluders.size() - 1);
+		}
+
+		void SetOccluderTransform(uint32_t occluderIndex, const glm::mat4& world)
+		{
+			m_occluders[occluderIndex].world = world;
+		}
+
+		void ClearOccluders()
+		{
+			m_occluders.clear();
+		}
+
+		void Rasterize(const glm::mat4& viewProjection)
+		{
+			m_viewProjection = viewProjection;
+			m_testedNum = 0;
+			m_culledNum = 0;
+
+			SetupTriangles();
+			BinTriangles();
+
+			const uint32_t tileNum = m_tileNum.x * m_tileNum.y;
+			ParallelFor(tileNum, 1, [this](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t tile = begin; tile < end; ++tile)
+				{
+					RasterizeTile(tile);
+				}
+			});
+
+			BuildHiZ();
+		}
+
+		bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) const
+		{
+			m_testedNum++;
+
+			const glm::mat4 mvp = m_viewProjection * world;
+			float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+			float maxX = -FLT_MAX, maxY = -FLT_MAX;
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				const glm::vec4 corner(
+					(i & 1) ? boundsMax.x : boundsMin.x,
+					(i & 2) ? boundsMax.y : boundsMin.y,
+					(i & 4) ? boundsMax.z : boundsMin.z,
+					1.0f);
+				const glm::vec4 clip = mvp * corner;
+
+				// the box crosses the near plane, treat it as visible
+				if (clip.w <= NEAR_W_EPSILON)
+				{
+					return true;
+				}
+
+				const float invW = 1.0f / clip.w;
+				const float x = (clip.x * invW * 0.5f + 0.5f) * m_resolution.x;
+				const float y = (0.5f - clip.y * invW * 0.5f) * m_resolution.y;
+				minX = std::min(minX, x);
+				maxX = std::max(maxX, x);
+				minY = std::min(minY, y);
+				maxY = std::max(maxY, y);
+				minZ = std::min(minZ, clip.z * invW);
+			}
+
+			if (maxX < 0.0f || maxY < 0.0f || minX >= m_resolution.x || minY >= m_resolution.y || minZ > 1.0f)
+			{
+				m_culledNum++;
+				return false;
+			}
+
+			if (m_triangles.empty())
+			{
+				return true;
+			}
+
+			// clamped while still float, a corner just in front of the near plane projects far outside the int range
+			const float maxPixelX = static_cast<float>(m_resolution.x - 1);
+			const float maxPixelY = static_cast<float>(m_resolution.y - 1);
+			const int32_t x0 = static_cast<int32_t>(std::clamp(minX, 0.0f, maxPixelX));
+			const int32_t y0 = static_cast<int32_t>(std::clamp(minY, 0.0f, maxPixelY));
+			const int32_t x1 = static_cast<int32_t>(std::clamp(maxX, 0.0f, maxPixelX));
+			const int32_t y1 = static_cast<int32_t>(std::clamp(maxY, 0.0f, maxPixelY));
+
+			// pick the mip where the footprint covers at most 3x3 texels
+			uint32_t mip = 0;
+			uint32_t extent = static_cast<uint32_t>(std::max(x1 - x0, y1 - y0));
+			while (extent > 2 && mip + 1 < m_mips.size())
+			{
+				extent >>= 1;
+				mip++;
+			}
+
+			const glm::uvec2 size = m_mipSizes[mip];
+			const std::vector<float>& depth = m_mips[mip];
+			const uint32_t mx0 = std::min(static_cast<uint32_t>(x0) >> mip, size.x - 1);
+			const uint32_t my0 = std::min(static_cast<uint32_t>(y0) >> mip, size.y - 1);
+			const uint32_t mx1 = std::min(static_cast<uint32_t>(x1) >> mip, size.x - 1);
+			const uint32_t my1 = std::min(static_cast<uint32_t>(y1) >> mip, size.y - 1);
+
+			float maxDepth = 0.0f;
+			for (uint32_t y = my0; y <= my1; ++y)
+			{
+				for (uint32_t x = mx0; x <= mx1; ++x)
+				{
+					maxDepth = std::max(maxDepth, depth[y * size.x + x]);
+				}
+			}
+
+			if (minZ > maxDepth)
+			{
+				m_culledNum++;
+				return false;
+			}
+			return true;
+		}
+
+		const float* GetDepth(uint32_t mip, glm::uvec2& size) const
+		{
+			size = m_mipSizes[mip];
+			return m_mips[mip].data();
+		}
+
+		uint32_t GetMipNum() const { return static_cast<uint32_t>(m_mips.size()); }
+
+		OcclusionStats GetStats() const
+		{
+			OcclusionStats stats;
+			stats.occluderTriangleNum = static_cast<uint32_t>(m_triangles.size());
+			stats.testedNum = m_testedNum;
+			stats.culledNum = m_culledNum;
+			return stats;
+		}
+
+	private:
+		void SetupTriangles()
+		{
+			m_triangles.clear();
+
+			const float width = static_cast<float>(m_resolution.x);
+			const float height = static_cast<float>(m_resolution.y);
+
+			for (const Occluder& occluder : m_occluders)
+			{
+				const glm::mat4 mvp = m_viewProjection * occluder.world;
+
+				m_clipPositions.resize(occluder.positions.size());
+				for (size_t i = 0; i < occluder.positions.size(); ++i)
+				{
+					m_clipPositions[i] = mvp * glm::vec4(occluder.positions[i], 1.0f);
+				}
+
+				for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+				{
+					ScreenTriangle tri;
+					bool clipped = false;
+					for (uint32_t v = 0; v < 3; ++v)
+					{
+						const glm::vec4& clip = m_clipPositions[occluder.indices[i + v]];
+						// occluders are never clipped, triangles touching the near plane are simply dropped
+						if (clip.w <= NEAR_W_EPSILON || clip.z < 0.0f)
+						{
+							clipped = true;
+							break;
+						}
+						const float invW = 1.0f / clip.w;
+						tri.x[v] = (clip.x * invW * 0.5f + 0.5f) * width;
+						tri.y[v] = (0.5f - clip.y * invW * 0.5f) * height;
+						tri.z[v] = clip.z * invW;
+					}
+					if (clipped)
+					{
+						continue;
+					}
+
+					const float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+					if (std::abs(area) < 1e-6f)
+					{
+						continue;
+					}
+					if (area < 0.0f)
+					{
+						std::swap(tri.x[1], tri.x[2]);
+						std::swap(tri.y[1], tri.y[2]);
+						std::swap(tri.z[1], tri.z[2]);
+					}
+
+					tri.minX = std::max(static_cast<int32_t>(std::floor(std::min({ tri.x[0], tri.x[1], tri.x[2] }))), 0);
+					tri.minY = std::max(static_cast<int32_t>(std::floor(std::min({ tri.y[0], tri.y[1], tri.y[2] }))), 0);
+					tri.maxX = std::min(static_cast<int32_t>(std::ceil(std::max({ tri.x[0], tri.x[1], tri.x[2] }))), static_cast<int32_t>(m_resolution.x));
+					tri.maxY = std::min(static_cast<int32_t>(std::ceil(std::max({ tri.y[0], tri.y[1], tri.y[2] }))), static_cast<int32_t>(m_resolution.y));
+					if (tri.minX >= tri.maxX || tri.minY >= tri.maxY)
+					{
+						continue;
+					}
+
+					m_triangles.push_back(tri);
+				}
+			}
+		}
+
+		void BinTriangles()
+		{
+			for (std::vector<uint32_t>& bin : m_tileBins)
+			{
+				bin.clear();
+			}
+
+			for (uint32_t i = 0, size = static_cast<uint32_t>(m_triangles.size()); i < size; ++i)
+			{
+				const ScreenTriangle& tri = m_triangles[i];
+				const uint32_t tx0 = tri.minX / TILE_WIDTH;
+				const uint32_t ty0 = tri.minY / TILE_HEIGHT;
+				const uint32_t tx1 = (tri.maxX - 1) / TILE_WIDTH;
+				const uint32_t ty1 = (tri.maxY - 1) / TILE_HEIGHT;
+				for (uint32_t ty = ty0; ty <= ty1; ++ty)
+				{
+					for (uint32_t tx = tx0; tx <= tx1; ++tx)
+					{
+						m_tileBins[ty * m_tileNum.x + tx].push_back(i);
+					}
+				}
+			}
+		}
+
+		void RasterizeTile(uint32_t tileIndex)
+		{
+			const int32_t tileX0 = (tileIndex % m_tileNum.x) * TILE_WIDTH;
+			const int32_t tileY0 = (tileIndex / m_tileNum.x) * TILE_HEIGHT;
+			const int32_t tileX1 = tileX0 + TILE_WIDTH;
+			const int32_t tileY1 = tileY0 + TILE_HEIGHT;
+			const uint32_t pitch = m_resolution.x;
+			float* depth = m_mips[0].data();
+
+			for (int32_t y = tileY0; y < tileY1; ++y)
+			{
+				std::fill_n(depth + y * pitch + tileX0, TILE_WIDTH, 1.0f);
+			}
+
+			for (uint32_t triIndex : m_tileBins[tileIndex])
+			{
+				const ScreenTriangle& tri = m_triangles[triIndex];
+
+				// edge functions, positive inside
+				const float a0 = tri.y[1] - tri.y[2], b0 = tri.x[2] - tri.x[1], c0 = tri.x[1] * tri.y[2] - tri.x[2] * tri.y[1];
+				const float a1 = tri.y[2] - tri.y[0], b1 = tri.x[0] - tri.x[2], c1 = tri.x[2] * tri.y[0] - tri.x[0] * tri.y[2];
+				const float a2 = tri.y[0] - tri.y[1], b2 = tri.x[1] - tri.x[0], c2 = tri.x[0] * tri.y[1] - tri.x[1] * tri.y[0];
+				const float invArea = 1.0f / (c0 + c1 + c2);
+
+				// depth plane
+				const float za = (a0 * tri.z[0] + a1 * tri.z[1] + a2 * tri.z[2]) * invArea;
+				const float zb = (b0 * tri.z[0] + b1 * tri.z[1] + b2 * tri.z[2]) * invArea;
+				const float zc = (c0 * tri.z[0] + c1 * tri.z[1] + c2 * tri.z[2]) * invArea;
+
+				const int32_t x0 = std::max(tri.minX, tileX0) & ~3;
+				const int32_t x1 = std::min(tri.maxX, tileX1);
+				const int32_t y0 = std::max(tri.minY, tileY0);
+				const int32_t y1 = std::min(tri.maxY, tileY1);
+
+#ifdef NFW_OCCLUSION_SSE2
+				const __m128 a0v = _mm_set1_ps(a0), a1v = _mm_set1_ps(a1), a2v = _mm_set1_ps(a2);
+				const __m128 zav = _mm_set1_ps(za);
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+				for (int32_t y = y0; y < y1; ++y)
+				{
+					const float py = y + 0.5f;
+					const __m128 row0 = _mm_set1_ps(b0 * py + c0);
+					const __m128 row1 = _mm_set1_ps(b1 * py + c1);
+					const __m128 row2 = _mm_set1_ps(b2 * py + c2);
+					const __m128 rowZ = _mm_set1_ps(zb * py + zc);
+					float* depthRow = depth + y * pitch;
+
+					for (int32_t x = x0; x < x1; x += 4)
+					{
+						const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffset);
+						const __m128 e0 = _mm_add_ps(_mm_mul_ps(a0v, px), row0);
+						const __m128 e1 = _mm_add_ps(_mm_mul_ps(a1v, px), row1);
+						const __m128 e2 = _mm_add_ps(_mm_mul_ps(a2v, px), row2);
+						const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+						if (_mm_movemask_ps(inside) == 0)
+						{
+							continue;
+						}
+
+						const __m128 z = _mm_add_ps(_mm_mul_ps(zav, px), rowZ);
+						const __m128 current = _mm_loadu_ps(depthRow + x);
+						const __m128 closest = _mm_min_ps(current, z);
+						_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, current)));
+					}
+				}
+#else
+				for (int32_t y = y0; y < y1; ++y)
+				{
+					const float py = y + 0.5f;
+					float* depthRow = depth + y * pitch;
+					for (int32_t x = x0; x < x1; ++x)
+					{
+						const float px = x + 0.5f;
+						if (a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f || a2 * px + b2 * py + c2 < 0.0f)
+						{
+							continue;
+						}
+						depthRow[x] = std::min(depthRow[x], za * px + zb * py + zc);
+					}
+				}
+#endif
+			}
+		}
+
+		void BuildHiZ()
+		{
+			for (size_t mip = 1; mip < m_mips.size(); ++mip)
+			{
+				const glm::uvec2 srcSize = m_mipSizes[mip - 1];
+				const glm::uvec2 dstSize = m_mipSizes[mip];
+				const float* src = m_mips[mip - 1].data();
+				float* dst = m_mips[mip].data();
+
+				ParallelFor(dstSize.y, 16, [=](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t y = begin; y < end; ++y)
+					{
+						const uint32_t sy0 = std::min(y * 2, srcSize.y - 1);
+						const uint32_t sy1 = std::min(y * 2 + 1, srcSize.y - 1);
+						for (uint32_t x = 0; x < dstSize.x; ++x)
+						{
+							const uint32_t sx0 = std::min(x * 2, srcSize.x - 1);
+							const uint32_t sx1 = std::min(x * 2 + 1, srcSize.x - 1);
+							dst[y * dstSize.x + x] = std::max(
+								std::max(src[sy0 * srcSize.x + sx0], src[sy0 * srcSize.x + sx1]),
+								std::max(src[sy1 * srcSize.x + sx0], src[sy1 * srcSize.x + sx1]));
+						}
+					}
+				});
+			}
+		}
+
+	private:
+		glm::uvec2 m_resolution;
+		glm::uvec2 m_tileNum;
+		glm::mat4 m_viewProjection = glm::mat4(1.0f);
+
+		std::vector<Occluder> m_occluders;
+		std::vector<glm::vec4> m_clipPositions;
+		std::vector<ScreenTriangle> m_triangles;
+		std::vector<std::vector<uint32_t>> m_tileBins;
+
+		std::vector<glm::uvec2> m_mipSizes;
+		std::vector<std::vector<float>> m_mips;
+
+		mutable std::atomic<uint32_t> m_testedNum = 0;
+		mutable std::atomic<uint32_t> m_culledNum = 0;
+	};
+
+	// constructor
+	OcclusionCuller::OcclusionCuller(glm::uvec2 resolution)
+		: m_impl(std::make_unique<Impl>(resolution))
+	{
+	}
+
+	// destructor
+	OcclusionCuller::~OcclusionCuller()
+	{
+	}
+
+	uint32_t OcclusionCuller::AddOccluder(const glm::vec3* positions, uint32_t vertexNum, const uint16_t* indices, uint32_t indexNum, const glm::mat4& world)
+	{
+		return m_impl->AddOccluder(positions, vertexNum, indices, indexNum, world);
+	}
+
+	void OcclusionCuller::SetOccluderTransform(uint32_t occluderIndex, const glm::mat4& world) { m_impl->SetOccluderTransform(occluderIndex, world); }
+
+	void OcclusionCuller::ClearOccluders() { m_impl->ClearOccluders(); }
+
+	void OcclusionCuller::Rasterize(const glm::mat4& viewProjection) { m_impl->Rasterize(viewProjection); }
+
+	bool OcclusionCuller::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) const
+	{
+		return m_impl->IsVisible(boundsMin, boundsMax, world);
+	}
+
+	const float* OcclusionCuller::GetDepth(uint32_t mip, glm::uvec2& size) const { return m_impl->GetDepth(mip, size); }
+
+	uint32_t OcclusionCuller::GetMipNum() const { return m_impl->GetMipNum(); }
+
+	OcclusionStats OcclusionCuller::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
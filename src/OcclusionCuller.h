@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct OcclusionStats
+	{
+		uint32_t occluderTriangleNum = 0;
+		uint32_t testedNum = 0;
+		uint32_t culledNum = 0;
+	};
+
+	// CPU occlusion culling.
+	// Occluder meshes are rasterized into a small depth buffer by a tile-binned SIMD rasterizer,
+	// and object bounds are tested against a hierarchical-Z pyramid built from it.
+	class OcclusionCuller
+	{
+		DISALLOW_COPY_AND_ASSIGN(OcclusionCuller);
+	public:
+		OcclusionCuller(glm::uvec2 resolution = { 256, 128 });
+		~OcclusionCuller();
+
+		uint32_t AddOccluder(const glm::vec3* positions, uint32_t vertexNum, const uint16_t* indices, uint32_t indexNum, const glm::mat4& world);
+		void SetOccluderTransform(uint32_t occluderIndex, const glm::mat4& world);
+		void ClearOccluders();
+
+		// Rasterizes all occluders and rebuilds the Hi-Z pyramid.
+		void Rasterize(const glm::mat4& viewProjection);
+
+		// Returns false if the box is completely hidden behind the occluders or outside the screen.
+		bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) const;
+
+		const float* GetDepth(uint32_t mip, glm::uvec2& size) const;
+		uint32_t GetMipNum() const;
+
+		OcclusionStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "JobSystem.h"
+
+namespace nfw
+{
+	// While one is alive, ParallelFor on this thread runs every chunk itself instead of spreading them over the
+	// job system; nested calls from those chunks stay on the thread too. Lets a benchmark measure per-thread
+	// scaling of code that parallelizes internally, like the image decoders.
+	class SerialScope
+	{
+	public:
+		SerialScope() { s_depth++; }
+		~SerialScope() { s_depth--; }
+
+		SerialScope(const SerialScope&) = delete;
+		void operator=(const SerialScope&) = delete;
+
+		static bool IsActive() { return s_depth != 0; }
+
+	private:
+		static inline thread_local uint32_t s_depth = 0;
+	};
+
+	// Splits [0, count) into chunks of grainSize and runs func(begin, end) for each chunk on the job system.
+	// The calling thread runs the first chunk and then helps with the rest until all are done.
+	template <typename Func>
+	void ParallelFor(uint32_t count, uint32_t grainSize, Func&& func)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		grainSize = std::max(grainSize, 1u);
+		const uint32_t chunkNum = (count + grainSize - 1) / grainSize;
+		if (chunkNum == 1 || JobSystem::GetWorkerNum() == 0 || SerialScope::IsActive())
+		{
+			func(0u, count);
+			return;
+		}
+
+		JobCounter counter;
+		for (uint32_t chunk = 1; chunk < chunkNum; chunk++)
+		{
+			JobSystem::Run([&func, chunk, grainSize, count]()
+			{
+				const uint32_t begin = chunk * grainSize;
+				func(begin, std::min(begin + grainSize, count));
+			}, &counter);
+		}
+
+		func(0u, std::min(grainSize, count));
+		JobSystem::Wait(counter);
+	}
+} // namespace nfw
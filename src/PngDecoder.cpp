@@ -0,0 +1,665 @@
+#include "ImageDecoder.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace nfw
+{
+	namespace
+	{
+		constexpr uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		constexpr uint64_t MAX_PIXEL_NUM = 1ull << 28;
+
+		uint32_t ReadBigEndian32(const uint8_t* p)
+		{
+			return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+		}
+
+		// Deflate bit stream, least significant bit first. Reads zeros past the end, which the callers catch as overruns.
+		class BitReader
+		{
+		public:
+			BitReader(const uint8_t* begin, const uint8_t* end) : m_p(begin), m_end(end) {}
+
+			uint32_t Peek(uint32_t bitNum)
+			{
+				Fill();
+				return (uint32_t)(m_buffer & ((1ull << bitNum) - 1));
+			}
+
+			void Skip(uint32_t bitNum)
+			{
+				m_buffer >>= bitNum;
+				m_bitNum -= bitNum;
+				m_consumed += bitNum;
+			}
+
+			uint32_t Read(uint32_t bitNum)
+			{
+				const uint32_t value = Peek(bitNum);
+				Skip(bitNum);
+				return value;
+			}
+
+			void AlignToByte() { Skip(m_bitNum & 7); }
+
+			// stored blocks are copied byte by byte past the buffered bits
+			bool CopyBytes(uint8_t* dst, uint32_t size)
+			{
+				for (; size && m_bitNum; size--)
+				{
+					*dst++ = (uint8_t)m_buffer;
+					Skip(8);
+				}
+				if (IsOverrun() || (size_t)(m_end - m_p) < size)
+				{
+					return false;
+				}
+				memcpy(dst, m_p, size);
+				m_p += size;
+				m_consumed += (uint64_t)size * 8;
+				return true;
+			}
+
+			bool IsOverrun() const { return m_consumed > m_total; }
+
+		private:
+			void Fill()
+			{
+				while (m_bitNum <= 56)
+				{
+					const uint64_t byte = (m_p < m_end) ? *m_p++ : 0;
+					m_buffer |= byte << m_bitNum;
+					m_bitNum += 8;
+				}
+			}
+
+			const uint8_t* m_p;
+			const uint8_t* m_end;
+			uint64_t m_buffer = 0;
+			uint32_t m_bitNum = 0;
+			uint64_t m_consumed = 0;
+			const uint64_t m_total = (uint64_t)(m_end - m_p) * 8;
+		};
+
+		constexpr uint32_t FAST_BITS = 10;
+
+		// Canonical code: short codes are looked up by their reversed bits, longer ones walked length by length
+		struct Huffman
+		{
+			std::array<uint16_t, 1 << FAST_BITS> fast;  // symbol << 4 | length, 0 for longer codes
+			std::array<uint16_t, 16> counts;
+			std::array<uint16_t, 288> symbols;          // ordered by code
+
+			bool Build(const uint8_t* lengths, uint32_t symbolNum)
+			{
+				fast.fill(0);
+				counts.fill(0);
+				for (uint32_t i = 0; i < symbolNum; i++)
+				{
+					counts[lengths[i]]++;
+				}
+				counts[0] = 0;
+
+				std::array<uint16_t, 16> offsets;
+				std::array<uint32_t, 16> nextCode;
+				uint32_t code = 0;
+				uint32_t offset = 0;
+				for (uint32_t length = 1; length < 16; length++)
+				{
+					offsets[length] = (uint16_t)offset;
+					nextCode[length] = code;
+					offset += counts[length];
+					code = (code + counts[length]) << 1;
+					if (nextCode[length] + counts[length] > (1u << length))
+					{
+						return false;
+					}
+				}
+
+				for (uint32_t symbol = 0; symbol < symbolNum; symbol++)
+				{
+					const uint32_t length = lengths[symbol];
+					if (!length)
+					{
+						continue;
+					}
+					symbols[offsets[length]++] = (uint16_t)symbol;
+
+					const uint32_t symbolCode = nextCode[length]++;
+					if (length <= FAST_BITS)
+					{
+						uint32_t reversed = 0;
+						for (uint32_t i = 0; i < length; i++)
+						{
+							reversed |= ((symbolCode >> i) & 1) << (length - 1 - i);
+						}
+						for (uint32_t i = reversed; i < (1u << FAST_BITS); i += 1u << length)
+						{
+							fast[i] = (uint16_t)(symbol << 4 | length);
+						}
+					}
+				}
+				return true;
+			}
+
+			int32_t Decode(BitReader& reader) const
+			{
+				const uint32_t bits = reader.Peek(15);
+				const uint32_t entry = fast[bits & ((1u << FAST_BITS) - 1)];
+				if (entry)
+				{
+					reader.Skip(entry & 15);
+					return entry >> 4;
+				}
+
+				int32_t code = 0;
+				int32_t first = 0;
+				int32_t index = 0;
+				for (uint32_t length = 1; length < 16; length++)
+				{
+					code |= (bits >> (length - 1)) & 1;
+					const int32_t count = counts[length];
+					if (code - first < count)
+					{
+						reader.Skip(length);
+						return symbols[index + code - first];
+					}
+					index += count;
+					first = (first + count) << 1;
+					code <<= 1;
+				}
+				return -1;
+			}
+		};
+
+		constexpr uint16_t LENGTH_BASES[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		constexpr uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		constexpr uint16_t DISTANCE_BASES[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		constexpr uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		bool InflateCodes(BitReader& reader, const Huffman& literals, const Huffman& distances, uint8_t* dst, size_t dstSize, size_t& position)
+		{
+			for (;;)
+			{
+				const int32_t symbol = literals.Decode(reader);
+				if (symbol < 0 || reader.IsOverrun())
+				{
+					return false;
+				}
+				if (symbol < 256)
+				{
+					if (position == dstSize)
+					{
+						return false;
+					}
+					dst[position++] = (uint8_t)symbol;
+					continue;
+				}
+				if (symbol == 256)
+				{
+					return true;
+				}
+
+				const uint32_t lengthSymbol = (uint32_t)symbol - 257;
+				if (lengthSymbol >= 29)
+				{
+					return false;
+				}
+				const size_t length = LENGTH_BASES[lengthSymbol] + reader.Read(LENGTH_EXTRA_BITS[lengthSymbol]);
+
+				const int32_t distanceSymbol = distances.Decode(reader);
+				if (distanceSymbol < 0 || distanceSymbol >= 30)
+				{
+					return false;
+				}
+				const size_t distance = DISTANCE_BASES[distanceSymbol] + reader.Read(DISTANCE_EXTRA_BITS[distanceSymbol]);
+				if (distance > position || length > dstSize - position)
+				{
+					return false;
+				}
+
+				// overlapping copies repeat the last bytes
+				const uint8_t* src = dst + position - distance;
+				uint8_t* out = dst + position;
+				for (size_t i = 0; i < length; i++)
+				{
+					out[i] = src[i];
+				}
+				position += length;
+			}
+		}
+
+		// zlib stream to exactly dstSize bytes, the checksum is not verified
+		bool Inflate(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+		{
+			NFW_TRACE_SCOPE("Inflate");
+
+			if (srcSize < 2 || (src[0] & 15) != 8 || (src[0] << 8 | src[1]) % 31 || (src[1] & 0x20))
+			{
+				return false;
+			}
+
+			BitReader reader(src + 2, src + srcSize);
+			std::unique_ptr<Huffman[]> huffmans = std::make_unique<Huffman[]>(2);
+			Huffman& literals = huffmans[0];
+			Huffman& distances = huffmans[1];
+			size_t position = 0;
+
+			bool last = false;
+			while (!last)
+			{
+				last = reader.Read(1);
+				const uint32_t type = reader.Read(2);
+				if (type == 0)
+				{
+					reader.AlignToByte();
+					const uint32_t length = reader.Read(16);
+					const uint32_t inverse = reader.Read(16);
+					if ((length ^ 0xFFFF) != inverse || length > dstSize - position || !reader.CopyBytes(dst + position, length))
+					{
+						return false;
+					}
+					position += length;
+					continue;
+				}
+
+				std::array<uint8_t, 288 + 32> lengths = {};
+				if (type == 1)
+				{
+					std::fill(lengths.begin(), lengths.begin() + 144, 8);
+					std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+					std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+					std::fill(lengths.begin() + 280, lengths.begin() + 288, 8);
+					std::fill(lengths.begin() + 288, lengths.end(), 5);
+					literals.Build(lengths.data(), 288);
+					distances.Build(lengths.data() + 288, 30);
+				}
+				else if (type == 2)
+				{
+					const uint32_t literalNum = reader.Read(5) + 257;
+					const uint32_t distanceNum = reader.Read(5) + 1;
+					const uint32_t codeLengthNum = reader.Read(4) + 4;
+					if (literalNum > 286 || distanceNum > 30)
+					{
+						return false;
+					}
+
+					std::array<uint8_t, 19> codeLengths = {};
+					for (uint32_t i = 0; i < codeLengthNum; i++)
+					{
+						codeLengths[CODE_LENGTH_ORDER[i]] = (uint8_t)reader.Read(3);
+					}
+					Huffman& codeLengthCode = literals;
+					if (!codeLengthCode.Build(codeLengths.data(), 19))
+					{
+						return false;
+					}
+
+					// literal and distance lengths form one sequence, repeats may cross between them
+					for (uint32_t i = 0; i < literalNum + distanceNum;)
+					{
+						const int32_t symbol = codeLengthCode.Decode(reader);
+						if (symbol < 0 || reader.IsOverrun())
+						{
+							return false;
+						}
+						if (symbol < 16)
+						{
+							lengths[i++] = (uint8_t)symbol;
+							continue;
+						}
+
+						uint8_t value = 0;
+						uint32_t repeat = 0;
+						if (symbol == 16)
+						{
+							if (!i)
+							{
+								return false;
+							}
+							value = lengths[i - 1];
+							repeat = 3 + reader.Read(2);
+						}
+						else if (symbol == 17)
+						{
+							repeat = 3 + reader.Read(3);
+						}
+						else
+						{
+							repeat = 11 + reader.Read(7);
+						}
+						if (i + repeat > literalNum + distanceNum)
+						{
+							return false;
+						}
+						std::fill(lengths.begin() + i, lengths.begin() + i + repeat, value);
+						i += repeat;
+					}
+
+					// the distances follow the literals in the same array, moved to their fixed place
+					std::array<uint8_t, 30> distanceLengths = {};
+					std::copy(lengths.begin() + literalNum, lengths.begin() + literalNum + distanceNum, distanceLengths.begin());
+					if (!literals.Build(lengths.data(), literalNum) || !distances.Build(distanceLengths.data(), distanceNum))
+					{
+						return false;
+					}
+				}
+				else
+				{
+					return false;
+				}
+
+				if (!InflateCodes(reader, literals, distances, dst, dstSize, position))
+				{
+					return false;
+				}
+			}
+			return position == dstSize;
+		}
+
+		uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c)
+		{
+			const int32_t p = a + b - c;
+			const int32_t pa = std::abs(p - a);
+			const int32_t pb = std::abs(p - b);
+			const int32_t pc = std::abs(p - c);
+			return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+		}
+
+		// Each row starts with its filter type and predicts from the row above, which is already unfiltered
+		bool Unfilter(uint8_t* data, uint32_t rowSize, uint32_t height, uint32_t pixelSize)
+		{
+			std::vector<uint8_t> zeroRow(rowSize, 0);
+			const uint8_t* previous = zeroRow.data();
+			for (uint32_t y = 0; y < height; y++)
+			{
+				const uint8_t filter = data[(size_t)y * (rowSize + 1)];
+				uint8_t* row = data + (size_t)y * (rowSize + 1) + 1;
+				switch (filter)
+				{
+				case 0:
+					break;
+				case 1:
+					for (uint32_t x = pixelSize; x < rowSize; x++)
+					{
+						row[x] = (uint8_t)(row[x] + row[x - pixelSize]);
+					}
+					break;
+				case 2:
+					for (uint32_t x = 0; x < rowSize; x++)
+					{
+						row[x] = (uint8_t)(row[x] + previous[x]);
+					}
+					break;
+				case 3:
+					for (uint32_t x = 0; x < rowSize; x++)
+					{
+						const uint32_t left = x >= pixelSize ? row[x - pixelSize] : 0;
+						row[x] = (uint8_t)(row[x] + ((left + previous[x]) >> 1));
+					}
+					break;
+				case 4:
+					for (uint32_t x = 0; x < rowSize; x++)
+					{
+						const uint8_t left = x >= pixelSize ? row[x - pixelSize] : 0;
+						const uint8_t upperLeft = x >= pixelSize ? previous[x - pixelSize] : 0;
+						row[x] = (uint8_t)(row[x] + Paeth(left, previous[x], upperLeft));
+					}
+					break;
+				default:
+					return false;
+				}
+				previous = row;
+			}
+			return true;
+		}
+
+		struct PngHeader
+		{
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t bitDepth = 0;
+			uint32_t colorType = 0;
+			uint32_t channelNum = 0;
+			bool interlaced = false;
+			std::array<uint8_t, 256 * 4> palette = {};
+			std::array<uint16_t, 3> transparentKey = {};
+			bool hasTransparentKey = false;
+		};
+
+		uint32_t GetRowSize(const PngHeader& header, uint32_t width)
+		{
+			return (uint32_t)(((uint64_t)width * header.channelNum * header.bitDepth + 7) / 8);
+		}
+
+		// one sample scaled to 8 bits, 16 bit samples keep their high byte
+		uint32_t ReadSample(const uint8_t* row, uint32_t index, uint32_t bitDepth)
+		{
+			switch (bitDepth)
+			{
+			case 16:
+				return row[index * 2];
+			case 8:
+				return row[index];
+			default:
+			{
+				const uint32_t bitOffset = index * bitDepth;
+				return (row[bitOffset / 8] >> (8 - bitDepth - bitOffset % 8)) & ((1u << bitDepth) - 1);
+			}
+			}
+		}
+
+		uint32_t ReadRawSample(const uint8_t* row, uint32_t index, uint32_t bitDepth)
+		{
+			return bitDepth == 16 ? (uint32_t)(row[index * 2] << 8 | row[index * 2 + 1]) : ReadSample(row, index, bitDepth);
+		}
+
+		// unfiltered rows of one pass to RGBA, its pixels land every stepX / stepY pixels of the image
+		void ConvertPass(const PngHeader& header, const uint8_t* data, uint32_t width, uint32_t height, uint32_t x0, uint32_t y0, uint32_t stepX, uint32_t stepY, DecodedImage& image)
+		{
+			const uint32_t rowSize = GetRowSize(header, width);
+			const uint32_t depth = header.bitDepth;
+			const uint32_t gradeScale = depth < 8 ? 255 / ((1u << depth) - 1) : 1;
+
+			ParallelFor(height, 64, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t y = begin; y < end; y++)
+				{
+					const uint8_t* row = data + (size_t)y * (rowSize + 1) + 1;
+					uint8_t* dst = image.pixels.data() + ((size_t)(y0 + y * stepY) * header.width + x0) * 4;
+					for (uint32_t x = 0; x < width; x++, dst += stepX * 4)
+					{
+						const uint32_t c = x * header.channelNum;
+						switch (header.colorType)
+						{
+						case 0:
+						{
+							const uint8_t gray = (uint8_t)(ReadSample(row, c, depth) * gradeScale);
+							dst[0] = dst[1] = dst[2] = gray;
+							dst[3] = (header.hasTransparentKey && ReadRawSample(row, c, depth) == header.transparentKey[0]) ? 0 : 0xFF;
+							break;
+						}
+						case 2:
+							dst[0] = (uint8_t)ReadSample(row, c, depth);
+							dst[1] = (uint8_t)ReadSample(row, c + 1, depth);
+							dst[2] = (uint8_t)ReadSample(row, c + 2, depth);
+							dst[3] = (header.hasTransparentKey && ReadRawSample(row, c, depth) == header.transparentKey[0]
+								&& ReadRawSample(row, c + 1, depth) == header.transparentKey[1] && ReadRawSample(row, c + 2, depth) == header.transparentKey[2]) ? 0 : 0xFF;
+							break;
+						case 3:
+							memcpy(dst, header.palette.data() + ReadSample(row, c, depth) * 4, 4);
+							break;
+						case 4:
+							dst[0] = dst[1] = dst[2] = (uint8_t)ReadSample(row, c, depth);
+							dst[3] = (uint8_t)ReadSample(row, c + 1, depth);
+							break;
+						default:
+							dst[0] = (uint8_t)ReadSample(row, c, depth);
+							dst[1] = (uint8_t)ReadSample(row, c + 1, depth);
+							dst[2] = (uint8_t)ReadSample(row, c + 2, depth);
+							dst[3] = (uint8_t)ReadSample(row, c + 3, depth);
+							break;
+						}
+					}
+				}
+			});
+		}
+
+		bool ReadHeader(const uint8_t* p, uint32_t size, PngHeader& header)
+		{
+			if (size != 13)
+			{
+				return false;
+			}
+			header.width = ReadBigEndian32(p);
+			header.height = ReadBigEndian32(p + 4);
+			header.bitDepth = p[8];
+			header.colorType = p[9];
+			header.interlaced = p[12] == 1;
+
+			static constexpr uint32_t CHANNEL_NUMS[7] = { 1, 0, 3, 1, 2, 0, 4 };
+			header.channelNum = header.colorType < 7 ? CHANNEL_NUMS[header.colorType] : 0;
+
+			const uint32_t depth = header.bitDepth;
+			const bool validDepth = (depth == 8 || depth == 16) || (depth < 8 && (header.colorType == 0 || header.colorType == 3) && (depth == 1 || depth == 2 || depth == 4));
+			return header.width && header.height && (uint64_t)header.width * header.height <= MAX_PIXEL_NUM && header.channelNum && validDepth
+				&& !(header.colorType == 3 && depth == 16) && p[10] == 0 && p[11] == 0 && p[12] <= 1;
+		}
+	}
+
+	bool DecodePng(const uint8_t* data, size_t size, DecodedImage& image)
+	{
+		NFW_TRACE_SCOPE("DecodePng");
+
+		if (size < 8 || memcmp(data, PNG_SIGNATURE, 8))
+		{
+			return false;
+		}
+
+		PngHeader header;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			header.palette[i * 4 + 3] = 0xFF;
+		}
+
+		std::vector<uint8_t> compressed;
+		bool headerRead = false;
+		for (const uint8_t* p = data + 8; p + 12 <= data + size;)
+		{
+			const uint32_t length = ReadBigEndian32(p);
+			const uint8_t* type = p + 4;
+			const uint8_t* chunk = p + 8;
+			if (length > (size_t)(data + size - chunk) - 4)
+			{
+				return false;
+			}
+			p = chunk + length + 4;
+
+			if (!memcmp(type, "IHDR", 4))
+			{
+				if (!ReadHeader(chunk, length, header))
+				{
+					return false;
+				}
+				headerRead = true;
+			}
+			else if (!memcmp(type, "PLTE", 4))
+			{
+				for (uint32_t i = 0; i < std::min(length / 3, 256u); i++)
+				{
+					memcpy(header.palette.data() + i * 4, chunk + i * 3, 3);
+				}
+			}
+			else if (!memcmp(type, "tRNS", 4))
+			{
+				if (header.colorType == 3)
+				{
+					for (uint32_t i = 0; i < std::min(length, 256u); i++)
+					{
+						header.palette[i * 4 + 3] = chunk[i];
+					}
+				}
+				else if (length >= 2 * header.channelNum)
+				{
+					for (uint32_t i = 0; i < header.channelNum; i++)
+					{
+						header.transparentKey[i] = (uint16_t)(chunk[i * 2] << 8 | chunk[i * 2 + 1]);
+					}
+					header.hasTransparentKey = true;
+				}
+			}
+			else if (!memcmp(type, "IDAT", 4))
+			{
+				compressed.insert(compressed.end(), chunk, chunk + length);
+			}
+			else if (!memcmp(type, "IEND", 4))
+			{
+				break;
+			}
+		}
+		if (!headerRead || compressed.empty())
+		{
+			return false;
+		}
+
+		// Adam7 passes: first pixel and spacing of each, a plain image is a single pass over everything
+		struct Pass
+		{
+			uint32_t x0, y0, stepX, stepY;
+		};
+		static constexpr Pass ADAM7[7] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+		static constexpr Pass FULL[1] = { { 0, 0, 1, 1 } };
+		const Pass* passes = header.interlaced ? ADAM7 : FULL;
+		const uint32_t passNum = header.interlaced ? 7 : 1;
+
+		const uint32_t pixelSize = std::max(header.channelNum * header.bitDepth / 8, 1u);
+		size_t filteredSize = 0;
+		for (uint32_t i = 0; i < passNum; i++)
+		{
+			const uint32_t width = (header.width + passes[i].stepX - 1 - passes[i].x0) / passes[i].stepX;
+			const uint32_t height = (header.height + passes[i].stepY - 1 - passes[i].y0) / passes[i].stepY;
+			if (header.width > passes[i].x0 && header.height > passes[i].y0)
+			{
+				filteredSize += (size_t)height * (GetRowSize(header, width) + 1);
+			}
+		}
+
+		std::vector<uint8_t> filtered(filteredSize);
+		if (!Inflate(compressed.data(), compressed.size(), filtered.data(), filtered.size()))
+		{
+			return false;
+		}
+
+		image.width = header.width;
+		image.height = header.height;
+		image.scaleShift = 0;
+		image.pixels.resize((size_t)header.width * header.height * 4);
+
+		uint8_t* passData = filtered.data();
+		for (uint32_t i = 0; i < passNum; i++)
+		{
+			const Pass& pass = passes[i];
+			if (header.width <= pass.x0 || header.height <= pass.y0)
+			{
+				continue;
+			}
+			const uint32_t width = (header.width + pass.stepX - 1 - pass.x0) / pass.stepX;
+			const uint32_t height = (header.height + pass.stepY - 1 - pass.y0) / pass.stepY;
+			const uint32_t rowSize = GetRowSize(header, width);
+			if (!Unfilter(passData, rowSize, height, pixelSize))
+			{
+				return false;
+			}
+			ConvertPass(header, passData, width, height, pass.x0, pass.y0, pass.stepX, pass.stepY, image);
+			passData += (size_t)height * (rowSize + 1);
+		}
+		return true;
+	}
+} // namespace nfw
@@ -0,0 +1,384 @@
+#include "ResidencyManager.h"
+#include "Texture.h"
+#include "TextureStorage.h"
+#include "TextureHeap.h"
+#include "UploadQueue.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+namespace nfw
+{
+	namespace
+	{
+		struct Slot
+		{
+			TextureHandle texture;
+			uint64_t lastUsedFrame = 0;     // frame index + 1, 0 is never
+			uint64_t pendingBytes = 0;      // of the restage in flight
+			bool pending = false;
+		};
+
+		// A texture created and uploaded on a job thread, swapped in by Update.
+		// The file is decoded into an image of the restage, the storage is only read on the frame thread.
+		struct Restage
+		{
+			TextureHandle texture;
+			uint32_t mipOffset = 0;
+			std::string path;
+			nri::TextureDesc textureDesc = {};     // of the full image
+			std::unique_ptr<Texture> image;
+			nri::Texture* staged = nullptr;
+			TextureMemory memory;
+			Task<nri::Result> task;
+		};
+
+		struct Candidate
+		{
+			TextureHandle texture;
+			uint64_t lastUsedFrame;
+		};
+
+		nri::TextureDesc GetMipDesc(const nri::TextureDesc& textureDesc, uint32_t mipOffset)
+		{
+			nri::TextureDesc mipDesc = textureDesc;
+			mipDesc.width = (nri::Dim_t)std::max(textureDesc.width >> mipOffset, 1);
+			mipDesc.height = (nri::Dim_t)std::max(textureDesc.height >> mipOffset, 1);
+			mipDesc.mipNum = (nri::Mip_t)(textureDesc.mipNum - mipOffset);
+			return mipDesc;
+		}
+	}
+
+	class ResidencyManager::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, TextureStoragePtr textureStorage, UploadQueuePtr uploadQueue, const ResidencyManagerDesc& desc)
+			: NRI(nri)
+			, m_device(device)
+			, m_storage(textureStorage)
+			, m_uploadQueue(uploadQueue)
+			, m_desc(desc)
+			, m_slots(textureStorage->GetCapacity())
+		{
+			m_candidates.reserve(m_slots.size());
+		}
+
+		~Impl()
+		{
+			for (std::unique_ptr<Restage>& restage : m_restages)
+			{
+				m_uploadQueue->Wait(restage->task);
+				DestroyStaged(*restage);
+			}
+		}
+
+		void MarkUsed(TextureHandle texture, uint64_t frameIndex)
+		{
+			GetSlot(texture).lastUsedFrame = frameIndex + 1;
+		}
+
+		void Update(uint64_t frameIndex)
+		{
+			NFW_TRACE_SCOPE("ResidencyManager::Update");
+
+			if (m_firstFrame == UINT64_MAX)
+			{
+				m_firstFrame = frameIndex;
+			}
+
+			InstallRestages();
+
+			const TextureMemoryStats memoryStats = m_storage->GetMemoryStats();
+			m_stats.residentBytes = memoryStats.gpuBytes;
+			m_stats.budget = GetBudget(memoryStats.gpuBytes);
+
+			// planned usage: a texture being restaged counts with the size it is about to have
+			uint64_t bytes = m_stats.residentBytes;
+			for (const std::unique_ptr<Restage>& restage : m_restages)
+			{
+				bytes -= std::min(m_storage->GetMemoryStats(restage->texture).gpuBytes, bytes);
+				bytes += GetSlot(restage->texture).pendingBytes;
+			}
+
+			// least recently used first
+			m_candidates.clear();
+			m_storage->ForEach([this](TextureHandle texture) { m_candidates.push_back({ texture, GetSlot(texture).lastUsedFrame }); });
+			std::sort(m_candidates.begin(), m_candidates.end(), [](const Candidate& a, const Candidate& b) { return a.lastUsedFrame < b.lastUsedFrame; });
+
+			// bytes the recently used textures are missing for their full mip chain, and for their last mip when evicted
+			uint64_t wantedBytes = 0;
+			uint64_t missingBytes = 0;
+			for (const Candidate& candidate : m_candidates)
+			{
+				const Slot& slot = GetSlot(candidate.texture);
+				if (!IsRecentlyUsed(slot, frameIndex) || slot.pending)
+				{
+					continue;
+				}
+				if (!m_storage->GetTexture(candidate.texture))
+				{
+					wantedBytes += GetMemorySize(candidate.texture, 0);
+					missingBytes += GetMemorySize(candidate.texture, m_storage->GetTextureDesc(candidate.texture).mipNum - 1);
+				}
+				else if (m_storage->GetMipOffset(candidate.texture))
+				{
+					wantedBytes += GetMemorySize(candidate.texture, 0) - m_storage->GetMemoryStats(candidate.texture).gpuBytes;
+				}
+			}
+
+			// idle textures make room for the ones being drawn, the deletion queue covers frames still in flight
+			for (const Candidate& candidate : m_candidates)
+			{
+				const Slot& slot = GetSlot(candidate.texture);
+				if (bytes + wantedBytes <= m_stats.budget || IsRecentlyUsed(slot, frameIndex))
+				{
+					break;
+				}
+
+				const uint64_t residentBytes = m_storage->GetMemoryStats(candidate.texture).gpuBytes;
+				if (!slot.pending && residentBytes && !m_storage->IsPinned(candidate.texture)
+					&& m_storage->ReplaceTexture(candidate.texture, nullptr, {}, 0) == nri::Result::SUCCESS)
+				{
+					bytes -= residentBytes;
+					m_stats.evictionNum++;
+				}
+			}
+
+			uint32_t restageNum = 0;
+			if (bytes + missingBytes > m_stats.budget)
+			{
+				// still over with only drawn textures left, the least recently used lose their top mip
+				for (const Candidate& candidate : m_candidates)
+				{
+					if (bytes + missingBytes <= m_stats.budget || restageNum == m_desc.restageMaxNum)
+					{
+						break;
+					}
+
+					const Slot& slot = GetSlot(candidate.texture);
+					const uint64_t residentBytes = m_storage->GetMemoryStats(candidate.texture).gpuBytes;
+					const uint32_t mipOffset = m_storage->GetMipOffset(candidate.texture) + 1;
+					if (slot.pending || !residentBytes || m_storage->IsPinned(candidate.texture) || mipOffset >= m_storage->GetTextureDesc(candidate.texture).mipNum)
+					{
+						continue;
+					}
+
+					const uint64_t reducedBytes = StartRestage(candidate.texture, mipOffset);
+					bytes -= residentBytes - std::min(reducedBytes, residentBytes);
+					restageNum++;
+				}
+			}
+			else
+			{
+				// most recently used first, at the largest mip that fits in place of the current one
+				for (auto it = m_candidates.rbegin(); it != m_candidates.rend() && restageNum < m_desc.restageMaxNum; ++it)
+				{
+					const Slot& slot = GetSlot(it->texture);
+					if (!IsRecentlyUsed(slot, frameIndex))
+					{
+						break;
+					}
+
+					const bool evicted = !m_storage->GetTexture(it->texture);
+					const uint32_t mipOffset = evicted ? m_storage->GetTextureDesc(it->texture).mipNum : m_storage->GetMipOffset(it->texture);
+					if (slot.pending || !mipOffset)
+					{
+						continue;
+					}
+
+					const uint64_t residentBytes = m_storage->GetMemoryStats(it->texture).gpuBytes;
+					for (uint32_t targetMipOffset = 0; targetMipOffset < mipOffset; targetMipOffset++)
+					{
+						const uint64_t targetBytes = GetMemorySize(it->texture, targetMipOffset);
+						if (bytes - residentBytes + targetBytes <= m_stats.budget)
+						{
+							StartRestage(it->texture, targetMipOffset);
+							bytes = bytes - residentBytes + targetBytes;
+							restageNum++;
+							break;
+						}
+					}
+				}
+			}
+
+			m_stats.pendingBytes = 0;
+			m_stats.evictedNum = 0;
+			m_stats.reducedNum = 0;
+			for (const Candidate& candidate : m_candidates)
+			{
+				m_stats.pendingBytes += GetSlot(candidate.texture).pendingBytes;
+				m_stats.evictedNum += m_storage->GetTexture(candidate.texture) ? 0 : 1;
+				m_stats.reducedNum += m_storage->GetMipOffset(candidate.texture) ? 1 : 0;
+			}
+		}
+
+		ResidencyStats GetStats() const { return m_stats; }
+
+	private:
+		Slot& GetSlot(TextureHandle texture)
+		{
+			// a slot reused by another texture starts over
+			Slot& slot = m_slots[texture.GetIndex()];
+			if (slot.texture != texture)
+			{
+				slot = {};
+				slot.texture = texture;
+			}
+			return slot;
+		}
+
+		bool IsRecentlyUsed(const Slot& slot, uint64_t frameIndex) const
+		{
+			// a texture not drawn yet counts as used when the manager started
+			const uint64_t lastUsedFrame = slot.lastUsedFrame ? slot.lastUsedFrame : m_firstFrame + 1;
+			return lastUsedFrame + m_desc.idleFrameNum > frameIndex;
+		}
+
+		uint64_t GetBudget(uint64_t residentBytes) const
+		{
+			if (m_desc.budget)
+			{
+				return m_desc.budget;
+			}
+
+			// what the rest of the application uses is not available to textures
+			nri::VideoMemoryInfo videoMemoryInfo = {};
+			if (NRI.QueryVideoMemoryInfo(m_device, nri::MemoryLocation::DEVICE, videoMemoryInfo) != nri::Result::SUCCESS)
+			{
+				return UINT64_MAX;
+			}
+			const uint64_t otherBytes = videoMemoryInfo.usageSize - std::min(residentBytes, videoMemoryInfo.usageSize);
+			const uint64_t budget = (uint64_t)((double)videoMemoryInfo.budgetSize * m_desc.budgetUsage);
+			return budget - std::min(otherBytes, budget);
+		}
+
+		uint64_t GetMemorySize(TextureHandle texture, uint32_t mipOffset) const
+		{
+			nri::MemoryDesc memoryDesc = {};
+			NRI.GetTextureMemoryDesc(m_device, GetMipDesc(m_storage->GetTextureDesc(texture), mipOffset), nri::MemoryLocation::DEVICE, memoryDesc);
+			return memoryDesc.size;
+		}
+
+		// Returns the device memory of the new texture
+		uint64_t StartRestage(TextureHandle texture, uint32_t mipOffset)
+		{
+			std::unique_ptr<Restage> restage = std::make_unique<Restage>();
+			restage->texture = texture;
+			restage->mipOffset = mipOffset;
+			restage->path = m_storage->GetImage(texture).GetPath();
+			restage->textureDesc = m_storage->GetTextureDesc(texture);
+			restage->task = RunRestage(*restage);
+			restage->task.Start();
+
+			Slot& slot = GetSlot(texture);
+			slot.pending = true;
+			slot.pendingBytes = GetMemorySize(texture, mipOffset);
+
+			m_restages.push_back(std::move(restage));
+			m_stats.restageNum++;
+			return slot.pendingBytes;
+		}
+
+		Task<nri::Result> RunRestage(Restage& restage)
+		{
+			// the image describes every mip from the top, the new texture starts mipOffset down and the mips above
+			// it are not decoded at all; the file must still match the texture it was first created from
+			restage.image = std::make_unique<Texture>();
+			const Texture& image = *restage.image;
+			if (!restage.image->LoadFromFile(restage.path, restage.mipOffset) || image.GetTextureDesc().format != restage.textureDesc.format
+				|| image.GetTextureDesc().width != restage.textureDesc.width || image.GetTextureDesc().height != restage.textureDesc.height
+				|| image.GetTextureDesc().mipNum != restage.textureDesc.mipNum)
+			{
+				restage.image = nullptr;
+				co_return nri::Result::FAILURE;
+			}
+			const nri::TextureDesc textureDesc = GetMipDesc(restage.textureDesc, restage.mipOffset);
+
+			nri::Result result = NRI.CreateTexture(m_device, textureDesc, restage.staged);
+			if (result == nri::Result::SUCCESS)
+			{
+				result = m_storage->GetTextureHeap().Bind(*restage.staged, restage.memory);
+			}
+
+			if (result == nri::Result::SUCCESS)
+			{
+				nri::TextureUploadDesc uploadDesc = image.GetTextureUploadDesc();
+				uploadDesc.texture = restage.staged;
+				uploadDesc.subresources += restage.mipOffset;
+				result = co_await m_uploadQueue->UploadTexture(uploadDesc);
+			}
+
+			restage.image = nullptr;
+			co_return result;
+		}
+
+		void InstallRestages()
+		{
+			for (size_t i = 0; i < m_restages.size();)
+			{
+				Restage& restage = *m_restages[i];
+				if (!restage.task.IsDone())
+				{
+					i++;
+					continue;
+				}
+
+				// a texture released meanwhile fails here, its staged copy was never drawn
+				if (restage.task.GetResult() != nri::Result::SUCCESS
+					|| m_storage->ReplaceTexture(restage.texture, restage.staged, restage.memory, restage.mipOffset) != nri::Result::SUCCESS)
+				{
+					DestroyStaged(restage);
+				}
+
+				Slot& slot = GetSlot(restage.texture);
+				slot.pending = false;
+				slot.pendingBytes = 0;
+
+				m_restages[i] = std::move(m_restages.back());
+				m_restages.pop_back();
+			}
+		}
+
+		void DestroyStaged(Restage& restage)
+		{
+			if (restage.staged)
+			{
+				NRI.DestroyTexture(*restage.staged);
+				restage.staged = nullptr;
+			}
+			m_storage->GetTextureHeap().Free(restage.memory);
+			restage.memory = {};
+		}
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		TextureStoragePtr m_storage;
+		UploadQueuePtr m_uploadQueue;
+		ResidencyManagerDesc m_desc;
+
+		std::vector<Slot> m_slots;      // by handle index
+		std::vector<Candidate> m_candidates;
+		std::vector<std::unique_ptr<Restage>> m_restages;
+		ResidencyStats m_stats;
+		uint64_t m_firstFrame = UINT64_MAX;
+	};
+
+	// constructor
+	ResidencyManager::ResidencyManager(NRIInterface& NRI, nri::Device& device, TextureStoragePtr textureStorage, UploadQueuePtr uploadQueue, const ResidencyManagerDesc& desc)
+		: m_impl(std::make_unique<Impl>(NRI, device, textureStorage, uploadQueue, desc))
+	{
+	}
+
+	// destructor
+	ResidencyManager::~ResidencyManager()
+	{
+	}
+
+
+	void ResidencyManager::MarkUsed(TextureHandle texture, uint64_t frameIndex) { m_impl->MarkUsed(texture, frameIndex); }
+
+	void ResidencyManager::Update(uint64_t frameIndex) { m_impl->Update(frameIndex); }
+
+	ResidencyStats ResidencyManager::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
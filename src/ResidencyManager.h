@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct ResidencyManagerDesc
+	{
+		uint64_t budget = 0;            // device memory the textures may use, 0 derives it from the adapter budget every frame
+		float budgetUsage = 0.9f;       // share of the adapter budget aimed for, the rest is headroom
+		uint32_t idleFrameNum = 2;      // textures unused for longer are evicted, recently used ones lose top mips instead
+		uint32_t restageMaxNum = 4;     // mip drops and restores started per frame
+	};
+
+	struct ResidencyStats
+	{
+		uint64_t budget = 0;            // texture budget of the last Update
+		uint64_t residentBytes = 0;     // device memory of the resident textures
+		uint64_t pendingBytes = 0;      // textures being restaged, not resident yet
+		uint32_t evictedNum = 0;        // textures without device memory
+		uint32_t reducedNum = 0;        // textures with dropped top mips
+		uint64_t evictionNum = 0;       // since start
+		uint64_t restageNum = 0;        // since start
+	};
+
+	// Keeps the device memory of a TextureStorage within a budget.
+	// Textures are marked when drawn. While over budget, Update evicts the least recently used idle textures and
+	// drops the top mip of recently used ones; when there is room again, textures drawn while evicted or reduced are
+	// restaged from their source files at the largest mip that fits. A restage creates and uploads a new texture on
+	// a job thread and swaps it in at the next Update, the old one goes through the storage's deletion queue.
+	// Update and MarkUsed must be called from the thread that builds frames.
+	class ResidencyManager
+	{
+		DISALLOW_COPY_AND_ASSIGN(ResidencyManager);
+	public:
+		ResidencyManager(NRIInterface& NRI, nri::Device& device, TextureStoragePtr textureStorage, UploadQueuePtr uploadQueue, const ResidencyManagerDesc& desc);
+
+		// Finishes running restages through UploadQueue::Wait, so it belongs on the thread that updates the queue
+		~ResidencyManager();
+
+		// Every texture a frame draws, once it has been created
+		void MarkUsed(TextureHandle texture, uint64_t frameIndex);
+
+		// Once per frame before it is built: swaps in finished restages, then evicts, reduces or restores
+		void Update(uint64_t frameIndex);
+
+		ResidencyStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
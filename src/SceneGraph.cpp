@@ -0,0 +1,271 @@
+#include "SceneGraph.h"
+#include "Parallel.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NFW_SCENEGRAPH_SSE2
+#endif
+
+namespace nfw
+{
+	constexpr uint32_t UPDATE_GRAIN_SIZE = 1024;
+
+	// out = a * b for column-major glm matrices
+	inline void MultiplyMatrix(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+	{
+#ifdef NFW_SCENEGRAPH_SSE2
+		const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+		const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+		const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+		const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+		for (int32_t i = 0; i < 4; ++i)
+		{
+			const __m128 column = _mm_loadu_ps(&b[i][0]);
+			__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+			r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+			r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+			r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(&out[i][0], r);
+		}
+#else
+		out = a * b;
+#endif
+	}
+
+	class SceneGraph::Impl
+	{
+	public:
+		Impl() {}
+		~Impl() {}
+
+		NodeId CreateNode(NodeId parent)
+		{
+			const uint32_t parentSlot = (parent == INVALID_NODE) ? INVALID_NODE : m_nodeToSlot[parent];
+			const uint32_t depth = (parentSlot == INVALID_NODE) ? 0 : m_depths[parentSlot] + 1;
+
+			const NodeId node = static_cast<NodeId>(m_nodeToSlot.size());
+			const uint32_t slot = static_cast<uint32_t>(m_slotToNode.size());
+			m_nodeToSlot.push_back(slot);
+			m_slotToNode.push_back(node);
+			m_parents.push_back(parentSlot);
+			m_depths.push_back(depth);
+			m_locals.push_back(glm::mat4(1.0f));
+			m_worlds.push_back(glm::mat4(1.0f));
+			m_dirty.push_back(1);
+
+			m_structureDirty = true;
+			m_anyDirty = true;
+			return node;
+		}
+
+		void Reserve(uint32_t nodeNum)
+		{
+			m_nodeToSlot.reserve(nodeNum);
+			m_slotToNode.reserve(nodeNum);
+			m_parents.reserve(nodeNum);
+			m_depths.reserve(nodeNum);
+			m_locals.reserve(nodeNum);
+			m_worlds.reserve(nodeNum);
+			m_dirty.reserve(nodeNum);
+		}
+
+		void SetLocalTransform(NodeId node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			glm::mat4 local = glm::mat4_cast(rotation);
+			local[0] *= scale.x;
+			local[1] *= scale.y;
+			local[2] *= scale.z;
+			local[3] = glm::vec4(translation, 1.0f);
+			SetLocalMatrix(node, local);
+		}
+
+		void SetLocalMatrix(NodeId node, const glm::mat4& local)
+		{
+			const uint32_t slot = m_nodeToSlot[node];
+			m_locals[slot] = local;
+			m_dirty[slot] = 1;
+			m_anyDirty = true;
+		}
+
+		const glm::mat4& GetLocalMatrix(NodeId node) const { return m_locals[m_nodeToSlot[node]]; }
+
+		const glm::mat4& GetWorldMatrix(NodeId node) const { return m_worlds[m_nodeToSlot[node]]; }
+
+		NodeId GetParent(NodeId node) const
+		{
+			const uint32_t parentSlot = m_parents[m_nodeToSlot[node]];
+			return (parentSlot == INVALID_NODE) ? INVALID_NODE : m_slotToNode[parentSlot];
+		}
+
+		uint32_t GetDepth(NodeId node) const { return m_depths[m_nodeToSlot[node]]; }
+
+		uint32_t GetNodeNum() const { return static_cast<uint32_t>(m_slotToNode.size()); }
+
+		void Update()
+		{
+			m_updatedNum = 0;
+			if (!m_anyDirty)
+			{
+				return;
+			}
+
+			if (m_structureDirty)
+			{
+				SortByDepth();
+			}
+
+			// parents are always on the previous level, so each level only depends on the one before it
+			std::atomic<uint32_t> updatedNum = 0;
+			for (size_t level = 0; level + 1 < m_levelOffsets.size(); ++level)
+			{
+				const uint32_t levelBegin = m_levelOffsets[level];
+				const uint32_t levelEnd = m_levelOffsets[level + 1];
+				ParallelFor(levelEnd - levelBegin, UPDATE_GRAIN_SIZE, [&](uint32_t begin, uint32_t end)
+				{
+					uint32_t count = 0;
+					for (uint32_t slot = levelBegin + begin, last = levelBegin + end; slot < last; ++slot)
+					{
+						const uint32_t parent = m_parents[slot];
+						if (parent == INVALID_NODE)
+						{
+							if (m_dirty[slot])
+							{
+								m_worlds[slot] = m_locals[slot];
+								count++;
+							}
+							continue;
+						}
+
+						if (m_dirty[parent])
+						{
+							m_dirty[slot] = 1;
+						}
+						if (m_dirty[slot])
+						{
+							MultiplyMatrix(m_worlds[parent], m_locals[slot], m_worlds[slot]);
+							count++;
+						}
+					}
+					updatedNum += count;
+				});
+			}
+
+			std::fill(m_dirty.begin(), m_dirty.end(), static_cast<uint8_t>(0));
+			m_anyDirty = false;
+			m_updatedNum = updatedNum;
+		}
+
+		uint32_t GetUpdatedNum() const { return m_updatedNum; }
+
+	private:
+		// Stable counting sort of all SoA arrays by depth
+		void SortByDepth()
+		{
+			const uint32_t nodeNum = static_cast<uint32_t>(m_slotToNode.size());
+			uint32_t levelNum = 0;
+			for (uint32_t depth : m_depths)
+			{
+				levelNum = std::max(levelNum, depth + 1);
+			}
+
+			m_levelOffsets.assign(levelNum + 1, 0);
+			for (uint32_t depth : m_depths)
+			{
+				m_levelOffsets[depth + 1]++;
+			}
+			for (uint32_t level = 0; level < levelNum; ++level)
+			{
+				m_levelOffsets[level + 1] += m_levelOffsets[level];
+			}
+
+			std::vector<uint32_t> newSlots(nodeNum);
+			std::vector<uint32_t> cursor(m_levelOffsets.begin(), m_levelOffsets.end() - 1);
+			for (uint32_t slot = 0; slot < nodeNum; ++slot)
+			{
+				newSlots[slot] = cursor[m_depths[slot]]++;
+			}
+
+			std::vector<uint32_t> parents(nodeNum);
+			std::vector<uint32_t> depths(nodeNum);
+			std::vector<glm::mat4> locals(nodeNum);
+			std::vector<glm::mat4> worlds(nodeNum);
+			std::vector<uint8_t> dirty(nodeNum);
+			std::vector<NodeId> slotToNode(nodeNum);
+			for (uint32_t slot = 0; slot < nodeNum; ++slot)
+			{
+				const uint32_t newSlot = newSlots[slot];
+				const uint32_t parent = m_parents[slot];
+				parents[newSlot] = (parent == INVALID_NODE) ? INVALID_NODE : newSlots[parent];
+				depths[newSlot] = m_depths[slot];
+				locals[newSlot] = m_locals[slot];
+				worlds[newSlot] = m_worlds[slot];
+				dirty[newSlot] = m_dirty[slot];
+				slotToNode[newSlot] = m_slotToNode[slot];
+				m_nodeToSlot[m_slotToNode[slot]] = newSlot;
+			}
+
+			m_parents.swap(parents);
+			m_depths.swap(depths);
+			m_locals.swap(locals);
+			m_worlds.swap(worlds);
+			m_dirty.swap(dirty);
+			m_slotToNode.swap(slotToNode);
+			m_structureDirty = false;
+		}
+
+	private:
+		std::vector<uint32_t> m_nodeToSlot;
+		std::vector<NodeId> m_slotToNode;
+
+		// SoA, indexed by slot and sorted by depth
+		std::vector<uint32_t> m_parents;
+		std::vector<uint32_t> m_depths;
+		std::vector<glm::mat4> m_locals;
+		std::vector<glm::mat4> m_worlds;
+		std::vector<uint8_t> m_dirty;
+
+		std::vector<uint32_t> m_levelOffsets;
+		bool m_structureDirty = false;
+		bool m_anyDirty = false;
+		uint32_t m_updatedNum = 0;
+	};
+
+	// constructor
+	SceneGraph::SceneGraph()
+		: m_impl(std::make_unique<Impl>())
+	{
+	}
+
+	// destructor
+	SceneGraph::~SceneGraph()
+	{
+	}
+
+	NodeId SceneGraph::CreateNode(NodeId parent) { return m_impl->CreateNode(parent); }
+
+	void SceneGraph::Reserve(uint32_t nodeNum) { m_impl->Reserve(nodeNum); }
+
+	void SceneGraph::SetLocalTransform(NodeId node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		m_impl->SetLocalTransform(node, translation, rotation, scale);
+	}
+
+	void SceneGraph::SetLocalMatrix(NodeId node, const glm::mat4& local) { m_impl->SetLocalMatrix(node, local); }
+
+	const glm::mat4& SceneGraph::GetLocalMatrix(NodeId node) const { return m_impl->GetLocalMatrix(node); }
+
+	const glm::mat4& SceneGraph::GetWorldMatrix(NodeId node) const { return m_impl->GetWorldMatrix(node); }
+
+	NodeId SceneGraph::GetParent(NodeId node) const { return m_impl->GetParent(node); }
+
+	uint32_t SceneGraph::GetDepth(NodeId node) const { return m_impl->GetDepth(node); }
+
+	uint32_t SceneGraph::GetNodeNum() const { return m_impl->GetNodeNum(); }
+
+	void SceneGraph::Update() { m_impl->Update(); }
+
+	uint32_t SceneGraph::GetUpdatedNum() const { return m_impl->GetUpdatedNum(); }
+
+} // namespace nfw
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	using NodeId = uint32_t;
+	constexpr NodeId INVALID_NODE = ~0u;
+
+	// Transform hierarchy.
+	// Local and world matrices are stored as SoA arrays sorted by hierarchy depth,
+	// and Update only recomputes the subtrees below nodes changed since the last update.
+	class SceneGraph
+	{
+		DISALLOW_COPY_AND_ASSIGN(SceneGraph);
+	public:
+		SceneGraph();
+		~SceneGraph();
+
+		NodeId CreateNode(NodeId parent = INVALID_NODE);
+		void Reserve(uint32_t nodeNum);
+
+		void SetLocalTransform(NodeId node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+		void SetLocalMatrix(NodeId node, const glm::mat4& local);
+
+		const glm::mat4& GetLocalMatrix(NodeId node) const;
+		const glm::mat4& GetWorldMatrix(NodeId node) const;
+		NodeId GetParent(NodeId node) const;
+		uint32_t GetDepth(NodeId node) const;
+		uint32_t GetNodeNum() const;
+
+		// Recomputes world matrices of dirty nodes and their descendants, one depth level at a time.
+		void Update();
+
+		// Number of world matrices recomputed by the last Update
+		uint32_t GetUpdatedNum() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
@@ -1,14 +1,11 @@
 #include "Shader.h"
+#include "FileSystem.h"
+#include "Trace.h"
 
-#include <fstream>
 #include <iostream>
-#include <filesystem>
-#include <wrl.h>
 
 namespace nfw
 {
-	namespace fs = std::filesystem;
-
 	struct ShaderExt {
 		const char* ext;
 		nri::StageBits stage;
@@ -47,7 +44,7 @@ namespace nfw
 		Impl() {}
 		~Impl() {}
 
-		nri::ShaderDesc GetShaderDesc() const
+		const nri::ShaderDesc& GetShaderDesc() const
 		{
 			return m_shaderDesc;
 		}
@@ -55,8 +52,10 @@ namespace nfw
 
 		bool LoadFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath)
 		{
+			NFW_TRACE_SCOPE("Shader::LoadFromFile");
+
 			const char* ext = GetShaderExt(graphicsAPI);
-			std::string path = "../shaders/" + shaderPath + ext;
+			std::string path = "shaders/" + shaderPath + ext;
 		
 			nri::StageBits stage = nri::StageBits::NONE;
 			if (shaderPath.find(".vs") != std::string::npos)
@@ -72,10 +71,10 @@ namespace nfw
 			{
 				if (path.rfind(ShaderExts[i].ext) != std::string::npos)
 				{
-					std::ifstream ifs(path, std::ios::in | std::ios::binary);
-					std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-					m_shaderData.resize(str.size());
-					memcpy(&m_shaderData[0], &str[0], str.size());
+					if (!FileSystem::ReadFile(path, m_shaderData) || m_shaderData.empty())
+					{
+						return false;
+					}
 
 					m_shaderDesc.stage = ShaderExts[i].stage;
 					m_shaderDesc.bytecode = m_shaderData.data();
@@ -108,7 +107,7 @@ namespace nfw
 		return m_impl->LoadFromFile(graphicsAPI, shaderPath);
 	}
 
-	nri::ShaderDesc Shader::GetShaderDesc() const
+	const nri::ShaderDesc& Shader::GetShaderDesc() const
 	{
 		return m_impl->GetShaderDesc();
 	}
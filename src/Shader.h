@@ -14,7 +14,7 @@ namespace nfw
 
 		bool LoadFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath);
 
-		nri::ShaderDesc GetShaderDesc() const;
+		const nri::ShaderDesc& GetShaderDesc() const;
 
 	private:
 		class Impl;
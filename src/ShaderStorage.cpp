@@ -3,30 +3,53 @@
 
 namespace nfw
 {
+	namespace
+	{
+		enum ShaderColumn
+		{
+			SHADER_DESC,
+			SHADER,     // owns the bytecode
+		};
+
+		using ShaderPool = HandlePool<ShaderTag, nri::ShaderDesc, std::unique_ptr<Shader>>;
+	}
+
 	class ShaderStorage::Impl
 	{
 	public:
-		Impl() {}
+		Impl(uint32_t capacity)
+			: m_shaders(capacity)
+		{}
 		~Impl() {}
 
-		ShaderConstPtr LoadShaderFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath)
+		ShaderHandle LoadShaderFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath)
 		{
-			ShaderPtr shader = std::make_shared<Shader>();
-			if (shader->LoadFromFile(graphicsAPI, shaderPath))
+			std::unique_ptr<Shader> shader = std::make_unique<Shader>();
+			if (!shader->LoadFromFile(graphicsAPI, shaderPath))
+			{
+				return {};
+			}
+
+			const ShaderHandle handle = m_shaders.Allocate();
+			if (handle)
 			{
-				m_shaderStorage.push_back(shader);
-				return shader;
+				m_shaders.Get<SHADER_DESC>(handle) = shader->GetShaderDesc();
+				m_shaders.Get<SHADER>(handle) = std::move(shader);
 			}
-			return nullptr;
+			return handle;
 		}
 
+		bool IsValid(ShaderHandle shader) const { return m_shaders.IsValid(shader); }
+
+		const nri::ShaderDesc& GetShaderDesc(ShaderHandle shader) const { return m_shaders.Get<SHADER_DESC>(shader); }
+
 	private:
-		std::vector<ShaderConstPtr> m_shaderStorage;
+		ShaderPool m_shaders;
 	};
 
 	// constructor
-	ShaderStorage::ShaderStorage()
-		: m_impl(std::make_unique<Impl>())
+	ShaderStorage::ShaderStorage(uint32_t capacity)
+		: m_impl(std::make_unique<Impl>(capacity))
 	{
 	}
 
@@ -35,9 +58,13 @@ namespace nfw
 	{
 	}
 
-	ShaderConstPtr ShaderStorage::LoadShaderFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath)
+	ShaderHandle ShaderStorage::LoadShaderFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath)
 	{
 		return m_impl->LoadShaderFromFile(graphicsAPI, shaderPath);
 	}
 
+	bool ShaderStorage::IsValid(ShaderHandle shader) const { return m_impl->IsValid(shader); }
+
+	const nri::ShaderDesc& ShaderStorage::GetShaderDesc(ShaderHandle shader) const { return m_impl->GetShaderDesc(shader); }
+
 } // namespace nfw
@@ -5,14 +5,23 @@
 
 namespace nfw
 {
+	constexpr uint32_t SHADER_STORAGE_DEFAULT_CAPACITY = 256;
+
+	// Shaders referenced by ShaderHandle, the descs are kept in one contiguous array
 	class ShaderStorage
 	{
 		DISALLOW_COPY_AND_ASSIGN(ShaderStorage);
 	public:
-		ShaderStorage();
+		explicit ShaderStorage(uint32_t capacity = SHADER_STORAGE_DEFAULT_CAPACITY);
 		~ShaderStorage();
 
-		ShaderConstPtr LoadShaderFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath);
+		// Invalid handle when the file could not be loaded or the storage is full
+		ShaderHandle LoadShaderFromFile(nri::GraphicsAPI graphicsAPI, const std::string& shaderPath);
+
+		bool IsValid(ShaderHandle shader) const;
+
+		// Points into the storage, valid until it is destroyed
+		const nri::ShaderDesc& GetShaderDesc(ShaderHandle shader) const;
 
 	private:
 		class Impl;
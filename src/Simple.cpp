@@ -1,12 +1,34 @@
 #include "Simple.h"
 
-#include <d3d12.h>
-#include <dxgi1_6.h>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
 
 #include "ShaderStorage.h"
 #include "Shader.h"
 #include "TextureStorage.h"
 #include "Texture.h"
+#include "Geometry.h"
+#include "SceneGraph.h"
+#include "DrawList.h"
+#include "CommandRecorder.h"
+#include "SpriteBatch.h"
+#include "GpuProfiler.h"
+#include "FramePacer.h"
+#include "DoubleBuffer.h"
+#include "UploadQueue.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "StateCache.h"
+#include "Allocator.h"
+#include "FrameArena.h"
+#include "HeapCheck.h"
+#include "ResidencyManager.h"
+#include "TextureHeap.h"
+#include "Defragmenter.h"
+#include "Trace.h"
 
 namespace nfw
 {
@@ -15,8 +37,9 @@ namespace nfw
 
 	struct ConstantBufferLayout
 	{
+		float world[16];
 		float color[3];
-		float scale;
+		float padding;
 	};
 
 	struct Vertex
@@ -37,6 +60,13 @@ namespace nfw
 
 	static const uint16_t g_indexData[] = { 0, 1, 2, 3, 4, 5 };
 
+	using Clock = std::chrono::steady_clock;
+
+	double GetElapsedMs(Clock::time_point begin, Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
 	struct Frame
 	{
 		nri::CommandAllocator* commandAllocator;
@@ -44,6 +74,30 @@ namespace nfw
 		nri::Descriptor* constantBufferView;
 		nri::DescriptorSet* constantBufferDescriptorSet;
 		uint64_t constantBufferViewOffset;
+		CommandRecorderPtr recorder;
+		Clock::time_point inputTime;    // WaitForFrame return, the input age starts here
+	};
+
+	// The residency manager may swap a texture's view at any frame, so every texture has two sets:
+	// a new view is written into the one no frame in flight draws with
+	struct TextureBinding
+	{
+		nri::DescriptorSet* sets[2];
+		uint64_t boundFrames[2];    // frame index + 1 of the last frame drawing with the set
+		uint32_t version;           // of the view in the active set
+		uint32_t active;
+	};
+
+	// Everything Render needs from Prepare, not modified after it is published
+	struct RenderPacket
+	{
+		uint32_t frameIndex;
+		FrameArenaPtr arena;                            // reset when the slot is written again
+		ConstantBufferLayout* constants;                // per quad, in the arena
+		DrawListPtr drawList;
+		SpriteBatchFrame sprites;
+		Clock::time_point inputTime;
+		double prepareMs;
 	};
 
 	struct BackBuffer
@@ -52,14 +106,17 @@ namespace nfw
 		nri::Texture* texture;
 	};
 
-	constexpr uint32_t BUFFERED_FRAME_MAX_NUM = 2;
-	constexpr uint32_t SWAP_CHAIN_TEXTURE_NUM = BUFFERED_FRAME_MAX_NUM;
+	constexpr uint32_t FRAME_IN_FLIGHT_MAX_NUM = 3;
+	constexpr uint32_t SWAP_CHAIN_TEXTURE_MIN_NUM = 2;
+	constexpr nri::Format OFFSCREEN_FORMAT = nri::Format::RGBA8_UNORM;
+	constexpr uint32_t SPRITE_CAPACITY = 1 << 20;
+	constexpr uint32_t DESCRIPTOR_POOL_SET_NUM = 1024;
 
 	size_t Align(size_t location, size_t align)
 	{
 		if ((0 == align) || (align & (align - 1)))
 		{
-			throw std::exception("non-pow2 alignment");
+			throw std::invalid_argument("non-pow2 alignment");
 		}
 		return ((location + (align - 1)) & ~(align - 1));
 	}
@@ -72,18 +129,37 @@ namespace nfw
 	class Simple::Impl
 	{
 	public:
-		Impl::Impl(void* hwnd, glm::uvec2 resolution)
+		Impl(const SimpleDesc& desc)
 		{
-			m_window.windows.hwnd = hwnd;
-			m_resolution = resolution;
+			m_window = desc.window;
+			m_resolution = desc.resolution;
+			m_graphicsAPI = desc.graphicsAPI;
+			m_headless = desc.headless;
+			m_quadNum = std::max(desc.quadNum, 1u);
+			m_textureNum = std::max(desc.textureNum, 1u);
+			m_pipelineNum = std::max(desc.pipelineNum, 1u);
+			m_frameInFlightNum = std::clamp(desc.frameInFlightNum, 1u, FRAME_IN_FLIGHT_MAX_NUM);
+			m_verticalSyncInterval = desc.verticalSyncInterval;
+			m_waitableSwapChain = desc.waitableSwapChain && !desc.headless;
+			m_frames.resize(m_frameInFlightNum);
+			m_textureMemoryBudget = desc.textureMemoryBudget;
+
+			m_framePacer = std::make_shared<FramePacer>();
+			m_framePacer->SetTargetFrameRate(desc.frameRateLimit);
 		}
 
-		Impl::~Impl()
+		~Impl()
 		{
+			m_defragmenter = nullptr;
+			m_residencyManager = nullptr;
 			NRI.WaitForIdle(*m_commandQueue);
 
+			m_spriteBatch = nullptr;
+			m_gpuProfiler = nullptr;
+
 			for (Frame& frame : m_frames)
 			{
+				frame.recorder = nullptr;
 				NRI.DestroyCommandBuffer(*frame.commandBuffer);
 				NRI.DestroyCommandAllocator(*frame.commandAllocator);
 				NRI.DestroyDescriptor(*frame.constantBufferView);
@@ -92,42 +168,63 @@ namespace nfw
 			for (BackBuffer& backBuffer : m_backBuffers)
 			{
 				NRI.DestroyDescriptor(*backBuffer.colorAttachment);
+				if (m_headless)
+				{
+					NRI.DestroyTexture(*backBuffer.texture);
+				}
+			}
+			for (nri::Memory* memory : m_offscreenMemoryAllocations)
+			{
+				NRI.FreeMemory(*memory);
 			}
 
-			NRI.DestroyPipeline(*m_pipeline);
-			NRI.DestroyPipelineLayout(*m_pipelineLayout);
+			m_pipelines.clear();
+			m_pipelineLayout = nullptr;
 			m_textureStorage = nullptr;
-			NRI.DestroyDescriptor(*m_sampler);
+			m_sampler = nullptr;
+			m_stateCache = nullptr;
 			NRI.DestroyBuffer(*m_constantBuffer);
 			NRI.DestroyBuffer(*m_geometryBuffer);
-			NRI.DestroyDescriptorPool(*m_descriptorPool);
+			m_deletionQueue->Flush();
+			m_deletionQueue = nullptr;
+			m_textureHeap = nullptr;
+			m_uploadQueue = nullptr;
+			m_descriptorAllocator = nullptr;
 			NRI.DestroyFence(*m_frameFence);
-			NRI.DestroySwapChain(*m_swapChain);
+			if (m_swapChain)
+			{
+				NRI.DestroySwapChain(*m_swapChain);
+			}
 
 			nri::nriDestroyDevice(*m_device);
 		}
 
 		bool Init()
 		{
-			nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::D3D12;
+			NFW_TRACE_SCOPE("Simple::Init");
+
+			// the NONE backend and some software ICDs report no adapter, let NRI pick the default one then
 			nri::AdapterDesc adapterDesc = {};
 			uint32_t adapterDescNum = 1;
-			NRI_ABORT_ON_FAILURE(nri::nriEnumerateAdapters(&adapterDesc, adapterDescNum));
+			const bool hasAdapter = nri::nriEnumerateAdapters(&adapterDesc, adapterDescNum) == nri::Result::SUCCESS && adapterDescNum != 0;
 
 			// Device
 			nri::DeviceCreationDesc deviceCreationDesc = {};
-			deviceCreationDesc.graphicsAPI = graphicsAPI;
+			deviceCreationDesc.graphicsAPI = m_graphicsAPI;
 			deviceCreationDesc.enableGraphicsAPIValidation = false;
 			deviceCreationDesc.enableNRIValidation = false;
 			deviceCreationDesc.enableD3D11CommandBufferEmulation = false;
 			deviceCreationDesc.spirvBindingOffsets = { 100, 200, 300, 400 };
-			deviceCreationDesc.adapterDesc = &adapterDesc;
-			deviceCreationDesc.allocationCallbacks = {};
+			deviceCreationDesc.adapterDesc = hasAdapter ? &adapterDesc : nullptr;
+			deviceCreationDesc.allocationCallbacks = Allocator::GetNRIAllocationCallbacks();
 			NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_device));
 
 			// NRI
 			NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
-			NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+			if (!m_headless)
+			{
+				NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+			}
 			NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
 
 			// Command queue
@@ -135,18 +232,26 @@ namespace nfw
 
 			// Fences
 			NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_device, 0, m_frameFence));
+			m_deletionQueue = std::make_shared<DeletionQueue>(NRI, *m_frameFence);
+			m_stateCache = std::make_shared<StateCache>(NRI, *m_device, m_deletionQueue);
 
 			// Swap chain
-			nri::Format swapChainFormat;
+			nri::Format swapChainFormat = OFFSCREEN_FORMAT;
+			if (m_headless)
+			{
+				InitOffscreenTargets();
+			}
+			else
 			{
 				nri::SwapChainDesc swapChainDesc = {};
 				swapChainDesc.window = m_window;
 				swapChainDesc.commandQueue = m_commandQueue;
 				swapChainDesc.format = nri::SwapChainFormat::BT709_G22_8BIT;
-				swapChainDesc.verticalSyncInterval = 0;
+				swapChainDesc.verticalSyncInterval = m_verticalSyncInterval;
 				swapChainDesc.width = m_resolution.x;
 				swapChainDesc.height = m_resolution.y;
-				swapChainDesc.textureNum = SWAP_CHAIN_TEXTURE_NUM;
+				swapChainDesc.textureNum = (uint8_t)std::max(m_frameInFlightNum, SWAP_CHAIN_TEXTURE_MIN_NUM);
+				swapChainDesc.waitable = m_waitableSwapChain;
 				NRI_ABORT_ON_FAILURE(NRI.CreateSwapChain(*m_device, swapChainDesc, m_swapChain));
 
 				uint32_t swapChainTextureNum;
@@ -170,24 +275,95 @@ namespace nfw
 			{
 				NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_commandQueue, frame.commandAllocator));
 				NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*frame.commandAllocator, frame.commandBuffer));
+				frame.recorder = std::make_shared<CommandRecorder>(NRI, *frame.commandBuffer);
 			}
 
 			InitPipeline(swapChainFormat);
-			InitDescriptorPool();
-			InitResources();
+			InitDescriptorAllocator();
+			if (!InitResources())
+			{
+				return false;
+			}
+
+			m_sceneGraph = std::make_shared<SceneGraph>();
+			m_sceneGraph->Reserve(m_quadNum);
+			m_quadNodes.resize(m_quadNum);
+			for (NodeId& node : m_quadNodes)
+			{
+				node = m_sceneGraph->CreateNode();
+			}
+
+			for (RenderPacket& packet : m_packets.GetSlots())
+			{
+				packet.arena = std::make_shared<FrameArena>();
+				packet.drawList = std::make_shared<DrawList>();
+			}
+
+			m_spriteBatch = std::make_shared<SpriteBatch>(NRI, *m_device, *m_frameFence, m_frameInFlightNum, SPRITE_CAPACITY);
+			if (!m_spriteBatch->Init(swapChainFormat))
+			{
+				return false;
+			}
+			m_spriteBatch->AddTexture(*m_textureStorage->GetTextureShaderDescriptor(m_textures[0]));
+
+			m_gpuProfiler = std::make_shared<GpuProfiler>(NRI, *m_device, m_frameInFlightNum);
+			if (!m_gpuProfiler->Init())
+			{
+				return false;
+			}
 
 			return true;
 		}
 
+		void InitOffscreenTargets()
+		{
+			std::vector<nri::Texture*> textures(m_frameInFlightNum, nullptr);
+			for (nri::Texture*& texture : textures)
+			{
+				nri::TextureDesc textureDesc = {};
+				textureDesc.type = nri::TextureType::TEXTURE_2D;
+				textureDesc.format = OFFSCREEN_FORMAT;
+				textureDesc.usageMask = nri::TextureUsageBits::COLOR_ATTACHMENT;
+				textureDesc.width = (nri::Dim_t)m_resolution.x;
+				textureDesc.height = (nri::Dim_t)m_resolution.y;
+				textureDesc.depth = 1;
+				textureDesc.mipNum = 1;
+				textureDesc.layerNum = 1;
+				textureDesc.sampleNum = 1;
+				NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_device, textureDesc, texture));
+			}
+
+			nri::ResourceGroupDesc resourceGroupDesc = {};
+			resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
+			resourceGroupDesc.textureNum = (uint32_t)textures.size();
+			resourceGroupDesc.textures = textures.data();
+
+			m_offscreenMemoryAllocations.resize(NRI.CalculateAllocationNumber(*m_device, resourceGroupDesc), nullptr);
+			NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_device, resourceGroupDesc, m_offscreenMemoryAllocations.data()));
+
+			for (nri::Texture* texture : textures)
+			{
+				nri::Texture2DViewDesc textureViewDesc = { texture, nri::Texture2DViewType::COLOR_ATTACHMENT, OFFSCREEN_FORMAT };
+
+				nri::Descriptor* colorAttachment;
+				NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(textureViewDesc, colorAttachment));
+
+				const BackBuffer backBuffer = { colorAttachment, texture };
+				m_backBuffers.push_back(backBuffer);
+			}
+		}
+
 		void InitPipeline(nri::Format swapChainFormat)
 		{
+			NFW_TRACE_SCOPE("Simple::InitPipeline");
+
 			const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_device);
 			ShaderStorage shaderStorage;
 
 			// PipelineLayout
 			{
-				nri::DescriptorRangeDesc descriptorRangeConstant[1];
-				descriptorRangeConstant[0] = { 0, 1, nri::DescriptorType::CONSTANT_BUFFER, nri::StageBits::ALL };
+				// per-quad constants live in one buffer and are selected with a dynamic offset
+				nri::DynamicConstantBufferDesc dynamicConstantBuffer = { 0, nri::StageBits::ALL };
 
 				nri::DescriptorRangeDesc descriptorRangeTexture[2];
 				descriptorRangeTexture[0] = { 0, 1, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER };
@@ -195,7 +371,7 @@ namespace nfw
 
 				nri::DescriptorSetDesc descriptorSetDescs[] =
 				{
-					{0, descriptorRangeConstant, std::size(descriptorRangeConstant)},
+					{0, nullptr, 0, &dynamicConstantBuffer, 1},
 					{1, descriptorRangeTexture, std::size(descriptorRangeTexture)},
 				};
 
@@ -208,7 +384,7 @@ namespace nfw
 				pipelineLayoutDesc.rootConstants = &pushConstant;
 				pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
 
-				NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_device, pipelineLayoutDesc, m_pipelineLayout));
+				NRI_ABORT_ON_FAILURE(m_stateCache->GetPipelineLayout(pipelineLayoutDesc, m_pipelineLayout));
 			}
 
 			{
@@ -255,17 +431,17 @@ namespace nfw
 				outputMergerDesc.colorNum = 1;
 				outputMergerDesc.colors = &colorAttachmentDesc;
 
-				ShaderConstPtr vertexShader = shaderStorage.LoadShaderFromFile(deviceDesc.graphicsAPI, "Simple.vs");
-				ShaderConstPtr pixelShader = shaderStorage.LoadShaderFromFile(deviceDesc.graphicsAPI, "Simple.fs");
+				ShaderHandle vertexShader = shaderStorage.LoadShaderFromFile(deviceDesc.graphicsAPI, "Simple.vs");
+				ShaderHandle pixelShader = shaderStorage.LoadShaderFromFile(deviceDesc.graphicsAPI, "Simple.fs");
 
 				nri::ShaderDesc shaderStages[] =
 				{
-					vertexShader->GetShaderDesc(),
-					pixelShader->GetShaderDesc(),
+					shaderStorage.GetShaderDesc(vertexShader),
+					shaderStorage.GetShaderDesc(pixelShader),
 				};
 
 				nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
-				graphicsPipelineDesc.pipelineLayout = m_pipelineLayout;
+				graphicsPipelineDesc.pipelineLayout = m_pipelineLayout.get();
 				graphicsPipelineDesc.vertexInput = &vertexInputDesc;
 				graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
 				graphicsPipelineDesc.rasterization = rasterizationDesc;
@@ -273,58 +449,100 @@ namespace nfw
 				graphicsPipelineDesc.shaders = shaderStages;
 				graphicsPipelineDesc.shaderNum = std::size(shaderStages);
 
-				NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_device, graphicsPipelineDesc, m_pipeline));
+				// identical descs, distinct objects, so pipeline switches can be benchmarked, only the first one is shared
+				m_pipelines.resize(m_pipelineNum);
+				NRI_ABORT_ON_FAILURE(m_stateCache->GetGraphicsPipeline(graphicsPipelineDesc, m_pipelines[0]));
+				for (uint32_t i = 1; i < m_pipelineNum; i++)
+				{
+					NRI_ABORT_ON_FAILURE(m_stateCache->CreateGraphicsPipeline(graphicsPipelineDesc, m_pipelines[i]));
+				}
 			}
 		}
 
-		void InitDescriptorPool()
+		void InitDescriptorAllocator()
 		{
-			nri::DescriptorPoolDesc descriptorPoolDesc = {};
-			descriptorPoolDesc.descriptorSetMaxNum = BUFFERED_FRAME_MAX_NUM + 1;
-			descriptorPoolDesc.constantBufferMaxNum = BUFFERED_FRAME_MAX_NUM;
-			descriptorPoolDesc.textureMaxNum = 1;
-			descriptorPoolDesc.samplerMaxNum = 1;
-
-			NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_device, descriptorPoolDesc, m_descriptorPool));
+			// every pool of a chain has room for one descriptor of each kind per set, the demo's sets fit into the first
+			const uint32_t persistentSetNum = std::max(m_frameInFlightNum + m_textureNum * 2, DESCRIPTOR_POOL_SET_NUM);
+
+			DescriptorAllocatorDesc descriptorAllocatorDesc = {};
+			nri::DescriptorPoolDesc& persistentPoolDesc = descriptorAllocatorDesc.persistentPoolDesc;
+			persistentPoolDesc.descriptorSetMaxNum = persistentSetNum;
+			persistentPoolDesc.constantBufferMaxNum = persistentSetNum;
+			persistentPoolDesc.dynamicConstantBufferMaxNum = persistentSetNum;
+			persistentPoolDesc.textureMaxNum = persistentSetNum;
+			persistentPoolDesc.samplerMaxNum = persistentSetNum;
+
+			nri::DescriptorPoolDesc& transientPoolDesc = descriptorAllocatorDesc.transientPoolDesc;
+			transientPoolDesc.descriptorSetMaxNum = DESCRIPTOR_POOL_SET_NUM;
+			transientPoolDesc.constantBufferMaxNum = DESCRIPTOR_POOL_SET_NUM;
+			transientPoolDesc.dynamicConstantBufferMaxNum = DESCRIPTOR_POOL_SET_NUM;
+			transientPoolDesc.textureMaxNum = DESCRIPTOR_POOL_SET_NUM;
+			transientPoolDesc.samplerMaxNum = DESCRIPTOR_POOL_SET_NUM;
+
+			// a pipelined Prepare allocates one frame ahead of the one being rendered
+			descriptorAllocatorDesc.frameSlotNum = m_frameInFlightNum + 1;
+
+			m_descriptorAllocator = std::make_shared<DescriptorAllocator>(NRI, *m_device, *m_frameFence, descriptorAllocatorDesc);
 		}
 
 		bool InitResources()
 		{
+			NFW_TRACE_SCOPE("Simple::InitResources");
+
 			const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_device);
-			// Load texture
-			m_textureStorage = std::make_shared<TextureStorage>(NRI);
-			nfw::TexturePtr texture = m_textureStorage->LoadFromFile("../../resource/texture/uimac.jpeg");
-			if (!texture)
+			m_uploadQueue = std::make_shared<UploadQueue>(NRI, *m_device, *m_commandQueue);
+			if (!m_uploadQueue->Init())
 			{
 				return false;
 			}
 
-			// Resources
-			const uint32_t constantBufferSize = Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.constantBufferOffsetAlignment);
-			const uint64_t indexDataSize = sizeof(g_indexData);
-			const uint64_t indexDataAlignedSize = Align(indexDataSize, 16);
-			const uint64_t vertexDataSize = sizeof(g_vertexData);
+			// Load textures, the same file is loaded once per texture so every one is a distinct resource
+			m_textureHeap = std::make_shared<TextureHeap>(NRI, *m_device, m_deletionQueue);
+			m_textureStorage = std::make_shared<TextureStorage>(NRI, m_textureHeap, m_deletionQueue);
+			m_textures = m_textureStorage->LoadFromFiles(std::vector<std::string>(m_textureNum, "resource/texture/uimac.jpeg"));
+			for (TextureHandle texture : m_textures)
 			{
-				nri::TextureDesc textureDesc = texture->GetTextureDesc();
-				// Texture
-				texture->CreateTexture(NRI, *m_device);
-
-				// Constant buffer
+				if (!texture)
 				{
-					nri::BufferDesc bufferDesc = {};
-					bufferDesc.size = constantBufferSize * BUFFERED_FRAME_MAX_NUM;
-					bufferDesc.usageMask = nri::BufferUsageBits::CONSTANT_BUFFER;
-					NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_device, bufferDesc, m_constantBuffer));
+					return false;
 				}
+			}
 
-				// Geometry buffer
-				{
-					nri::BufferDesc bufferDesc = {};
-					bufferDesc.size = indexDataAlignedSize + vertexDataSize;
-					bufferDesc.usageMask = nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::INDEX_BUFFER;
-					NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_device, bufferDesc, m_geometryBuffer));
-				}
-				m_geometryOffset = indexDataAlignedSize;
+			// Resources
+			m_constantBufferSize = Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.constantBufferOffsetAlignment);
+			const uint64_t frameConstantBufferSize = (uint64_t)m_constantBufferSize * m_quadNum;
+
+			Geometry geometry;
+			geometry.SetIndices(g_indexData, (uint32_t)std::size(g_indexData));
+			geometry.SetVertices(g_vertexData, (uint32_t)std::size(g_vertexData), sizeof(Vertex));
+			std::vector<uint8_t> geometryBufferData(geometry.GetPackedSize());
+			geometry.Pack(geometryBufferData.data());
+
+			// Textures and the geometry buffer are created and uploaded on job threads while the rest is set up
+			std::vector<Task<nri::Result>> textureTasks;
+			textureTasks.reserve(m_textureNum);
+			for (TextureHandle texture : m_textures)
+			{
+				textureTasks.push_back(m_uploadQueue->CreateTexture(*m_textureStorage, texture));
+				textureTasks.back().Start();
+			}
+
+			Task<nri::Buffer*> geometryTask;
+			{
+				nri::BufferDesc bufferDesc = {};
+				bufferDesc.size = geometryBufferData.size();
+				bufferDesc.usageMask = nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::INDEX_BUFFER;
+				geometryTask = m_uploadQueue->CreateBuffer(bufferDesc, geometryBufferData.data(), { nri::AccessBits::INDEX_BUFFER | nri::AccessBits::VERTEX_BUFFER });
+				geometryTask.Start();
+			}
+			m_geometryOffset = geometry.GetVertexOffset();
+
+			// Constant buffer
+			{
+				nri::BufferDesc bufferDesc = {};
+				bufferDesc.size = frameConstantBufferSize * m_frameInFlightNum;
+				bufferDesc.usageMask = nri::BufferUsageBits::CONSTANT_BUFFER;
+				NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_device, bufferDesc, m_constantBuffer));
 			}
 
 			nri::ResourceGroupDesc resourceGroupDesc = {};
@@ -335,39 +553,40 @@ namespace nfw
 			m_memoryAllocations.resize(1, nullptr);
 			NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_device, resourceGroupDesc, m_memoryAllocations.data()));
 
-			resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
-			resourceGroupDesc.bufferNum = 1;
-			resourceGroupDesc.buffers = &m_geometryBuffer;
-			resourceGroupDesc.textureNum = 1;
-			nri::Texture* texturePtr = texture->GetTexture();
-			resourceGroupDesc.textures = &texturePtr;
-
-			m_memoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_device, resourceGroupDesc), nullptr);
-			NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_device, resourceGroupDesc, m_memoryAllocations.data() + 1));
+			// Views and descriptor sets need the textures
+			for (Task<nri::Result>& task : textureTasks)
+			{
+				m_uploadQueue->Wait(task);
+				NRI_ABORT_ON_FAILURE(task.GetResult());
+			}
+			m_uploadQueue->Wait(geometryTask);
+			m_geometryBuffer = geometryTask.GetResult();
+			if (!m_geometryBuffer)
+			{
+				return false;
+			}
 
 			// Descriptors
 			{
-				// Texture
-				nri::Texture2DViewDesc texture2DViewDesc = texture->GetTexture2DViewDesc();
+				// Textures
 				NRI_ABORT_ON_FAILURE(m_textureStorage->CreateTexture2DView());
 
 				// Sampler
 				nri::SamplerDesc samplerDesc = {};
-				samplerDesc.anisotropy = 4;
 				samplerDesc.addressModes = { nri::AddressMode::MIRRORED_REPEAT, nri::AddressMode::MIRRORED_REPEAT };
 				samplerDesc.filters = { nri::Filter::LINEAR, nri::Filter::LINEAR, nri::Filter::LINEAR };
 				samplerDesc.anisotropy = 4;
 				samplerDesc.mipMax = 16.0f;
-				NRI_ABORT_ON_FAILURE(NRI.CreateSampler(*m_device, samplerDesc, m_sampler));
+				NRI_ABORT_ON_FAILURE(m_stateCache->GetSampler(samplerDesc, m_sampler));
 
-				// Constant buffer
-				for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++)
+				// Constant buffer, one quad slot per view, the dynamic offset selects the quad
+				for (uint32_t i = 0; i < m_frameInFlightNum; i++)
 				{
 					nri::BufferViewDesc bufferViewDesc = {};
 					bufferViewDesc.buffer = m_constantBuffer;
 					bufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
-					bufferViewDesc.offset = i * constantBufferSize;
-					bufferViewDesc.size = constantBufferSize;
+					bufferViewDesc.offset = i * frameConstantBufferSize;
+					bufferViewDesc.size = m_constantBufferSize;
 					NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_frames[i].constantBufferView));
 
 					m_frames[i].constantBufferViewOffset = bufferViewDesc.offset;
@@ -376,46 +595,78 @@ namespace nfw
 
 			// Descriptor sets
 			{
-				// Texture
-				NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_descriptorPool, *m_pipelineLayout, 1,
-					&m_textureDescriptorSet, 1, 0));
-
-				nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[2] = {};
-				descriptorRangeUpdateDescs[0].descriptorNum = 1;
-				nri::Descriptor* descriptor = m_textureStorage->GetTextureShaderDescriptor();
-				descriptorRangeUpdateDescs[0].descriptors = &descriptor;
+				// Textures
+				std::vector<nri::DescriptorSet*> textureDescriptorSets(m_textureNum * 2, nullptr);
+				NRI_ABORT_ON_FAILURE(m_descriptorAllocator->AllocatePersistent(*m_pipelineLayout, 1,
+					textureDescriptorSets.data(), m_textureNum * 2, 0, &m_sceneDescriptorPool));
 
-				descriptorRangeUpdateDescs[1].descriptorNum = 1;
-				descriptorRangeUpdateDescs[1].descriptors = &m_sampler;
-				NRI.UpdateDescriptorRanges(*m_textureDescriptorSet, 0, std::size(descriptorRangeUpdateDescs), descriptorRangeUpdateDescs);
+				m_textureBindings.resize(m_textureNum);
+				for (uint32_t i = 0; i < m_textureNum; i++)
+				{
+					TextureBinding& binding = m_textureBindings[i];
+					binding = { { textureDescriptorSets[i * 2], textureDescriptorSets[i * 2 + 1] }, { 0, 0 }, m_textureStorage->GetVersion(m_textures[i]), 0 };
+					WriteTextureDescriptorSet(*binding.sets[0], m_textureStorage->GetTextureShaderDescriptor(m_textures[i]));
+				}
 
 				// Constant buffer
 				for (Frame& frame : m_frames)
 				{
-					NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_descriptorPool, *m_pipelineLayout, 0, &frame.constantBufferDescriptorSet, 1, 0));
-
-					nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = { &frame.constantBufferView, 1 };
-					NRI.UpdateDescriptorRanges(*frame.constantBufferDescriptorSet, 0, 1, &descriptorRangeUpdateDesc);
+					NRI_ABORT_ON_FAILURE(m_descriptorAllocator->AllocatePersistent(*m_pipelineLayout, 0, &frame.constantBufferDescriptorSet, 1));
+					NRI.UpdateDynamicConstantBuffers(*frame.constantBufferDescriptorSet, 0, 1, &frame.constantBufferView);
 				}
 			}
 
-			// Upload data
-			{
-				std::vector<uint8_t> geometryBufferData(indexDataAlignedSize + vertexDataSize);
-				memcpy(&geometryBufferData[0], g_indexData, indexDataSize);
-				memcpy(&geometryBufferData[indexDataAlignedSize], g_vertexData, vertexDataSize);
+			// Residency, the first texture stands in for evicted ones and is pinned, so its view never changes
+			m_textureStorage->SetPinned(m_textures[0], true);
+
+			ResidencyManagerDesc residencyManagerDesc = {};
+			residencyManagerDesc.budget = m_textureMemoryBudget;
+			m_residencyManager = std::make_shared<ResidencyManager>(NRI, *m_device, m_textureStorage, m_uploadQueue, residencyManagerDesc);
+
+			// Evictions and restages leave holes in the heap blocks, the defragmenter compacts them
+			m_defragmenter = std::make_shared<Defragmenter>(NRI, *m_device, m_textureStorage, m_uploadQueue);
+			return true;
+		}
+
+		void WriteTextureDescriptorSet(nri::DescriptorSet& descriptorSet, nri::Descriptor* texture)
+		{
+			nri::Descriptor* sampler = m_sampler.get();
+
+			nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[2] = {};
+			descriptorRangeUpdateDescs[0].descriptorNum = 1;
+			descriptorRangeUpdateDescs[0].descriptors = &texture;
 
-				nri::TextureUploadDesc textureData = texture->GetTextureUploadDesc();
+			descriptorRangeUpdateDescs[1].descriptorNum = 1;
+			descriptorRangeUpdateDescs[1].descriptors = &sampler;
+			NRI.UpdateDescriptorRanges(descriptorSet, 0, std::size(descriptorRangeUpdateDescs), descriptorRangeUpdateDescs);
+		}
+
+		// An evicted texture, or one whose other set is still in flight, is drawn with the pinned first texture.
+		// nullptr when not even that one has a set with its current view, the draw is skipped then.
+		nri::DescriptorSet* GetTextureDescriptorSet(uint32_t textureIndex, uint32_t frameIndex)
+		{
+			const TextureHandle texture = m_textures[textureIndex];
+			m_residencyManager->MarkUsed(texture, frameIndex);
 
-				nri::BufferUploadDesc bufferData = {};
-				bufferData.buffer = m_geometryBuffer;
-				bufferData.data = &geometryBufferData[0];
-				bufferData.dataSize = geometryBufferData.size();
-				bufferData.after = { nri::AccessBits::INDEX_BUFFER | nri::AccessBits::VERTEX_BUFFER };
+			TextureBinding& binding = m_textureBindings[textureIndex];
+			const uint32_t version = m_textureStorage->GetVersion(texture);
+			if (version != binding.version)
+			{
+				// frame i signals 1 + i
+				nri::Descriptor* descriptor = m_textureStorage->GetTextureShaderDescriptor(texture);
+				const uint32_t inactive = binding.active ^ 1;
+				if (!descriptor || NRI.GetFenceValue(*m_frameFence) < binding.boundFrames[inactive])
+				{
+					// the active set holds a view already given to the deletion queue
+					return textureIndex ? GetTextureDescriptorSet(0, frameIndex) : nullptr;
+				}
 
-				NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_commandQueue, &textureData, 1, &bufferData, 1));
+				WriteTextureDescriptorSet(*binding.sets[inactive], descriptor);
+				binding.active = inactive;
+				binding.version = version;
 			}
-			return true;
+			binding.boundFrames[binding.active] = frameIndex + 1;
+			return binding.sets[binding.active];
 		}
 
 		void SetResolution(glm::uvec2 resolution)
@@ -423,59 +674,285 @@ namespace nfw
 			m_resolution = resolution;
 		}
 
+		CommandRecorderStats GetCommandRecorderStats() const
+		{
+			return m_commandRecorderStats;
+		}
+
+		SpriteBatchPtr GetSpriteBatch() const
+		{
+			return m_spriteBatch;
+		}
+
+		GpuProfilerPtr GetGpuProfiler() const
+		{
+			return m_gpuProfiler;
+		}
+
+		FramePacerPtr GetFramePacer() const
+		{
+			return m_framePacer;
+		}
+
+		UploadQueuePtr GetUploadQueue() const
+		{
+			return m_uploadQueue;
+		}
+
+		DeletionQueuePtr GetDeletionQueue() const
+		{
+			return m_deletionQueue;
+		}
+
+		DescriptorAllocatorPtr GetDescriptorAllocator() const
+		{
+			return m_descriptorAllocator;
+		}
+
+		StateCachePtr GetStateCache() const
+		{
+			return m_stateCache;
+		}
+
+		FrameArenaPtr GetFrameArena() const
+		{
+			return m_frameArena;
+		}
+
+		TextureStoragePtr GetTextureStorage() const
+		{
+			return m_textureStorage;
+		}
+
+		ResidencyManagerPtr GetResidencyManager() const
+		{
+			return m_residencyManager;
+		}
+
+		DefragmenterPtr GetDefragmenter() const
+		{
+			return m_defragmenter;
+		}
+
+		SimpleFrameStats GetFrameStats() const
+		{
+			return m_frameStats;
+		}
+
+		void WaitForFrame(uint32_t frameIndex)
+		{
+			NFW_TRACE_SCOPE("Simple::WaitForFrame");
+
+			const Clock::time_point begin = Clock::now();
+			Frame& frame = m_frames[frameIndex % m_frameInFlightNum];
+
+			// the slot is reused, its previous frame has to be finished on the GPU
+			if (frameIndex >= m_frameInFlightNum)
+			{
+				{
+					NFW_TRACE_SCOPE("WaitFrameFence");
+					NRI.Wait(*m_frameFence, 1 + frameIndex - m_frameInFlightNum);
+				}
+				m_frameStats.inputToPresentMs = GetElapsedMs(frame.inputTime, Clock::now());
+				NRI.ResetCommandAllocator(*frame.commandAllocator);
+				m_deletionQueue->Collect();
+			}
+
+			if (m_waitableSwapChain)
+			{
+				NFW_TRACE_SCOPE("WaitForPresent");
+				NRI.WaitForPresent(*m_swapChain);
+			}
+
+			m_framePacer->Wait();
+
+			frame.inputTime = Clock::now();
+			m_frameStats.waitMs = GetElapsedMs(begin, frame.inputTime);
+			m_waitedFrameIndex = frameIndex;
+		}
+
 		void Prepare(uint32_t frameIndex)
 		{
+			NFW_TRACE_SCOPE("Simple::Prepare");
+
+			Allocator::BeginFrame();
+			RenderPacket* packet = m_packets.BeginWrite();
+			if (!packet)
+			{
+				return;
+			}
+			HeapCheck::BeginFrame();
+
+			// Render of the slot's previous frame is done with it
+			packet->arena->Reset();
+			m_frameArena = packet->arena;
+
+			// anything released while this frame is built may still be drawn by it
+			m_deletionQueue->SetFenceValue(1 + frameIndex);
+			m_descriptorAllocator->BeginFrame(frameIndex);
+			m_residencyManager->Update(frameIndex);
+			m_defragmenter->Update();
+
+			const Clock::time_point begin = Clock::now();
+
+			// quads on a square grid in NDC, a single quad keeps the original centered layout
+			const uint32_t gridSize = (uint32_t)std::ceil(std::sqrt((float)m_quadNum));
+			const float cellSize = 2.0f / gridSize;
+			const float quadScale = (m_quadNum == 1) ? m_scale : cellSize * 0.9f * m_scale;
+			for (uint32_t i = 0; i < m_quadNum; i++)
+			{
+				const glm::vec3 position = (m_quadNum == 1) ? glm::vec3(0.0f) :
+					glm::vec3(-1.0f + cellSize * ((i % gridSize) + 0.5f), 1.0f - cellSize * ((i / gridSize) + 0.5f), 0.0f);
+				m_sceneGraph->SetLocalTransform(m_quadNodes[i], position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(quadScale));
+			}
+			m_sceneGraph->Update();
+
+			m_spriteBatch->Begin(frameIndex);
+			if (m_prepareCallback)
+			{
+				m_prepareCallback(frameIndex);
+			}
+
+			BuildRenderPacket(frameIndex, *packet);
+			packet->inputTime = begin;
+			packet->prepareMs = GetElapsedMs(begin, Clock::now());
+
+			m_packets.EndWrite();
+		}
+
+		void BuildRenderPacket(uint32_t frameIndex, RenderPacket& packet)
+		{
+			const Frame& frame = m_frames[frameIndex % m_frameInFlightNum];
+			packet.frameIndex = frameIndex;
+			packet.constants = packet.arena->Allocate<ConstantBufferLayout>(m_quadNum);
+
+			// out of memory, the frame goes without quads
+			const uint32_t quadNum = packet.constants ? m_quadNum : 0;
+
+			for (uint32_t i = 0; i < quadNum; i++)
+			{
+				ConstantBufferLayout& quadConstants = packet.constants[i];
+				memcpy(quadConstants.world, glm::value_ptr(m_sceneGraph->GetWorldMatrix(m_quadNodes[i])), sizeof(quadConstants.world));
+				quadConstants.color[0] = 1.0f;
+				quadConstants.color[1] = 1.0f;
+				quadConstants.color[2] = 1.0f;
+				quadConstants.padding = 0.0f;
+			}
+
+			// Draw list
+			DrawList& drawList = *packet.drawList;
+			drawList.Clear();
+			{
+				// no occlusion culling: the quads are translucent and all on screen, there is nothing to occlude them
+				for (uint32_t i = 0; i < quadNum; i++)
+				{
+					const glm::mat4& quadWorld = m_sceneGraph->GetWorldMatrix(m_quadNodes[i]);
+
+					const uint32_t pipelineIndex = i % m_pipelineNum;
+					const uint32_t textureIndex = i % m_textureNum;
+					nri::DescriptorSet* textureDescriptorSet = GetTextureDescriptorSet(textureIndex, frameIndex);
+					if (!textureDescriptorSet)
+					{
+						continue;
+					}
+
+					DrawCommand command;
+					command.pipelineLayout = m_pipelineLayout.get();
+					command.pipeline = m_pipelines[pipelineIndex].get();
+					command.descriptorPool = m_sceneDescriptorPool;
+					command.descriptorSets[0] = frame.constantBufferDescriptorSet;
+					command.descriptorSets[1] = textureDescriptorSet;
+					command.dynamicConstantBufferOffsets[0] = i * m_constantBufferSize;
+					command.dynamicConstantBufferMask = 1 << 0;
+					command.rootConstants = &m_transparency;
+					command.rootConstantSize = sizeof(m_transparency);
+					command.indexBuffer = m_geometryBuffer;
+					command.indexType = nri::IndexType::UINT16;
+					command.vertexBuffer = m_geometryBuffer;
+					command.vertexOffset = m_geometryOffset;
+					command.drawIndexedDesc = { 6, 1, 0, 0, 0 };
+
+					// the quad pipeline blends, so it goes into the back-to-front pass
+					const glm::vec4 center = m_viewProjection * quadWorld[3];
+					drawList.Add(MakeDrawKey(DrawPass::TRANSLUCENT, pipelineIndex, textureIndex, center.z / center.w), command);
+				}
+			}
+			drawList.Sort();
+
+			packet.sprites = m_spriteBatch->End();
 		}
 
 		void Render(uint32_t frameIndex)
 		{
+			NFW_TRACE_SCOPE("Simple::Render");
+
 			const nri::Dim_t windowWidth = static_cast<int16_t>(m_resolution.x);
 			const nri::Dim_t windowHeight = static_cast<int16_t>(m_resolution.y);
-			const uint32_t bufferedFrameIndex = frameIndex % BUFFERED_FRAME_MAX_NUM;
-			const Frame& frame = m_frames[bufferedFrameIndex];
+			const uint32_t bufferedFrameIndex = frameIndex % m_frameInFlightNum;
+			Frame& frame = m_frames[bufferedFrameIndex];
 
-			const uint32_t currentTextureIndex = NRI.AcquireNextSwapChainTexture(*m_swapChain);
-			BackBuffer& currentBackBuffer = m_backBuffers[currentTextureIndex];
+			const RenderPacket* packet = m_packets.BeginRead();
+			if (!packet)
+			{
+				return;
+			}
+			assert(packet->frameIndex == frameIndex);
 
-			if (frameIndex >= BUFFERED_FRAME_MAX_NUM)
+			if (m_waitedFrameIndex != frameIndex)
 			{
-				NRI.Wait(*m_frameFence, 1 + frameIndex - BUFFERED_FRAME_MAX_NUM);
-				NRI.ResetCommandAllocator(*frame.commandAllocator);
+				WaitForFrame(frameIndex);
 			}
 
-			ConstantBufferLayout* constants = (ConstantBufferLayout*)NRI.MapBuffer(*m_constantBuffer, frame.constantBufferViewOffset, sizeof(ConstantBufferLayout));
+			// uploads go to the queue ahead of the frame, so resources finished here are usable by it
+			m_uploadQueue->Update();
+
+			// a pipelined packet was prepared before the wait, its input is older
+			frame.inputTime = std::min(frame.inputTime, packet->inputTime);
+			m_frameStats.prepareMs = packet->prepareMs;
+
+			const uint32_t currentTextureIndex = m_headless ? bufferedFrameIndex : NRI.AcquireNextSwapChainTexture(*m_swapChain);
+			BackBuffer& currentBackBuffer = m_backBuffers[currentTextureIndex];
+
+			const Clock::time_point recordBegin = Clock::now();
+
+			uint8_t* constants = (uint8_t*)NRI.MapBuffer(*m_constantBuffer, frame.constantBufferViewOffset, (uint64_t)m_constantBufferSize * m_quadNum);
 			if (constants)
 			{
-				constants->color[0] = 1.0f;
-				constants->color[1] = 1.0f;
-				constants->color[2] = 1.0f;
-				constants->scale = m_scale;
+				for (uint32_t i = 0; packet->constants && i < m_quadNum; i++)
+				{
+					memcpy(constants + (uint64_t)i * m_constantBufferSize, &packet->constants[i], sizeof(ConstantBufferLayout));
+				}
 
 				NRI.UnmapBuffer(*m_constantBuffer);
 			}
 
+			const DrawList& drawList = *packet->drawList;
+
 			nri::TextureBarrierDesc  textureBarrierDesc = {};
 			textureBarrierDesc.texture = currentBackBuffer.texture;
 			textureBarrierDesc.after = { nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT };
 			textureBarrierDesc.layerNum = 1;
 			textureBarrierDesc.mipNum = 1;
 
-			nri::CommandBuffer* commandBuffer = frame.commandBuffer;
-			NRI.BeginCommandBuffer(*commandBuffer, m_descriptorPool);
+			CommandRecorder& recorder = *frame.recorder;
+			recorder.Begin(m_sceneDescriptorPool);
+			m_gpuProfiler->BeginFrame(recorder.GetCommandBuffer(), frameIndex);
 			{
+				GpuProfileScope frameScope(NRI, *m_gpuProfiler, recorder.GetCommandBuffer(), "Frame");
+
 				nri::BarrierGroupDesc barrierGroupDesc = {};
 				barrierGroupDesc.textureNum = 1;
 				barrierGroupDesc.textures = &textureBarrierDesc;
-				NRI.CmdBarrier(*commandBuffer, barrierGroupDesc);
+				recorder.Barrier(barrierGroupDesc);
 
 				nri::AttachmentsDesc attachmentsDesc = {};
 				attachmentsDesc.colorNum = 1;
 				attachmentsDesc.colors = &currentBackBuffer.colorAttachment;
 
-				NRI.CmdBeginRendering(*commandBuffer, attachmentsDesc);
+				recorder.BeginRendering(attachmentsDesc);
 				{
 					{
-						//helper::Annotation annotation(NRI, *commandBuffer, "Clear");
+						GpuProfileScope scope(NRI, *m_gpuProfiler, recorder.GetCommandBuffer(), "Clear");
 
 						nri::Dim_t halfWidth = windowWidth / 2;
 						nri::Dim_t halfHeight = windowHeight / 2;
@@ -484,45 +961,65 @@ namespace nfw
 						clearDesc.colorAttachmentIndex = 0;
 						clearDesc.planes = nri::PlaneBits::COLOR;
 						clearDesc.value.color.f = COLOR_0;
-						NRI.CmdClearAttachments(*commandBuffer, &clearDesc, 1, nullptr, 0);
+						recorder.ClearAttachments(&clearDesc, 1, nullptr, 0);
 
 						clearDesc.value.color.f = COLOR_1;
 						nri::Rect rects[2];
 						rects[0] = { 0, 0, halfWidth, halfHeight };
 						rects[1] = { (int16_t)halfWidth, (int16_t)halfHeight, halfWidth, halfHeight };
-						NRI.CmdClearAttachments(*commandBuffer, &clearDesc, 1, rects, std::size(rects));
+						recorder.ClearAttachments(&clearDesc, 1, rects, std::size(rects));
 					}
 
+					if (drawList.GetDrawNum())
 					{
-						//helper::Annotation annotation(NRI, *commandBuffer, "Triangle");
+						GpuProfileScope scope(NRI, *m_gpuProfiler, recorder.GetCommandBuffer(), "Scene");
 
 						const nri::Viewport viewport = { 0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f };
-						NRI.CmdSetViewports(*commandBuffer, &viewport, 1);
+						recorder.SetViewports(&viewport, 1);
+
+						nri::Rect scissor = { 0, 0, (nri::Dim_t)(windowWidth), (nri::Dim_t)(windowHeight) };
+						recorder.SetScissors(&scissor, 1);
 
-						NRI.CmdSetPipelineLayout(*commandBuffer, *m_pipelineLayout);
-						NRI.CmdSetPipeline(*commandBuffer, *m_pipeline);
-						NRI.CmdSetRootConstants(*commandBuffer, 0, &m_transparency, 4);
-						NRI.CmdSetIndexBuffer(*commandBuffer, *m_geometryBuffer, 0, nri::IndexType::UINT16);
-						NRI.CmdSetVertexBuffers(*commandBuffer, 0, 1, &m_geometryBuffer, &m_geometryOffset);
+						drawList.Record(recorder);
+					}
 
-						NRI.CmdSetDescriptorSet(*commandBuffer, 0, *frame.constantBufferDescriptorSet, nullptr);
-						NRI.CmdSetDescriptorSet(*commandBuffer, 1, *m_textureDescriptorSet, nullptr);
+					if (packet->sprites.spriteNum)
+					{
+						GpuProfileScope scope(NRI, *m_gpuProfiler, recorder.GetCommandBuffer(), "Sprites");
+
+						const nri::Viewport viewport = { 0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f };
+						recorder.SetViewports(&viewport, 1);
 
 						nri::Rect scissor = { 0, 0, (nri::Dim_t)(windowWidth), (nri::Dim_t)(windowHeight) };
-						NRI.CmdSetScissors(*commandBuffer, &scissor, 1);
-						NRI.CmdDrawIndexed(*commandBuffer, { 6, 1, 0, 0, 0 });
+						recorder.SetScissors(&scissor, 1);
+
+						m_spriteBatch->Record(recorder, m_resolution, packet->sprites);
 					}
 
 					//RenderUserInterface(*commandBuffer);
 				}
-				NRI.CmdEndRendering(*commandBuffer);
+				recorder.EndRendering();
 
 				textureBarrierDesc.before = textureBarrierDesc.after;
-				textureBarrierDesc.after = { nri::AccessBits::UNKNOWN, nri::Layout::PRESENT };
+				// offscreen targets are left readable for captures
+				if (m_headless)
+				{
+					textureBarrierDesc.after = { nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE };
+				}
+				else
+				{
+					textureBarrierDesc.after = { nri::AccessBits::UNKNOWN, nri::Layout::PRESENT };
+				}
 
-				NRI.CmdBarrier(*commandBuffer, barrierGroupDesc);
+				recorder.Barrier(barrierGroupDesc);
 			}
-			NRI.EndCommandBuffer(*commandBuffer);
+			m_gpuProfiler->EndFrame(recorder.GetCommandBuffer());
+			recorder.End();
+			m_commandRecorderStats = recorder.GetStats();
+
+			const Clock::time_point submitBegin = Clock::now();
+			m_frameStats.recordMs = GetElapsedMs(recordBegin, submitBegin);
+			m_frameStats.drawNum = drawList.GetDrawNum();
 
 			{ // Submit
 				nri::QueueSubmitDesc queueSubmitDesc = {};
@@ -531,7 +1028,11 @@ namespace nfw
 				NRI.QueueSubmit(*m_commandQueue, queueSubmitDesc);
 			}
 
-			NRI.QueuePresent(*m_swapChain);
+			if (!m_headless)
+			{
+				NFW_TRACE_SCOPE("QueuePresent");
+				NRI.QueuePresent(*m_swapChain);
+			}
 
 			{ // Signaling after "Present" improves D3D11 performance a bit
 				nri::FenceSubmitDesc signalFence = {};
@@ -544,21 +1045,36 @@ namespace nfw
 
 				NRI.QueueSubmit(*m_commandQueue, queueSubmitDesc);
 			}
+
+			m_frameStats.submitMs = GetElapsedMs(submitBegin, Clock::now());
+
+			m_packets.EndRead();
+			HeapCheck::EndFrame(frameIndex);
+		}
+
+		void SetPrepareCallback(const PrepareCallback& callback)
+		{
+			m_prepareCallback = callback;
+		}
+
+		void Stop()
+		{
+			m_packets.Close();
 		}
 
 		void Render2(uint32_t frameIndex)
 		{
 			const uint32_t windowWidth = m_resolution.x;
 			const uint32_t windowHeight = m_resolution.y;
-			const uint32_t bufferedFrameIndex = frameIndex % BUFFERED_FRAME_MAX_NUM;
+			const uint32_t bufferedFrameIndex = frameIndex % m_frameInFlightNum;
 			const Frame& frame = m_frames[bufferedFrameIndex];
 
 			const uint32_t backBufferIndex = NRI.AcquireNextSwapChainTexture(*m_swapChain);
 			const BackBuffer& backBuffer = m_backBuffers[backBufferIndex];
 
-			if (frameIndex >= BUFFERED_FRAME_MAX_NUM)
+			if (frameIndex >= m_frameInFlightNum)
 			{
-				NRI.Wait(*m_frameFence, 1 + frameIndex - BUFFERED_FRAME_MAX_NUM);
+				NRI.Wait(*m_frameFence, 1 + frameIndex - m_frameInFlightNum);
 				NRI.ResetCommandAllocator(*frame.commandAllocator);
 			}
 
@@ -623,38 +1139,86 @@ namespace nfw
 		nri::SwapChain* m_swapChain = nullptr;
 		nri::CommandQueue* m_commandQueue = nullptr;
 		nri::Fence* m_frameFence = nullptr;
-		nri::DescriptorPool* m_descriptorPool = {};
+		DescriptorAllocatorPtr m_descriptorAllocator;
+		nri::DescriptorPool* m_sceneDescriptorPool = nullptr;
 
-		nri::Pipeline* m_pipeline = {};
-		nri::PipelineLayout* m_pipelineLayout = {};
+		StateCachePtr m_stateCache;
+		std::vector<PipelinePtr> m_pipelines;
+		PipelineLayoutPtr m_pipelineLayout;
 		
 		nri::Buffer* m_constantBuffer = {};
 		nri::Buffer* m_geometryBuffer = {};
 
-		nri::DescriptorSet* m_textureDescriptorSet = {};
-		nri::Descriptor* m_sampler = {};
+		std::vector<TextureBinding> m_textureBindings;
+		SamplerPtr m_sampler;
 
-		std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_frames = {};
+		std::vector<Frame> m_frames;
 		std::vector<BackBuffer> m_backBuffers;
+		std::vector<nri::Memory*> m_offscreenMemoryAllocations;
 		std::vector<nri::Memory*> m_memoryAllocations;
+		TextureHeapPtr m_textureHeap;
 		TextureStoragePtr m_textureStorage;
+		std::vector<TextureHandle> m_textures;
+		ResidencyManagerPtr m_residencyManager;
+		DefragmenterPtr m_defragmenter;
+		uint64_t m_textureMemoryBudget = 0;
+		SceneGraphPtr m_sceneGraph;
+		std::vector<NodeId> m_quadNodes;
+		DoubleBuffer<RenderPacket> m_packets;
+		FrameArenaPtr m_frameArena;
+		PrepareCallback m_prepareCallback;
+		CommandRecorderStats m_commandRecorderStats;
+		SpriteBatchPtr m_spriteBatch;
+		GpuProfilerPtr m_gpuProfiler;
+		FramePacerPtr m_framePacer;
+		UploadQueuePtr m_uploadQueue;
+		DeletionQueuePtr m_deletionQueue;
 
 		uint64_t m_geometryOffset = 0;
 		float m_transparency = 1.0f;
 		float m_scale = 1.0f;
+		glm::mat4 m_viewProjection = glm::mat4(1.0f);
 		nri::Window m_window;
+		nri::GraphicsAPI m_graphicsAPI = nri::GraphicsAPI::D3D12;
+		bool m_headless = false;
+		uint32_t m_frameInFlightNum = 2;
+		uint8_t m_verticalSyncInterval = 0;
+		bool m_waitableSwapChain = false;
+		uint32_t m_waitedFrameIndex = ~0u;
+		uint32_t m_quadNum = 1;
+		uint32_t m_textureNum = 1;
+		uint32_t m_pipelineNum = 1;
+		uint32_t m_constantBufferSize = 0;
+		SimpleFrameStats m_frameStats = {};
 	};
 
 
-	Simple::Simple(void* hwnd, glm::uvec2 resolution)
-		: m_impl(std::make_unique<Impl>(hwnd, resolution))
+	Simple::Simple(const SimpleDesc& desc)
+		: m_impl(std::make_unique<Impl>(desc))
 	{}
 
 	Simple::~Simple() {}
 
 	bool Simple::Init() { return m_impl->Init(); }
+	void Simple::WaitForFrame(uint32_t frameIndex) { m_impl->WaitForFrame(frameIndex); }
 	void Simple::Prepare(uint32_t frameIndex) { m_impl->Prepare(frameIndex); }
 	void Simple::Render(uint32_t frameIndex) { m_impl->Render(frameIndex); }
+	void Simple::SetPrepareCallback(const PrepareCallback& callback) { m_impl->SetPrepareCallback(callback); }
+	void Simple::Stop() { m_impl->Stop(); }
 	void Simple::SetResolution(glm::uvec2 resolution) { m_impl->SetResolution(resolution); }
+	SimpleFrameStats Simple::GetFrameStats() const { return m_impl->GetFrameStats(); }
+	CommandRecorderStats Simple::GetCommandRecorderStats() const { return m_impl->GetCommandRecorderStats(); }
+	SpriteBatchPtr Simple::GetSpriteBatch() const { return m_impl->GetSpriteBatch(); }
+	GpuProfilerPtr Simple::GetGpuProfiler() const { return m_impl->GetGpuProfiler(); }
+	FramePacerPtr Simple::GetFramePacer() const { return m_impl->GetFramePacer(); }
+	UploadQueuePtr Simple::GetUploadQueue() const { return m_impl->GetUploadQueue(); }
+	DeletionQueuePtr Simple::GetDeletionQueue() const { return m_impl->GetDeletionQueue(); }
+	DescriptorAllocatorPtr Simple::GetDescriptorAllocator() const { return m_impl->GetDescriptorAllocator(); }
+	StateCachePtr Simple::GetStateCache() const { return m_impl->GetStateCache(); }
+	FrameArenaPtr Simple::GetFrameArena() const { return m_impl->GetFrameArena(); }
+	TextureStoragePtr Simple::GetTextureStorage() const { return m_impl->GetTextureStorage(); }
+	ResidencyManagerPtr Simple::GetResidencyManager() const { return m_impl->GetResidencyManager(); }
+
+	DefragmenterPtr Simple::GetDefragmenter() const { return m_impl->GetDefragmenter(); }
 
 } // namespace nwf
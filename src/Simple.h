@@ -2,21 +2,106 @@
 
 #include "Api.h"
 #include "Types.h"
+#include "CommandRecorder.h"
 
 namespace nfw
 {
+	struct SimpleDesc
+	{
+		nri::Window window = {};                // ignored when headless
+		glm::uvec2 resolution = { 800, 600 };
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::D3D12;
+		bool headless = false;                  // render into offscreen targets, no swap chain or window
+
+		// frame pacing
+		uint32_t frameInFlightNum = 2;          // 1-3, fewer frames queued means less latency and less throughput
+		uint8_t verticalSyncInterval = 0;
+		bool waitableSwapChain = false;         // WaitForFrame also blocks until the swap chain can take a frame
+		double frameRateLimit = 0.0;            // 0 is unlimited
+
+		// scene size, quads are laid out on a grid and cycle through the textures and pipelines
+		uint32_t quadNum = 1;
+		uint32_t textureNum = 1;
+		uint32_t pipelineNum = 1;
+
+		uint64_t textureMemoryBudget = 0;       // device memory for scene textures, 0 derives it from the adapter budget
+	};
+
+	// CPU time of the last rendered frame per phase, in milliseconds; read it on the Render thread
+	struct SimpleFrameStats
+	{
+		double prepareMs;
+		double waitMs;      // frame fence, present wait, frame rate limit and command allocator reset
+		double recordMs;    // constants, draw list build and command recording
+		double submitMs;    // submit, present and fence signal
+		double inputToPresentMs;    // WaitForFrame return to observed GPU completion of the newest finished frame
+		uint32_t drawNum;
+	};
+
+	// Runs on the Prepare thread after the scene update, frame data such as sprites is added here
+	using PrepareCallback = std::function<void(uint32_t frameIndex)>;
+
+	// Prepare builds a render packet for a frame and Render records and submits it. The packets
+	// are double buffered, so Prepare(i + 1) may run on one thread while Render(i) runs on another;
+	// each of the two must be called from a single thread in frame order.
 	class Simple
 	{
 		DISALLOW_COPY_AND_ASSIGN(Simple);
 	public:
-		Simple(void* hwnd, glm::uvec2 resolution);
+		Simple(const SimpleDesc& desc);
 		~Simple();
 
 		bool Init();
+
+		// Blocks until frameIndex may be recorded: frame fence, present wait and frame rate limit.
+		// Call it right before sampling input; Render does the wait itself when it was skipped.
+		void WaitForFrame(uint32_t frameIndex);
 		void Prepare(uint32_t frameIndex);
 		void Render(uint32_t frameIndex);
+
+		void SetPrepareCallback(const PrepareCallback& callback);
+
+		// Wakes Prepare and Render when they wait for each other, both return without work afterwards
+		void Stop();
 		void SetResolution(glm::uvec2 resolution);
 
+		SimpleFrameStats GetFrameStats() const;
+
+		// Bind calls issued and dropped while recording the last frame
+		CommandRecorderStats GetCommandRecorderStats() const;
+
+		// Sprites added from the prepare callback are drawn on top of the scene
+		SpriteBatchPtr GetSpriteBatch() const;
+
+		// Per-pass GPU timings, resolved frameInFlightNum frames after they were recorded
+		GpuProfilerPtr GetGpuProfiler() const;
+
+		FramePacerPtr GetFramePacer() const;
+
+		// Streaming loaders create resources through it, Render submits its uploads every frame
+		UploadQueuePtr GetUploadQueue() const;
+
+		// Release GPU objects here instead of destroying them while frames may still use them
+		DeletionQueuePtr GetDeletionQueue() const;
+
+		// Transient sets allocated from the prepare callback are valid for that frame
+		DescriptorAllocatorPtr GetDescriptorAllocator() const;
+
+		// Samplers, pipeline layouts and pipelines shared by desc
+		StateCachePtr GetStateCache() const;
+
+		// Arena of the frame being prepared, for transient data of the prepare callback; valid until that frame is rendered
+		FrameArenaPtr GetFrameArena() const;
+
+		// Scene textures, with their CPU and GPU memory
+		TextureStoragePtr GetTextureStorage() const;
+
+		// Keeps the scene textures within SimpleDesc::textureMemoryBudget
+		ResidencyManagerPtr GetResidencyManager() const;
+
+		// Compacts the heap the scene textures live in
+		DefragmenterPtr GetDefragmenter() const;
+
 	private:
 		class Impl;
 		std::unique_ptr<Impl> m_impl;
@@ -0,0 +1,368 @@
+#include "SpriteBatch.h"
+#include "CommandRecorder.h"
+#include "ShaderStorage.h"
+#include "Shader.h"
+
+namespace nfw
+{
+	struct SpriteConstants
+	{
+		float invViewportSize[2];
+		float padding[2];
+	};
+
+	class SpriteBatch::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, nri::Fence& frameFence, uint32_t bufferedFrameNum, uint32_t spriteCapacity)
+			: NRI(nri)
+			, m_device(device)
+			, m_frameFence(frameFence)
+			, m_bufferedFrameNum(bufferedFrameNum)
+			, m_spriteCapacity(spriteCapacity)
+		{}
+
+		~Impl()
+		{
+			if (m_mappedSprites)
+			{
+				NRI.UnmapBuffer(*m_instanceBuffer);
+			}
+			if (m_pipeline)
+			{
+				NRI.DestroyPipeline(*m_pipeline);
+			}
+			if (m_pipelineLayout)
+			{
+				NRI.DestroyPipelineLayout(*m_pipelineLayout);
+			}
+			if (m_sampler)
+			{
+				NRI.DestroyDescriptor(*m_sampler);
+			}
+			if (m_descriptorPool)
+			{
+				NRI.DestroyDescriptorPool(*m_descriptorPool);
+			}
+			if (m_instanceBuffer)
+			{
+				NRI.DestroyBuffer(*m_instanceBuffer);
+			}
+			for (nri::Memory* memory : m_memoryAllocations)
+			{
+				NRI.FreeMemory(*memory);
+			}
+		}
+
+		bool Init(nri::Format colorFormat)
+		{
+			const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(m_device);
+
+			// PipelineLayout
+			{
+				nri::DescriptorRangeDesc descriptorRanges[2] = {};
+				descriptorRanges[0] = { 0, SPRITE_TEXTURE_MAX_NUM, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER };
+				descriptorRanges[0].isArray = true;
+				descriptorRanges[1] = { 0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER };
+
+				nri::DescriptorSetDesc descriptorSetDesc = { 0, descriptorRanges, std::size(descriptorRanges) };
+
+				nri::RootConstantDesc pushConstant = { 0, sizeof(SpriteConstants), nri::StageBits::VERTEX_SHADER };
+
+				nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+				pipelineLayoutDesc.descriptorSetNum = 1;
+				pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+				pipelineLayoutDesc.rootConstantNum = 1;
+				pipelineLayoutDesc.rootConstants = &pushConstant;
+				pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
+
+				if (NRI.CreatePipelineLayout(m_device, pipelineLayoutDesc, m_pipelineLayout) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+			}
+
+			// Pipeline
+			{
+				nri::VertexStreamDesc vertexStreamDesc = {};
+				vertexStreamDesc.bindingSlot = 0;
+				vertexStreamDesc.stride = sizeof(Sprite);
+				vertexStreamDesc.stepRate = nri::VertexStreamStepRate::PER_INSTANCE;
+
+				nri::VertexAttributeDesc vertexAttributeDesc[5] = {};
+				{
+					vertexAttributeDesc[0].format = nri::Format::RG32_SFLOAT;
+					vertexAttributeDesc[0].offset = offsetof(Sprite, position);
+					vertexAttributeDesc[0].d3d = { "POSITION", 0 };
+					vertexAttributeDesc[0].vk.location = { 0 };
+
+					vertexAttributeDesc[1].format = nri::Format::RG32_SFLOAT;
+					vertexAttributeDesc[1].offset = offsetof(Sprite, size);
+					vertexAttributeDesc[1].d3d = { "TEXCOORD", 0 };
+					vertexAttributeDesc[1].vk.location = { 1 };
+
+					vertexAttributeDesc[2].format = nri::Format::RGBA32_SFLOAT;
+					vertexAttributeDesc[2].offset = offsetof(Sprite, uvRect);
+					vertexAttributeDesc[2].d3d = { "TEXCOORD", 1 };
+					vertexAttributeDesc[2].vk.location = { 2 };
+
+					vertexAttributeDesc[3].format = nri::Format::RGBA8_UNORM;
+					vertexAttributeDesc[3].offset = offsetof(Sprite, color);
+					vertexAttributeDesc[3].d3d = { "COLOR", 0 };
+					vertexAttributeDesc[3].vk.location = { 3 };
+
+					vertexAttributeDesc[4].format = nri::Format::R32_UINT;
+					vertexAttributeDesc[4].offset = offsetof(Sprite, textureIndex);
+					vertexAttributeDesc[4].d3d = { "TEXCOORD", 2 };
+					vertexAttributeDesc[4].vk.location = { 4 };
+				}
+
+				nri::VertexInputDesc vertexInputDesc = {};
+				vertexInputDesc.attributes = vertexAttributeDesc;
+				vertexInputDesc.attributeNum = (uint8_t)std::size(vertexAttributeDesc);
+				vertexInputDesc.streams = &vertexStreamDesc;
+				vertexInputDesc.streamNum = 1;
+
+				nri::InputAssemblyDesc inputAssemblyDesc = {};
+				inputAssemblyDesc.topology = nri::Topology::TRIANGLE_LIST;
+
+				nri::RasterizationDesc rasterizationDesc = {};
+				rasterizationDesc.viewportNum = 1;
+				rasterizationDesc.fillMode = nri::FillMode::SOLID;
+				rasterizationDesc.cullMode = nri::CullMode::NONE;
+
+				nri::ColorAttachmentDesc colorAttachmentDesc = {};
+				colorAttachmentDesc.format = colorFormat;
+				colorAttachmentDesc.colorWriteMask = nri::ColorWriteBits::RGBA;
+				colorAttachmentDesc.blendEnabled = true;
+				colorAttachmentDesc.colorBlend = { nri::BlendFactor::SRC_ALPHA, nri::BlendFactor::ONE_MINUS_SRC_ALPHA, nri::BlendFunc::ADD };
+
+				nri::OutputMergerDesc outputMergerDesc = {};
+				outputMergerDesc.colorNum = 1;
+				outputMergerDesc.colors = &colorAttachmentDesc;
+
+				ShaderStorage shaderStorage;
+				ShaderHandle vertexShader = shaderStorage.LoadShaderFromFile(deviceDesc.graphicsAPI, "Sprite.vs");
+				ShaderHandle pixelShader = shaderStorage.LoadShaderFromFile(deviceDesc.graphicsAPI, "Sprite.fs");
+				if (!vertexShader || !pixelShader)
+				{
+					return false;
+				}
+
+				nri::ShaderDesc shaderStages[] =
+				{
+					shaderStorage.GetShaderDesc(vertexShader),
+					shaderStorage.GetShaderDesc(pixelShader),
+				};
+
+				nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
+				graphicsPipelineDesc.pipelineLayout = m_pipelineLayout;
+				graphicsPipelineDesc.vertexInput = &vertexInputDesc;
+				graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
+				graphicsPipelineDesc.rasterization = rasterizationDesc;
+				graphicsPipelineDesc.outputMerger = outputMergerDesc;
+				graphicsPipelineDesc.shaders = shaderStages;
+				graphicsPipelineDesc.shaderNum = std::size(shaderStages);
+
+				if (NRI.CreateGraphicsPipeline(m_device, graphicsPipelineDesc, m_pipeline) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+			}
+
+			// Instance buffer, one region per buffered frame, mapped for the lifetime of the batch
+			{
+				nri::BufferDesc bufferDesc = {};
+				bufferDesc.size = (uint64_t)sizeof(Sprite) * m_spriteCapacity * m_bufferedFrameNum;
+				bufferDesc.usageMask = nri::BufferUsageBits::VERTEX_BUFFER;
+				if (NRI.CreateBuffer(m_device, bufferDesc, m_instanceBuffer) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+
+				nri::ResourceGroupDesc resourceGroupDesc = {};
+				resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+				resourceGroupDesc.bufferNum = 1;
+				resourceGroupDesc.buffers = &m_instanceBuffer;
+
+				m_memoryAllocations.resize(NRI.CalculateAllocationNumber(m_device, resourceGroupDesc), nullptr);
+				if (NRI.AllocateAndBindMemory(m_device, resourceGroupDesc, m_memoryAllocations.data()) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+
+				m_mappedSprites = (Sprite*)NRI.MapBuffer(*m_instanceBuffer, 0, bufferDesc.size);
+				if (!m_mappedSprites)
+				{
+					return false;
+				}
+			}
+
+			// Descriptors
+			{
+				nri::SamplerDesc samplerDesc = {};
+				samplerDesc.addressModes = { nri::AddressMode::CLAMP_TO_EDGE, nri::AddressMode::CLAMP_TO_EDGE };
+				samplerDesc.filters = { nri::Filter::LINEAR, nri::Filter::LINEAR, nri::Filter::LINEAR };
+				samplerDesc.mipMax = 16.0f;
+				if (NRI.CreateSampler(m_device, samplerDesc, m_sampler) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+
+				nri::DescriptorPoolDesc descriptorPoolDesc = {};
+				descriptorPoolDesc.descriptorSetMaxNum = 1;
+				descriptorPoolDesc.textureMaxNum = SPRITE_TEXTURE_MAX_NUM;
+				descriptorPoolDesc.samplerMaxNum = 1;
+				if (NRI.CreateDescriptorPool(m_device, descriptorPoolDesc, m_descriptorPool) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+
+				if (NRI.AllocateDescriptorSets(*m_descriptorPool, *m_pipelineLayout, 0, &m_descriptorSet, 1, 0) != nri::Result::SUCCESS)
+				{
+					return false;
+				}
+
+				nri::DescriptorRangeUpdateDesc samplerUpdateDesc = { &m_sampler, 1 };
+				NRI.UpdateDescriptorRanges(*m_descriptorSet, 1, 1, &samplerUpdateDesc);
+			}
+
+			return true;
+		}
+
+		uint32_t AddTexture(nri::Descriptor& textureView)
+		{
+			if (m_textureNum >= SPRITE_TEXTURE_MAX_NUM)
+			{
+				return UINT32_MAX;
+			}
+
+			// the first texture fills every slot so that the whole array is always valid
+			std::array<nri::Descriptor*, SPRITE_TEXTURE_MAX_NUM> descriptors;
+			const uint32_t slot = m_textureNum++;
+			const uint32_t descriptorNum = (slot == 0) ? SPRITE_TEXTURE_MAX_NUM : 1;
+			descriptors.fill(&textureView);
+
+			nri::DescriptorRangeUpdateDesc textureUpdateDesc = { descriptors.data(), descriptorNum, slot };
+			NRI.UpdateDescriptorRanges(*m_descriptorSet, 0, 1, &textureUpdateDesc);
+			return slot;
+		}
+
+		void Begin(uint32_t frameIndex)
+		{
+			if (frameIndex >= m_bufferedFrameNum)
+			{
+				NRI.Wait(m_frameFence, 1 + frameIndex - m_bufferedFrameNum);
+			}
+
+			m_frameSprites = m_mappedSprites + (uint64_t)(frameIndex % m_bufferedFrameNum) * m_spriteCapacity;
+			m_frameOffset = (uint64_t)(frameIndex % m_bufferedFrameNum) * m_spriteCapacity * sizeof(Sprite);
+			m_spriteNum = 0;
+			m_droppedNum = 0;
+		}
+
+		void Add(const Sprite& sprite)
+		{
+			Sprite* dst = Allocate(1);
+			if (dst)
+			{
+				*dst = sprite;
+			}
+		}
+
+		Sprite* Allocate(uint32_t count)
+		{
+			if (!m_frameSprites || m_spriteNum + count > m_spriteCapacity)
+			{
+				m_droppedNum += count;
+				return nullptr;
+			}
+			Sprite* sprites = m_frameSprites + m_spriteNum;
+			m_spriteNum += count;
+			return sprites;
+		}
+
+		SpriteBatchFrame End() const
+		{
+			return { m_frameOffset, m_spriteNum };
+		}
+
+		void Record(CommandRecorder& recorder, glm::uvec2 viewportSize, const SpriteBatchFrame& frame)
+		{
+			if (frame.spriteNum == 0)
+			{
+				return;
+			}
+
+			SpriteConstants constants = {};
+			constants.invViewportSize[0] = 1.0f / viewportSize.x;
+			constants.invViewportSize[1] = 1.0f / viewportSize.y;
+
+			recorder.SetPipelineLayout(*m_pipelineLayout);
+			recorder.SetPipeline(*m_pipeline);
+			recorder.SetRootConstants(0, &constants, sizeof(constants));
+			recorder.SetDescriptorPool(*m_descriptorPool);
+			recorder.SetDescriptorSet(0, *m_descriptorSet, nullptr);
+			recorder.SetVertexBuffers(0, 1, &m_instanceBuffer, &frame.offset);
+			recorder.Draw({ 6, frame.spriteNum, 0, 0 });
+		}
+
+		uint32_t GetSpriteNum() const { return m_spriteNum; }
+
+		uint32_t GetDroppedNum() const { return m_droppedNum; }
+
+	private:
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		nri::Fence& m_frameFence;
+		const uint32_t m_bufferedFrameNum;
+		const uint32_t m_spriteCapacity;
+
+		nri::PipelineLayout* m_pipelineLayout = nullptr;
+		nri::Pipeline* m_pipeline = nullptr;
+		nri::Buffer* m_instanceBuffer = nullptr;
+		nri::Descriptor* m_sampler = nullptr;
+		nri::DescriptorPool* m_descriptorPool = nullptr;
+		nri::DescriptorSet* m_descriptorSet = nullptr;
+		std::vector<nri::Memory*> m_memoryAllocations;
+
+		Sprite* m_mappedSprites = nullptr;
+		Sprite* m_frameSprites = nullptr;
+		uint64_t m_frameOffset = 0;
+		uint32_t m_textureNum = 0;
+		uint32_t m_spriteNum = 0;
+		uint32_t m_droppedNum = 0;
+	};
+
+	// constructor
+	SpriteBatch::SpriteBatch(NRIInterface& NRI, nri::Device& device, nri::Fence& frameFence, uint32_t bufferedFrameNum, uint32_t spriteCapacity)
+		: m_impl(std::make_unique<Impl>(NRI, device, frameFence, bufferedFrameNum, spriteCapacity))
+	{
+	}
+
+	// destructor
+	SpriteBatch::~SpriteBatch()
+	{
+	}
+
+	bool SpriteBatch::Init(nri::Format colorFormat) { return m_impl->Init(colorFormat); }
+
+	uint32_t SpriteBatch::AddTexture(nri::Descriptor& textureView) { return m_impl->AddTexture(textureView); }
+
+	void SpriteBatch::Begin(uint32_t frameIndex) { m_impl->Begin(frameIndex); }
+
+	void SpriteBatch::Add(const Sprite& sprite) { m_impl->Add(sprite); }
+
+	Sprite* SpriteBatch::Allocate(uint32_t count) { return m_impl->Allocate(count); }
+
+	SpriteBatchFrame SpriteBatch::End() const { return m_impl->End(); }
+
+	void SpriteBatch::Record(CommandRecorder& recorder, glm::uvec2 viewportSize) { m_impl->Record(recorder, viewportSize, m_impl->End()); }
+
+	void SpriteBatch::Record(CommandRecorder& recorder, glm::uvec2 viewportSize, const SpriteBatchFrame& frame) { m_impl->Record(recorder, viewportSize, frame); }
+
+	uint32_t SpriteBatch::GetSpriteNum() const { return m_impl->GetSpriteNum(); }
+
+	uint32_t SpriteBatch::GetDroppedNum() const { return m_impl->GetDroppedNum(); }
+
+} // namespace nfw
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	constexpr uint32_t SPRITE_TEXTURE_MAX_NUM = 8;
+
+	// One instance in the sprite instance buffer, must match the vertex input of Sprite.vs
+	struct Sprite
+	{
+		glm::vec2 position;     // top-left corner in pixels
+		glm::vec2 size;         // in pixels
+		glm::vec4 uvRect;       // u0, v0, u1, v1
+		uint32_t color;         // RGBA8, R in the lowest byte
+		uint32_t textureIndex;  // index returned by AddTexture
+	};
+
+	// Sprites of one frame, taken with End() so that a later Begin() can run while they are recorded
+	struct SpriteBatchFrame
+	{
+		uint64_t offset;
+		uint32_t spriteNum;
+	};
+
+	// Instanced 2D sprite renderer.
+	// Sprites are written straight into a persistently mapped per-frame instance buffer
+	// and drawn with a single instanced draw; the quad corners are expanded in the vertex shader.
+	class SpriteBatch
+	{
+		DISALLOW_COPY_AND_ASSIGN(SpriteBatch);
+	public:
+		SpriteBatch(NRIInterface& NRI, nri::Device& device, nri::Fence& frameFence, uint32_t bufferedFrameNum, uint32_t spriteCapacity);
+		~SpriteBatch();
+
+		bool Init(nri::Format colorFormat);
+
+		// Returns the texture index to store in Sprite::textureIndex, UINT32_MAX once SPRITE_TEXTURE_MAX_NUM are added
+		uint32_t AddTexture(nri::Descriptor& textureView);
+
+		// Waits until the GPU is done with this frame's instance buffer region
+		void Begin(uint32_t frameIndex);
+
+		void Add(const Sprite& sprite);
+
+		// Reserves count sprites to be filled by the caller, returns nullptr when the frame is full
+		Sprite* Allocate(uint32_t count);
+
+		SpriteBatchFrame End() const;
+
+		void Record(CommandRecorder& recorder, glm::uvec2 viewportSize);
+		void Record(CommandRecorder& recorder, glm::uvec2 viewportSize, const SpriteBatchFrame& frame);
+
+		uint32_t GetSpriteNum() const;
+		uint32_t GetDroppedNum() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
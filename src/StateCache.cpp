@@ -0,0 +1,397 @@
+#include "StateCache.h"
+#include "DeletionQueue.h"
+#include "Trace.h"
+
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace nfw
+{
+	namespace
+	{
+		// FNV-1a
+		uint64_t HashBytes(const void* data, size_t size)
+		{
+			const uint8_t* bytes = (const uint8_t*)data;
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		// Flattens a desc into bytes field by field, padding and pointer values never end up in the key
+		class KeyWriter
+		{
+		public:
+			template<typename T>
+			void Add(const T& value)
+			{
+				static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>);
+				m_key.append((const char*)&value, sizeof(T));
+			}
+
+			void AddString(const char* string)
+			{
+				const std::string_view view = string ? string : "";
+				Add((uint32_t)view.size());
+				m_key.append(view);
+			}
+
+			// objects created by the same device are told apart by identity
+			void AddObject(const void* object)
+			{
+				Add((uint64_t)(uintptr_t)object);
+			}
+
+			const std::string& GetKey() const
+			{
+				return m_key;
+			}
+
+		private:
+			std::string m_key;
+		};
+
+		void Write(KeyWriter& writer, const nri::SamplerDesc& desc)
+		{
+			writer.Add(desc.filters.min);
+			writer.Add(desc.filters.mag);
+			writer.Add(desc.filters.mip);
+			writer.Add(desc.filters.ext);
+			writer.Add(desc.anisotropy);
+			writer.Add(desc.mipBias);
+			writer.Add(desc.mipMin);
+			writer.Add(desc.mipMax);
+			writer.Add(desc.addressModes.u);
+			writer.Add(desc.addressModes.v);
+			writer.Add(desc.addressModes.w);
+			writer.Add(desc.compareFunc);
+			writer.Add(desc.borderColor);
+			writer.Add(desc.isInteger);
+		}
+
+		void Write(KeyWriter& writer, const nri::PipelineLayoutDesc& desc)
+		{
+			writer.Add(desc.rootRegisterSpace);
+			writer.Add(desc.rootConstantNum);
+			for (uint32_t i = 0; i < desc.rootConstantNum; i++)
+			{
+				const nri::RootConstantDesc& rootConstant = desc.rootConstants[i];
+				writer.Add(rootConstant.registerIndex);
+				writer.Add(rootConstant.size);
+				writer.Add(rootConstant.shaderStages);
+			}
+			writer.Add(desc.rootDescriptorNum);
+			for (uint32_t i = 0; i < desc.rootDescriptorNum; i++)
+			{
+				const nri::RootDescriptorDesc& rootDescriptor = desc.rootDescriptors[i];
+				writer.Add(rootDescriptor.registerIndex);
+				writer.Add(rootDescriptor.descriptorType);
+				writer.Add(rootDescriptor.shaderStages);
+			}
+			writer.Add(desc.descriptorSetNum);
+			for (uint32_t i = 0; i < desc.descriptorSetNum; i++)
+			{
+				const nri::DescriptorSetDesc& descriptorSet = desc.descriptorSets[i];
+				writer.Add(descriptorSet.registerSpace);
+				writer.Add(descriptorSet.rangeNum);
+				for (uint32_t j = 0; j < descriptorSet.rangeNum; j++)
+				{
+					const nri::DescriptorRangeDesc& range = descriptorSet.ranges[j];
+					writer.Add(range.baseRegisterIndex);
+					writer.Add(range.descriptorNum);
+					writer.Add(range.descriptorType);
+					writer.Add(range.shaderStages);
+					writer.Add(range.isDescriptorNumVariable);
+					writer.Add(range.isArray);
+				}
+				writer.Add(descriptorSet.dynamicConstantBufferNum);
+				for (uint32_t j = 0; j < descriptorSet.dynamicConstantBufferNum; j++)
+				{
+					writer.Add(descriptorSet.dynamicConstantBuffers[j].registerIndex);
+					writer.Add(descriptorSet.dynamicConstantBuffers[j].shaderStages);
+				}
+				writer.Add(descriptorSet.partiallyBound);
+			}
+			writer.Add(desc.shaderStages);
+			writer.Add(desc.ignoreGlobalSPIRVOffsets);
+			writer.Add(desc.enableD3D12DrawParametersEmulation);
+		}
+
+		void Write(KeyWriter& writer, const nri::BlendingDesc& desc)
+		{
+			writer.Add(desc.srcFactor);
+			writer.Add(desc.dstFactor);
+			writer.Add(desc.func);
+		}
+
+		void Write(KeyWriter& writer, const nri::StencilDesc& desc)
+		{
+			writer.Add(desc.compareFunc);
+			writer.Add(desc.fail);
+			writer.Add(desc.pass);
+			writer.Add(desc.depthFail);
+			writer.Add(desc.writeMask);
+			writer.Add(desc.compareMask);
+		}
+
+		void Write(KeyWriter& writer, const nri::GraphicsPipelineDesc& desc)
+		{
+			writer.AddObject(desc.pipelineLayout);
+
+			writer.Add(desc.vertexInput != nullptr);
+			if (desc.vertexInput)
+			{
+				const nri::VertexInputDesc& vertexInput = *desc.vertexInput;
+				writer.Add(vertexInput.attributeNum);
+				for (uint32_t i = 0; i < vertexInput.attributeNum; i++)
+				{
+					const nri::VertexAttributeDesc& attribute = vertexInput.attributes[i];
+					writer.AddString(attribute.d3d.semanticName);
+					writer.Add(attribute.d3d.semanticIndex);
+					writer.Add(attribute.vk.location);
+					writer.Add(attribute.offset);
+					writer.Add(attribute.format);
+					writer.Add(attribute.streamIndex);
+				}
+				writer.Add(vertexInput.streamNum);
+				for (uint32_t i = 0; i < vertexInput.streamNum; i++)
+				{
+					const nri::VertexStreamDesc& stream = vertexInput.streams[i];
+					writer.Add(stream.stride);
+					writer.Add(stream.bindingSlot);
+					writer.Add(stream.stepRate);
+				}
+			}
+
+			writer.Add(desc.inputAssembly.topology);
+			writer.Add(desc.inputAssembly.tessControlPointNum);
+			writer.Add(desc.inputAssembly.primitiveRestart);
+
+			const nri::RasterizationDesc& rasterization = desc.rasterization;
+			writer.Add(rasterization.viewportNum);
+			writer.Add(rasterization.depthBias);
+			writer.Add(rasterization.depthBiasClamp);
+			writer.Add(rasterization.depthBiasSlope);
+			writer.Add(rasterization.fillMode);
+			writer.Add(rasterization.cullMode);
+			writer.Add(rasterization.frontCounterClockwise);
+			writer.Add(rasterization.depthClamp);
+			writer.Add(rasterization.antialiasedLines);
+			writer.Add(rasterization.conservativeRasterization);
+
+			writer.Add(desc.multisample != nullptr);
+			if (desc.multisample)
+			{
+				writer.Add(desc.multisample->sampleMask);
+				writer.Add(desc.multisample->sampleNum);
+				writer.Add(desc.multisample->alphaToCoverage);
+				writer.Add(desc.multisample->programmableSampleLocations);
+			}
+
+			const nri::OutputMergerDesc& outputMerger = desc.outputMerger;
+			writer.Add(outputMerger.colorNum);
+			for (uint32_t i = 0; i < outputMerger.colorNum; i++)
+			{
+				const nri::ColorAttachmentDesc& color = outputMerger.colors[i];
+				writer.Add(color.format);
+				Write(writer, color.colorBlend);
+				Write(writer, color.alphaBlend);
+				writer.Add(color.colorWriteMask);
+				writer.Add(color.blendEnabled);
+			}
+			writer.Add(outputMerger.depth.compareFunc);
+			writer.Add(outputMerger.depth.write);
+			writer.Add(outputMerger.depth.boundsTest);
+			Write(writer, outputMerger.stencil.front);
+			Write(writer, outputMerger.stencil.back);
+			writer.Add(outputMerger.depthStencilFormat);
+			writer.Add(outputMerger.colorLogicFunc);
+
+			writer.Add(desc.shaderNum);
+			for (uint32_t i = 0; i < desc.shaderNum; i++)
+			{
+				const nri::ShaderDesc& shader = desc.shaders[i];
+				writer.Add(shader.stage);
+				writer.Add(shader.size);
+				writer.Add(HashBytes(shader.bytecode, (size_t)shader.size));
+				writer.AddString(shader.entryPointName);
+			}
+		}
+
+		template<typename T>
+		struct ObjectCache
+		{
+			std::mutex mutex;
+			std::unordered_map<std::string, std::weak_ptr<T>> objects;
+			size_t purgeSize = 64;
+			StateCacheCounters counters;
+		};
+	}
+
+	class StateCache::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, DeletionQueuePtr deletionQueue)
+			: NRI(nri)
+			, m_device(device)
+			, m_deletionQueue(deletionQueue)
+		{}
+
+		nri::Result GetSampler(const nri::SamplerDesc& samplerDesc, SamplerPtr& sampler)
+		{
+			return Get(m_samplers, samplerDesc, sampler, [&](nri::Descriptor*& object) { return NRI.CreateSampler(m_device, samplerDesc, object); });
+		}
+
+		nri::Result GetPipelineLayout(const nri::PipelineLayoutDesc& pipelineLayoutDesc, PipelineLayoutPtr& pipelineLayout)
+		{
+			return Get(m_pipelineLayouts, pipelineLayoutDesc, pipelineLayout,
+				[&](nri::PipelineLayout*& object) { return NRI.CreatePipelineLayout(m_device, pipelineLayoutDesc, object); });
+		}
+
+		nri::Result GetGraphicsPipeline(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, PipelinePtr& pipeline)
+		{
+			return Get(m_pipelines, graphicsPipelineDesc, pipeline,
+				[&](nri::Pipeline*& object) { return NRI.CreateGraphicsPipeline(m_device, graphicsPipelineDesc, object); });
+		}
+
+		nri::Result CreateGraphicsPipeline(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, PipelinePtr& pipeline)
+		{
+			NFW_TRACE_SCOPE("StateCache::Create");
+
+			nri::Pipeline* object = nullptr;
+			const nri::Result result = NRI.CreateGraphicsPipeline(m_device, graphicsPipelineDesc, object);
+			if (result == nri::Result::SUCCESS)
+			{
+				pipeline = Wrap(object);
+			}
+			return result;
+		}
+
+		StateCacheStats GetStats()
+		{
+			StateCacheStats stats;
+			stats.samplers = GetCounters(m_samplers);
+			stats.pipelineLayouts = GetCounters(m_pipelineLayouts);
+			stats.pipelines = GetCounters(m_pipelines);
+			return stats;
+		}
+
+	private:
+		template<typename T, typename Desc, typename Create>
+		nri::Result Get(ObjectCache<T>& cache, const Desc& desc, std::shared_ptr<T>& object, Create create)
+		{
+			KeyWriter writer;
+			Write(writer, desc);
+
+			// held while creating, so two threads asking for the same desc never create it twice
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			std::weak_ptr<T>& entry = cache.objects[writer.GetKey()];
+			object = entry.lock();
+			if (object)
+			{
+				cache.counters.hitNum++;
+				return nri::Result::SUCCESS;
+			}
+			cache.counters.missNum++;
+
+			NFW_TRACE_SCOPE("StateCache::Create");
+			T* created = nullptr;
+			const nri::Result result = create(created);
+			if (result != nri::Result::SUCCESS)
+			{
+				cache.objects.erase(writer.GetKey());
+				return result;
+			}
+			object = Wrap(created);
+			entry = object;
+
+			// released objects leave expired entries behind, drop them once the map has doubled
+			if (cache.objects.size() >= cache.purgeSize)
+			{
+				std::erase_if(cache.objects, [](const auto& item) { return item.second.expired(); });
+				cache.purgeSize = std::max(cache.objects.size() * 2, (size_t)64);
+			}
+			return nri::Result::SUCCESS;
+		}
+
+		template<typename T>
+		std::shared_ptr<T> Wrap(T* object)
+		{
+			// the deleter may run after the cache is gone, it must not reference it
+			NRIInterface& nri = NRI;
+			DeletionQueuePtr deletionQueue = m_deletionQueue;
+			return std::shared_ptr<T>(object, [&nri, deletionQueue](T* object)
+			{
+				if (deletionQueue)
+				{
+					deletionQueue->Release(*object);
+				}
+				else
+				{
+					Destroy(nri, *object);
+				}
+			});
+		}
+
+		static void Destroy(NRIInterface& nri, nri::Descriptor& sampler) { nri.DestroyDescriptor(sampler); }
+		static void Destroy(NRIInterface& nri, nri::PipelineLayout& pipelineLayout) { nri.DestroyPipelineLayout(pipelineLayout); }
+		static void Destroy(NRIInterface& nri, nri::Pipeline& pipeline) { nri.DestroyPipeline(pipeline); }
+
+		template<typename T>
+		StateCacheCounters GetCounters(ObjectCache<T>& cache)
+		{
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			StateCacheCounters counters = cache.counters;
+			for (const auto& item : cache.objects)
+			{
+				counters.objectNum += item.second.expired() ? 0 : 1;
+			}
+			return counters;
+		}
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		DeletionQueuePtr m_deletionQueue;
+
+		ObjectCache<nri::Descriptor> m_samplers;
+		ObjectCache<nri::PipelineLayout> m_pipelineLayouts;
+		ObjectCache<nri::Pipeline> m_pipelines;
+	};
+
+	// constructor
+	StateCache::StateCache(NRIInterface& NRI, nri::Device& device, DeletionQueuePtr deletionQueue)
+		: m_impl(std::make_unique<Impl>(NRI, device, deletionQueue))
+	{
+	}
+
+	// destructor
+	StateCache::~StateCache()
+	{
+	}
+
+	nri::Result StateCache::GetSampler(const nri::SamplerDesc& samplerDesc, SamplerPtr& sampler) { return m_impl->GetSampler(samplerDesc, sampler); }
+
+	nri::Result StateCache::GetPipelineLayout(const nri::PipelineLayoutDesc& pipelineLayoutDesc, PipelineLayoutPtr& pipelineLayout)
+	{
+		return m_impl->GetPipelineLayout(pipelineLayoutDesc, pipelineLayout);
+	}
+
+	nri::Result StateCache::GetGraphicsPipeline(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, PipelinePtr& pipeline)
+	{
+		return m_impl->GetGraphicsPipeline(graphicsPipelineDesc, pipeline);
+	}
+
+	nri::Result StateCache::CreateGraphicsPipeline(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, PipelinePtr& pipeline)
+	{
+		return m_impl->CreateGraphicsPipeline(graphicsPipelineDesc, pipeline);
+	}
+
+	StateCacheStats StateCache::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
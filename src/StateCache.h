@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct StateCacheCounters
+	{
+		uint64_t hitNum = 0;
+		uint64_t missNum = 0;
+		uint32_t objectNum = 0;     // objects still referenced
+
+		double GetHitRate() const
+		{
+			const uint64_t lookupNum = hitNum + missNum;
+			return lookupNum ? (double)hitNum / (double)lookupNum : 0.0;
+		}
+	};
+
+	struct StateCacheStats
+	{
+		StateCacheCounters samplers;
+		StateCacheCounters pipelineLayouts;
+		StateCacheCounters pipelines;
+	};
+
+	// Deduplicates samplers, pipeline layouts and graphics pipelines.
+	// A desc is hashed by value, following its pointers, shaders by a hash of their bytecode, so two identical descs
+	// built from different memory share one object. The cache holds weak references only, an object is released
+	// once the last pointer to it goes away, through the deletion queue if one is given. Lookups are thread-safe.
+	class StateCache
+	{
+		DISALLOW_COPY_AND_ASSIGN(StateCache);
+	public:
+		StateCache(NRIInterface& NRI, nri::Device& device, DeletionQueuePtr deletionQueue = nullptr);
+		~StateCache();
+
+		nri::Result GetSampler(const nri::SamplerDesc& samplerDesc, SamplerPtr& sampler);
+		nri::Result GetPipelineLayout(const nri::PipelineLayoutDesc& pipelineLayoutDesc, PipelineLayoutPtr& pipelineLayout);
+
+		// The layout is part of the key, layouts from GetPipelineLayout make identical descs match
+		nri::Result GetGraphicsPipeline(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, PipelinePtr& pipeline);
+
+		// Always creates a new pipeline, for objects that must stay distinct, and does not count as a lookup
+		nri::Result CreateGraphicsPipeline(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, PipelinePtr& pipeline);
+
+		StateCacheStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "JobSystem.h"
+
+namespace nfw
+{
+	class TaskPromiseBase
+	{
+	public:
+		// resumes whoever awaited the task, or marks it done for Task::IsDone
+		struct FinalAwaiter
+		{
+			bool await_ready() const noexcept { return false; }
+
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+			{
+				TaskPromiseBase& promise = handle.promise();
+
+				// read before publishing done, the owner may destroy the frame right after
+				const std::coroutine_handle<> continuation = promise.m_continuation;
+				promise.m_done.store(true, std::memory_order_release);
+				return continuation ? continuation : std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept {}
+		};
+
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		FinalAwaiter final_suspend() const noexcept { return {}; }
+		void unhandled_exception() { m_exception = std::current_exception(); }
+
+		void SetContinuation(std::coroutine_handle<> continuation) { m_continuation = continuation; }
+		bool IsDone() const { return m_done.load(std::memory_order_acquire); }
+
+	protected:
+		void RethrowIfFailed() const
+		{
+			if (m_exception)
+			{
+				std::rethrow_exception(m_exception);
+			}
+		}
+
+	private:
+		std::coroutine_handle<> m_continuation;
+		std::exception_ptr m_exception;
+		std::atomic<bool> m_done = false;
+	};
+
+	template <typename T>
+	class TaskPromise : public TaskPromiseBase
+	{
+	public:
+		template <typename U>
+		void return_value(U&& value) { m_value.emplace(std::forward<U>(value)); }
+
+		T& GetResult()
+		{
+			RethrowIfFailed();
+			return *m_value;
+		}
+
+	private:
+		std::optional<T> m_value;
+	};
+
+	template <>
+	class TaskPromise<void> : public TaskPromiseBase
+	{
+	public:
+		void return_void() {}
+		void GetResult() { RethrowIfFailed(); }
+	};
+
+	// Coroutine result that starts suspended.
+	// co_await runs it on the awaiting thread and resumes the awaiting coroutine when it returns.
+	// Start() runs it on a job thread for callers that are not coroutines, poll IsDone or wait with JobSystem::Wait.
+	template <typename T = void>
+	class Task
+	{
+	public:
+		class promise_type : public TaskPromise<T>
+		{
+		public:
+			Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		};
+
+		using Handle = std::coroutine_handle<promise_type>;
+
+		Task() = default;
+		Task(Task&& other) noexcept
+			: m_handle(std::exchange(other.m_handle, {}))
+			, m_started(std::exchange(other.m_started, false))
+		{}
+		Task& operator=(Task&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				m_handle = std::exchange(other.m_handle, {});
+				m_started = std::exchange(other.m_started, false);
+			}
+			return *this;
+		}
+
+		Task(const Task&) = delete;
+		void operator=(const Task&) = delete;
+
+		~Task() { Reset(); }
+
+		void Start()
+		{
+			assert(m_handle && !m_started);
+			m_started = true;
+			JobSystem::Run([handle = m_handle]() { handle.resume(); });
+		}
+
+		bool IsValid() const { return (bool)m_handle; }
+		bool IsDone() const { return m_handle && m_handle.promise().IsDone(); }
+
+		// Only after IsDone, rethrows what the coroutine threw
+		decltype(auto) GetResult() { return m_handle.promise().GetResult(); }
+
+		auto operator co_await() && noexcept
+		{
+			struct Awaiter
+			{
+				Handle handle;
+
+				bool await_ready() const noexcept { return false; }
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+				{
+					handle.promise().SetContinuation(awaiting);
+					return handle;
+				}
+
+				T await_resume()
+				{
+					if constexpr (std::is_void_v<T>)
+					{
+						handle.promise().GetResult();
+					}
+					else
+					{
+						return std::move(handle.promise().GetResult());
+					}
+				}
+			};
+			assert(m_handle && !m_started);
+			m_started = true;
+			return Awaiter{ m_handle };
+		}
+
+	private:
+		explicit Task(Handle handle) : m_handle(handle) {}
+
+		void Reset()
+		{
+			if (m_handle)
+			{
+				// a started task owns its frame until it finishes
+				assert(!m_started || m_handle.promise().IsDone());
+				m_handle.destroy();
+				m_handle = {};
+			}
+		}
+
+		Handle m_handle;
+		bool m_started = false;
+	};
+
+	// co_await ResumeOnJobThread() moves the rest of the coroutine onto a job thread
+	inline auto ResumeOnJobThread()
+	{
+		struct Awaiter
+		{
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> handle) const { JobSystem::Run([handle]() { handle.resume(); }); }
+			void await_resume() const noexcept {}
+		};
+		return Awaiter{};
+	}
+} // namespace nfw
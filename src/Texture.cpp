@@ -1,68 +1,93 @@
 #include "Texture.h"
+#include "FileSystem.h"
+#include "ImageDecoder.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+// WIC decodes the formats the built-in decoders do not, it is only available on Windows
+#if defined(_WIN32)
+#define NFW_TEXTURE_WIC
 #include <DirectXTex.h>
-#include <filesystem>
 #include <Extensions/NRIWrapperD3D12.h>
+#endif
 
 
 namespace nfw
 {
-	namespace fs = std::filesystem;
-
 	class Texture::Impl
 	{
+		struct MipLevel
+		{
+			const uint8_t* pixels;
+			uint32_t rowPitch;
+			uint32_t slicePitch;
+		};
+
 	public:
 		Impl() {}
 		~Impl() 
 		{
 		}
 
-		bool LoadFromFile(const std::string& texturePath)
+		bool LoadFromFile(const std::string& texturePath, uint32_t firstMip)
 		{
-			fs::path filePath = texturePath;
+			NFW_TRACE_SCOPE("Texture::LoadFromFile");
 
-			DirectX::TexMetadata metaData;
-			DirectX::ScratchImage scratch;
-			if (DirectX::LoadFromWICFile(filePath.wstring().c_str(), DirectX::WIC_FLAGS::WIC_FLAGS_NONE, &metaData, scratch) == S_OK)
+			m_path = texturePath;
+			if (!Decode(firstMip))
 			{
+				return false;
+			}
+			UpdateUploadDesc();
+			return true;
+		}
 
-				const DirectX::Image* scratchImage = scratch.GetImage(0, 0, 0);
-				if (DirectX::GenerateMipMaps(*scratchImage, DirectX::TEX_FILTER_LINEAR, 0, m_image, false) == S_OK)
-				{
-					const DirectX::TexMetadata& texMeta = m_image.GetMetadata();
-					m_textureDesc.type = nri::TextureType::TEXTURE_2D;
-					m_textureDesc.format = nri::nriConvertDXGIFormatToNRI(texMeta.format);
-					m_textureDesc.usageMask = nri::TextureUsageBits::SHADER_RESOURCE;
-					m_textureDesc.width = texMeta.width;
-					m_textureDesc.height = texMeta.height;
-					m_textureDesc.depth = 1;
-					m_textureDesc.mipNum = texMeta.mipLevels;
-					m_textureDesc.layerNum = texMeta.arraySize;
-					m_textureDesc.sampleNum = 1;
-					return true;
-				}
+		bool ReloadPixels(uint32_t firstMip)
+		{
+			NFW_TRACE_SCOPE("Texture::ReloadPixels");
+
+			if (HasPixels() && m_firstMip <= firstMip)
+			{
+				return true;
 			}
+			ReleasePixels();
 
-			return false;
+			// the NRI texture was created from the first decode, the file must still match it
+			const nri::TextureDesc textureDesc = m_textureDesc;
+			if (!Decode(firstMip) || m_textureDesc.format != textureDesc.format || m_textureDesc.width != textureDesc.width
+				|| m_textureDesc.height != textureDesc.height || m_textureDesc.mipNum != textureDesc.mipNum)
+			{
+				m_textureDesc = textureDesc;
+				ReleasePixels();
+				return false;
+			}
+			UpdateUploadDesc();
+			return true;
+		}
+
+		void ReleasePixels()
+		{
+#ifdef NFW_TEXTURE_WIC
+			m_image.Release();
+#endif
+			std::vector<uint8_t>().swap(m_pixels);
+			m_firstMip = 0;
+			m_mips = {};
+			m_subresources = {};
+			m_uploadDesc.subresources = nullptr;
 		}
 
+		bool HasPixels() const { return m_mips[m_firstMip].pixels != nullptr; }
+
 		nri::Result CreateTexture(NRIInterface & NRI, nri::Device & device)
 		{
 			nri::Result res = NRI.CreateTexture(device, m_textureDesc, m_texture);
 			if (res == nri::Result::SUCCESS)
 			{
 				m_texture2DViewDesc = { m_texture, nri::Texture2DViewType::SHADER_RESOURCE_2D, m_textureDesc.format };
-				
-				for (uint32_t mip = 0; mip < m_textureDesc.mipNum; mip++)
-				{
-					nri::TextureSubresourceUploadDesc& subresource = m_subresources[mip];
-					auto* image = m_image.GetImage(mip, 0, 0);
-					subresource.slices = image->pixels;
-					subresource.sliceNum = 1;
-					subresource.rowPitch = (uint32_t)image->rowPitch;
-					subresource.slicePitch = (uint32_t)image->slicePitch;
-				}
-
-				m_uploadDesc.subresources = m_subresources.data();
 				m_uploadDesc.texture = m_texture;
 				m_uploadDesc.after = { nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE };
 			}
@@ -74,16 +99,183 @@ namespace nfw
 			return NRI.CreateTexture2DView(m_texture2DViewDesc, *textureShaderDescriptor);
 		}
 
-		nri::Texture* GetTexture() { return m_texture; }
+		nri::Texture* GetTexture() const { return m_texture; }
 
-		nri::TextureDesc GetTextureDesc() const { return m_textureDesc; }
+		const nri::TextureDesc& GetTextureDesc() const { return m_textureDesc; }
 
-		nri::Texture2DViewDesc GetTexture2DViewDesc() const { return m_texture2DViewDesc; }
+		const nri::Texture2DViewDesc& GetTexture2DViewDesc() const { return m_texture2DViewDesc; }
 
-		nri::TextureUploadDesc GetTextureUploadDesc() const { return m_uploadDesc; }
+		const nri::TextureUploadDesc& GetTextureUploadDesc() const { return m_uploadDesc; }
+
+		const std::string& GetPath() const { return m_path; }
+
+		uint64_t GetPixelDataSize() const
+		{
+			uint64_t size = 0;
+			for (uint32_t mip = 0; mip < m_textureDesc.mipNum; mip++)
+			{
+				size += m_mips[mip].slicePitch;
+			}
+			return size;
+		}
 
 	private:
+		// Mips above firstMip are left out, JPEG decodes straight at the size of the first one it needs (up to 1/8)
+		bool Decode(uint32_t firstMip)
+		{
+			std::vector<uint8_t> fileData;
+			if (!FileSystem::ReadFile(m_path, fileData) || fileData.empty())
+			{
+				return false;
+			}
+
+			DecodedImage image;
+			if (DecodeImage(fileData.data(), fileData.size(), std::min(firstMip, 3u), image))
+			{
+				SetImage(image, firstMip);
+				return true;
+			}
+
+#ifdef NFW_TEXTURE_WIC
+			DirectX::TexMetadata metaData;
+			DirectX::ScratchImage scratch;
+			if (DirectX::LoadFromWICMemory(fileData.data(), fileData.size(), DirectX::WIC_FLAGS::WIC_FLAGS_NONE, &metaData, scratch) == S_OK)
+			{
+
+				const DirectX::Image* scratchImage = scratch.GetImage(0, 0, 0);
+				if (DirectX::GenerateMipMaps(*scratchImage, DirectX::TEX_FILTER_LINEAR, 0, m_image, false) == S_OK)
+				{
+					const DirectX::TexMetadata& texMeta = m_image.GetMetadata();
+					SetTextureDesc(nri::nriConvertDXGIFormatToNRI(texMeta.format), (uint32_t)texMeta.width, (uint32_t)texMeta.height, (uint32_t)texMeta.mipLevels);
+					m_textureDesc.layerNum = texMeta.arraySize;
+
+					for (uint32_t mip = 0; mip < m_textureDesc.mipNum; mip++)
+					{
+						const DirectX::Image* image = m_image.GetImage(mip, 0, 0);
+						m_mips[mip] = { image->pixels, (uint32_t)image->rowPitch, (uint32_t)image->slicePitch };
+					}
+					return true;
+				}
+			}
+#endif
+
+			return false;
+		}
+
+		// subresources point into the decoded mips
+		void UpdateUploadDesc()
+		{
+			for (uint32_t mip = 0; mip < m_textureDesc.mipNum; mip++)
+			{
+				nri::TextureSubresourceUploadDesc& subresource = m_subresources[mip];
+				subresource.slices = m_mips[mip].pixels;
+				subresource.sliceNum = 1;
+				subresource.rowPitch = m_mips[mip].rowPitch;
+				subresource.slicePitch = m_mips[mip].slicePitch;
+			}
+			m_uploadDesc.subresources = m_subresources.data();
+		}
+
+		void SetTextureDesc(nri::Format format, uint32_t width, uint32_t height, uint32_t mipNum)
+		{
+			m_textureDesc.type = nri::TextureType::TEXTURE_2D;
+			m_textureDesc.format = format;
+			m_textureDesc.usageMask = nri::TextureUsageBits::SHADER_RESOURCE;
+			m_textureDesc.width = (nri::Dim_t)width;
+			m_textureDesc.height = (nri::Dim_t)height;
+			m_textureDesc.depth = 1;
+			m_textureDesc.mipNum = (nri::Mip_t)mipNum;
+			m_textureDesc.layerNum = 1;
+			m_textureDesc.sampleNum = 1;
+		}
+
+		// RGBA8 mip chain from firstMip down, box filtered from the decoded image
+		void SetImage(const DecodedImage& image, uint32_t firstMip)
+		{
+			uint32_t mipNum = 1;
+			while ((std::max(image.width, image.height) >> mipNum) != 0)
+			{
+				mipNum++;
+			}
+			firstMip = std::min(firstMip, mipNum - 1);
+			const uint32_t decodedMip = std::min(image.scaleShift, mipNum - 1);
+
+			size_t pixelsSize = 0;
+			for (uint32_t mip = firstMip; mip < mipNum; mip++)
+			{
+				pixelsSize += (size_t)std::max(image.width >> mip, 1u) * std::max(image.height >> mip, 1u) * 4;
+			}
+			m_pixels.resize(pixelsSize);
+			m_mips = {};
+			m_firstMip = firstMip;
+
+			// mips above firstMip are only steps towards it
+			std::array<std::vector<uint8_t>, 2> scratch;
+			const uint8_t* src = image.pixels.data();
+			size_t offset = 0;
+			for (uint32_t mip = decodedMip; mip < mipNum; mip++)
+			{
+				const uint32_t width = std::max(image.width >> mip, 1u);
+				const uint32_t height = std::max(image.height >> mip, 1u);
+				const size_t slicePitch = (size_t)width * height * 4;
+
+				uint8_t* dst = nullptr;
+				if (mip >= firstMip)
+				{
+					dst = m_pixels.data() + offset;
+					m_mips[mip] = { dst, width * 4, (uint32_t)slicePitch };
+					offset += slicePitch;
+				}
+				else
+				{
+					scratch[mip & 1].resize(slicePitch);
+					dst = scratch[mip & 1].data();
+				}
+
+				if (mip == decodedMip)
+				{
+					memcpy(dst, src, slicePitch);
+				}
+				else
+				{
+					Downsample(src, std::max(image.width >> (mip - 1), 1u), std::max(image.height >> (mip - 1), 1u), dst, width, height);
+				}
+				src = dst;
+			}
+
+			SetTextureDesc(nri::Format::RGBA8_UNORM, image.width, image.height, mipNum);
+		}
+
+		// 2x2 box filter, the last row or column of an odd size is repeated
+		static void Downsample(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, uint32_t width, uint32_t height)
+		{
+			ParallelFor(height, 64, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t y = begin; y < end; y++)
+				{
+					const uint8_t* row0 = src + (size_t)std::min(y * 2, srcHeight - 1) * srcWidth * 4;
+					const uint8_t* row1 = src + (size_t)std::min(y * 2 + 1, srcHeight - 1) * srcWidth * 4;
+					uint8_t* out = dst + (size_t)y * width * 4;
+					for (uint32_t x = 0; x < width; x++)
+					{
+						const uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+						const uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+						for (uint32_t c = 0; c < 4; c++)
+						{
+							out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+						}
+					}
+				}
+			});
+		}
+
+		std::string m_path;
+#ifdef NFW_TEXTURE_WIC
 		DirectX::ScratchImage m_image;
+#endif
+		std::vector<uint8_t> m_pixels;     // mips from m_firstMip down
+		uint32_t m_firstMip = 0;
+		std::array<MipLevel, 16> m_mips = {};
 
 		nri::Texture* m_texture = {};
 		nri::TextureDesc m_textureDesc{};
@@ -103,21 +295,31 @@ namespace nfw
 	{
 	}
 
-	bool Texture::LoadFromFile(const std::string& texturePath)
+	bool Texture::LoadFromFile(const std::string& texturePath, uint32_t firstMip)
 	{
-		return m_impl->LoadFromFile(texturePath);
+		return m_impl->LoadFromFile(texturePath, firstMip);
 	}
 
-	nri::Texture* Texture::GetTexture()  { return m_impl->GetTexture(); }
+	bool Texture::ReloadPixels(uint32_t firstMip) { return m_impl->ReloadPixels(firstMip); }
+
+	void Texture::ReleasePixels() { m_impl->ReleasePixels(); }
+
+	bool Texture::HasPixels() const { return m_impl->HasPixels(); }
 
-	nri::TextureDesc Texture::GetTextureDesc() const { return m_impl->GetTextureDesc(); }
+	nri::Texture* Texture::GetTexture() const { return m_impl->GetTexture(); }
 
-	nri::Texture2DViewDesc Texture::GetTexture2DViewDesc() const { return m_impl->GetTexture2DViewDesc(); }
+	const nri::TextureDesc& Texture::GetTextureDesc() const { return m_impl->GetTextureDesc(); }
+
+	const nri::Texture2DViewDesc& Texture::GetTexture2DViewDesc() const { return m_impl->GetTexture2DViewDesc(); }
 
 	nri::Result Texture::CreateTexture(NRIInterface& NRI, nri::Device& device) { return m_impl->CreateTexture(NRI, device); }
 
 	nri::Result Texture::CreateTexture2DView(NRIInterface& NRI, nri::Descriptor** textureShaderDescriptor) { return m_impl->CreateTexture2DView(NRI, textureShaderDescriptor); }
 
-	nri::TextureUploadDesc Texture::GetTextureUploadDesc() const { return m_impl->GetTextureUploadDesc(); }
+	const nri::TextureUploadDesc& Texture::GetTextureUploadDesc() const { return m_impl->GetTextureUploadDesc(); }
+
+	const std::string& Texture::GetPath() const { return m_impl->GetPath(); }
+
+	uint64_t Texture::GetPixelDataSize() const { return m_impl->GetPixelDataSize(); }
 
 } // namespace nfw
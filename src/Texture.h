@@ -5,6 +5,8 @@
 
 namespace nfw
 {
+	// Decoded image of one texture file and the NRI texture created from it.
+	// Owned by TextureStorage, which keeps the fields needed per frame in its own arrays.
 	class Texture
 	{
 		DISALLOW_COPY_AND_ASSIGN(Texture);
@@ -12,13 +14,28 @@ namespace nfw
 		Texture();
 		~Texture();
 
-		bool LoadFromFile(const std::string& texturePath);
+		// Mips above firstMip are skipped like in ReloadPixels, the descs still describe the full image
+		bool LoadFromFile(const std::string& texturePath, uint32_t firstMip = 0);
 
-		nri::Texture* Texture::GetTexture();
+		// Decodes the file again after ReleasePixels, fails when it no longer matches the created texture.
+		// Mips above firstMip are skipped, and a JPEG is decoded directly at a smaller size for them.
+		// The upload desc points into the pixels again afterwards, with no data for the skipped mips.
+		bool ReloadPixels(uint32_t firstMip = 0);
 
-		nri::TextureDesc GetTextureDesc() const;
-		nri::Texture2DViewDesc GetTexture2DViewDesc() const;
-		nri::TextureUploadDesc GetTextureUploadDesc() const;
+		// Drops the decoded pixels once they are on the GPU, the descs and the NRI texture stay
+		void ReleasePixels();
+		bool HasPixels() const;
+
+		nri::Texture* GetTexture() const;
+
+		const nri::TextureDesc& GetTextureDesc() const;
+		const nri::Texture2DViewDesc& GetTexture2DViewDesc() const;
+		const nri::TextureUploadDesc& GetTextureUploadDesc() const;
+
+		const std::string& GetPath() const;
+
+		// Bytes of decoded pixel data over all mips, 0 while released
+		uint64_t GetPixelDataSize() const;
 
 		nri::Result CreateTexture(NRIInterface& NRI, nri::Device& device);
 		nri::Result CreateTexture2DView(NRIInterface& NRI, nri::Descriptor** textureShaderResource);
@@ -0,0 +1,350 @@
+#include "TextureHeap.h"
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace nfw
+{
+	namespace
+	{
+		uint64_t AlignUp(uint64_t value, uint64_t alignment)
+		{
+			return alignment ? (value + alignment - 1) / alignment * alignment : value;
+		}
+
+		struct Range
+		{
+			uint64_t offset;
+			uint64_t size;
+		};
+
+		struct Block
+		{
+			nri::Memory* memory = nullptr;      // nullptr once the block is freed, its slot is reused
+			nri::MemoryType type = 0;
+			uint64_t size = 0;
+			uint64_t usedSize = 0;
+			std::vector<Range> freeRanges;      // sorted by offset, neighbours merged
+			bool dedicated = false;
+			bool evacuating = false;
+		};
+	}
+
+	class TextureHeap::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, DeletionQueuePtr deletionQueue, const TextureHeapDesc& desc)
+			: NRI(nri)
+			, m_device(device)
+			, m_deletionQueue(deletionQueue)
+			, m_desc(desc)
+		{}
+
+		~Impl()
+		{
+			for (Block& block : m_blocks)
+			{
+				if (block.memory)
+				{
+					NRI.FreeMemory(*block.memory);
+				}
+			}
+		}
+
+		nri::Result Bind(nri::Texture& texture, TextureMemory& memory)
+		{
+			nri::MemoryDesc memoryDesc = {};
+			NRI.GetTextureMemoryDesc(m_device, NRI.GetTextureDesc(texture), nri::MemoryLocation::DEVICE, memoryDesc);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			memory = {};
+
+			const bool dedicated = memoryDesc.mustBeDedicated || memoryDesc.size > m_desc.blockSize;
+			for (uint32_t i = 0; i < m_blocks.size() && !dedicated; i++)
+			{
+				const Block& block = m_blocks[i];
+				if (block.memory && !block.dedicated && !block.evacuating && block.type == memoryDesc.type && Place(i, memoryDesc, memory))
+				{
+					break;
+				}
+			}
+
+			if (!memory)
+			{
+				const uint32_t blockIndex = CreateBlock(dedicated ? memoryDesc.size : m_desc.blockSize, memoryDesc.type, dedicated);
+				if (blockIndex == UINT32_MAX)
+				{
+					return nri::Result::OUT_OF_MEMORY;
+				}
+				Place(blockIndex, memoryDesc, memory);
+			}
+
+			const nri::TextureMemoryBindingDesc bindingDesc = { m_blocks[memory.block].memory, &texture, memory.offset };
+			const nri::Result result = NRI.BindTextureMemory(m_device, &bindingDesc, 1);
+			if (result != nri::Result::SUCCESS)
+			{
+				FreeRange(memory);
+				memory = {};
+			}
+			return result;
+		}
+
+		void Free(const TextureMemory& memory)
+		{
+			if (!memory)
+			{
+				return;
+			}
+
+			if (m_deletionQueue)
+			{
+				// queued after the texture, so the range is reused only once nothing is bound to it
+				m_deletionQueue->Release([this, memory]()
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					FreeRange(memory);
+				});
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				FreeRange(memory);
+			}
+		}
+
+		uint32_t BeginEvacuation(float maxUsage, const std::vector<uint32_t>& keptBlocks)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto isKept = [&keptBlocks](uint32_t i) { return std::find(keptBlocks.begin(), keptBlocks.end(), i) != keptBlocks.end(); };
+
+			// one block at a time, a block that has to be kept meanwhile takes new ranges again
+			for (uint32_t i = 0; i < m_blocks.size(); i++)
+			{
+				if (m_blocks[i].memory && m_blocks[i].evacuating)
+				{
+					if (!isKept(i))
+					{
+						return i;
+					}
+					m_blocks[i].evacuating = false;
+				}
+			}
+
+			uint32_t sparsest = UINT32_MAX;
+			for (uint32_t i = 0; i < m_blocks.size(); i++)
+			{
+				const Block& block = m_blocks[i];
+				if (!block.memory || block.dedicated || !block.usedSize || (double)block.usedSize >= (double)block.size * maxUsage || isKept(i))
+				{
+					continue;
+				}
+				if (sparsest == UINT32_MAX || block.usedSize * m_blocks[sparsest].size < m_blocks[sparsest].usedSize * block.size)
+				{
+					sparsest = i;
+				}
+			}
+			if (sparsest == UINT32_MAX)
+			{
+				return UINT32_MAX;
+			}
+
+			// moving into a new block would only trade one sparse block for another
+			uint64_t roomSize = 0;
+			for (uint32_t i = 0; i < m_blocks.size(); i++)
+			{
+				const Block& block = m_blocks[i];
+				if (i != sparsest && block.memory && !block.dedicated && block.type == m_blocks[sparsest].type)
+				{
+					roomSize += block.size - block.usedSize;
+				}
+			}
+			if (roomSize < m_blocks[sparsest].usedSize)
+			{
+				return UINT32_MAX;
+			}
+
+			m_blocks[sparsest].evacuating = true;
+			return sparsest;
+		}
+
+		bool IsEvacuating(uint32_t block) const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return block < m_blocks.size() && m_blocks[block].memory && m_blocks[block].evacuating;
+		}
+
+		TextureHeapStats GetStats() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			TextureHeapStats stats;
+			stats.releasedBlockNum = m_releasedBlockNum;
+			for (const Block& block : m_blocks)
+			{
+				if (!block.memory)
+				{
+					continue;
+				}
+				stats.blockNum++;
+				stats.blockBytes += block.size;
+				stats.usedBytes += block.usedSize;
+				for (const Range& range : block.freeRanges)
+				{
+					if (!block.dedicated && !block.evacuating)
+					{
+						stats.largestFreeBytes = std::max(stats.largestFreeBytes, range.size);
+					}
+				}
+			}
+			return stats;
+		}
+
+	private:
+		// m_mutex must be held for the rest
+
+		uint32_t CreateBlock(uint64_t size, nri::MemoryType type, bool dedicated)
+		{
+			nri::AllocateMemoryDesc allocateMemoryDesc = {};
+			allocateMemoryDesc.size = size;
+			allocateMemoryDesc.type = type;
+
+			nri::Memory* memory = nullptr;
+			if (NRI.AllocateMemory(m_device, allocateMemoryDesc, memory) != nri::Result::SUCCESS)
+			{
+				return UINT32_MAX;
+			}
+
+			auto it = std::find_if(m_blocks.begin(), m_blocks.end(), [](const Block& block) { return !block.memory; });
+			if (it == m_blocks.end())
+			{
+				it = m_blocks.insert(it, Block());
+			}
+			it->memory = memory;
+			it->type = type;
+			it->size = size;
+			it->usedSize = 0;
+			it->freeRanges.assign(1, { 0, size });
+			it->dedicated = dedicated;
+			it->evacuating = false;
+			return (uint32_t)(it - m_blocks.begin());
+		}
+
+		// First fit, the alignment gap in front stays free
+		bool Place(uint32_t blockIndex, const nri::MemoryDesc& memoryDesc, TextureMemory& memory)
+		{
+			Block& block = m_blocks[blockIndex];
+			for (size_t i = 0; i < block.freeRanges.size(); i++)
+			{
+				const Range range = block.freeRanges[i];
+				const uint64_t offset = AlignUp(range.offset, memoryDesc.alignment);
+				const uint64_t end = offset + memoryDesc.size;
+				const uint64_t rangeEnd = range.offset + range.size;
+				if (end > rangeEnd)
+				{
+					continue;
+				}
+
+				if (offset > range.offset)
+				{
+					block.freeRanges[i].size = offset - range.offset;
+					if (end < rangeEnd)
+					{
+						block.freeRanges.insert(block.freeRanges.begin() + i + 1, { end, rangeEnd - end });
+					}
+				}
+				else if (end < rangeEnd)
+				{
+					block.freeRanges[i] = { end, rangeEnd - end };
+				}
+				else
+				{
+					block.freeRanges.erase(block.freeRanges.begin() + i);
+				}
+
+				block.usedSize += memoryDesc.size;
+				memory = { blockIndex, offset, memoryDesc.size };
+				return true;
+			}
+			return false;
+		}
+
+		void FreeRange(const TextureMemory& memory)
+		{
+			Block& block = m_blocks[memory.block];
+			std::vector<Range>& ranges = block.freeRanges;
+
+			auto it = std::lower_bound(ranges.begin(), ranges.end(), memory.offset, [](const Range& range, uint64_t offset) { return range.offset < offset; });
+			it = ranges.insert(it, { memory.offset, memory.size });
+			if (it + 1 != ranges.end() && it->offset + it->size == (it + 1)->offset)
+			{
+				it->size += (it + 1)->size;
+				ranges.erase(it + 1);
+			}
+			if (it != ranges.begin() && (it - 1)->offset + (it - 1)->size == it->offset)
+			{
+				(it - 1)->size += it->size;
+				ranges.erase(it);
+			}
+
+			block.usedSize -= memory.size;
+			if (!block.usedSize)
+			{
+				ReleaseBlock(memory.block);
+			}
+		}
+
+		// An empty block is freed unless it is one of the spares kept to avoid reallocating on the next load
+		void ReleaseBlock(uint32_t blockIndex)
+		{
+			Block& block = m_blocks[blockIndex];
+			if (!block.dedicated && !block.evacuating)
+			{
+				const uint32_t spareNum = (uint32_t)std::count_if(m_blocks.begin(), m_blocks.end(), [](const Block& other)
+				{
+					return other.memory && !other.dedicated && !other.evacuating && !other.usedSize;
+				});
+				if (spareNum <= m_desc.spareBlockNum)
+				{
+					return;
+				}
+			}
+
+			NRI.FreeMemory(*block.memory);
+			block = Block();
+			m_releasedBlockNum++;
+		}
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		DeletionQueuePtr m_deletionQueue;
+		const TextureHeapDesc m_desc;
+
+		mutable std::mutex m_mutex;
+		std::vector<Block> m_blocks;
+		uint64_t m_releasedBlockNum = 0;
+	};
+
+	// constructor
+	TextureHeap::TextureHeap(NRIInterface& NRI, nri::Device& device, DeletionQueuePtr deletionQueue, const TextureHeapDesc& desc)
+		: m_impl(std::make_unique<Impl>(NRI, device, deletionQueue, desc))
+	{
+	}
+
+	// destructor
+	TextureHeap::~TextureHeap()
+	{
+	}
+
+	nri::Result TextureHeap::Bind(nri::Texture& texture, TextureMemory& memory) { return m_impl->Bind(texture, memory); }
+
+	void TextureHeap::Free(const TextureMemory& memory) { m_impl->Free(memory); }
+
+	uint32_t TextureHeap::BeginEvacuation(float maxUsage, const std::vector<uint32_t>& keptBlocks) { return m_impl->BeginEvacuation(maxUsage, keptBlocks); }
+
+	bool TextureHeap::IsEvacuating(uint32_t block) const { return m_impl->IsEvacuating(block); }
+
+	TextureHeapStats TextureHeap::GetStats() const { return m_impl->GetStats(); }
+
+} // namespace nfw
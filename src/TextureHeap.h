@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Api.h"
+#include "Types.h"
+
+namespace nfw
+{
+	struct TextureHeapDesc
+	{
+		uint64_t blockSize = 64 * 1024 * 1024;  // textures that do not fit get a block of their own
+		uint32_t spareBlockNum = 1;             // emptied blocks kept for reuse, the rest are freed
+	};
+
+	// Range of a heap block bound to one texture
+	struct TextureMemory
+	{
+		uint32_t block = 0;
+		uint64_t offset = 0;
+		uint64_t size = 0;
+
+		explicit operator bool() const { return size != 0; }
+	};
+
+	struct TextureHeapStats
+	{
+		uint32_t blockNum = 0;
+		uint64_t blockBytes = 0;        // device memory allocated for blocks
+		uint64_t usedBytes = 0;         // bound to textures or waiting for the deletion queue
+		uint64_t largestFreeBytes = 0;  // biggest range a texture can still be placed in without a new block
+		uint64_t releasedBlockNum = 0;  // since start
+	};
+
+	// Device memory for textures, sub-allocated from large blocks instead of one allocation per texture.
+	// Ranges are placed first fit and merged with their neighbours when freed. A block can be evacuated: nothing new
+	// is placed in it and it is freed as soon as its last range is, Defragmenter moves the textures out.
+	// Bind and Free are thread-safe.
+	class TextureHeap
+	{
+		DISALLOW_COPY_AND_ASSIGN(TextureHeap);
+	public:
+		// With a deletion queue freed ranges wait for the frames in flight, flush it before destroying the heap
+		TextureHeap(NRIInterface& NRI, nri::Device& device, DeletionQueuePtr deletionQueue = nullptr, const TextureHeapDesc& desc = {});
+		~TextureHeap();
+
+		// Places the texture in a block, allocating one when none has room
+		nri::Result Bind(nri::Texture& texture, TextureMemory& memory);
+
+		// The range is reused once the texture bound to it has been destroyed
+		void Free(const TextureMemory& memory);
+
+		// Picks the block used least, as long as it is used less than maxUsage and the other blocks have room for
+		// its textures; UINT32_MAX when there is none. The block stays evacuating until it is freed or shows up in
+		// keptBlocks, which are never picked.
+		uint32_t BeginEvacuation(float maxUsage, const std::vector<uint32_t>& keptBlocks = {});
+		bool IsEvacuating(uint32_t block) const;
+
+		TextureHeapStats GetStats() const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
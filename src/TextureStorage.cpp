@@ -1,66 +1,324 @@
 #include "TextureStorage.h"
 #include "Texture.h"
+#include "DeletionQueue.h"
+#include "TextureHeap.h"
+#include "Parallel.h"
 
 namespace nfw
 {
+	namespace
+	{
+		// columns of the texture pool, hot first
+		enum TextureColumn
+		{
+			TEXTURE,
+			SHADER_DESCRIPTOR,
+			TEXTURE_DESC,
+			VERSION,
+			MIP_OFFSET,
+			PINNED,
+			UPLOAD_DESC,
+			GPU_SIZE,
+			MEMORY,
+			IMAGE,
+		};
+
+		using TexturePool = HandlePool<TextureTag, nri::Texture*, nri::Descriptor*, nri::TextureDesc, uint32_t, uint32_t, uint8_t, nri::TextureUploadDesc, uint64_t,
+			TextureMemory, std::unique_ptr<Texture>>;
+	}
+
 	class TextureStorage::Impl
 	{
 	public:
-		Impl(NRIInterface& nri)
+		Impl(NRIInterface& nri, TextureHeapPtr textureHeap, DeletionQueuePtr deletionQueue, uint32_t capacity)
 			: NRI(nri)
+			, m_heap(textureHeap)
+			, m_deletionQueue(deletionQueue)
+			, m_textures(capacity)
 		{}
-		~Impl() 
+		~Impl()
 		{
-			if (m_textureShaderDescriptor)
+			m_textures.ForEach([this](TextureHandle texture) { DestroyResources(texture); });
+		}
+
+		TextureHandle LoadFromFile(const std::string& texturePath)
+		{
+			std::unique_ptr<Texture> image = std::make_unique<Texture>();
+			if (!image->LoadFromFile(texturePath))
 			{
-				NRI.DestroyDescriptor(*m_textureShaderDescriptor);
+				return {};
 			}
-			for (auto texture : m_textures)
+			return Add(std::move(image));
+		}
+
+		std::vector<TextureHandle> LoadFromFiles(const std::vector<std::string>& texturePaths)
+		{
+			std::vector<std::unique_ptr<Texture>> images(texturePaths.size());
+			ParallelFor(static_cast<uint32_t>(texturePaths.size()), 1, [&](uint32_t begin, uint32_t end)
 			{
-				nri::Texture* tex = texture->GetTexture();
-				if (tex)
+				for (uint32_t i = begin; i < end; i++)
 				{
-					NRI.DestroyTexture(*tex);
+					std::unique_ptr<Texture> image = std::make_unique<Texture>();
+					if (image->LoadFromFile(texturePaths[i]))
+					{
+						images[i] = std::move(image);
+					}
+				}
+			});
+
+			// added in path order so that slots do not depend on which load finished first
+			std::vector<TextureHandle> textures(texturePaths.size());
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				if (images[i])
+				{
+					textures[i] = Add(std::move(images[i]));
 				}
 			}
+			return textures;
 		}
 
-		TexturePtr LoadFromFile(const std::string& texturePath)
+		nri::Result CreateTexture(nri::Device& device, TextureHandle texture)
 		{
-			TexturePtr texture = std::make_shared<Texture>();
-			if (texture->LoadFromFile(texturePath))
+			if (!m_textures.IsValid(texture))
+			{
+				return nri::Result::INVALID_ARGUMENT;
+			}
+
+			Texture& image = *m_textures.Get<IMAGE>(texture);
+			nri::Result result = image.CreateTexture(NRI, device);
+			if (result != nri::Result::SUCCESS)
+			{
+				return result;
+			}
+
+			TextureMemory memory;
+			result = m_heap->Bind(*image.GetTexture(), memory);
+			if (result != nri::Result::SUCCESS)
 			{
-				m_textures.push_back(texture);
-				return texture;
+				NRI.DestroyTexture(*image.GetTexture());
+				return result;
 			}
-			return nullptr;
+
+			m_textures.Get<TEXTURE>(texture) = image.GetTexture();
+			m_textures.Get<UPLOAD_DESC>(texture) = image.GetTextureUploadDesc();
+			m_textures.Get<GPU_SIZE>(texture) = memory.size;
+			m_textures.Get<MEMORY>(texture) = memory;
+			return result;
 		}
 
-		nri::Result CreateTexture2DView()
+		nri::Result ReplaceTexture(TextureHandle texture, nri::Texture* replacement, const TextureMemory& memory, uint32_t mipOffset)
 		{
-			for (uint32_t i = 0, size = static_cast<uint32_t>(m_textures.size()); i < size; ++i)
+			if (!m_textures.IsValid(texture))
 			{
-				nri::Result res = m_textures[i]->CreateTexture2DView(NRI, &m_textureShaderDescriptor);
-				if (res != nri::Result::SUCCESS)
+				return nri::Result::INVALID_ARGUMENT;
+			}
+
+			nri::Descriptor* descriptor = nullptr;
+			if (replacement)
+			{
+				const nri::TextureDesc& textureDesc = NRI.GetTextureDesc(*replacement);
+				const nri::Texture2DViewDesc viewDesc = { replacement, nri::Texture2DViewType::SHADER_RESOURCE_2D, textureDesc.format };
+				const nri::Result result = NRI.CreateTexture2DView(viewDesc, descriptor);
+				if (result != nri::Result::SUCCESS)
 				{
-					return nri::Result::FAILURE;
+					return result;
 				}
 			}
+
+			// frames still drawing the old texture keep it alive through the deletion queue
+			DestroyResources(texture);
+
+			m_textures.Get<TEXTURE>(texture) = replacement;
+			m_textures.Get<SHADER_DESCRIPTOR>(texture) = descriptor;
+			m_textures.Get<VERSION>(texture)++;
+			m_textures.Get<MIP_OFFSET>(texture) = replacement ? mipOffset : 0;
+			m_textures.Get<GPU_SIZE>(texture) = memory.size;
+			m_textures.Get<MEMORY>(texture) = memory;
+
+			nri::TextureUploadDesc& uploadDesc = m_textures.Get<UPLOAD_DESC>(texture);
+			uploadDesc.texture = replacement;
+			uploadDesc.subresources = nullptr;
 			return nri::Result::SUCCESS;
 		}
 
+		void ReleasePixels(TextureHandle texture)
+		{
+			if (m_textures.IsValid(texture))
+			{
+				m_textures.Get<IMAGE>(texture)->ReleasePixels();
+				m_textures.Get<UPLOAD_DESC>(texture).subresources = nullptr;
+			}
+		}
+
+		bool ReloadPixels(TextureHandle texture, uint32_t firstMip)
+		{
+			if (!m_textures.IsValid(texture))
+			{
+				return false;
+			}
+
+			// an evicted texture has no mips of its own to keep
+			if (m_textures.Get<TEXTURE>(texture))
+			{
+				firstMip = std::min(firstMip, m_textures.Get<MIP_OFFSET>(texture));
+			}
+			Texture& image = *m_textures.Get<IMAGE>(texture);
+			if (!image.ReloadPixels(firstMip == UINT32_MAX ? 0 : firstMip))
+			{
+				return false;
+			}
+			// the image describes every mip, the current texture may start further down the chain
+			nri::TextureUploadDesc& uploadDesc = m_textures.Get<UPLOAD_DESC>(texture);
+			uploadDesc = image.GetTextureUploadDesc();
+			uploadDesc.texture = m_textures.Get<TEXTURE>(texture);
+			uploadDesc.subresources += m_textures.Get<MIP_OFFSET>(texture);
+			return true;
+		}
+
+		bool HasPixels(TextureHandle texture) const
+		{
+			return m_textures.IsValid(texture) && m_textures.Get<IMAGE>(texture)->HasPixels();
+		}
+
+		nri::Result CreateTexture2DView()
+		{
+			nri::Result result = nri::Result::SUCCESS;
+			m_textures.ForEach([&](TextureHandle texture)
+			{
+				nri::Descriptor*& descriptor = m_textures.Get<SHADER_DESCRIPTOR>(texture);
+				if (result != nri::Result::SUCCESS || descriptor || !m_textures.Get<TEXTURE>(texture))
+				{
+					return;
+				}
+				if (m_textures.Get<IMAGE>(texture)->CreateTexture2DView(NRI, &descriptor) != nri::Result::SUCCESS)
+				{
+					descriptor = nullptr;
+					result = nri::Result::FAILURE;
+				}
+			});
+			return result;
+		}
+
+		void Release(TextureHandle texture)
+		{
+			if (m_textures.IsValid(texture))
+			{
+				DestroyResources(texture);
+				m_textures.Free(texture);
+			}
+		}
+
+		bool IsValid(TextureHandle texture) const { return m_textures.IsValid(texture); }
+
+		nri::Texture* GetTexture(TextureHandle texture) const { return m_textures.IsValid(texture) ? m_textures.Get<TEXTURE>(texture) : nullptr; }
+
+		nri::Descriptor* GetTextureShaderDescriptor(TextureHandle texture) const
+		{
+			return m_textures.IsValid(texture) ? m_textures.Get<SHADER_DESCRIPTOR>(texture) : nullptr;
+		}
+
+		uint32_t GetVersion(TextureHandle texture) const { return m_textures.Get<VERSION>(texture); }
+
+		uint32_t GetMipOffset(TextureHandle texture) const { return m_textures.Get<MIP_OFFSET>(texture); }
 
-		nri::Descriptor* GetTextureShaderDescriptor() const { return m_textureShaderDescriptor; }
+		void SetPinned(TextureHandle texture, bool pinned) { m_textures.Get<PINNED>(texture) = pinned; }
+
+		bool IsPinned(TextureHandle texture) const { return m_textures.Get<PINNED>(texture) != 0; }
+
+		const nri::TextureDesc& GetTextureDesc(TextureHandle texture) const { return m_textures.Get<TEXTURE_DESC>(texture); }
+
+		const nri::TextureUploadDesc& GetTextureUploadDesc(TextureHandle texture) const { return m_textures.Get<UPLOAD_DESC>(texture); }
+
+		const Texture& GetImage(TextureHandle texture) const { return *m_textures.Get<IMAGE>(texture); }
+
+		const TextureMemory& GetTextureMemory(TextureHandle texture) const { return m_textures.Get<MEMORY>(texture); }
+
+		TextureHeap& GetTextureHeap() const { return *m_heap; }
+
+		uint32_t GetTextureNum() const { return m_textures.GetAliveNum(); }
+
+		uint32_t GetCapacity() const { return m_textures.GetCapacity(); }
+
+		void ForEach(const std::function<void(TextureHandle)>& func) const { m_textures.ForEach(func); }
+
+		TextureMemoryStats GetMemoryStats(TextureHandle texture) const
+		{
+			TextureMemoryStats stats;
+			if (m_textures.IsValid(texture))
+			{
+				stats.cpuBytes = m_textures.Get<IMAGE>(texture)->GetPixelDataSize();
+				stats.gpuBytes = m_textures.Get<GPU_SIZE>(texture);
+			}
+			return stats;
+		}
+
+		TextureMemoryStats GetMemoryStats() const
+		{
+			TextureMemoryStats stats;
+			m_textures.ForEach([&](TextureHandle texture)
+			{
+				const TextureMemoryStats textureStats = GetMemoryStats(texture);
+				stats.cpuBytes += textureStats.cpuBytes;
+				stats.gpuBytes += textureStats.gpuBytes;
+			});
+			return stats;
+		}
 
 	private:
+		TextureHandle Add(std::unique_ptr<Texture> image)
+		{
+			const TextureHandle texture = m_textures.Allocate();
+			if (texture)
+			{
+				m_textures.Get<TEXTURE_DESC>(texture) = image->GetTextureDesc();
+				m_textures.Get<IMAGE>(texture) = std::move(image);
+			}
+			return texture;
+		}
+
+		void DestroyResources(TextureHandle texture)
+		{
+			nri::Descriptor* descriptor = m_textures.Get<SHADER_DESCRIPTOR>(texture);
+			if (descriptor)
+			{
+				if (m_deletionQueue)
+				{
+					m_deletionQueue->Release(*descriptor);
+				}
+				else
+				{
+					NRI.DestroyDescriptor(*descriptor);
+				}
+			}
+
+			nri::Texture* tex = m_textures.Get<TEXTURE>(texture);
+			if (tex)
+			{
+				if (m_deletionQueue)
+				{
+					m_deletionQueue->Release(*tex);
+				}
+				else
+				{
+					NRI.DestroyTexture(*tex);
+				}
+			}
+
+			// after the texture, the heap goes through the same deletion queue
+			m_heap->Free(m_textures.Get<MEMORY>(texture));
+			m_textures.Get<MEMORY>(texture) = {};
+		}
+
 		NRIInterface& NRI;
-		std::vector<TexturePtr> m_textures;
-		nri::Descriptor* m_textureShaderDescriptor = nullptr;
+		TextureHeapPtr m_heap;
+		DeletionQueuePtr m_deletionQueue;
+		TexturePool m_textures;
 	};
 
 	// constructor
-	TextureStorage::TextureStorage(NRIInterface& NRI)
-		: m_impl(std::make_unique<Impl>(NRI))
+	TextureStorage::TextureStorage(NRIInterface& NRI, TextureHeapPtr textureHeap, DeletionQueuePtr deletionQueue, uint32_t capacity)
+		: m_impl(std::make_unique<Impl>(NRI, textureHeap, deletionQueue, capacity))
 	{
 	}
 
@@ -69,16 +327,68 @@ namespace nfw
 	{
 	}
 
-	TexturePtr TextureStorage::LoadFromFile(const std::string& texturePath)
+	TextureHandle TextureStorage::LoadFromFile(const std::string& texturePath)
 	{
 		return m_impl->LoadFromFile(texturePath);
 	}
 
+	std::vector<TextureHandle> TextureStorage::LoadFromFiles(const std::vector<std::string>& texturePaths)
+	{
+		return m_impl->LoadFromFiles(texturePaths);
+	}
+
+	nri::Result TextureStorage::CreateTexture(nri::Device& device, TextureHandle texture) { return m_impl->CreateTexture(device, texture); }
+
 	nri::Result TextureStorage::CreateTexture2DView()
 	{
 		return m_impl->CreateTexture2DView();
 	}
 
-	nri::Descriptor* TextureStorage::GetTextureShaderDescriptor() const { return m_impl->GetTextureShaderDescriptor(); }
+	void TextureStorage::ReleasePixels(TextureHandle texture) { m_impl->ReleasePixels(texture); }
+
+	bool TextureStorage::ReloadPixels(TextureHandle texture, uint32_t firstMip) { return m_impl->ReloadPixels(texture, firstMip); }
+
+	bool TextureStorage::HasPixels(TextureHandle texture) const { return m_impl->HasPixels(texture); }
+
+	nri::Result TextureStorage::ReplaceTexture(TextureHandle texture, nri::Texture* replacement, const TextureMemory& memory, uint32_t mipOffset)
+	{
+		return m_impl->ReplaceTexture(texture, replacement, memory, mipOffset);
+	}
+
+	void TextureStorage::Release(TextureHandle texture) { m_impl->Release(texture); }
+
+	bool TextureStorage::IsValid(TextureHandle texture) const { return m_impl->IsValid(texture); }
+
+	nri::Texture* TextureStorage::GetTexture(TextureHandle texture) const { return m_impl->GetTexture(texture); }
+
+	nri::Descriptor* TextureStorage::GetTextureShaderDescriptor(TextureHandle texture) const { return m_impl->GetTextureShaderDescriptor(texture); }
+
+	uint32_t TextureStorage::GetVersion(TextureHandle texture) const { return m_impl->GetVersion(texture); }
+
+	uint32_t TextureStorage::GetMipOffset(TextureHandle texture) const { return m_impl->GetMipOffset(texture); }
+
+	void TextureStorage::SetPinned(TextureHandle texture, bool pinned) { m_impl->SetPinned(texture, pinned); }
+
+	bool TextureStorage::IsPinned(TextureHandle texture) const { return m_impl->IsPinned(texture); }
+
+	const nri::TextureDesc& TextureStorage::GetTextureDesc(TextureHandle texture) const { return m_impl->GetTextureDesc(texture); }
+
+	const nri::TextureUploadDesc& TextureStorage::GetTextureUploadDesc(TextureHandle texture) const { return m_impl->GetTextureUploadDesc(texture); }
+
+	const Texture& TextureStorage::GetImage(TextureHandle texture) const { return m_impl->GetImage(texture); }
+
+	const TextureMemory& TextureStorage::GetTextureMemory(TextureHandle texture) const { return m_impl->GetTextureMemory(texture); }
+
+	TextureHeap& TextureStorage::GetTextureHeap() const { return m_impl->GetTextureHeap(); }
+
+	uint32_t TextureStorage::GetTextureNum() const { return m_impl->GetTextureNum(); }
+
+	uint32_t TextureStorage::GetCapacity() const { return m_impl->GetCapacity(); }
+
+	void TextureStorage::ForEach(const std::function<void(TextureHandle)>& func) const { m_impl->ForEach(func); }
+
+	TextureMemoryStats TextureStorage::GetMemoryStats(TextureHandle texture) const { return m_impl->GetMemoryStats(texture); }
+
+	TextureMemoryStats TextureStorage::GetMemoryStats() const { return m_impl->GetMemoryStats(); }
 
 } // namespace nfw
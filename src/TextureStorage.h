@@ -5,18 +5,78 @@
 
 namespace nfw
 {
+	constexpr uint32_t TEXTURE_STORAGE_DEFAULT_CAPACITY = 4096;
+
+	struct TextureMemoryStats
+	{
+		uint64_t cpuBytes = 0;  // decoded pixels still held
+		uint64_t gpuBytes = 0;  // device memory required by the NRI texture
+	};
+
+	// Textures referenced by TextureHandle.
+	// The NRI texture, its view and its descs are kept in contiguous per-field arrays for per-frame access,
+	// the decoded image stays with the rarely touched data. The capacity is fixed, loading fails once it is reached.
 	class TextureStorage
 	{
 		DISALLOW_COPY_AND_ASSIGN(TextureStorage);
 	public:
-		TextureStorage(NRIInterface& NRI);
+		// Texture memory comes from the heap. With a deletion queue the textures and views are released to it instead
+		// of destroyed on the spot, the heap should share it.
+		TextureStorage(NRIInterface& NRI, TextureHeapPtr textureHeap, DeletionQueuePtr deletionQueue = nullptr, uint32_t capacity = TEXTURE_STORAGE_DEFAULT_CAPACITY);
 		~TextureStorage();
 
-		TexturePtr LoadFromFile(const std::string& texturePath);
+		TextureHandle LoadFromFile(const std::string& texturePath);
+
+		// Loads the files in parallel on the job system, failed entries are invalid handles
+		std::vector<TextureHandle> LoadFromFiles(const std::vector<std::string>& texturePaths);
+
+		// Creates the NRI texture of a loaded image and binds heap memory to it; thread-safe for distinct handles
+		nri::Result CreateTexture(nri::Device& device, TextureHandle texture);
+
+		// Swaps in another NRI texture of the same image, starting mipOffset mips down the chain, bound to memory
+		// of the heap; nullptr evicts. The old texture, view and memory go through the deletion queue and the version
+		// changes, descriptor sets written with the old view must be rewritten before the next draw.
+		nri::Result ReplaceTexture(TextureHandle texture, nri::Texture* replacement, const TextureMemory& memory, uint32_t mipOffset);
 
+		// Creates a shader resource view for every created texture that does not have one yet
 		nri::Result CreateTexture2DView();
 
-		nri::Descriptor* GetTextureShaderDescriptor() const;
+		// Decoded pixels are only needed to upload, UploadQueue drops them once the upload has completed.
+		// ReloadPixels decodes the source file again for another upload, from the first mip the current texture
+		// holds, or from firstMip when that is further up.
+		void ReleasePixels(TextureHandle texture);
+		bool ReloadPixels(TextureHandle texture, uint32_t firstMip = UINT32_MAX);
+		bool HasPixels(TextureHandle texture) const;
+
+		// Destroys the texture and its view and invalidates the handle
+		void Release(TextureHandle texture);
+
+		bool IsValid(TextureHandle texture) const;
+		nri::Texture* GetTexture(TextureHandle texture) const;
+		nri::Descriptor* GetTextureShaderDescriptor(TextureHandle texture) const;    // nullptr while evicted
+		uint32_t GetVersion(TextureHandle texture) const;
+		uint32_t GetMipOffset(TextureHandle texture) const;
+
+		// A pinned texture keeps its NRI texture and view: ResidencyManager never evicts or reduces it and
+		// Defragmenter never moves it, e.g. the one drawn in place of evicted textures
+		void SetPinned(TextureHandle texture, bool pinned);
+		bool IsPinned(TextureHandle texture) const;
+
+		// Desc of the full image, the resident texture may have fewer mips
+		const nri::TextureDesc& GetTextureDesc(TextureHandle texture) const;
+		const nri::TextureUploadDesc& GetTextureUploadDesc(TextureHandle texture) const;
+		const Texture& GetImage(TextureHandle texture) const;
+		const TextureMemory& GetTextureMemory(TextureHandle texture) const;    // empty while evicted
+		TextureHeap& GetTextureHeap() const;
+
+		uint32_t GetTextureNum() const;
+		uint32_t GetCapacity() const;
+
+		// Every live texture in slot order; no texture may be loaded or released meanwhile
+		void ForEach(const std::function<void(TextureHandle)>& func) const;
+
+		TextureMemoryStats GetMemoryStats(TextureHandle texture) const;
+		TextureMemoryStats GetMemoryStats() const;    // over all textures
 
 	private:
 		class Impl;
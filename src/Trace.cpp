@@ -0,0 +1,201 @@
+#include "Trace.h"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nfw
+{
+	namespace
+	{
+		constexpr uint32_t TRACE_CHUNK_EVENT_NUM = 4096;
+
+		struct TraceEvent
+		{
+			const char* name;
+			uint64_t beginNs;
+			uint64_t endNs;
+		};
+
+		// written by the owning thread only, count is published with release so a reader sees complete events
+		struct TraceChunk
+		{
+			std::array<TraceEvent, TRACE_CHUNK_EVENT_NUM> events;
+			std::atomic<uint32_t> count = 0;
+			std::atomic<TraceChunk*> next = nullptr;
+		};
+
+		struct TraceThreadBuffer
+		{
+			uint32_t threadId = 0;
+			std::string name;
+			std::unique_ptr<TraceChunk> head;
+			TraceChunk* tail = nullptr;
+		};
+
+		// buffers outlive their threads so events of finished threads can still be written
+		struct TraceRegistry
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<TraceThreadBuffer>> buffers;
+			const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+		};
+
+		TraceRegistry& GetRegistry()
+		{
+			static TraceRegistry registry;
+			return registry;
+		}
+
+		thread_local TraceThreadBuffer* t_buffer = nullptr;
+
+		TraceThreadBuffer& GetThreadBuffer()
+		{
+			if (!t_buffer)
+			{
+				TraceRegistry& registry = GetRegistry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+
+				std::unique_ptr<TraceThreadBuffer> buffer = std::make_unique<TraceThreadBuffer>();
+				buffer->threadId = static_cast<uint32_t>(registry.buffers.size());
+				buffer->head = std::make_unique<TraceChunk>();
+				buffer->tail = buffer->head.get();
+				t_buffer = buffer.get();
+				registry.buffers.push_back(std::move(buffer));
+			}
+			return *t_buffer;
+		}
+
+		void FreeChunks(TraceChunk* chunk)
+		{
+			while (chunk)
+			{
+				TraceChunk* next = chunk->next.load(std::memory_order_acquire);
+				delete chunk;
+				chunk = next;
+			}
+		}
+
+		void WriteEscaped(std::ofstream& ofs, const char* str)
+		{
+			for (; *str; ++str)
+			{
+				const char c = *str;
+				if (c == '"' || c == '\\')
+				{
+					ofs << '\\' << c;
+				}
+				else if (static_cast<unsigned char>(c) >= 0x20)
+				{
+					ofs << c;
+				}
+			}
+		}
+
+		void WriteMicroseconds(std::ofstream& ofs, uint64_t ns)
+		{
+			const uint64_t fraction = ns % 1000;
+			ofs << ns / 1000 << '.' << char('0' + fraction / 100) << char('0' + fraction / 10 % 10) << char('0' + fraction % 10);
+		}
+	}
+
+	void Trace::SetEnabled(bool enabled)
+	{
+		s_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	uint64_t Trace::GetTimestamp()
+	{
+		const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - GetRegistry().origin;
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	}
+
+	void Trace::Record(const char* name, uint64_t beginNs, uint64_t endNs)
+	{
+		TraceThreadBuffer& buffer = GetThreadBuffer();
+
+		TraceChunk* chunk = buffer.tail;
+		uint32_t count = chunk->count.load(std::memory_order_relaxed);
+		if (count == TRACE_CHUNK_EVENT_NUM)
+		{
+			TraceChunk* next = new TraceChunk();
+			chunk->next.store(next, std::memory_order_release);
+			buffer.tail = next;
+			chunk = next;
+			count = 0;
+		}
+
+		chunk->events[count] = { name, beginNs, endNs };
+		chunk->count.store(count + 1, std::memory_order_release);
+	}
+
+	void Trace::SetThreadName(const char* name)
+	{
+		TraceThreadBuffer& buffer = GetThreadBuffer();
+
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		buffer.name = name;
+	}
+
+	bool Trace::WriteChromeTrace(const std::string& path)
+	{
+		std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+		if (!ofs)
+		{
+			return false;
+		}
+
+		TraceRegistry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		bool first = true;
+		for (const std::unique_ptr<TraceThreadBuffer>& buffer : registry.buffers)
+		{
+			if (!buffer->name.empty())
+			{
+				ofs << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"";
+				WriteEscaped(ofs, buffer->name.c_str());
+				ofs << "\"}}";
+				first = false;
+			}
+
+			for (const TraceChunk* chunk = buffer->head.get(); chunk; chunk = chunk->next.load(std::memory_order_acquire))
+			{
+				const uint32_t count = chunk->count.load(std::memory_order_acquire);
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					const TraceEvent& event = chunk->events[i];
+					ofs << (first ? "" : ",") << "\n{\"name\":\"";
+					WriteEscaped(ofs, event.name);
+					ofs << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId << ",\"ts\":";
+					WriteMicroseconds(ofs, event.beginNs);
+					ofs << ",\"dur\":";
+					WriteMicroseconds(ofs, event.endNs - event.beginNs);
+					ofs << "}";
+					first = false;
+				}
+			}
+		}
+		ofs << "\n]}\n";
+
+		return ofs.good();
+	}
+
+	void Trace::Clear()
+	{
+		TraceRegistry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		for (const std::unique_ptr<TraceThreadBuffer>& buffer : registry.buffers)
+		{
+			FreeChunks(buffer->head->next.exchange(nullptr, std::memory_order_acq_rel));
+			buffer->head->count.store(0, std::memory_order_release);
+			buffer->tail = buffer->head.get();
+		}
+	}
+
+} // namespace nfw
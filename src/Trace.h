@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace nfw
+{
+	// CPU event tracing.
+	// Every thread appends complete events to its own buffer without locking, the buffers are
+	// only walked when the trace is written. Recording is off until SetEnabled(true); while off
+	// a scope costs one relaxed load. Building without NFW_TRACE_ENABLED removes the scopes entirely.
+	class Trace
+	{
+	public:
+		static void SetEnabled(bool enabled);
+		static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+		// Nanoseconds on a monotonic clock
+		static uint64_t GetTimestamp();
+
+		// name must stay valid until the trace is written, string literals are expected
+		static void Record(const char* name, uint64_t beginNs, uint64_t endNs);
+
+		static void SetThreadName(const char* name);
+
+		// Chrome trace event JSON, also loaded by Perfetto and chrome://tracing
+		static bool WriteChromeTrace(const std::string& path);
+
+		// Drops recorded events, no thread may be recording at the same time
+		static void Clear();
+
+	private:
+		static inline std::atomic<bool> s_enabled = false;
+	};
+
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* name)
+			: m_name(Trace::IsEnabled() ? name : nullptr)
+			, m_begin(m_name ? Trace::GetTimestamp() : 0)
+		{
+		}
+
+		~TraceScope()
+		{
+			if (m_name)
+			{
+				Trace::Record(m_name, m_begin, Trace::GetTimestamp());
+			}
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		void operator=(const TraceScope&) = delete;
+
+	private:
+		const char* m_name;
+		uint64_t m_begin;
+	};
+} // namespace nfw
+
+#define NFW_TRACE_CONCAT_INNER(a, b) a##b
+#define NFW_TRACE_CONCAT(a, b) NFW_TRACE_CONCAT_INNER(a, b)
+
+#ifdef NFW_TRACE_ENABLED
+#define NFW_TRACE_SCOPE(name) nfw::TraceScope NFW_TRACE_CONCAT(nfwTraceScope, __LINE__)(name)
+#else
+#define NFW_TRACE_SCOPE(name) ((void)0)
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Api.h"
+#include "HandlePool.h"
 
 namespace nfw
 {
@@ -11,18 +12,67 @@ namespace nfw
 	{};
 
 	class Texture;
-	using TexturePtr = std::shared_ptr<Texture>;
-	using TextureConstPtr = std::shared_ptr<const Texture>;
+	struct TextureTag;
+	using TextureHandle = Handle<TextureTag>;
 
 	class TextureStorage;
 	using TextureStoragePtr = std::shared_ptr<TextureStorage>;
 
+	class TextureHeap;
+	struct TextureMemory;
+	using TextureHeapPtr = std::shared_ptr<TextureHeap>;
+
 	class Shader;
-	using ShaderPtr = std::shared_ptr<Shader>;
-	using ShaderConstPtr = std::shared_ptr<const Shader>;
+	struct ShaderTag;
+	using ShaderHandle = Handle<ShaderTag>;
 
 	class Geometry;
 	using GeometryPtr = std::shared_ptr<Geometry>;
 	using GeometryConstPtr = std::shared_ptr<const Geometry>;
 
+	class OcclusionCuller;
+	using OcclusionCullerPtr = std::shared_ptr<OcclusionCuller>;
+
+	class SceneGraph;
+	using SceneGraphPtr = std::shared_ptr<SceneGraph>;
+
+	class DrawList;
+	using DrawListPtr = std::shared_ptr<DrawList>;
+
+	class CommandRecorder;
+	using CommandRecorderPtr = std::shared_ptr<CommandRecorder>;
+
+	class SpriteBatch;
+	using SpriteBatchPtr = std::shared_ptr<SpriteBatch>;
+
+	class GpuProfiler;
+	using GpuProfilerPtr = std::shared_ptr<GpuProfiler>;
+
+	class FramePacer;
+	using FramePacerPtr = std::shared_ptr<FramePacer>;
+
+	class UploadQueue;
+	using UploadQueuePtr = std::shared_ptr<UploadQueue>;
+
+	class DeletionQueue;
+	using DeletionQueuePtr = std::shared_ptr<DeletionQueue>;
+
+	class DescriptorAllocator;
+	using DescriptorAllocatorPtr = std::shared_ptr<DescriptorAllocator>;
+
+	class StateCache;
+	using StateCachePtr = std::shared_ptr<StateCache>;
+	using SamplerPtr = std::shared_ptr<nri::Descriptor>;
+	using PipelineLayoutPtr = std::shared_ptr<nri::PipelineLayout>;
+	using PipelinePtr = std::shared_ptr<nri::Pipeline>;
+
+	class FrameArena;
+	using FrameArenaPtr = std::shared_ptr<FrameArena>;
+
+	class ResidencyManager;
+	using ResidencyManagerPtr = std::shared_ptr<ResidencyManager>;
+
+	class Defragmenter;
+	using DefragmenterPtr = std::shared_ptr<Defragmenter>;
+
 }
@@ -0,0 +1,631 @@
+#include "UploadQueue.h"
+#include "TextureStorage.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+namespace nfw
+{
+	namespace
+	{
+		uint64_t AlignUp(uint64_t value, uint64_t alignment)
+		{
+			return alignment ? (value + alignment - 1) / alignment * alignment : value;
+		}
+
+		struct StagingChunk
+		{
+			nri::Buffer* buffer = nullptr;
+			std::vector<nri::Memory*> memories;
+			uint8_t* mappedData = nullptr;
+			uint64_t size = 0;
+			uint64_t usedSize = 0;
+			uint64_t fenceValue = 0;        // last batch that reads from it
+		};
+
+		struct CommandSet
+		{
+			nri::CommandAllocator* commandAllocator = nullptr;
+			nri::CommandBuffer* commandBuffer = nullptr;
+			uint64_t fenceValue = 0;
+		};
+
+		struct TextureCopy
+		{
+			nri::TextureRegionDesc region;
+			nri::TextureDataLayoutDesc layout;
+			const nri::Buffer* staging;
+		};
+
+		struct PendingTexture
+		{
+			nri::Texture* texture;
+			nri::Mip_t mipNum;
+			nri::Dim_t layerNum;
+			nri::AccessLayoutStage after;
+			std::vector<TextureCopy> copies;
+		};
+
+		struct PendingTextureCopy
+		{
+			nri::Texture* dst;
+			nri::Texture* src;
+			nri::Mip_t mipNum;
+			nri::Dim_t layerNum;
+			nri::AccessLayoutStage state;
+		};
+
+		struct PendingBuffer
+		{
+			nri::Buffer* buffer;
+			uint64_t offset;
+			const nri::Buffer* staging;
+			uint64_t stagingOffset;
+			uint64_t size;
+			nri::AccessStage after;
+		};
+
+		struct Waiter
+		{
+			uint64_t fenceValue;
+			std::coroutine_handle<> handle;
+		};
+	}
+
+	class UploadQueue::Impl
+	{
+	public:
+		Impl(NRIInterface& nri, nri::Device& device, nri::CommandQueue& commandQueue, uint64_t stagingChunkSize)
+			: NRI(nri)
+			, m_device(device)
+			, m_commandQueue(commandQueue)
+			, m_stagingChunkSize(stagingChunkSize)
+		{}
+
+		~Impl()
+		{
+			if (!m_fence)
+			{
+				return;
+			}
+
+			NRI.Wait(*m_fence, m_submittedValue);
+
+			for (std::unique_ptr<StagingChunk>& chunk : m_chunks)
+			{
+				DestroyChunk(*chunk);
+			}
+			for (CommandSet& commandSet : m_commandSets)
+			{
+				NRI.DestroyCommandBuffer(*commandSet.commandBuffer);
+				NRI.DestroyCommandAllocator(*commandSet.commandAllocator);
+			}
+			for (nri::Memory* memory : m_resourceMemories)
+			{
+				NRI.FreeMemory(*memory);
+			}
+			NRI.DestroyFence(*m_fence);
+		}
+
+		bool Init()
+		{
+			const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(m_device);
+			m_rowAlignment = std::max(deviceDesc.uploadBufferTextureRowAlignment, 1u);
+			m_sliceAlignment = std::max(deviceDesc.uploadBufferTextureSliceAlignment, 1u);
+
+			return NRI.CreateFence(m_device, 0, m_fence) == nri::Result::SUCCESS;
+		}
+
+		UploadAwaitable UploadTexture(UploadQueue& queue, const nri::TextureUploadDesc& textureUploadDesc)
+		{
+			const nri::TextureDesc& textureDesc = NRI.GetTextureDesc(*textureUploadDesc.texture);
+
+			PendingTexture pending = { textureUploadDesc.texture, textureDesc.mipNum, textureDesc.layerNum, textureUploadDesc.after };
+			pending.copies.reserve((size_t)textureDesc.mipNum * textureDesc.layerNum);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (uint32_t layer = 0; layer < textureDesc.layerNum; layer++)
+			{
+				for (uint32_t mip = 0; mip < textureDesc.mipNum; mip++)
+				{
+					const nri::TextureSubresourceUploadDesc& subresource = textureUploadDesc.subresources[layer * textureDesc.mipNum + mip];
+					const uint32_t sliceNum = std::max(subresource.sliceNum, 1u);
+					const uint32_t rowNum = subresource.slicePitch / subresource.rowPitch;
+					const uint64_t rowPitch = AlignUp(subresource.rowPitch, m_rowAlignment);
+					const uint64_t slicePitch = AlignUp(rowPitch * rowNum, m_sliceAlignment);
+
+					uint64_t offset = 0;
+					StagingChunk* chunk = AllocateStaging(slicePitch * sliceNum, m_sliceAlignment, offset);
+					if (!chunk)
+					{
+						return UploadAwaitable(queue, 0, nri::Result::OUT_OF_MEMORY);
+					}
+
+					// rows are repacked to the pitch the copy engine wants
+					const uint8_t* src = (const uint8_t*)subresource.slices;
+					for (uint32_t slice = 0; slice < sliceNum; slice++)
+					{
+						for (uint32_t row = 0; row < rowNum; row++)
+						{
+							memcpy(chunk->mappedData + offset + slice * slicePitch + row * rowPitch,
+								src + (uint64_t)slice * subresource.slicePitch + (uint64_t)row * subresource.rowPitch, subresource.rowPitch);
+						}
+					}
+
+					TextureCopy copy = {};
+					copy.region.mipOffset = (nri::Mip_t)mip;
+					copy.region.layerOffset = (nri::Dim_t)layer;
+					copy.region.width = (nri::Dim_t)std::max(textureDesc.width >> mip, 1);
+					copy.region.height = (nri::Dim_t)std::max(textureDesc.height >> mip, 1);
+					copy.region.depth = (nri::Dim_t)sliceNum;
+					copy.layout.offset = offset;
+					copy.layout.rowPitch = (uint32_t)rowPitch;
+					copy.layout.slicePitch = (uint32_t)slicePitch;
+					copy.staging = chunk->buffer;
+					pending.copies.push_back(copy);
+				}
+			}
+
+			m_pendingTextures.push_back(std::move(pending));
+			return UploadAwaitable(queue, m_batchValue, nri::Result::SUCCESS);
+		}
+
+		UploadAwaitable UploadBuffer(UploadQueue& queue, const nri::BufferUploadDesc& bufferUploadDesc)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			uint64_t offset = 0;
+			StagingChunk* chunk = AllocateStaging(bufferUploadDesc.dataSize, 16, offset);
+			if (!chunk)
+			{
+				return UploadAwaitable(queue, 0, nri::Result::OUT_OF_MEMORY);
+			}
+			memcpy(chunk->mappedData + offset, bufferUploadDesc.data, bufferUploadDesc.dataSize);
+
+			m_pendingBuffers.push_back({ bufferUploadDesc.buffer, bufferUploadDesc.bufferOffset, chunk->buffer, offset, bufferUploadDesc.dataSize, bufferUploadDesc.after });
+			return UploadAwaitable(queue, m_batchValue, nri::Result::SUCCESS);
+		}
+
+		UploadAwaitable CopyTexture(UploadQueue& queue, nri::Texture& dst, nri::Texture& src, nri::AccessLayoutStage state)
+		{
+			const nri::TextureDesc& textureDesc = NRI.GetTextureDesc(src);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pendingCopies.push_back({ &dst, &src, textureDesc.mipNum, textureDesc.layerNum, state });
+			return UploadAwaitable(queue, m_batchValue, nri::Result::SUCCESS);
+		}
+
+		nri::Result CreateTextureResource(TextureStorage& storage, TextureHandle texture)
+		{
+			// the storage binds memory of its heap, so the texture can be evicted or moved
+			return storage.CreateTexture(m_device, texture);
+		}
+
+		nri::Buffer* CreateBufferResource(const nri::BufferDesc& bufferDesc)
+		{
+			nri::Buffer* buffer = nullptr;
+			if (NRI.CreateBuffer(m_device, bufferDesc, buffer) != nri::Result::SUCCESS)
+			{
+				return nullptr;
+			}
+
+			nri::ResourceGroupDesc resourceGroupDesc = {};
+			resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
+			resourceGroupDesc.bufferNum = 1;
+			resourceGroupDesc.buffers = &buffer;
+			if (BindDeviceMemory(resourceGroupDesc) != nri::Result::SUCCESS)
+			{
+				NRI.DestroyBuffer(*buffer);
+				return nullptr;
+			}
+			return buffer;
+		}
+
+		void DestroyBuffer(nri::Buffer& buffer)
+		{
+			NRI.DestroyBuffer(buffer);
+		}
+
+		nri::Result BindDeviceMemory(const nri::ResourceGroupDesc& resourceGroupDesc)
+		{
+			std::vector<nri::Memory*> memories(NRI.CalculateAllocationNumber(m_device, resourceGroupDesc), nullptr);
+			const nri::Result result = NRI.AllocateAndBindMemory(m_device, resourceGroupDesc, memories.data());
+			if (result == nri::Result::SUCCESS)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_resourceMemories.insert(m_resourceMemories.end(), memories.begin(), memories.end());
+			}
+			return result;
+		}
+
+		void Update()
+		{
+			std::vector<PendingTexture> textures;
+			std::vector<PendingTextureCopy> copies;
+			std::vector<PendingBuffer> buffers;
+			uint64_t batchValue = 0;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_pendingTextures.empty() || !m_pendingCopies.empty() || !m_pendingBuffers.empty())
+				{
+					textures.swap(m_pendingTextures);
+					copies.swap(m_pendingCopies);
+					buffers.swap(m_pendingBuffers);
+					batchValue = m_batchValue++;
+					m_openChunk = nullptr;
+				}
+			}
+
+			if (batchValue)
+			{
+				Submit(textures, copies, buffers, batchValue);
+			}
+
+			std::vector<Waiter> finished;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_completedValue = NRI.GetFenceValue(*m_fence);
+
+				auto it = std::partition(m_waiters.begin(), m_waiters.end(), [this](const Waiter& waiter) { return waiter.fenceValue > m_completedValue; });
+				finished.assign(it, m_waiters.end());
+				m_waiters.erase(it, m_waiters.end());
+
+				// chunks bigger than usual were made for one upload, do not keep them around
+				auto chunkIt = std::remove_if(m_chunks.begin(), m_chunks.end(), [this](std::unique_ptr<StagingChunk>& chunk)
+				{
+					if (chunk.get() == m_openChunk || chunk->size <= m_stagingChunkSize || chunk->fenceValue > m_completedValue)
+					{
+						return false;
+					}
+					DestroyChunk(*chunk);
+					return true;
+				});
+				m_chunks.erase(chunkIt, m_chunks.end());
+			}
+
+			for (const Waiter& waiter : finished)
+			{
+				JobSystem::Run([handle = waiter.handle]() { handle.resume(); });
+			}
+		}
+
+		bool IsComplete(uint64_t fenceValue)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return fenceValue <= m_completedValue;
+		}
+
+		bool Resume(uint64_t fenceValue, std::coroutine_handle<> handle)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (fenceValue <= m_completedValue)
+			{
+				return false;
+			}
+			m_waiters.push_back({ fenceValue, handle });
+			return true;
+		}
+
+	private:
+		// m_mutex must be held
+		StagingChunk* AllocateStaging(uint64_t size, uint64_t alignment, uint64_t& offset)
+		{
+			if (m_openChunk)
+			{
+				offset = AlignUp(m_openChunk->usedSize, alignment);
+				if (offset + size <= m_openChunk->size)
+				{
+					m_openChunk->usedSize = offset + size;
+					return m_openChunk;
+				}
+			}
+
+			// reuse a chunk the GPU is done with, otherwise make one
+			m_openChunk = nullptr;
+			for (std::unique_ptr<StagingChunk>& chunk : m_chunks)
+			{
+				if (chunk->fenceValue <= m_completedValue && chunk->size >= size)
+				{
+					m_openChunk = chunk.get();
+					break;
+				}
+			}
+			if (!m_openChunk)
+			{
+				m_openChunk = CreateChunk(std::max(size, m_stagingChunkSize));
+				if (!m_openChunk)
+				{
+					return nullptr;
+				}
+			}
+
+			offset = 0;
+			m_openChunk->usedSize = size;
+			m_openChunk->fenceValue = m_batchValue;
+			return m_openChunk;
+		}
+
+		StagingChunk* CreateChunk(uint64_t size)
+		{
+			std::unique_ptr<StagingChunk> chunk = std::make_unique<StagingChunk>();
+			chunk->size = size;
+
+			nri::BufferDesc bufferDesc = {};
+			bufferDesc.size = size;
+			if (NRI.CreateBuffer(m_device, bufferDesc, chunk->buffer) != nri::Result::SUCCESS)
+			{
+				return nullptr;
+			}
+
+			nri::ResourceGroupDesc resourceGroupDesc = {};
+			resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+			resourceGroupDesc.bufferNum = 1;
+			resourceGroupDesc.buffers = &chunk->buffer;
+
+			chunk->memories.resize(NRI.CalculateAllocationNumber(m_device, resourceGroupDesc), nullptr);
+			if (NRI.AllocateAndBindMemory(m_device, resourceGroupDesc, chunk->memories.data()) != nri::Result::SUCCESS)
+			{
+				chunk->memories.clear();
+				DestroyChunk(*chunk);
+				return nullptr;
+			}
+
+			chunk->mappedData = (uint8_t*)NRI.MapBuffer(*chunk->buffer, 0, size);
+			m_chunks.push_back(std::move(chunk));
+			return m_chunks.back().get();
+		}
+
+		void DestroyChunk(StagingChunk& chunk)
+		{
+			if (chunk.mappedData)
+			{
+				NRI.UnmapBuffer(*chunk.buffer);
+			}
+			NRI.DestroyBuffer(*chunk.buffer);
+			for (nri::Memory* memory : chunk.memories)
+			{
+				NRI.FreeMemory(*memory);
+			}
+		}
+
+		CommandSet* AcquireCommandSet()
+		{
+			for (CommandSet& commandSet : m_commandSets)
+			{
+				if (commandSet.fenceValue <= m_completedValue)
+				{
+					NRI.ResetCommandAllocator(*commandSet.commandAllocator);
+					return &commandSet;
+				}
+			}
+
+			CommandSet commandSet;
+			if (NRI.CreateCommandAllocator(m_commandQueue, commandSet.commandAllocator) != nri::Result::SUCCESS)
+			{
+				return nullptr;
+			}
+			if (NRI.CreateCommandBuffer(*commandSet.commandAllocator, commandSet.commandBuffer) != nri::Result::SUCCESS)
+			{
+				NRI.DestroyCommandAllocator(*commandSet.commandAllocator);
+				return nullptr;
+			}
+			m_commandSets.push_back(commandSet);
+			return &m_commandSets.back();
+		}
+
+		void Submit(const std::vector<PendingTexture>& textures, const std::vector<PendingTextureCopy>& copies, const std::vector<PendingBuffer>& buffers, uint64_t batchValue)
+		{
+			NFW_TRACE_SCOPE("UploadQueue::Submit");
+
+			CommandSet* commandSet = AcquireCommandSet();
+			NRI_ABORT_ON_FAILURE(commandSet ? nri::Result::SUCCESS : nri::Result::OUT_OF_MEMORY);
+			commandSet->fenceValue = batchValue;
+
+			nri::CommandBuffer& commandBuffer = *commandSet->commandBuffer;
+			NRI_ABORT_ON_FAILURE(NRI.BeginCommandBuffer(commandBuffer, nullptr));
+			{
+				// uploaded textures, then copy destinations and sources
+				std::vector<nri::TextureBarrierDesc> textureBarriers(textures.size() + copies.size() * 2);
+				for (size_t i = 0; i < textures.size(); i++)
+				{
+					nri::TextureBarrierDesc& barrier = textureBarriers[i];
+					barrier.texture = textures[i].texture;
+					barrier.mipNum = textures[i].mipNum;
+					barrier.layerNum = textures[i].layerNum;
+					barrier.before = { nri::AccessBits::UNKNOWN, nri::Layout::UNKNOWN };
+					barrier.after = { nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY };
+				}
+				for (size_t i = 0; i < copies.size(); i++)
+				{
+					nri::TextureBarrierDesc& dstBarrier = textureBarriers[textures.size() + i * 2];
+					dstBarrier.texture = copies[i].dst;
+					dstBarrier.mipNum = copies[i].mipNum;
+					dstBarrier.layerNum = copies[i].layerNum;
+					dstBarrier.before = { nri::AccessBits::UNKNOWN, nri::Layout::UNKNOWN };
+					dstBarrier.after = { nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY };
+
+					nri::TextureBarrierDesc& srcBarrier = textureBarriers[textures.size() + i * 2 + 1];
+					srcBarrier = dstBarrier;
+					srcBarrier.texture = copies[i].src;
+					srcBarrier.before = copies[i].state;
+					srcBarrier.after = { nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY };
+				}
+
+				nri::BarrierGroupDesc barrierGroupDesc = {};
+				barrierGroupDesc.textures = textureBarriers.data();
+				barrierGroupDesc.textureNum = (uint16_t)textureBarriers.size();
+				if (barrierGroupDesc.textureNum)
+				{
+					NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+				}
+
+				for (const PendingTexture& texture : textures)
+				{
+					for (const TextureCopy& copy : texture.copies)
+					{
+						NRI.CmdUploadBufferToTexture(commandBuffer, *texture.texture, copy.region, *copy.staging, copy.layout);
+					}
+				}
+				for (const PendingTextureCopy& copy : copies)
+				{
+					NRI.CmdCopyTexture(commandBuffer, *copy.dst, nullptr, *copy.src, nullptr);
+				}
+				for (const PendingBuffer& buffer : buffers)
+				{
+					NRI.CmdCopyBuffer(commandBuffer, *buffer.buffer, buffer.offset, *buffer.staging, buffer.stagingOffset, buffer.size);
+				}
+
+				for (size_t i = 0; i < textures.size(); i++)
+				{
+					textureBarriers[i].before = textureBarriers[i].after;
+					textureBarriers[i].after = textures[i].after;
+				}
+				for (size_t i = textures.size(); i < textureBarriers.size(); i++)
+				{
+					textureBarriers[i].before = textureBarriers[i].after;
+					textureBarriers[i].after = copies[(i - textures.size()) / 2].state;
+				}
+
+				std::vector<nri::BufferBarrierDesc> bufferBarriers(buffers.size());
+				for (size_t i = 0; i < buffers.size(); i++)
+				{
+					bufferBarriers[i].buffer = buffers[i].buffer;
+					bufferBarriers[i].before = { nri::AccessBits::COPY_DESTINATION, nri::StageBits::COPY };
+					bufferBarriers[i].after = buffers[i].after;
+				}
+
+				barrierGroupDesc.buffers = bufferBarriers.data();
+				barrierGroupDesc.bufferNum = (uint16_t)bufferBarriers.size();
+				NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+			}
+			NRI_ABORT_ON_FAILURE(NRI.EndCommandBuffer(commandBuffer));
+
+			nri::FenceSubmitDesc signalFence = {};
+			signalFence.fence = m_fence;
+			signalFence.value = batchValue;
+
+			nri::QueueSubmitDesc queueSubmitDesc = {};
+			const nri::CommandBuffer* commandBuffers[] = { &commandBuffer };
+			queueSubmitDesc.commandBuffers = commandBuffers;
+			queueSubmitDesc.commandBufferNum = 1;
+			queueSubmitDesc.signalFences = &signalFence;
+			queueSubmitDesc.signalFenceNum = 1;
+			NRI.QueueSubmit(m_commandQueue, queueSubmitDesc);
+
+			m_submittedValue = batchValue;
+		}
+
+		NRIInterface& NRI;
+		nri::Device& m_device;
+		nri::CommandQueue& m_commandQueue;
+		nri::Fence* m_fence = nullptr;
+		const uint64_t m_stagingChunkSize;
+		uint32_t m_rowAlignment = 1;
+		uint32_t m_sliceAlignment = 1;
+
+		std::mutex m_mutex;
+		std::vector<std::unique_ptr<StagingChunk>> m_chunks;
+		StagingChunk* m_openChunk = nullptr;
+		std::vector<PendingTexture> m_pendingTextures;
+		std::vector<PendingTextureCopy> m_pendingCopies;
+		std::vector<PendingBuffer> m_pendingBuffers;
+		std::vector<Waiter> m_waiters;
+		std::vector<nri::Memory*> m_resourceMemories;
+		uint64_t m_batchValue = 1;          // fence value of the batch being recorded
+		uint64_t m_completedValue = 0;
+
+		// owned by the thread calling Update
+		std::deque<CommandSet> m_commandSets;
+		uint64_t m_submittedValue = 0;
+	};
+
+	bool UploadAwaitable::await_ready() const { return m_result != nri::Result::SUCCESS || m_queue.IsComplete(m_fenceValue); }
+
+	bool UploadAwaitable::await_suspend(std::coroutine_handle<> handle) const { return m_queue.Resume(m_fenceValue, handle); }
+
+	// constructor
+	UploadQueue::UploadQueue(NRIInterface& NRI, nri::Device& device, nri::CommandQueue& commandQueue, uint64_t stagingChunkSize)
+		: m_impl(std::make_unique<Impl>(NRI, device, commandQueue, stagingChunkSize))
+	{
+	}
+
+	// destructor
+	UploadQueue::~UploadQueue()
+	{
+	}
+
+	bool UploadQueue::Init() { return m_impl->Init(); }
+
+	UploadAwaitable UploadQueue::UploadTexture(const nri::TextureUploadDesc& textureUploadDesc) { return m_impl->UploadTexture(*this, textureUploadDesc); }
+
+	UploadAwaitable UploadQueue::UploadBuffer(const nri::BufferUploadDesc& bufferUploadDesc) { return m_impl->UploadBuffer(*this, bufferUploadDesc); }
+
+	UploadAwaitable UploadQueue::CopyTexture(nri::Texture& dst, nri::Texture& src, nri::AccessLayoutStage state) { return m_impl->CopyTexture(*this, dst, src, state); }
+
+	Task<nri::Result> UploadQueue::CreateTexture(TextureStorage& storage, TextureHandle texture)
+	{
+		const nri::Result result = m_impl->CreateTextureResource(storage, texture);
+		if (result != nri::Result::SUCCESS)
+		{
+			co_return result;
+		}
+		co_return co_await ReuploadTexture(storage, texture);
+	}
+
+	Task<nri::Result> UploadQueue::ReuploadTexture(TextureStorage& storage, TextureHandle texture)
+	{
+		// an evicted texture has nothing to upload into
+		if (!storage.GetTexture(texture) || (!storage.HasPixels(texture) && !storage.ReloadPixels(texture)))
+		{
+			co_return nri::Result::FAILURE;
+		}
+
+		const nri::Result result = co_await UploadTexture(storage.GetTextureUploadDesc(texture));
+		if (result == nri::Result::SUCCESS)
+		{
+			// the data is on the GPU, the decoded copy is dead weight until the next upload
+			storage.ReleasePixels(texture);
+		}
+		co_return result;
+	}
+
+	Task<nri::Buffer*> UploadQueue::CreateBuffer(nri::BufferDesc bufferDesc, const void* data, nri::AccessStage after)
+	{
+		nri::Buffer* buffer = m_impl->CreateBufferResource(bufferDesc);
+		if (!buffer)
+		{
+			co_return nullptr;
+		}
+
+		nri::BufferUploadDesc bufferUploadDesc = {};
+		bufferUploadDesc.data = data;
+		bufferUploadDesc.dataSize = bufferDesc.size;
+		bufferUploadDesc.buffer = buffer;
+		bufferUploadDesc.after = after;
+		if (co_await UploadBuffer(bufferUploadDesc) != nri::Result::SUCCESS)
+		{
+			m_impl->DestroyBuffer(*buffer);
+			co_return nullptr;
+		}
+		co_return buffer;
+	}
+
+	void UploadQueue::Update() { m_impl->Update(); }
+
+	void UploadQueue::Wait(const std::function<bool()>& done)
+	{
+		JobSystem::Wait([this, &done]()
+		{
+			m_impl->Update();
+			return done();
+		});
+	}
+
+	bool UploadQueue::IsComplete(uint64_t fenceValue) const { return m_impl->IsComplete(fenceValue); }
+
+	bool UploadQueue::Resume(uint64_t fenceValue, std::coroutine_handle<> handle) { return m_impl->Resume(fenceValue, handle); }
+
+} // namespace nfw
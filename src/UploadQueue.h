@@ -0,0 +1,82 @@
+#pragma once
+
+#include <coroutine>
+
+#include "Api.h"
+#include "Types.h"
+#include "Task.h"
+
+namespace nfw
+{
+	class UploadQueue;
+
+	// co_await suspends until the GPU has finished the upload, the coroutine then resumes on a job thread
+	class UploadAwaitable
+	{
+	public:
+		UploadAwaitable(UploadQueue& queue, uint64_t fenceValue, nri::Result result)
+			: m_queue(queue)
+			, m_fenceValue(fenceValue)
+			, m_result(result)
+		{}
+
+		bool await_ready() const;
+		bool await_suspend(std::coroutine_handle<> handle) const;
+		nri::Result await_resume() const { return m_result; }
+
+	private:
+		UploadQueue& m_queue;
+		uint64_t m_fenceValue;
+		nri::Result m_result;
+	};
+
+	// Asynchronous resource creation and upload.
+	// Uploads may be started from any thread: the data is copied into persistently mapped staging chunks right away
+	// and the copy commands are recorded and submitted by Update, which must run on the thread that submits to the
+	// command queue. Each submission signals the queue's fence and Update resumes the coroutines waiting on it.
+	// Memory of buffers created here belongs to the queue and is freed with it, destroy the buffers first;
+	// texture memory comes from the heap of the TextureStorage.
+	class UploadQueue
+	{
+		DISALLOW_COPY_AND_ASSIGN(UploadQueue);
+	public:
+		UploadQueue(NRIInterface& NRI, nri::Device& device, nri::CommandQueue& commandQueue, uint64_t stagingChunkSize = 16 * 1024 * 1024);
+		~UploadQueue();
+
+		bool Init();
+
+		// The awaitable returns FAILURE when no staging memory could be allocated
+		UploadAwaitable UploadTexture(const nri::TextureUploadDesc& textureUploadDesc);
+		UploadAwaitable UploadBuffer(const nri::BufferUploadDesc& bufferUploadDesc);
+
+		// Copies every subresource of src into dst of the same desc. src is read in state and left in it, dst ends in
+		// it. On the queue frames are submitted to, the copy waits for earlier frames reading src.
+		UploadAwaitable CopyTexture(nri::Texture& dst, nri::Texture& src, nri::AccessLayoutStage state);
+
+		// Create the resource, bind device memory and upload, completing once the data is on the GPU
+		// Texture pixels are released from the storage once uploaded; storage must outlive the task
+		Task<nri::Result> CreateTexture(TextureStorage& storage, TextureHandle texture);
+
+		// Uploads a created texture again, decoding its file first when the pixels were released
+		Task<nri::Result> ReuploadTexture(TextureStorage& storage, TextureHandle texture);
+		Task<nri::Buffer*> CreateBuffer(nri::BufferDesc bufferDesc, const void* data, nri::AccessStage after);    // data must outlive the task
+
+		// Submits the uploads recorded since the last call and resumes the coroutines whose uploads finished
+		void Update();
+
+		// Updates and runs jobs until done returns true, for loading before the frame loop takes over Update
+		void Wait(const std::function<bool()>& done);
+
+		template <typename T>
+		void Wait(const Task<T>& task) { Wait([&task]() { return task.IsDone(); }); }
+
+		bool IsComplete(uint64_t fenceValue) const;
+
+		// false when the fence value has already been reached and the caller may continue right away
+		bool Resume(uint64_t fenceValue, std::coroutine_handle<> handle);
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
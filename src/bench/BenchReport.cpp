@@ -0,0 +1,276 @@
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+
+namespace nfw
+{
+	BenchPercentiles ComputePercentiles(std::vector<double> samples)
+	{
+		BenchPercentiles result = {};
+		if (samples.empty())
+		{
+			return result;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		// nearest-rank percentile
+		auto percentile = [&](double p)
+		{
+			const size_t rank = (size_t)std::ceil(p * samples.size());
+			return samples[std::min(std::max(rank, (size_t)1), samples.size()) - 1];
+		};
+
+		result.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		result.p50 = percentile(0.50);
+		result.p95 = percentile(0.95);
+		result.p99 = percentile(0.99);
+		result.max = samples.back();
+		return result;
+	}
+
+	namespace
+	{
+		void WriteEscaped(std::ostream& os, const std::string& str)
+		{
+			for (char c : str)
+			{
+				if (c == '"' || c == '\\')
+				{
+					os << '\\';
+				}
+				os << c;
+			}
+		}
+
+		// Reads the entries of a report written by BenchReport::ToJson.
+		// Only the shape this file writes is understood: "name" followed by a flat "metrics" object.
+		using BaselineMetrics = std::unordered_map<std::string, double>;
+
+		bool ReadString(const std::string& json, size_t& pos, std::string& str)
+		{
+			pos = json.find('"', pos);
+			if (pos == std::string::npos)
+			{
+				return false;
+			}
+			str.clear();
+			for (++pos; pos < json.size() && json[pos] != '"'; ++pos)
+			{
+				if (json[pos] == '\\' && pos + 1 < json.size())
+				{
+					++pos;
+				}
+				str += json[pos];
+			}
+			++pos;
+			return pos <= json.size();
+		}
+
+		bool ParseBaseline(const std::string& json, std::unordered_map<std::string, BaselineMetrics>& entries)
+		{
+			size_t pos = json.find("\"entries\"");
+			if (pos == std::string::npos)
+			{
+				return false;
+			}
+
+			const char* nameKey = "{\"name\":";
+			while ((pos = json.find(nameKey, pos)) != std::string::npos)
+			{
+				pos += strlen(nameKey);
+
+				std::string entryName;
+				if (!ReadString(json, pos, entryName))
+				{
+					return false;
+				}
+
+				pos = json.find("\"metrics\":{", pos);
+				if (pos == std::string::npos)
+				{
+					return false;
+				}
+				pos += strlen("\"metrics\":{");
+
+				BaselineMetrics& metrics = entries[entryName];
+				while (pos < json.size() && json[pos] != '}')
+				{
+					std::string metricName;
+					if (!ReadString(json, pos, metricName))
+					{
+						return false;
+					}
+					pos = json.find(':', pos) + 1;
+
+					char* end = nullptr;
+					metrics[metricName] = strtod(json.c_str() + pos, &end);
+					pos = end - json.c_str();
+					if (pos < json.size() && json[pos] == ',')
+					{
+						++pos;
+					}
+				}
+			}
+			return true;
+		}
+	}
+
+	class BenchReport::Impl
+	{
+	public:
+		Impl(const std::string& suiteName)
+			: m_suiteName(suiteName)
+		{}
+		~Impl() {}
+
+		void SetProperty(const std::string& name, const std::string& value)
+		{
+			m_properties.push_back({ name, value });
+		}
+
+		BenchEntry& AddEntry(const std::string& name)
+		{
+			m_entries.push_back(std::make_unique<BenchEntry>());
+			m_entries.back()->name = name;
+			return *m_entries.back();
+		}
+
+		void AddPercentiles(BenchEntry& entry, const std::string& prefix, const std::vector<double>& samples, bool gated)
+		{
+			const BenchPercentiles percentiles = ComputePercentiles(samples);
+			entry.Add(prefix + "_mean", percentiles.mean);
+			entry.Add(prefix + "_p50", percentiles.p50, false, gated);
+			entry.Add(prefix + "_p95", percentiles.p95, false, gated);
+			entry.Add(prefix + "_p99", percentiles.p99);
+			entry.Add(prefix + "_max", percentiles.max);
+		}
+
+		std::string ToJson() const
+		{
+			std::ostringstream os;
+			os.precision(6);
+			os << std::fixed;
+
+			os << "{\n\"suite\":\"";
+			WriteEscaped(os, m_suiteName);
+			os << "\",\n\"properties\":{";
+			for (size_t i = 0; i < m_properties.size(); i++)
+			{
+				os << (i ? "," : "") << "\"";
+				WriteEscaped(os, m_properties[i].first);
+				os << "\":\"";
+				WriteEscaped(os, m_properties[i].second);
+				os << "\"";
+			}
+			os << "},\n\"entries\":[";
+			for (size_t i = 0; i < m_entries.size(); i++)
+			{
+				const BenchEntry& entry = *m_entries[i];
+				os << (i ? "," : "") << "\n{\"name\":\"";
+				WriteEscaped(os, entry.name);
+				os << "\",\"metrics\":{";
+				for (size_t j = 0; j < entry.metrics.size(); j++)
+				{
+					os << (j ? "," : "") << "\"";
+					WriteEscaped(os, entry.metrics[j].name);
+					os << "\":" << entry.metrics[j].value;
+				}
+				os << "}}";
+			}
+			os << "\n]\n}\n";
+			return os.str();
+		}
+
+		bool WriteJson(const std::string& path) const
+		{
+			std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+			if (!ofs)
+			{
+				return false;
+			}
+			ofs << ToJson();
+			return ofs.good();
+		}
+
+		int CompareWithBaseline(const std::string& baselinePath, double threshold) const
+		{
+			std::ifstream ifs(baselinePath, std::ios::in | std::ios::binary);
+			const std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+			std::unordered_map<std::string, BaselineMetrics> baseline;
+			if (json.empty() || !ParseBaseline(json, baseline))
+			{
+				std::cerr << "can not read baseline: " << baselinePath << std::endl;
+				return -1;
+			}
+
+			int regressionNum = 0;
+			for (const std::unique_ptr<BenchEntry>& entry : m_entries)
+			{
+				auto baselineEntry = baseline.find(entry->name);
+				if (baselineEntry == baseline.end())
+				{
+					continue;
+				}
+
+				for (const BenchMetric& metric : entry->metrics)
+				{
+					auto baselineMetric = baselineEntry->second.find(metric.name);
+					if (!metric.gated || baselineMetric == baselineEntry->second.end() || baselineMetric->second <= 0.0)
+					{
+						continue;
+					}
+
+					// positive change is always "worse"
+					const double reference = baselineMetric->second;
+					const double change = metric.higherIsBetter ? (reference - metric.value) / reference : (metric.value - reference) / reference;
+					if (change > threshold)
+					{
+						std::cerr << "REGRESSION " << entry->name << " " << metric.name << ": " << reference << " -> " << metric.value
+							<< " (" << (metric.higherIsBetter ? "-" : "+") << change * 100.0 << "%)" << std::endl;
+						regressionNum++;
+					}
+				}
+			}
+			return regressionNum;
+		}
+
+	private:
+		std::string m_suiteName;
+		std::vector<std::pair<std::string, std::string>> m_properties;
+		std::vector<std::unique_ptr<BenchEntry>> m_entries;    // stable addresses for AddEntry callers
+	};
+
+	// constructor
+	BenchReport::BenchReport(const std::string& suiteName)
+		: m_impl(std::make_unique<Impl>(suiteName))
+	{
+	}
+
+	// destructor
+	BenchReport::~BenchReport()
+	{
+	}
+
+	void BenchReport::SetProperty(const std::string& name, const std::string& value) { m_impl->SetProperty(name, value); }
+
+	BenchEntry& BenchReport::AddEntry(const std::string& name) { return m_impl->AddEntry(name); }
+
+	void BenchReport::AddPercentiles(BenchEntry& entry, const std::string& prefix, const std::vector<double>& samples, bool gated) { m_impl->AddPercentiles(entry, prefix, samples, gated); }
+
+	bool BenchReport::WriteJson(const std::string& path) const { return m_impl->WriteJson(path); }
+
+	std::string BenchReport::ToJson() const { return m_impl->ToJson(); }
+
+	int BenchReport::CompareWithBaseline(const std::string& baselinePath, double threshold) const { return m_impl->CompareWithBaseline(baselinePath, threshold); }
+
+} // namespace nfw
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nfw
+{
+	struct BenchMetric
+	{
+		std::string name;
+		double value;
+		bool higherIsBetter;    // throughput metrics, times are lower-is-better
+		bool gated;             // compared against the baseline
+	};
+
+	struct BenchEntry
+	{
+		std::string name;
+		std::vector<BenchMetric> metrics;
+
+		void Add(const std::string& metricName, double value, bool higherIsBetter = false, bool gated = false)
+		{
+			metrics.push_back({ metricName, value, higherIsBetter, gated });
+		}
+	};
+
+	struct BenchPercentiles
+	{
+		double mean;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	BenchPercentiles ComputePercentiles(std::vector<double> samples);
+
+	// Collects benchmark results, writes them as JSON and compares them against a previous run.
+	// The baseline is a JSON file written by WriteJson, entries and metrics are matched by name.
+	class BenchReport
+	{
+	public:
+		BenchReport(const std::string& suiteName);
+		~BenchReport();
+
+		BenchReport(const BenchReport&) = delete;
+		void operator=(const BenchReport&) = delete;
+
+		void SetProperty(const std::string& name, const std::string& value);
+
+		BenchEntry& AddEntry(const std::string& name);
+
+		// Adds <prefix>_mean, _p50, _p95, _p99 and _max, p50 and p95 are gated when requested
+		void AddPercentiles(BenchEntry& entry, const std::string& prefix, const std::vector<double>& samples, bool gated);
+
+		bool WriteJson(const std::string& path) const;
+		std::string ToJson() const;
+
+		// Prints every gated metric that got worse than the baseline by more than threshold (0.1 = 10%).
+		// Returns the number of regressions, or -1 when the baseline can not be read.
+		int CompareWithBaseline(const std::string& baselinePath, double threshold) const;
+
+	private:
+		class Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+} // namespace nfw
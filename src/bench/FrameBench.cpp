@@ -0,0 +1,344 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Simple.h"
+#include "GpuProfiler.h"
+#include "Trace.h"
+
+#include "BenchReport.h"
+
+namespace
+{
+	using namespace nfw;
+
+	using Clock = std::chrono::steady_clock;
+
+	double GetElapsedMs(Clock::time_point begin)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+	}
+
+	struct Scenario
+	{
+		std::string name;
+		uint32_t quadNum = 1;
+		uint32_t textureNum = 1;
+		uint32_t pipelineNum = 1;
+		glm::uvec2 resolution = { 1280, 720 };
+	};
+
+	struct Options
+	{
+#if defined(_WIN32)
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::D3D12;
+#else
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::VK;
+#endif
+		uint32_t frameNum = 300;
+		uint32_t warmupFrameNum = 30;
+		std::string scenarioPath;
+		std::string filter;
+		std::string outPath = "bench_frame.json";
+		std::string baselinePath;
+		double threshold = 0.1;
+	};
+
+	const char* GetGraphicsAPIName(nri::GraphicsAPI graphicsAPI)
+	{
+		switch (graphicsAPI)
+		{
+		case nri::GraphicsAPI::D3D11: return "d3d11";
+		case nri::GraphicsAPI::D3D12: return "d3d12";
+		case nri::GraphicsAPI::VK: return "vk";
+		default: return "none";
+		}
+	}
+
+	bool ParseGraphicsAPI(const char* name, nri::GraphicsAPI& graphicsAPI)
+	{
+		if (!strcmp(name, "d3d11"))
+			graphicsAPI = nri::GraphicsAPI::D3D11;
+		else if (!strcmp(name, "d3d12"))
+			graphicsAPI = nri::GraphicsAPI::D3D12;
+		else if (!strcmp(name, "vk"))
+			graphicsAPI = nri::GraphicsAPI::VK;
+		else if (!strcmp(name, "none"))
+			graphicsAPI = nri::GraphicsAPI::NONE;
+		else
+			return false;
+
+		return true;
+	}
+
+	// --api=d3d11|d3d12|vk|none --frames=N --warmup=N --scenarios=file --filter=substring
+	// --out=file --baseline=file --threshold=0.1
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			if (!strncmp(arg, "--api=", 6))
+			{
+				if (!ParseGraphicsAPI(arg + 6, options.graphicsAPI))
+				{
+					std::cerr << "unknown graphics API: " << arg + 6 << std::endl;
+					return false;
+				}
+			}
+			else if (!strncmp(arg, "--frames=", 9))
+				options.frameNum = (uint32_t)strtoul(arg + 9, nullptr, 10);
+			else if (!strncmp(arg, "--warmup=", 9))
+				options.warmupFrameNum = (uint32_t)strtoul(arg + 9, nullptr, 10);
+			else if (!strncmp(arg, "--scenarios=", 12))
+				options.scenarioPath = arg + 12;
+			else if (!strncmp(arg, "--filter=", 9))
+				options.filter = arg + 9;
+			else if (!strncmp(arg, "--out=", 6))
+				options.outPath = arg + 6;
+			else if (!strncmp(arg, "--baseline=", 11))
+				options.baselinePath = arg + 11;
+			else if (!strncmp(arg, "--threshold=", 12))
+				options.threshold = strtod(arg + 12, nullptr);
+			else
+			{
+				std::cerr << "unknown option: " << arg << std::endl;
+				return false;
+			}
+		}
+		return options.frameNum > 0;
+	}
+
+	std::vector<Scenario> GetDefaultScenarios()
+	{
+		std::vector<Scenario> scenarios;
+		auto add = [&](const std::string& name, uint32_t quadNum, uint32_t textureNum, uint32_t pipelineNum, glm::uvec2 resolution)
+		{
+			scenarios.push_back({ name, quadNum, textureNum, pipelineNum, resolution });
+		};
+
+		// draw count
+		for (uint32_t quadNum : { 1u, 100u, 1000u, 10000u })
+			add("quads_" + std::to_string(quadNum), quadNum, 1, 1, { 1280, 720 });
+
+		// texture switches
+		for (uint32_t textureNum : { 1u, 8u, 64u })
+			add("textures_" + std::to_string(textureNum), 1000, textureNum, 1, { 1280, 720 });
+
+		// pipeline switches
+		for (uint32_t pipelineNum : { 1u, 16u, 64u })
+			add("pipelines_" + std::to_string(pipelineNum), 1000, 1, pipelineNum, { 1280, 720 });
+
+		// fill rate
+		for (glm::uvec2 resolution : { glm::uvec2(640, 360), glm::uvec2(1280, 720), glm::uvec2(1920, 1080), glm::uvec2(3840, 2160) })
+			add("resolution_" + std::to_string(resolution.x) + "x" + std::to_string(resolution.y), 100, 1, 1, resolution);
+
+		return scenarios;
+	}
+
+	// one scenario per line: name quads textures pipelines width height, # starts a comment
+	bool LoadScenarios(const std::string& path, std::vector<Scenario>& scenarios)
+	{
+		std::ifstream ifs(path);
+		if (!ifs)
+		{
+			std::cerr << "can not open scenario file: " << path << std::endl;
+			return false;
+		}
+
+		std::string line;
+		uint32_t lineNumber = 0;
+		while (std::getline(ifs, line))
+		{
+			lineNumber++;
+			line = line.substr(0, line.find('#'));
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+			{
+				continue;
+			}
+
+			Scenario scenario;
+			std::istringstream iss(line);
+			if (!(iss >> scenario.name >> scenario.quadNum >> scenario.textureNum >> scenario.pipelineNum >> scenario.resolution.x >> scenario.resolution.y)
+				|| !scenario.quadNum || !scenario.textureNum || !scenario.pipelineNum || !scenario.resolution.x || !scenario.resolution.y)
+			{
+				std::cerr << path << "(" << lineNumber << "): invalid scenario" << std::endl;
+				return false;
+			}
+			scenarios.push_back(scenario);
+		}
+		return true;
+	}
+
+	bool RunScenario(const Options& options, const Scenario& scenario, BenchReport& report)
+	{
+		NFW_TRACE_SCOPE("Bench::RunScenario");
+
+		SimpleDesc simpleDesc = {};
+		simpleDesc.resolution = scenario.resolution;
+		simpleDesc.graphicsAPI = options.graphicsAPI;
+		simpleDesc.headless = true;
+		simpleDesc.quadNum = scenario.quadNum;
+		simpleDesc.textureNum = scenario.textureNum;
+		simpleDesc.pipelineNum = scenario.pipelineNum;
+
+		const Clock::time_point initBegin = Clock::now();
+		std::unique_ptr<Simple> simple = std::make_unique<Simple>(simpleDesc);
+		if (!simple->Init())
+		{
+			std::cerr << scenario.name << ": initialization failed" << std::endl;
+			return false;
+		}
+		const double initMs = GetElapsedMs(initBegin);
+
+		std::vector<double> frameMs, prepareMs, waitMs, recordMs, submitMs, gpuFrameMs;
+		frameMs.reserve(options.frameNum);
+		prepareMs.reserve(options.frameNum);
+		waitMs.reserve(options.frameNum);
+		recordMs.reserve(options.frameNum);
+		submitMs.reserve(options.frameNum);
+		gpuFrameMs.reserve(options.frameNum);
+
+		uint32_t drawNum = 0;
+		uint32_t lastGpuFrameIndex = ~0u;
+		GpuProfilerPtr gpuProfiler = simple->GetGpuProfiler();
+
+		const uint32_t totalFrameNum = options.warmupFrameNum + options.frameNum;
+		for (uint32_t i = 0; i < totalFrameNum; i++)
+		{
+			const Clock::time_point frameBegin = Clock::now();
+			simple->Prepare(i);
+			simple->Render(i);
+			const double elapsedMs = GetElapsedMs(frameBegin);
+
+			if (i < options.warmupFrameNum)
+			{
+				continue;
+			}
+
+			const SimpleFrameStats stats = simple->GetFrameStats();
+			frameMs.push_back(elapsedMs);
+			prepareMs.push_back(stats.prepareMs);
+			waitMs.push_back(stats.waitMs);
+			recordMs.push_back(stats.recordMs);
+			submitMs.push_back(stats.submitMs);
+			drawNum = stats.drawNum;
+
+			// timings arrive a few frames late, take each resolved frame once
+			if (gpuProfiler && gpuProfiler->GetTimingsFrameIndex() != lastGpuFrameIndex)
+			{
+				lastGpuFrameIndex = gpuProfiler->GetTimingsFrameIndex();
+				for (const GpuScopeTiming& timing : gpuProfiler->GetTimings())
+				{
+					if (timing.depth == 0)
+					{
+						gpuFrameMs.push_back(timing.milliseconds);
+						break;
+					}
+				}
+			}
+		}
+
+		// destruction waits for the GPU, keep it out of the frame numbers
+		simple.reset();
+
+		BenchEntry& entry = report.AddEntry(scenario.name);
+		entry.Add("quads", scenario.quadNum);
+		entry.Add("textures", scenario.textureNum);
+		entry.Add("pipelines", scenario.pipelineNum);
+		entry.Add("width", scenario.resolution.x);
+		entry.Add("height", scenario.resolution.y);
+		entry.Add("draws", drawNum);
+		entry.Add("init_ms", initMs);
+		report.AddPercentiles(entry, "frame_ms", frameMs, true);
+		report.AddPercentiles(entry, "prepare_ms", prepareMs, false);
+		report.AddPercentiles(entry, "wait_ms", waitMs, false);
+		report.AddPercentiles(entry, "record_ms", recordMs, false);
+		report.AddPercentiles(entry, "submit_ms", submitMs, false);
+		if (!gpuFrameMs.empty())
+		{
+			report.AddPercentiles(entry, "gpu_frame_ms", gpuFrameMs, false);
+		}
+
+		const BenchPercentiles frame = ComputePercentiles(frameMs);
+		std::cout << scenario.name << ": init " << initMs << " ms, frame p50 " << frame.p50 << " ms, p95 " << frame.p95
+			<< " ms, p99 " << frame.p99 << " ms (" << drawNum << " draws)" << std::endl;
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+
+	std::vector<Scenario> scenarios;
+	if (options.scenarioPath.empty())
+	{
+		scenarios = GetDefaultScenarios();
+	}
+	else if (!LoadScenarios(options.scenarioPath, scenarios))
+	{
+		return 1;
+	}
+
+	// NFW_TRACE=<file> records CPU trace scopes of the whole run
+	const char* tracePath = std::getenv("NFW_TRACE");
+	if (tracePath)
+	{
+		Trace::SetThreadName("Main");
+		Trace::SetEnabled(true);
+	}
+
+	BenchReport report("frame");
+	report.SetProperty("api", GetGraphicsAPIName(options.graphicsAPI));
+	report.SetProperty("frames", std::to_string(options.frameNum));
+	report.SetProperty("warmup", std::to_string(options.warmupFrameNum));
+
+	bool failed = false;
+	for (const Scenario& scenario : scenarios)
+	{
+		if (!options.filter.empty() && scenario.name.find(options.filter) == std::string::npos)
+		{
+			continue;
+		}
+		failed |= !RunScenario(options, scenario, report);
+	}
+
+	if (tracePath)
+	{
+		Trace::WriteChromeTrace(tracePath);
+	}
+
+	if (!report.WriteJson(options.outPath))
+	{
+		std::cerr << "can not write " << options.outPath << std::endl;
+		return 1;
+	}
+	std::cout << "results written to " << options.outPath << std::endl;
+
+	if (!options.baselinePath.empty())
+	{
+		const int regressionNum = report.CompareWithBaseline(options.baselinePath, options.threshold);
+		if (regressionNum < 0)
+		{
+			return 1;
+		}
+		if (regressionNum > 0)
+		{
+			std::cerr << regressionNum << " regression(s) over " << options.threshold * 100.0 << "%" << std::endl;
+			return 2;
+		}
+		std::cout << "no regressions against " << options.baselinePath << std::endl;
+	}
+
+	return failed ? 1 : 0;
+}
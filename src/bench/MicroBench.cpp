@@ -0,0 +1,729 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Api.h"
+#include "Types.h"
+#include "Texture.h"
+#include "TextureStorage.h"
+#include "TextureHeap.h"
+#include "Shader.h"
+#include "Geometry.h"
+#include "OcclusionCuller.h"
+#include "SceneGraph.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#include "BenchReport.h"
+
+namespace
+{
+	using namespace nfw;
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Options
+	{
+#if defined(_WIN32)
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::D3D12;
+#else
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::VK;
+#endif
+		std::vector<uint32_t> threadNums;
+		uint32_t repeatNum = 5;
+		std::string texturePath = "resource/texture/uimac.jpeg";
+		std::string shaderPath = "Simple.vs";
+		std::string filter;
+		std::string outPath = "bench_micro.json";
+		std::string baselinePath;
+		double threshold = 0.1;
+	};
+
+	const char* GetGraphicsAPIName(nri::GraphicsAPI graphicsAPI)
+	{
+		switch (graphicsAPI)
+		{
+		case nri::GraphicsAPI::D3D11: return "d3d11";
+		case nri::GraphicsAPI::D3D12: return "d3d12";
+		case nri::GraphicsAPI::VK: return "vk";
+		default: return "none";
+		}
+	}
+
+	bool ParseGraphicsAPI(const char* name, nri::GraphicsAPI& graphicsAPI)
+	{
+		if (!strcmp(name, "d3d11"))
+			graphicsAPI = nri::GraphicsAPI::D3D11;
+		else if (!strcmp(name, "d3d12"))
+			graphicsAPI = nri::GraphicsAPI::D3D12;
+		else if (!strcmp(name, "vk"))
+			graphicsAPI = nri::GraphicsAPI::VK;
+		else if (!strcmp(name, "none"))
+			graphicsAPI = nri::GraphicsAPI::NONE;
+		else
+			return false;
+
+		return true;
+	}
+
+	// 1, 2, 4, ... up to the hardware thread count, which is always included
+	std::vector<uint32_t> GetDefaultThreadNums()
+	{
+		const uint32_t hardwareThreadNum = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<uint32_t> threadNums;
+		for (uint32_t threadNum = 1; threadNum < hardwareThreadNum; threadNum *= 2)
+		{
+			threadNums.push_back(threadNum);
+		}
+		threadNums.push_back(hardwareThreadNum);
+		return threadNums;
+	}
+
+	// --api=d3d11|d3d12|vk|none --threads=1,2,4 --repeat=N --texture=file --shader=name
+	// --filter=substring --out=file --baseline=file --threshold=0.1
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			if (!strncmp(arg, "--api=", 6))
+			{
+				if (!ParseGraphicsAPI(arg + 6, options.graphicsAPI))
+				{
+					std::cerr << "unknown graphics API: " << arg + 6 << std::endl;
+					return false;
+				}
+			}
+			else if (!strncmp(arg, "--threads=", 10))
+			{
+				for (const char* str = arg + 10; *str; )
+				{
+					char* end = nullptr;
+					const uint32_t threadNum = (uint32_t)strtoul(str, &end, 10);
+					if (end == str || threadNum == 0)
+					{
+						std::cerr << "invalid thread count: " << arg + 10 << std::endl;
+						return false;
+					}
+					options.threadNums.push_back(threadNum);
+					str = (*end == ',') ? end + 1 : end;
+				}
+			}
+			else if (!strncmp(arg, "--repeat=", 9))
+				options.repeatNum = (uint32_t)strtoul(arg + 9, nullptr, 10);
+			else if (!strncmp(arg, "--texture=", 10))
+				options.texturePath = arg + 10;
+			else if (!strncmp(arg, "--shader=", 9))
+				options.shaderPath = arg + 9;
+			else if (!strncmp(arg, "--filter=", 9))
+				options.filter = arg + 9;
+			else if (!strncmp(arg, "--out=", 6))
+				options.outPath = arg + 6;
+			else if (!strncmp(arg, "--baseline=", 11))
+				options.baselinePath = arg + 11;
+			else if (!strncmp(arg, "--threshold=", 12))
+				options.threshold = strtod(arg + 12, nullptr);
+			else
+			{
+				std::cerr << "unknown option: " << arg << std::endl;
+				return false;
+			}
+		}
+
+		if (options.threadNums.empty())
+		{
+			options.threadNums = GetDefaultThreadNums();
+		}
+		return options.repeatNum > 0;
+	}
+
+	// Runs func(threadIndex) on threadNum threads that start together, returns the wall time in milliseconds.
+	// Thread creation is not part of the measurement.
+	double RunOnThreads(uint32_t threadNum, const std::function<void(uint32_t)>& func)
+	{
+		std::atomic<uint32_t> readyNum = 0;
+		std::atomic<bool> start = false;
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadNum);
+		for (uint32_t i = 0; i < threadNum; i++)
+		{
+			threads.emplace_back([&, i]()
+			{
+				readyNum.fetch_add(1, std::memory_order_acq_rel);
+				while (!start.load(std::memory_order_acquire))
+				{
+					std::this_thread::yield();
+				}
+				func(i);
+			});
+		}
+
+		while (readyNum.load(std::memory_order_acquire) != threadNum)
+		{
+			std::this_thread::yield();
+		}
+
+		const Clock::time_point begin = Clock::now();
+		start.store(true, std::memory_order_release);
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+	}
+
+	// One micro-benchmark: setup prepares per-thread state outside the measurement, run processes
+	// itemNum items on one thread and returns the bytes it processed, 0 when there is no payload.
+	// A serial run keeps the ParallelFor calls inside it on its thread, so the thread count is all it uses.
+	// A worker sweep runs on one thread instead and the thread count is that of the job system: the thread plus
+	// threadNum - 1 workers. check runs after each repeat and fails the benchmark when the results are wrong.
+	struct MicroBenchmark
+	{
+		std::string name;
+		uint32_t itemNum;
+		bool serial = false;
+		bool sweepWorkers = false;
+		std::function<bool(uint32_t threadNum)> setup;
+		std::function<uint64_t(uint32_t threadIndex)> run;
+		std::function<bool()> check;
+		std::function<void()> teardown;
+	};
+
+	bool RunBenchmark(const Options& options, const MicroBenchmark& benchmark, BenchReport& report)
+	{
+		for (uint32_t threadNum : options.threadNums)
+		{
+			// the job system always has a worker, a single thread runs serial instead
+			const uint32_t runThreadNum = benchmark.sweepWorkers ? 1 : threadNum;
+			const bool serial = benchmark.serial || (benchmark.sweepWorkers && threadNum == 1);
+			if (benchmark.sweepWorkers)
+			{
+				JobSystemDesc jobSystemDesc = {};
+				jobSystemDesc.workerNum = std::max(threadNum - 1, 1u);
+				JobSystem::Init(jobSystemDesc);
+			}
+
+			std::vector<double> samples;
+			std::atomic<uint64_t> byteNum = 0;
+			for (uint32_t repeat = 0; repeat < options.repeatNum; repeat++)
+			{
+				if (benchmark.setup && !benchmark.setup(runThreadNum))
+				{
+					std::cerr << benchmark.name << ": setup failed" << std::endl;
+					if (benchmark.teardown)
+					{
+						benchmark.teardown();
+					}
+					return false;
+				}
+
+				byteNum = 0;
+				samples.push_back(RunOnThreads(runThreadNum, [&](uint32_t threadIndex)
+				{
+					std::optional<SerialScope> serialScope;
+					if (serial)
+					{
+						serialScope.emplace();
+					}
+					byteNum.fetch_add(benchmark.run(threadIndex), std::memory_order_relaxed);
+				}));
+
+				const bool checked = !benchmark.check || benchmark.check();
+				if (benchmark.teardown)
+				{
+					benchmark.teardown();
+				}
+				if (!checked)
+				{
+					std::cerr << benchmark.name << ": check failed" << std::endl;
+					return false;
+				}
+			}
+
+			const BenchPercentiles percentiles = ComputePercentiles(samples);
+			const double seconds = percentiles.p50 / 1000.0;
+			const uint64_t itemNum = (uint64_t)benchmark.itemNum * runThreadNum;
+			const double itemsPerSecond = seconds > 0.0 ? itemNum / seconds : 0.0;
+			const double megabytesPerSecond = seconds > 0.0 ? byteNum.load() / (1024.0 * 1024.0) / seconds : 0.0;
+
+			BenchEntry& entry = report.AddEntry(benchmark.name + "_t" + std::to_string(threadNum));
+			entry.Add("threads", threadNum);
+			entry.Add("inner_threads", serial ? 1 : JobSystem::GetWorkerNum() + 1);
+			entry.Add("items", (double)itemNum);
+			entry.Add("bytes", (double)byteNum.load());
+			report.AddPercentiles(entry, "wall_ms", samples, false);
+			entry.Add("items_per_s", itemsPerSecond, true, true);
+			if (byteNum.load())
+			{
+				entry.Add("mb_per_s", megabytesPerSecond, true, true);
+			}
+
+			std::cout << benchmark.name << " x" << threadNum << ": " << itemsPerSecond << " items/s, "
+				<< megabytesPerSecond << " MB/s (p50 " << percentiles.p50 << " ms)" << std::endl;
+		}
+		return true;
+	}
+
+	// NRI device for the benchmarks that create GPU objects
+	class BenchDevice
+	{
+	public:
+		BenchDevice() {}
+		~BenchDevice()
+		{
+			if (m_device)
+			{
+				nri::nriDestroyDevice(*m_device);
+			}
+		}
+
+		BenchDevice(const BenchDevice&) = delete;
+		void operator=(const BenchDevice&) = delete;
+
+		bool Init(nri::GraphicsAPI graphicsAPI)
+		{
+			nri::AdapterDesc adapterDesc = {};
+			uint32_t adapterDescNum = 1;
+			const bool hasAdapter = nri::nriEnumerateAdapters(&adapterDesc, adapterDescNum) == nri::Result::SUCCESS && adapterDescNum != 0;
+
+			nri::DeviceCreationDesc deviceCreationDesc = {};
+			deviceCreationDesc.graphicsAPI = graphicsAPI;
+			deviceCreationDesc.adapterDesc = hasAdapter ? &adapterDesc : nullptr;
+			if (nri::nriCreateDevice(deviceCreationDesc, m_device) != nri::Result::SUCCESS)
+			{
+				return false;
+			}
+
+			return nri::nriGetInterface(*m_device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI) == nri::Result::SUCCESS
+				&& nri::nriGetInterface(*m_device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI) == nri::Result::SUCCESS;
+		}
+
+		NRIInterface NRI = {};
+		nri::Device* m_device = nullptr;
+	};
+
+	MicroBenchmark MakeTextureLoadBenchmark(const Options& options)
+	{
+		MicroBenchmark benchmark;
+		benchmark.name = "texture_load";
+		benchmark.itemNum = 8;
+		benchmark.serial = true;
+		benchmark.run = [&options, itemNum = benchmark.itemNum](uint32_t)
+		{
+			uint64_t byteNum = 0;
+			for (uint32_t i = 0; i < itemNum; i++)
+			{
+				Texture texture;
+				if (texture.LoadFromFile(options.texturePath))
+				{
+					byteNum += texture.GetPixelDataSize();
+				}
+			}
+			return byteNum;
+		};
+		return benchmark;
+	}
+
+	// Decoding for a texture that lost its top two mips, JPEG goes through the 1/4 scaled IDCT
+	MicroBenchmark MakeTextureReloadBenchmark(const Options& options)
+	{
+		MicroBenchmark benchmark;
+		benchmark.name = "texture_reload_mip2";
+		benchmark.itemNum = 8;
+		benchmark.serial = true;
+		benchmark.run = [&options, itemNum = benchmark.itemNum](uint32_t)
+		{
+			uint64_t byteNum = 0;
+			Texture texture;
+			if (!texture.LoadFromFile(options.texturePath))
+			{
+				return byteNum;
+			}
+			for (uint32_t i = 0; i < itemNum; i++)
+			{
+				texture.ReleasePixels();
+				if (texture.ReloadPixels(2))
+				{
+					byteNum += texture.GetPixelDataSize();
+				}
+			}
+			return byteNum;
+		};
+		return benchmark;
+	}
+
+	MicroBenchmark MakeShaderLoadBenchmark(const Options& options)
+	{
+		MicroBenchmark benchmark;
+		benchmark.name = "shader_load";
+		benchmark.itemNum = 256;
+		benchmark.run = [&options, itemNum = benchmark.itemNum](uint32_t)
+		{
+			uint64_t byteNum = 0;
+			for (uint32_t i = 0; i < itemNum; i++)
+			{
+				Shader shader;
+				if (shader.LoadFromFile(options.graphicsAPI, options.shaderPath))
+				{
+					byteNum += shader.GetShaderDesc().size;
+				}
+			}
+			return byteNum;
+		};
+		return benchmark;
+	}
+
+	// Every thread owns a storage of itemNum created textures, only the view creation is measured
+	struct TextureViewState
+	{
+		std::unique_ptr<TextureStorage> storage;
+		std::vector<TextureHandle> textures;
+	};
+
+	MicroBenchmark MakeTextureViewBenchmark(const Options& options, BenchDevice& device, std::vector<TextureViewState>& states)
+	{
+		MicroBenchmark benchmark;
+		benchmark.name = "texture_view";
+		benchmark.itemNum = 64;
+
+		NRIInterface& NRI = device.NRI;
+		benchmark.setup = [&, itemNum = benchmark.itemNum](uint32_t threadNum)
+		{
+			states.resize(threadNum);
+			for (TextureViewState& state : states)
+			{
+				state.storage = std::make_unique<TextureStorage>(NRI, std::make_shared<TextureHeap>(NRI, *device.m_device));
+				for (uint32_t i = 0; i < itemNum; i++)
+				{
+					TextureHandle texture = state.storage->LoadFromFile(options.texturePath);
+					if (!texture || state.storage->CreateTexture(*device.m_device, texture) != nri::Result::SUCCESS)
+					{
+						return false;
+					}
+					state.textures.push_back(texture);
+				}
+			}
+			return true;
+		};
+		benchmark.run = [&](uint32_t threadIndex)
+		{
+			// no payload, only items/s is meaningful
+			states[threadIndex].storage->CreateTexture2DView();
+			return (uint64_t)0;
+		};
+		benchmark.teardown = [&]()
+		{
+			for (TextureViewState& state : states)
+			{
+				// the storage destroys textures and views before its heap frees the blocks
+				state.textures.clear();
+				state.storage = nullptr;
+			}
+			states.clear();
+		};
+		return benchmark;
+	}
+
+	struct GeometryVertex
+	{
+		float position[2];
+		float uv[2];
+	};
+
+	// Walls of OCCLUSION_WALL_GRID_SIZE^2 quads cover the left half of the screen halfway into the depth range,
+	// the rows of a box grid alternate between behind and in front of them. Exactly the boxes behind the left half
+	// are culled, the view is the identity so the scene is laid out in NDC.
+	constexpr uint32_t OCCLUSION_WALL_GRID_SIZE = 8;
+	constexpr uint32_t OCCLUSION_BOX_GRID_SIZE = 64;
+
+	struct OcclusionState
+	{
+		std::unique_ptr<OcclusionCuller> culler;
+		std::vector<glm::mat4> boxWorlds;
+		uint32_t expectedCulledNum = 0;
+	};
+
+	MicroBenchmark MakeOcclusionCullBenchmark(OcclusionState& state)
+	{
+		static const glm::vec3 wallPositions[4] = { { 0.0f, 0.0f, 0.5f }, { 1.0f, 0.0f, 0.5f }, { 1.0f, 1.0f, 0.5f }, { 0.0f, 1.0f, 0.5f } };
+		static const uint16_t wallIndices[6] = { 0, 1, 2, 0, 2, 3 };
+
+		state.culler = std::make_unique<OcclusionCuller>();
+		const glm::vec3 wallSize(1.0f / OCCLUSION_WALL_GRID_SIZE, 2.0f / OCCLUSION_WALL_GRID_SIZE, 1.0f);
+		for (uint32_t y = 0; y < OCCLUSION_WALL_GRID_SIZE; y++)
+		{
+			for (uint32_t x = 0; x < OCCLUSION_WALL_GRID_SIZE; x++)
+			{
+				const glm::vec3 corner(-1.0f + x * wallSize.x, -1.0f + y * wallSize.y, 0.0f);
+				const glm::mat4 world = glm::scale(glm::translate(glm::mat4(1.0f), corner), wallSize);
+				state.culler->AddOccluder(wallPositions, 4, wallIndices, 6, world);
+			}
+		}
+
+		const float cellSize = 2.0f / OCCLUSION_BOX_GRID_SIZE;
+		state.boxWorlds.clear();
+		state.expectedCulledNum = 0;
+		for (uint32_t y = 0; y < OCCLUSION_BOX_GRID_SIZE; y++)
+		{
+			for (uint32_t x = 0; x < OCCLUSION_BOX_GRID_SIZE; x++)
+			{
+				const bool behind = (y % 2) == 0;
+				const glm::vec3 center(-1.0f + (x + 0.5f) * cellSize, -1.0f + (y + 0.5f) * cellSize, behind ? 0.75f : 0.25f);
+				state.boxWorlds.push_back(glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(cellSize * 0.5f, cellSize * 0.5f, 0.1f)));
+				state.expectedCulledNum += (behind && x < OCCLUSION_BOX_GRID_SIZE / 2) ? 1 : 0;
+			}
+		}
+
+		MicroBenchmark benchmark;
+		benchmark.name = "occlusion_cull";
+		benchmark.itemNum = 16;
+		benchmark.sweepWorkers = true;
+		benchmark.run = [&state, itemNum = benchmark.itemNum](uint32_t)
+		{
+			const glm::vec3 boundsMin(-0.5f);
+			const glm::vec3 boundsMax(0.5f);
+			for (uint32_t i = 0; i < itemNum; i++)
+			{
+				state.culler->Rasterize(glm::mat4(1.0f));
+				for (const glm::mat4& world : state.boxWorlds)
+				{
+					state.culler->IsVisible(boundsMin, boundsMax, world);
+				}
+			}
+			return (uint64_t)0;
+		};
+		benchmark.check = [&state]()
+		{
+			const OcclusionStats stats = state.culler->GetStats();
+			return stats.testedNum == state.boxWorlds.size() && stats.culledNum == state.expectedCulledNum;
+		};
+		return benchmark;
+	}
+
+	// A SCENE_BRANCH_NUM-ary hierarchy of SCENE_NODE_NUM nodes, every leafStride-th leaf is animated and a stride
+	// of 0 animates every node. Each item sets the animated local matrices and updates the graph, the check compares
+	// the updated count against the animated nodes and their descendants.
+	constexpr uint32_t SCENE_NODE_NUM = 100000;
+	constexpr uint32_t SCENE_BRANCH_NUM = 8;
+
+	struct SceneUpdateState
+	{
+		std::unique_ptr<SceneGraph> sceneGraph;
+		std::vector<NodeId> animatedNodes;
+		std::vector<glm::mat4> animatedLocals;
+		uint32_t expectedUpdatedNum = 0;
+	};
+
+	MicroBenchmark MakeSceneUpdateBenchmark(SceneUpdateState& state, const char* name, uint32_t leafStride)
+	{
+		MicroBenchmark benchmark;
+		benchmark.name = name;
+		benchmark.itemNum = 16;
+		benchmark.sweepWorkers = true;
+		benchmark.setup = [&state, leafStride](uint32_t)
+		{
+			state.sceneGraph = std::make_unique<SceneGraph>();
+			state.sceneGraph->Reserve(SCENE_NODE_NUM);
+			state.animatedNodes.clear();
+			state.animatedLocals.clear();
+			state.expectedUpdatedNum = 0;
+
+			// parents are created before their children, so a node's parent is already marked
+			std::vector<uint8_t> updated(SCENE_NODE_NUM);
+			uint32_t leafIndex = 0;
+			for (uint32_t i = 0; i < SCENE_NODE_NUM; i++)
+			{
+				const NodeId parent = (i == 0) ? INVALID_NODE : (i - 1) / SCENE_BRANCH_NUM;
+				const NodeId node = state.sceneGraph->CreateNode(parent);
+				const bool isLeaf = i * SCENE_BRANCH_NUM + 1 >= SCENE_NODE_NUM;
+				const bool animated = (leafStride == 0) || (isLeaf && (leafIndex++ % leafStride) == 0);
+				if (animated)
+				{
+					state.animatedNodes.push_back(node);
+					state.animatedLocals.push_back(glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 7), 0.5f, -(float)(i % 3))));
+				}
+
+				updated[i] = animated || (parent != INVALID_NODE && updated[parent]);
+				state.expectedUpdatedNum += updated[i];
+			}
+
+			// the first update computes every node, keep it out of the measurement
+			state.sceneGraph->Update();
+			return true;
+		};
+		benchmark.run = [&state, itemNum = benchmark.itemNum](uint32_t)
+		{
+			for (uint32_t i = 0; i < itemNum; i++)
+			{
+				for (size_t j = 0; j < state.animatedNodes.size(); j++)
+				{
+					state.sceneGraph->SetLocalMatrix(state.animatedNodes[j], state.animatedLocals[j]);
+				}
+				state.sceneGraph->Update();
+			}
+			return (uint64_t)0;
+		};
+		benchmark.check = [&state]()
+		{
+			return state.sceneGraph->GetNodeNum() == SCENE_NODE_NUM && state.sceneGraph->GetUpdatedNum() == state.expectedUpdatedNum;
+		};
+		benchmark.teardown = [&state]()
+		{
+			state.sceneGraph.reset();
+		};
+		return benchmark;
+	}
+
+	// a grid mesh close to the 16 bit index limit
+	constexpr uint32_t GEOMETRY_GRID_SIZE = 255;
+
+	MicroBenchmark MakeGeometryPackBenchmark(std::vector<GeometryVertex>& vertices, std::vector<uint16_t>& indices)
+	{
+		const uint32_t rowVertexNum = GEOMETRY_GRID_SIZE + 1;
+		vertices.resize(rowVertexNum * rowVertexNum);
+		for (uint32_t y = 0; y < rowVertexNum; y++)
+		{
+			for (uint32_t x = 0; x < rowVertexNum; x++)
+			{
+				const float u = (float)x / GEOMETRY_GRID_SIZE;
+				const float v = (float)y / GEOMETRY_GRID_SIZE;
+				vertices[y * rowVertexNum + x] = { { u - 0.5f, 0.5f - v }, { u, v } };
+			}
+		}
+
+		indices.clear();
+		for (uint32_t y = 0; y < GEOMETRY_GRID_SIZE; y++)
+		{
+			for (uint32_t x = 0; x < GEOMETRY_GRID_SIZE; x++)
+			{
+				const uint16_t i0 = (uint16_t)(y * rowVertexNum + x);
+				const uint16_t i1 = (uint16_t)(i0 + rowVertexNum);
+				indices.insert(indices.end(), { i0, i1, (uint16_t)(i0 + 1), i1, (uint16_t)(i1 + 1), (uint16_t)(i0 + 1) });
+			}
+		}
+
+		MicroBenchmark benchmark;
+		benchmark.name = "geometry_pack";
+		benchmark.itemNum = 64;
+		benchmark.run = [&, itemNum = benchmark.itemNum](uint32_t)
+		{
+			uint64_t byteNum = 0;
+			for (uint32_t i = 0; i < itemNum; i++)
+			{
+				Geometry geometry;
+				geometry.SetIndices(indices.data(), (uint32_t)indices.size());
+				geometry.SetVertices(vertices.data(), (uint32_t)vertices.size(), sizeof(GeometryVertex));
+
+				std::vector<uint8_t> packed(geometry.GetPackedSize());
+				geometry.Pack(packed.data());
+				byteNum += packed.size();
+			}
+			return byteNum;
+		};
+		return benchmark;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+
+	const char* tracePath = std::getenv("NFW_TRACE");
+	if (tracePath)
+	{
+		Trace::SetThreadName("Main");
+		Trace::SetEnabled(true);
+	}
+
+	auto isSelected = [&](const char* name)
+	{
+		return options.filter.empty() || std::string(name).find(options.filter) != std::string::npos;
+	};
+
+	std::vector<GeometryVertex> geometryVertices;
+	std::vector<uint16_t> geometryIndices;
+	std::vector<TextureViewState> textureViewStates;
+	OcclusionState occlusionState;
+	SceneUpdateState sceneUpdateState;
+
+	std::vector<MicroBenchmark> benchmarks;
+	benchmarks.push_back(MakeTextureLoadBenchmark(options));
+	benchmarks.push_back(MakeTextureReloadBenchmark(options));
+	benchmarks.push_back(MakeShaderLoadBenchmark(options));
+	benchmarks.push_back(MakeGeometryPackBenchmark(geometryVertices, geometryIndices));
+	benchmarks.push_back(MakeOcclusionCullBenchmark(occlusionState));
+	benchmarks.push_back(MakeSceneUpdateBenchmark(sceneUpdateState, "scene_update_100k", 0));
+	benchmarks.push_back(MakeSceneUpdateBenchmark(sceneUpdateState, "scene_update_100k_leaf10", 10));
+
+	// only create a device when a benchmark needs one
+	BenchDevice device;
+	if (isSelected("texture_view"))
+	{
+		if (device.Init(options.graphicsAPI))
+		{
+			benchmarks.push_back(MakeTextureViewBenchmark(options, device, textureViewStates));
+		}
+		else
+		{
+			std::cerr << "device creation failed, skipping texture_view" << std::endl;
+		}
+	}
+
+	BenchReport report("micro");
+	report.SetProperty("api", GetGraphicsAPIName(options.graphicsAPI));
+	report.SetProperty("repeat", std::to_string(options.repeatNum));
+
+	bool failed = false;
+	for (const MicroBenchmark& benchmark : benchmarks)
+	{
+		if (isSelected(benchmark.name.c_str()))
+		{
+			failed |= !RunBenchmark(options, benchmark, report);
+			if (benchmark.sweepWorkers)
+			{
+				JobSystem::Init();
+			}
+		}
+	}
+
+	if (tracePath)
+	{
+		Trace::WriteChromeTrace(tracePath);
+	}
+
+	if (!report.WriteJson(options.outPath))
+	{
+		std::cerr << "can not write " << options.outPath << std::endl;
+		return 1;
+	}
+	std::cout << "results written to " << options.outPath << std::endl;
+
+	if (!options.baselinePath.empty())
+	{
+		const int regressionNum = report.CompareWithBaseline(options.baselinePath, options.threshold);
+		if (regressionNum < 0)
+		{
+			return 1;
+		}
+		if (regressionNum > 0)
+		{
+			std::cerr << regressionNum << " regression(s) over " << options.threshold * 100.0 << "%" << std::endl;
+			return 2;
+		}
+		std::cout << "no regressions against " << options.baselinePath << std::endl;
+	}
+
+	return failed ? 1 : 0;
+}
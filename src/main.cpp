@@ -1,38 +1,347 @@
+#include <atomic>
 #include <iostream>
 #include <thread>
-#include <chrono>
+#include <cstdlib>
+#include <cstring>
 
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 
+#include "Allocator.h"
+#include "HeapCheck.h"
+#include "JobSystem.h"
+#include "ResidencyManager.h"
+#include "TextureHeap.h"
+#include "Defragmenter.h"
+#include "FileSystem.h"
 #include "Simple.h"
+#include "StateCache.h"
+#include "TextureStorage.h"
+#include "Trace.h"
 
-int main()
+namespace
 {
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	GLFWwindow* window = glfwCreateWindow(800, 600, "NFW", nullptr, nullptr);
+	struct Options
+	{
+		bool headless = false;
+#if defined(_WIN32)
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::D3D12;
+#else
+		nri::GraphicsAPI graphicsAPI = nri::GraphicsAPI::VK;
+#endif
+		uint32_t frameNum = 0;      // 0 runs until the window is closed
+		glm::uvec2 resolution = { 800, 600 };
+		uint32_t frameInFlightNum = 2;
+		uint8_t verticalSyncInterval = 0;
+		bool waitableSwapChain = false;
+		double frameRateLimit = 0.0;
+		bool pipelined = false;     // Prepare and Render on their own threads
+		uint64_t textureMemoryBudget = 0;
+		nfw::JobSystemDesc jobSystemDesc;
+		nfw::FileSystemDesc fileSystemDesc;
+		std::string packPath;       // packs the loose directories into an archive instead of running
+	};
+
+	bool ParseGraphicsAPI(const char* name, nri::GraphicsAPI& graphicsAPI)
+	{
+		if (!strcmp(name, "d3d11"))
+			graphicsAPI = nri::GraphicsAPI::D3D11;
+		else if (!strcmp(name, "d3d12"))
+			graphicsAPI = nri::GraphicsAPI::D3D12;
+		else if (!strcmp(name, "vk"))
+			graphicsAPI = nri::GraphicsAPI::VK;
+		else if (!strcmp(name, "none"))
+			graphicsAPI = nri::GraphicsAPI::NONE;
+		else
+			return false;
+
+		return true;
+	}
+
+	// --headless --api=d3d11|d3d12|vk|none --frames=N --width=W --height=H
+	// --frames-in-flight=1..3 --vsync=N --waitable --fps=N --pipelined
+	// --workers=N --affinity=mask --pin-workers --texture-budget=MB
+	// --archive=file (mounted over the default archives) --pack=file
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			if (!strcmp(arg, "--headless"))
+				options.headless = true;
+			else if (!strncmp(arg, "--api=", 6))
+			{
+				if (!ParseGraphicsAPI(arg + 6, options.graphicsAPI))
+				{
+					std::cerr << "unknown graphics API: " << arg + 6 << std::endl;
+					return false;
+				}
+			}
+			else if (!strncmp(arg, "--frames=", 9))
+				options.frameNum = (uint32_t)strtoul(arg + 9, nullptr, 10);
+			else if (!strncmp(arg, "--width=", 8))
+				options.resolution.x = (uint32_t)strtoul(arg + 8, nullptr, 10);
+			else if (!strncmp(arg, "--height=", 9))
+				options.resolution.y = (uint32_t)strtoul(arg + 9, nullptr, 10);
+			else if (!strncmp(arg, "--frames-in-flight=", 19))
+				options.frameInFlightNum = (uint32_t)strtoul(arg + 19, nullptr, 10);
+			else if (!strncmp(arg, "--vsync=", 8))
+				options.verticalSyncInterval = (uint8_t)strtoul(arg + 8, nullptr, 10);
+			else if (!strcmp(arg, "--waitable"))
+				options.waitableSwapChain = true;
+			else if (!strncmp(arg, "--fps=", 6))
+				options.frameRateLimit = strtod(arg + 6, nullptr);
+			else if (!strcmp(arg, "--pipelined"))
+				options.pipelined = true;
+			else if (!strncmp(arg, "--workers=", 10))
+				options.jobSystemDesc.workerNum = (uint32_t)strtoul(arg + 10, nullptr, 10);
+			else if (!strncmp(arg, "--affinity=", 11))
+				options.jobSystemDesc.affinityMask = strtoull(arg + 11, nullptr, 0);
+			else if (!strcmp(arg, "--pin-workers"))
+				options.jobSystemDesc.pinWorkers = true;
+			else if (!strncmp(arg, "--texture-budget=", 17))
+				options.textureMemoryBudget = strtoull(arg + 17, nullptr, 10) * 1024 * 1024;
+			else if (!strncmp(arg, "--archive=", 10))
+				options.fileSystemDesc.archives.push_back({ arg + 10, "" });
+			else if (!strncmp(arg, "--pack=", 7))
+				options.packPath = arg + 7;
+			else
+			{
+				std::cerr << "unknown option: " << arg << std::endl;
+				return false;
+			}
+		}
+
+		// a headless run has no window to close
+		if (options.headless && options.frameNum == 0)
+		{
+			options.frameNum = 100;
+		}
+		if (options.frameInFlightNum < 1 || options.frameInFlightNum > 3)
+		{
+			std::cerr << "frames in flight must be 1-3" << std::endl;
+			return false;
+		}
+		return options.resolution.x && options.resolution.y;
+	}
+
+	nri::Window GetNativeWindow(GLFWwindow* window)
+	{
+		nri::Window nativeWindow = {};
+#if defined(_WIN32)
+		nativeWindow.windows.hwnd = glfwGetWin32Window(window);
+#else
+		nativeWindow.x11.dpy = glfwGetX11Display();
+		nativeWindow.x11.window = glfwGetX11Window(window);
+#endif
+		return nativeWindow;
+	}
+
+	struct LatencyStats
+	{
+		double sumMs = 0.0;
+		uint32_t frameNum = 0;
+
+		void Add(const nfw::SimpleFrameStats& stats)
+		{
+			if (stats.inputToPresentMs > 0.0)
+			{
+				sumMs += stats.inputToPresentMs;
+				frameNum++;
+			}
+		}
+	};
+
+	// Frame i is prepared on a simulation thread while frame i - 1 is rendered on a render thread.
+	// The main thread only pumps window events, Stop() releases both threads when the window closes.
+	LatencyStats RunPipelined(nfw::Simple& simple, GLFWwindow* window, uint32_t frameNum)
+	{
+		using namespace nfw;
 
+		std::atomic<bool> running = true;
+		LatencyStats latency;
+
+		std::thread simulationThread([&]()
+		{
+			Trace::SetThreadName("Simulation");
+			for (uint32_t i = 0; running.load(std::memory_order_relaxed) && (frameNum == 0 || i < frameNum); ++i)
+			{
+				simple.Prepare(i);
+			}
+		});
+
+		std::thread renderThread([&]()
+		{
+			Trace::SetThreadName("Render");
+			for (uint32_t i = 0; running.load(std::memory_order_relaxed) && (frameNum == 0 || i < frameNum); ++i)
+			{
+				simple.Render(i);
+				latency.Add(simple.GetFrameStats());
+			}
+			running.store(false, std::memory_order_relaxed);
+		});
+
+		while (window && running.load(std::memory_order_relaxed))
+		{
+			glfwWaitEventsTimeout(0.005);
+			JobSystem::ExecuteMainThreadJobs();
+			if (glfwWindowShouldClose(window))
+			{
+				running.store(false, std::memory_order_relaxed);
+			}
+		}
+
+		// a closed window leaves one thread waiting for the other, a headless run ends after frameNum frames
+		if (window)
+		{
+			simple.Stop();
+		}
+		renderThread.join();
+		simple.Stop();
+		simulationThread.join();
+		return latency;
+	}
+}
+
+int main(int argc, char** argv)
+{
 	using namespace nfw;
-	Simple* simple = new Simple(glfwGetWin32Window(window), {800, 600});
-	simple->Init();
 
-	uint32_t i = 0;
-	while (!glfwWindowShouldClose(window))
+	Options options;
+	if (!ParseOptions(argc, argv, options))
 	{
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return 1;
+	}
+
+	// NFW_TRACE=<file> records CPU trace scopes and writes them as Chrome trace JSON on exit
+	const char* tracePath = std::getenv("NFW_TRACE");
+	if (tracePath)
+	{
+		Trace::SetThreadName("Main");
+		Trace::SetEnabled(true);
+	}
 
-		glfwPollEvents();
+	// NFW_HEAP_CHECK=1 reports heap allocations made inside frames, needs a build with NFW_ENABLE_HEAP_CHECK
+	if (std::getenv("NFW_HEAP_CHECK"))
+	{
+		HeapCheck::SetEnabled(true);
+	}
 
-		simple->Prepare(i);
-		simple->Render(i);
-		++i;
+	JobSystem::Init(options.jobSystemDesc);
+	FileSystem::Init(options.fileSystemDesc);
+
+	if (!options.packPath.empty())
+	{
+		const bool packed = FileSystem::PackArchive(options.fileSystemDesc.directories, options.packPath);
+		std::cout << (packed ? "packed " : "failed to pack ") << options.packPath << std::endl;
+		FileSystem::Shutdown();
+		JobSystem::Shutdown();
+		return packed ? 0 : 1;
+	}
+
+	SimpleDesc simpleDesc = {};
+	simpleDesc.resolution = options.resolution;
+	simpleDesc.graphicsAPI = options.graphicsAPI;
+	simpleDesc.headless = options.headless;
+	simpleDesc.frameInFlightNum = options.frameInFlightNum;
+	simpleDesc.verticalSyncInterval = options.verticalSyncInterval;
+	simpleDesc.waitableSwapChain = options.waitableSwapChain;
+	simpleDesc.frameRateLimit = options.frameRateLimit;
+	simpleDesc.textureMemoryBudget = options.textureMemoryBudget;
+
+	GLFWwindow* window = nullptr;
+	if (!options.headless)
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		window = glfwCreateWindow(options.resolution.x, options.resolution.y, "NFW", nullptr, nullptr);
+		simpleDesc.window = GetNativeWindow(window);
+	}
+
+	Simple* simple = new Simple(simpleDesc);
+	if (!simple->Init())
+	{
+		std::cerr << "initialization failed" << std::endl;
+		return 1;
+	}
+
+	LatencyStats latency;
+	if (options.pipelined)
+	{
+		latency = RunPipelined(*simple, window, options.frameNum);
+	}
+	else
+	{
+		uint32_t i = 0;
+		while (options.frameNum == 0 || i < options.frameNum)
+		{
+			if (window && glfwWindowShouldClose(window))
+			{
+				break;
+			}
+
+			// all waiting happens before input is sampled so the frame works with fresh input
+			simple->WaitForFrame(i);
+
+			if (window)
+			{
+				glfwPollEvents();
+			}
+			JobSystem::ExecuteMainThreadJobs();
+
+			simple->Prepare(i);
+			simple->Render(i);
+			latency.Add(simple->GetFrameStats());
+			++i;
+		}
+	}
+
+	if (latency.frameNum)
+	{
+		std::cout << "average input to present latency: " << latency.sumMs / latency.frameNum << " ms over " << latency.frameNum << " frames" << std::endl;
+	}
+
+	const nfw::StateCacheStats stateCacheStats = simple->GetStateCache()->GetStats();
+	std::cout << "state cache hit rate: samplers " << stateCacheStats.samplers.GetHitRate()
+		<< ", pipeline layouts " << stateCacheStats.pipelineLayouts.GetHitRate()
+		<< ", pipelines " << stateCacheStats.pipelines.GetHitRate() << std::endl;
+
+	const nfw::TextureMemoryStats textureMemoryStats = simple->GetTextureStorage()->GetMemoryStats();
+	std::cout << "texture memory: " << textureMemoryStats.cpuBytes << " bytes CPU, " << textureMemoryStats.gpuBytes << " bytes GPU" << std::endl;
+
+	const nfw::ResidencyStats residencyStats = simple->GetResidencyManager()->GetStats();
+	std::cout << "texture residency: " << residencyStats.residentBytes << " of " << residencyStats.budget << " bytes budget, "
+		<< residencyStats.evictedNum << " evicted, " << residencyStats.reducedNum << " reduced, "
+		<< residencyStats.evictionNum << " evictions and " << residencyStats.restageNum << " restages in total" << std::endl;
+
+	const nfw::TextureHeapStats textureHeapStats = simple->GetTextureStorage()->GetTextureHeap().GetStats();
+	const nfw::DefragmenterStats defragmenterStats = simple->GetDefragmenter()->GetStats();
+	std::cout << "texture heap: " << textureHeapStats.usedBytes << " of " << textureHeapStats.blockBytes << " bytes used in "
+		<< textureHeapStats.blockNum << " blocks, " << defragmenterStats.moveNum << " moves of " << defragmenterStats.movedBytes << " bytes, "
+		<< textureHeapStats.releasedBlockNum << " blocks released" << std::endl;
+
+	for (uint32_t i = 0; i < (uint32_t)nfw::MemoryCategory::MAX_NUM; i++)
+	{
+		const nfw::MemoryCategory category = (nfw::MemoryCategory)i;
+		const nfw::MemoryCategoryStats memoryStats = nfw::Allocator::GetStats(category);
+		std::cout << nfw::Allocator::GetCategoryName(category) << " memory: " << memoryStats.liveBytes << " bytes live, " << memoryStats.peakBytes << " peak, "
+			<< memoryStats.allocationNum << " allocations, " << memoryStats.frameAllocationNum << " in the last frame" << std::endl;
 	}
 
 	delete simple;
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	FileSystem::Shutdown();
+	JobSystem::Shutdown();
+
+	if (tracePath)
+	{
+		Trace::WriteChromeTrace(tracePath);
+	}
+
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 
 	return 0;
 }
-
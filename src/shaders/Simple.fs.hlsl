@@ -3,8 +3,9 @@
 
 NRI_RESOURCE( cbuffer, Constants, b, 0, 0 )
 {
+    float4x4 world;
     float3 color;
-    float scale;
+    float padding;
 };
 
 struct PushConstants
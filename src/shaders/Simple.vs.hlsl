@@ -3,8 +3,9 @@
 
 NRI_RESOURCE( cbuffer, Constants, b, 0, 0 )
 {
+    float4x4 world;
     float3 color;
-    float scale;
+    float padding;
 };
 
 struct outputVS
@@ -21,8 +22,7 @@ outputVS main
 {
     outputVS output;
 
-    output.position.xy = inPos * scale;
-    output.position.zw = float2( 0.0, 1.0 );
+    output.position = mul( world, float4( inPos, 0.0, 1.0 ) );
     output.texCoord = inTexCoord;
 
     return output;
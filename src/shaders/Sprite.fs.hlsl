@@ -0,0 +1,39 @@
+#include "BindingBridge.hlsli"
+
+#define SPRITE_TEXTURE_MAX_NUM 8
+
+NRI_RESOURCE( Texture2D, spriteTextures[SPRITE_TEXTURE_MAX_NUM], t, 0, 0 );
+NRI_RESOURCE( SamplerState, linearSampler, s, 0, 0 );
+
+struct outputVS
+{
+    float4 position : SV_Position;
+    float2 texCoord : TEXCOORD0;
+    float4 color : COLOR0;
+    nointerpolation uint textureIndex : TEXCOORD1;
+};
+
+float4 SampleSprite( uint textureIndex, float2 texCoord )
+{
+#if( defined(COMPILER_FXC) )
+    // SM5.0 can't index resource arrays dynamically
+    [branch] switch( textureIndex )
+    {
+        case 1: return spriteTextures[1].Sample( linearSampler, texCoord );
+        case 2: return spriteTextures[2].Sample( linearSampler, texCoord );
+        case 3: return spriteTextures[3].Sample( linearSampler, texCoord );
+        case 4: return spriteTextures[4].Sample( linearSampler, texCoord );
+        case 5: return spriteTextures[5].Sample( linearSampler, texCoord );
+        case 6: return spriteTextures[6].Sample( linearSampler, texCoord );
+        case 7: return spriteTextures[7].Sample( linearSampler, texCoord );
+        default: return spriteTextures[0].Sample( linearSampler, texCoord );
+    }
+#else
+    return spriteTextures[NonUniformResourceIndex( textureIndex )].Sample( linearSampler, texCoord );
+#endif
+}
+
+float4 main( in outputVS input ) : SV_Target
+{
+    return SampleSprite( input.textureIndex, input.texCoord ) * input.color;
+}
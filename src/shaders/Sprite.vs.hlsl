@@ -0,0 +1,51 @@
+#include "BindingBridge.hlsli"
+
+struct PushConstants
+{
+    float2 invViewportSize;
+    float2 padding;
+};
+
+NRI_PUSH_CONSTANTS( PushConstants, pushConstants, 0 );
+
+struct outputVS
+{
+    float4 position : SV_Position;
+    float2 texCoord : TEXCOORD0;
+    float4 color : COLOR0;
+    nointerpolation uint textureIndex : TEXCOORD1;
+};
+
+static const float2 g_corners[6] =
+{
+    float2( 0.0, 0.0 ),
+    float2( 1.0, 0.0 ),
+    float2( 0.0, 1.0 ),
+    float2( 1.0, 0.0 ),
+    float2( 1.0, 1.0 ),
+    float2( 0.0, 1.0 ),
+};
+
+outputVS main
+(
+    float2 inPos : POSITION0,
+    float2 inSize : TEXCOORD0,
+    float4 inUVRect : TEXCOORD1,
+    float4 inColor : COLOR0,
+    uint inTextureIndex : TEXCOORD2,
+    uint vertexID : SV_VertexID
+)
+{
+    outputVS output;
+
+    float2 corner = g_corners[vertexID];
+    float2 pixel = inPos + corner * inSize;
+    float2 ndc = pixel * pushConstants.invViewportSize * 2.0 - 1.0;
+
+    output.position = float4( ndc.x, -ndc.y, 0.0, 1.0 );
+    output.texCoord = lerp( inUVRect.xy, inUVRect.zw, corner );
+    output.color = inColor;
+    output.textureIndex = inTextureIndex;
+
+    return output;
+}